@@ -0,0 +1,29 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2017 Tempesta Technologies.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __ASM_FPU_API_H__
+#define __ASM_FPU_API_H__
+
+/*
+ * The user-space FPU is always available - the kernel_fpu_*()
+ * sections around SIMD code become no-ops.
+ */
+static inline void kernel_fpu_begin(void) {}
+static inline void kernel_fpu_end(void) {}
+#endif /* __ASM_FPU_API_H__ */
@@ -20,6 +20,8 @@
 #ifndef __BITOPS_H__
 #define __BITOPS_H__
 
+#include "compiler.h"
+
 #define IS_IMMEDIATE(nr)		(__builtin_constant_p(nr))
 #define BITOP_ADDR(x)			"+m" (*(volatile long *) (x))
 #define CONST_MASK_ADDR(nr, addr)	BITOP_ADDR((void *)(addr) + ((nr)>>3))
@@ -40,6 +42,22 @@ set_bit(unsigned int nr, volatile unsigned long *addr)
 	}
 }
 
+static inline int
+test_bit(long nr, const volatile unsigned long *addr)
+{
+	return !!(addr[nr / BITS_PER_LONG]
+		  & (1UL << (nr % BITS_PER_LONG)));
+}
+
+static inline unsigned long
+__ffs(unsigned long word)
+{
+	asm("rep; bsf %1,%0"
+		: "=r" (word)
+		: "rm" (word));
+	return word;
+}
+
 static inline unsigned long
 ffz(unsigned long word)
 {
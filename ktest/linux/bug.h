@@ -0,0 +1,34 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2017 Tempesta Technologies.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __BUG_H__
+#define __BUG_H__
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "kernel.h"
+
+#define BUG_ON(c)	assert(!(c))
+#define BUG()		abort()
+#define WARN_ON_ONCE(c)	({ int __r = !!(c); if (__r) \
+				   pr_warn("WARNING at %s:%d\n", \
+					   __FILE__, __LINE__); __r; })
+#define BUILD_BUG_ON(c)	do { (void)sizeof(char[1 - 2 * !!(c)]); } while (0)
+#endif /* __BUG_H__ */
@@ -28,21 +28,37 @@
 #define DEBUG 1
 #endif
 
-#ifndef ENOMEM
-#define ENOMEM		1
-#endif
+#include <errno.h>
+
+#define min(a, b)	({ typeof(a) _a = (a); typeof(b) _b = (b);	\
+			   _a < _b ? _a : _b; })
+#define max(a, b)	({ typeof(a) _a = (a); typeof(b) _b = (b);	\
+			   _a > _b ? _a : _b; })
+#define min_t(t, a, b)	min((t)(a), (t)(b))
+#define max_t(t, a, b)	max((t)(a), (t)(b))
 
 #define ARRAY_SIZE(x)   (sizeof(x) / sizeof(*(x)))
 
 #define pr_err(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
 #define pr_warn(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define pr_info(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
 #define pr_debug(fmt, ...)	fprintf(stdout, fmt, ##__VA_ARGS__)
+#define net_warn_ratelimited(fmt, ...)	\
+	fprintf(stderr, fmt, ##__VA_ARGS__)
+#define net_err_ratelimited(fmt, ...)	\
+	fprintf(stderr, fmt, ##__VA_ARGS__)
+
+#ifndef EXPORT_SYMBOL
+#define EXPORT_SYMBOL(sym)
+#endif
 
 /* asm/cache.h */
 #ifndef L1_CACHE_BYTES
 #define L1_CACHE_BYTES 64
 #endif
 
+#include "prefetch.h"
+
 #define SMP_CACHE_BYTES L1_CACHE_BYTES
 #define ____cacheline_aligned __attribute__((__aligned__(SMP_CACHE_BYTES)))
 #define ____cacheline_aligned_in_smp ____cacheline_aligned
@@ -27,11 +27,15 @@
 typedef pthread_mutex_t	spinlock_t;
 
 #define __RAW_SPIN_LOCK_UNLOCKED(lock)	PTHREAD_MUTEX_INITIALIZER
+#define DEFINE_SPINLOCK(lock)		\
+	spinlock_t lock = PTHREAD_MUTEX_INITIALIZER
 
 #define spin_lock_init(lock)		pthread_mutex_init(lock, NULL)
 #define spin_lock(lock)			pthread_mutex_lock(lock)
 #define spin_trylock(lock)		(!pthread_mutex_trylock(lock))
 #define spin_unlock(lock)		pthread_mutex_unlock(lock)
+#define spin_lock_bh(lock)		pthread_mutex_lock(lock)
+#define spin_unlock_bh(lock)		pthread_mutex_unlock(lock)
 
 /*
  * Pthread doesn't have RW spin-locks,
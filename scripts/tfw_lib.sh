@@ -85,18 +85,29 @@ tfw_set_net_queues()
 	min_queues=$(calc "$CPUS_N / 2")
 	cpu_mask=$(perl -le 'printf("%x", (1 << '$CPUS_N') - 1)')
 
+	# Size the RFS tables: Tempesta records its flows from softirq,
+	# and with accelerated RFS capable NICs the flows follow the
+	# CPUs processing the sockets.
+	rfs_entries=32768
+	sysctl -w net.core.rps_sock_flow_entries=$rfs_entries >/dev/null
+
 	for dev in $devs; do
 		queues=$(ls -d /sys/class/net/$dev/queues/rx-* | wc -l)
 		if [ $queues -le $min_queues ]; then
 			echo "...enable RPS on $dev"
 			for rx in $TFW_NETDEV_PATH/$dev/queues/rx-*; do
 				echo $cpu_mask > $rx/rps_cpus
+				echo $(calc "$rfs_entries / $queues") \
+					> $rx/rps_flow_cnt
 			done
 		else
 
-			# Switch off RPS for multi-queued interfaces.
+			# Switch off RPS for multi-queued interfaces, but
+			# keep per-queue RFS for the flow steering.
 			for rx in $TFW_NETDEV_PATH/$dev/queues/rx-*; do
 				echo 0 > $rx/rps_cpus
+				echo $(calc "$rfs_entries / $queues") \
+					> $rx/rps_flow_cnt
 			done
 
 			distribute_queues $dev
@@ -48,6 +48,8 @@ static MArea mas[MAX_NUMNODES];
 
 /**
  * Find and return best fit free memory area.
+ * All areas are multiples of the TDB extent (huge page) size, so an
+ * exactly fitting area is acceptable and even the best choice.
  */
 static MArea *
 ma_get_best_fit(unsigned long len, int node)
@@ -57,7 +59,7 @@ ma_get_best_fit(unsigned long len, int node)
 
 	for (ma = &mas[node]; ma; ma = ma->next) {
 		if (MA_FREE(ma)
-		    && ma->pages > req_pages
+		    && ma->pages >= req_pages
 		    && (!best_fit || best_fit->pages > ma->pages))
 			best_fit = ma;
 	}
@@ -186,34 +188,48 @@ tempesta_map_file(struct file *file, unsigned long len, int node)
 	if (!ma) {
 		TDB_ERR("Cannot allocate %lu pages at node %d\n",
 			len / PAGE_SIZE, node);
-		goto err;
+		mutex_unlock(&map_mtx);
+		return addr;
 	}
 
 	ma = ma_split(ma, len);
-	if (!ma)
-		goto err;
+	if (!ma) {
+		mutex_unlock(&map_mtx);
+		return addr;
+	}
+
+	/*
+	 * The area is reserved at this point, so the long file read
+	 * below runs without the mutex and tables of different NUMA
+	 * nodes are populated in parallel on startup.
+	 */
+	mutex_unlock(&map_mtx);
+
+	/*
+	 * The table must start at a huge page boundary, otherwise the
+	 * direct map PMD entries backing the area are not guaranteed to
+	 * stay huge and the TLB benefit of the 2MB reservation is lost.
+	 */
+	BUG_ON(ma->start & (TDB_EXT_SZ - 1));
 
 	get_file(file);
 
 	oldfs = get_fs();
 	set_fs(get_ds());
-
 	addr = vfs_read(file, (char *)ma->start, len, &off);
+	set_fs(oldfs);
+
 	if (addr != len) {
 		TDB_ERR("Cannot read %lu bytes to addr %p, ret = %ld\n",
 			len, (void *)ma->start, addr);
 		fput(file);
+		mutex_lock(&map_mtx);
 		__ma_free(ma);
-		goto err_fs;
+		mutex_unlock(&map_mtx);
+		return -EIO;
 	}
 
-	addr = ma->start;
-err_fs:
-	set_fs(oldfs);
-err:
-	mutex_unlock(&map_mtx);
-
-	return addr;
+	return ma->start;
 }
 
 /**
@@ -333,6 +349,12 @@ tdb_init_mappings(void)
 			TDB_ERR("Cannot get mapping for node %d\n", node);
 			return -ENOMEM;
 		}
+		/*
+		 * The reservation is built of 2MB compound pages (see
+		 * tempesta_mm.c in the kernel patch), so the extent
+		 * alignment must hold for the whole area base.
+		 */
+		BUG_ON(tm->addr & (TDB_EXT_SZ - 1));
 		mas[node].start = tm->addr;
 		mas[node].pages = tm->pages;
 	}
@@ -24,11 +24,14 @@
  */
 #include <asm/sync_bitops.h>
 #include <linux/bitops.h>
+#include <linux/prefetch.h>
 #include <linux/slab.h>
 
 #include "htrie.h"
 
 #define TDB_MAGIC	0x434947414D424454UL /* "TDBMAGIC" */
+/* The table is mapped and may be inconsistent on disk. */
+#define TDB_MAGIC_DIRTY	0x5954524944424454UL /* "TDBDIRTY" */
 #define TDB_BLK_SZ	PAGE_SIZE
 #define TDB_BLK_MASK	(~(TDB_BLK_SZ - 1))
 
@@ -57,11 +60,18 @@ typedef struct {
  */
 #define TDB_HTRIE_FOREACH_REC_UNLOCKED(d, b, r)				\
 	for ( ; b; b = TDB_HTRIE_BUCKET_NEXT(d, b))			\
-		for (r = TDB_HTRIE_BCKT_1ST_REC(b);			\
-		     (char *)r - (char *)b + sizeof(*r)	<= TDB_HTRIE_MINDREC \
-		     && (char *)r - (char *)b + TDB_HTRIE_RECLEN(d, r)	\
-			<= TDB_HTRIE_MINDREC;				\
-		     r = (typeof(r))((char *)r + TDB_HTRIE_RECLEN(d, r)))
+		TDB_HTRIE_FOREACH_BCKT_REC(d, b, r)
+
+/*
+ * Iterate over records of one bucket only, the caller locks the bucket
+ * and walks the collision chain itself.
+ */
+#define TDB_HTRIE_FOREACH_BCKT_REC(d, b, r)				\
+	for (r = TDB_HTRIE_BCKT_1ST_REC(b);				\
+	     (char *)r - (char *)b + sizeof(*r)	<= TDB_HTRIE_MINDREC	\
+	     && (char *)r - (char *)b + TDB_HTRIE_RECLEN(d, r)		\
+		<= TDB_HTRIE_MINDREC;					\
+	     r = (typeof(r))((char *)r + TDB_HTRIE_RECLEN(d, r)))
 
 
 static inline TdbExt *
@@ -179,59 +189,82 @@ repeat:
 	       + (i * BITS_PER_LONG + r) * TDB_BLK_SZ;
 }
 
+/*
+ * Grab a whole fresh extent for the calling CPU's magazine, or 0 when
+ * the linear space is exhausted. The global next-write-block cursor
+ * advances by a whole extent per grab, so the shared cmpxchg is hit
+ * once per TDB_EXT_SZ of writes instead of once per block.
+ */
+static unsigned long
+tdb_grab_ext(TdbHdr *dbh)
+{
+	while (1) {
+		long g_nwb = atomic64_read(&dbh->nwb);
+		unsigned long e_base = g_nwb & TDB_EXT_MASK;
+
+		/* Partially used extent (e.g. the header one): skip it. */
+		if (g_nwb & ~TDB_EXT_MASK)
+			e_base += TDB_EXT_SZ;
+		if (unlikely(e_base >= dbh->dbsz))
+			return 0;
+		if (atomic64_cmpxchg(&dbh->nwb, g_nwb,
+				     e_base + TDB_EXT_SZ) != g_nwb)
+			continue;
+		set_bit(TDB_EXT_ID(e_base), dbh->ext_bmp);
+		TDB_DBG("Allocated new extent at %#lx\n", e_base);
+		return e_base;
+	}
+}
+
 static unsigned long
 tdb_alloc_blk(TdbHdr *dbh)
 {
+	TdbPerCpu *pcpu = this_cpu_ptr(dbh->pcpu);
 	TdbExt *e;
-	long g_nwb, rptr, next_blk;
-
-retry:
-	g_nwb = atomic64_read(&dbh->nwb);
-	e = tdb_ext(dbh, TDB_PTR(dbh, g_nwb));
+	long rptr;
+	unsigned long i;
 
-	if (likely(g_nwb & ~TDB_EXT_MASK)) {
-		/*
-		 * Current extent was already getted.
-		 * Probably we can allocate some memory in this extent.
-		 */
+	/*
+	 * Per-CPU extent magazines: each CPU allocates blocks from an
+	 * extent it owns, so concurrent inserts from different CPUs
+	 * don't bounce a shared block bitmap - write throughput scales
+	 * with writer CPUs and the shared state is touched only once
+	 * per extent grab. Block frees may still clear bits of another
+	 * CPU's extent; the bitmap ops stay atomic for that.
+	 */
+	if (pcpu->c_ext) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, pcpu->c_ext));
 		rptr = __tdb_alloc_blk_ext(dbh, e);
 		if (likely(rptr))
 			goto allocated;
-		/*
-		 * No way, there is no room in current extent -
-		 * update current pointer or try the next extent.
-		 *
-		 * TODO we recheck dbh->nwb just in assumption
-		 * that eviction/freeing thread moved it back.
-		 */
-		if (unlikely(g_nwb != atomic64_read(&dbh->nwb)))
-			goto retry;
-		e = (TdbExt *)((unsigned long)e + TDB_EXT_SZ);
+		pcpu->c_ext = 0;
+	}
+
+	if ((pcpu->c_ext = tdb_grab_ext(dbh))) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, pcpu->c_ext));
+		rptr = __tdb_alloc_blk_ext(dbh, e);
+		BUG_ON(!rptr);
+		goto allocated;
 	}
 
 	/*
-	 * The new extent should be used.
-	 * Whole extent shouldn't be fully utilized by concurrent contexts
-	 * while we're in the function, so we expect that it will satisfy
-	 * our allocation request.
+	 * No fresh extents left: fall back to scanning all used
+	 * extents for blocks freed by eviction. Contended, but this
+	 * only runs under space pressure, when the alternative is
+	 * failing the insert.
 	 */
-	if (unlikely(TDB_HTRIE_OFF(dbh, e) == dbh->dbsz)) {
-		TDB_ERR("out of free space\n");
-		return 0;
+	for (i = 0; i * TDB_EXT_SZ < dbh->dbsz; ++i) {
+		if (!test_bit(i, dbh->ext_bmp))
+			continue;
+		e = tdb_ext(dbh, TDB_PTR(dbh, i * TDB_EXT_SZ));
+		rptr = __tdb_alloc_blk_ext(dbh, e);
+		if (rptr)
+			goto allocated;
 	}
-	BUG_ON(TDB_HTRIE_OFF(dbh, e) > dbh->dbsz);
-	set_bit(TDB_EXT_ID(TDB_EXT_BASE(dbh, e)), dbh->ext_bmp);
-
-	TDB_DBG("Allocated new extent %p\n", e);
-
-	rptr = __tdb_alloc_blk_ext(dbh, e);
-	BUG_ON(!rptr);
+	TDB_ERR("out of free space\n");
+	return 0;
 
 allocated:
-	next_blk = rptr + TDB_BLK_SZ;
-	for ( ; g_nwb <= rptr; g_nwb = atomic64_read(&dbh->nwb))
-		atomic64_cmpxchg(&dbh->nwb, g_nwb, next_blk);
-
 	/*
 	 * Align offsets of new blocks for data records.
 	 * This is only for first blocks in extents, so we lose only
@@ -252,6 +285,71 @@ tdb_htrie_init_bucket(TdbBucket *b)
 #endif
 }
 
+/*
+ * Buckets unlinked from collision chains by the compaction are recycled
+ * through a free list threaded via @coll_next in data block units. The
+ * list head lives in the database header, so the recycled space
+ * survives restarts together with the data. The operations are rare,
+ * thus one lock for all tables is enough.
+ */
+static DEFINE_SPINLOCK(tdb_bckt_fl_lock);
+
+static unsigned long tdb_alloc_data(TdbHdr *dbh, size_t *len, int bucket_hdr);
+
+static void
+tdb_free_bckt(TdbHdr *dbh, TdbBucket *b)
+{
+	spin_lock_bh(&tdb_bckt_fl_lock);
+	b->coll_next = atomic64_read(&dbh->bckt_fl);
+	atomic64_set(&dbh->bckt_fl, TDB_O2DI(TDB_HTRIE_OFF(dbh, b)));
+	spin_unlock_bh(&tdb_bckt_fl_lock);
+}
+
+/**
+ * Allocate a bucket with a record room of @*len bytes, reusing a
+ * recycled bucket when the record fits into TDB_HTRIE_MINDREC.
+ * Recycled buckets are reused as exactly one TDB_HTRIE_MINDREC unit:
+ * if the original allocation was larger, the tail stays unused until
+ * a database restart.
+ *
+ * Both this function and tdb_alloc_data() return the offset of the
+ * record room just past the bucket header.
+ */
+static unsigned long
+tdb_alloc_bckt(TdbHdr *dbh, size_t *len)
+{
+	unsigned long o = 0;
+	size_t hdr_len;
+	TdbBucket *b;
+
+	hdr_len = sizeof(TdbBucket)
+		  + (TDB_HTRIE_VARLENRECS(dbh)
+		     ? sizeof(TdbVRec)
+		     : sizeof(TdbFRec));
+
+	if (TDB_HTRIE_DALIGN(*len + hdr_len) <= TDB_HTRIE_MINDREC) {
+		spin_lock_bh(&tdb_bckt_fl_lock);
+		o = atomic64_read(&dbh->bckt_fl);
+		if (o) {
+			b = TDB_PTR(dbh, TDB_DI2O(o));
+			atomic64_set(&dbh->bckt_fl, b->coll_next);
+		}
+		spin_unlock_bh(&tdb_bckt_fl_lock);
+	}
+	if (!o)
+		return tdb_alloc_data(dbh, len, 1);
+
+	b = TDB_PTR(dbh, TDB_DI2O(o));
+	memset(b, 0, TDB_HTRIE_MINDREC);
+	tdb_htrie_init_bucket(b);
+	if (*len > TDB_HTRIE_MINDREC - hdr_len)
+		*len = TDB_HTRIE_MINDREC - hdr_len;
+
+	TDB_DBG("reuse free bucket %#lx for len=%lu\n", TDB_DI2O(o), *len);
+
+	return TDB_DI2O(o) + sizeof(TdbBucket);
+}
+
 /**
  * @return byte offset of the allocated data block and sets @len to actually
  * available room for writting if @len doesn't fit to block.
@@ -549,27 +647,46 @@ tdb_htrie_descend(TdbHdr *dbh, TdbHtrieNode **node, unsigned long key,
 
 		o = (*node)->shifts[TDB_HTRIE_IDX(key, *bits)];
 
-		BUG_ON(o
-		       && (TDB_DI2O(o & ~TDB_HTRIE_DBIT)
+		/*
+		 * An index reference is in node-size units and a data
+		 * reference in data-block units - validate each with
+		 * its own conversion. Checking both through TDB_DI2O()
+		 * falsely fired on valid index nodes in the upper half
+		 * of the table.
+		 */
+		BUG_ON(o && (o & TDB_HTRIE_DBIT
+			     ? TDB_DI2O(o ^ TDB_HTRIE_DBIT)
+				< TDB_HDR_SZ(dbh) + sizeof(TdbExt)
+			       || TDB_DI2O(o ^ TDB_HTRIE_DBIT) > dbh->dbsz
+			     : TDB_II2O(o)
 				< TDB_HDR_SZ(dbh) + sizeof(TdbExt)
-			   || TDB_DI2O(o & ~TDB_HTRIE_DBIT)
-				> dbh->dbsz));
+			       || TDB_II2O(o) > dbh->dbsz));
 
 		if (o & TDB_HTRIE_DBIT) {
 			/* We're at a data pointer - resolve it. */
 			*bits += TDB_HTRIE_BITS;
 			o ^= TDB_HTRIE_DBIT;
 			BUG_ON(!o);
+			/* Warm the bucket line before the caller locks it. */
+			prefetch(TDB_PTR(dbh, TDB_DI2O(o)));
 			return TDB_DI2O(o);
 		} else {
 			if (!o)
 				return 0; /* cannot descend deeper */
 			*node = TDB_PTR(dbh, TDB_II2O(o));
+			/*
+			 * Start fetching the next level under the loop
+			 * arithmetic; the node is exactly one aligned
+			 * cache line (16 x 32-bit in-extent offsets),
+			 * so one prefetch covers the whole dispatch.
+			 */
+			prefetch(*node);
 			*bits += TDB_HTRIE_BITS;
 		}
 	}
 }
 
+/* All record creations go through here, so count them for the stats. */
 static TdbRec *
 tdb_htrie_create_rec(TdbHdr *dbh, unsigned long off, unsigned long key,
 		     void *data, size_t len)
@@ -590,6 +707,8 @@ tdb_htrie_create_rec(TdbHdr *dbh, unsigned long off, unsigned long key,
 	}
 	memcpy(ptr, data, len);
 
+	atomic64_inc(&dbh->rec_n);
+
 	return r;
 }
 
@@ -662,7 +781,7 @@ retry:
 		TDB_DBG("Create a new htrie node for key=%#lx len=%lu"
 			" bits_used=%d\n", key, *len, bits);
 
-		o = tdb_alloc_data(dbh, len, 1);
+		o = tdb_alloc_bckt(dbh, len);
 		if (!o)
 			return NULL;
 
@@ -743,7 +862,7 @@ retry:
 			bckt = next;
 		}
 
-		o = tdb_alloc_data(dbh, len, 1);
+		o = tdb_alloc_bckt(dbh, len);
 		if (!o) {
 			write_unlock_bh(&bckt->lock);
 			return NULL;
@@ -780,6 +899,356 @@ retry:
 	goto retry;
 }
 
+/**
+ * Remove all live records with @key from the bucket collision chain.
+ * @eq_cb, if set, additionally filters the records to remove; it's called
+ * under the bucket write lock, so it must be fast and must not sleep.
+ *
+ * Removed records are marked as freed and their room is reused by
+ * following inserts, see tdb_htrie_smallrec_link(). Wholly freed blocks
+ * are left to the garbage collector just as in tdb_htrie_burst().
+ *
+ * @return number of removed records.
+ */
+int
+tdb_htrie_remove(TdbHdr *dbh, unsigned long key,
+		 bool (*eq_cb)(TdbRec *, void *), void *cb_data)
+{
+	int removed = 0;
+	TdbBucket *b, *b_next;
+
+	b = tdb_htrie_lookup(dbh, key);
+	if (!b)
+		return 0;
+
+	write_lock_bh(&b->lock);
+	while (b) {
+		if (TDB_HTRIE_VARLENRECS(dbh)) {
+			TdbVRec *r, *c, *n;
+			TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, r) {
+				if (!tdb_live_vsrec(r) || r->key != key)
+					continue;
+				if (eq_cb && !eq_cb((TdbRec *)r, cb_data))
+					continue;
+				/*
+				 * Free the whole chunk chain. Extension
+				 * chunks are reachable through the head
+				 * chunk only, so they can be marked w/o
+				 * additional locking.
+				 */
+				for (c = r; c; c = n) {
+					n = c->chunk_next
+					    ? TDB_PTR(dbh,
+						      TDB_DI2O(c->chunk_next))
+					    : NULL;
+					tdb_free_vsrec(c);
+				}
+				++removed;
+			}
+		} else {
+			TdbFRec *r;
+			TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, r) {
+				if (!tdb_live_fsrec(dbh, r) || r->key != key)
+					continue;
+				if (eq_cb && !eq_cb(r, cb_data))
+					continue;
+				tdb_free_fsrec(dbh, r);
+				++removed;
+			}
+		}
+		b_next = TDB_HTRIE_BUCKET_NEXT(dbh, b);
+		if (b_next)
+			write_lock_bh(&b_next->lock);
+		write_unlock_bh(&b->lock);
+		b = b_next;
+	}
+
+	TDB_DBG("htrie remove: key=%#lx removed=%d\n", key, removed);
+	atomic64_sub(removed, &dbh->rec_n);
+
+	return removed;
+}
+
+/**
+ * Free the expired records of the bucket (the TTL index of the table,
+ * see tdb_set_expire_cb()) and tell whether any live record remains.
+ * Called under the bucket write lock.
+ */
+static int
+tdb_bckt_all_free(TdbHdr *dbh, TdbBucket *b, bool (*expired)(TdbRec *))
+{
+	int live = 0;
+
+	if (TDB_HTRIE_VARLENRECS(dbh)) {
+		TdbVRec *r, *c, *n;
+		TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, r) {
+			if (!tdb_live_vsrec(r))
+				continue;
+			if (!expired || !expired((TdbRec *)r)) {
+				live = 1;
+				continue;
+			}
+			for (c = r; c; c = n) {
+				n = c->chunk_next
+				    ? TDB_PTR(dbh, TDB_DI2O(c->chunk_next))
+				    : NULL;
+				tdb_free_vsrec(c);
+			}
+			atomic64_dec(&dbh->rec_n);
+		}
+	} else {
+		TdbFRec *r;
+		TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, r) {
+			if (!tdb_live_fsrec(dbh, r))
+				continue;
+			if (!expired || !expired(r)) {
+				live = 1;
+				continue;
+			}
+			tdb_free_fsrec(dbh, r);
+			atomic64_dec(&dbh->rec_n);
+		}
+	}
+	return !live;
+}
+
+/**
+ * Unlink fully freed buckets from the collision chain headed by @b.
+ * The write locks are taken with the same coupling as in the lookup
+ * and remove paths, so no context can stand on or reach a bucket
+ * being recycled. The head bucket is never unlinked since the index
+ * references it.
+ */
+static void
+tdb_htrie_compact_chain(TdbHdr *dbh, TdbBucket *b, bool (*expired)(TdbRec *))
+{
+	TdbBucket *prev = b, *victim;
+
+	write_lock_bh(&prev->lock);
+	/* Expire the head bucket records, the head is never unlinked. */
+	tdb_bckt_all_free(dbh, b, expired);
+	while (prev->coll_next) {
+		victim = TDB_PTR(dbh, TDB_DI2O(prev->coll_next));
+		write_lock_bh(&victim->lock);
+		if (tdb_bckt_all_free(dbh, victim, expired)) {
+			prev->coll_next = victim->coll_next;
+			write_unlock_bh(&victim->lock);
+			tdb_free_bckt(dbh, victim);
+			continue;
+		}
+		write_unlock_bh(&prev->lock);
+		prev = victim;
+	}
+	write_unlock_bh(&prev->lock);
+}
+
+/**
+ * Read-only walk over all live records, e.g. to reload persisted
+ * state after a restart. The callback runs under the bucket read
+ * lock and must not sleep; a non-zero return stops the walk.
+ */
+int
+tdb_htrie_walk(TdbHdr *dbh, int (*cb)(TdbRec *, void *), void *data)
+{
+	struct {
+		TdbHtrieNode	*node;
+		int		i;
+	} stack[BITS_PER_LONG / TDB_HTRIE_BITS];
+	int i = 0, sp = 0, r = 0;
+	TdbHtrieNode *node = TDB_HTRIE_ROOT(dbh);
+
+	while (1) {
+		unsigned int o;
+
+		if (i == TDB_HTRIE_FANOUT) {
+			if (!sp)
+				break;
+			--sp;
+			node = stack[sp].node;
+			i = stack[sp].i;
+			continue;
+		}
+		o = node->shifts[i];
+		if (!o) {
+			++i;
+			continue;
+		}
+		if (o & TDB_HTRIE_DBIT) {
+			TdbBucket *b = TDB_PTR(dbh,
+					       TDB_DI2O(o & ~TDB_HTRIE_DBIT));
+			read_lock_bh(&b->lock);
+			while (1) {
+				TdbRec *rec;
+				TdbBucket *next;
+
+				TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, rec) {
+					if (!tdb_live_rec(dbh, rec))
+						continue;
+					if ((r = cb(rec, data)))
+						break;
+				}
+				if (r) {
+					read_unlock_bh(&b->lock);
+					return r;
+				}
+				/*
+				 * Couple the locks on the chain step as
+				 * the other walkers do: with the lock
+				 * dropped first, compaction could unlink
+				 * and recycle the next bucket, turning
+				 * @coll_next into a free list link.
+				 */
+				next = TDB_HTRIE_BUCKET_NEXT(dbh, b);
+				if (!next) {
+					read_unlock_bh(&b->lock);
+					break;
+				}
+				read_lock_bh(&next->lock);
+				read_unlock_bh(&b->lock);
+				b = next;
+			}
+			++i;
+			continue;
+		}
+		BUG_ON(sp >= ARRAY_SIZE(stack));
+		stack[sp].node = node;
+		stack[sp].i = i + 1;
+		++sp;
+		node = TDB_PTR(dbh, TDB_II2O(o));
+		i = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tdb_htrie_walk);
+
+/**
+ * Resumable bucket walk for snapshot streaming. @pos encodes the
+ * index path to the next bucket to visit, one TDB_HTRIE_BITS nibble
+ * per trie level starting at the low bits, so a caller with a bounded
+ * output buffer can stop between buckets and pick the walk up later
+ * while writers keep running. @cb runs under the bucket read lock for
+ * the head bucket of a chain and must not sleep; returning non-zero
+ * means "no room, revisit this bucket" - @pos is set to it and 1 is
+ * returned. Returns 0 when the whole index has been visited.
+ *
+ * The image is consistent per bucket chain, not per table: that's the
+ * freeze-free trade-off, concurrent writers are never blocked.
+ */
+int
+tdb_htrie_walk_buckets(TdbHdr *dbh, unsigned long *pos,
+		       int (*cb)(TdbHdr *, TdbBucket *, void *), void *data)
+{
+	struct {
+		TdbHtrieNode	*node;
+		int		i;
+		int		cur;
+		bool		spine;
+	} stack[BITS_PER_LONG / TDB_HTRIE_BITS];
+	int sp = 0, l;
+
+	stack[0].node = TDB_HTRIE_ROOT(dbh);
+	stack[0].i = *pos & TDB_HTRIE_KMASK;
+	stack[0].spine = true;
+
+	while (sp >= 0) {
+		unsigned int o;
+
+		if (stack[sp].i == TDB_HTRIE_FANOUT) {
+			--sp;
+			continue;
+		}
+		stack[sp].cur = stack[sp].i++;
+		o = stack[sp].node->shifts[stack[sp].cur];
+		if (!o)
+			continue;
+		if (o & TDB_HTRIE_DBIT) {
+			TdbBucket *b = TDB_PTR(dbh,
+					       TDB_DI2O(o & ~TDB_HTRIE_DBIT));
+			int r;
+
+			read_lock_bh(&b->lock);
+			r = cb(dbh, b, data);
+			read_unlock_bh(&b->lock);
+			if (r) {
+				unsigned long p = 0;
+
+				for (l = sp; l >= 0; --l)
+					p = (p << TDB_HTRIE_BITS)
+					    | stack[l].cur;
+				*pos = p;
+				return 1;
+			}
+			continue;
+		}
+		BUG_ON(sp + 1 >= ARRAY_SIZE(stack));
+		stack[sp + 1].node = TDB_PTR(dbh, TDB_II2O(o));
+		stack[sp + 1].spine = stack[sp].spine
+				      && stack[sp].cur
+					 == (int)((*pos
+						   >> (sp * TDB_HTRIE_BITS))
+						  & TDB_HTRIE_KMASK);
+		stack[sp + 1].i = stack[sp + 1].spine
+				  ? (*pos >> ((sp + 1) * TDB_HTRIE_BITS))
+				    & TDB_HTRIE_KMASK
+				  : 0;
+		++sp;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tdb_htrie_walk_buckets);
+
+/**
+ * Background compaction pass: walk the index and defragment the
+ * collision chains, recycling fully freed buckets through the free
+ * list consumed by tdb_alloc_bckt(). Runs concurrently with lookups,
+ * inserts and removals; index nodes created during the walk are simply
+ * picked up by the next pass.
+ */
+void
+tdb_htrie_compact(TdbHdr *dbh, bool (*expired)(TdbRec *))
+{
+	/* Manual DFS, the depth is bounded by the key size. */
+	struct {
+		TdbHtrieNode	*node;
+		int		i;
+	} stack[BITS_PER_LONG / TDB_HTRIE_BITS];
+	int i = 0, sp = 0;
+	TdbHtrieNode *node = TDB_HTRIE_ROOT(dbh);
+
+	while (1) {
+		unsigned int o;
+
+		if (i == TDB_HTRIE_FANOUT) {
+			if (!sp)
+				break;
+			--sp;
+			node = stack[sp].node;
+			i = stack[sp].i;
+			continue;
+		}
+		o = node->shifts[i];
+		if (!o) {
+			++i;
+			continue;
+		}
+		if (o & TDB_HTRIE_DBIT) {
+			TdbBucket *b = TDB_PTR(dbh,
+					       TDB_DI2O(o & ~TDB_HTRIE_DBIT));
+			tdb_htrie_compact_chain(dbh, b, expired);
+			++i;
+			continue;
+		}
+		BUG_ON(sp >= ARRAY_SIZE(stack));
+		stack[sp].node = node;
+		stack[sp].i = i + 1;
+		++sp;
+		node = TDB_PTR(dbh, TDB_II2O(o));
+		i = 0;
+	}
+}
+
 TdbBucket *
 tdb_htrie_lookup(TdbHdr *dbh, unsigned long key)
 {
@@ -882,13 +1351,23 @@ tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len)
 	int cpu;
 	TdbHdr *hdr = (TdbHdr *)p;
 
+	/*
+	 * Fast crash recovery: only a cleanly closed table carries the
+	 * clean magic. A dirty or unknown magic means the on-disk image
+	 * may be torn mid-update, so it is discarded and the table is
+	 * reinitialized - all the tables are rebuildable caches.
+	 */
 	if (hdr->magic != TDB_MAGIC) {
+		if (hdr->magic == TDB_MAGIC_DIRTY)
+			TDB_LOG("unclean shutdown detected, the table is"
+				" reinitialized\n");
 		hdr = tdb_init_mapping(p, db_size, rec_len);
 		if (!hdr) {
 			TDB_ERR("cannot init db mapping\n");
 			return NULL;
 		}
 	}
+	hdr->magic = TDB_MAGIC_DIRTY;
 
 	/* Set per-CPU pointers. */
 	hdr->pcpu = alloc_percpu(TdbPerCpu);
@@ -911,5 +1390,7 @@ tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len)
 void
 tdb_htrie_exit(TdbHdr *dbh)
 {
+	/* The mapping is synced to the file right after, see the caller. */
+	dbh->magic = TDB_MAGIC;
 	free_percpu(dbh->pcpu);
 }
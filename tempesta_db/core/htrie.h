@@ -134,6 +134,13 @@ tdb_live_rec(TdbHdr *dbh, TdbRec *r)
 TdbVRec *tdb_htrie_extend_rec(TdbHdr *dbh, TdbVRec *rec, size_t size);
 TdbRec *tdb_htrie_insert(TdbHdr *dbh, unsigned long key, void *data,
 			 size_t *len);
+int tdb_htrie_remove(TdbHdr *dbh, unsigned long key,
+		     bool (*eq_cb)(TdbRec *, void *), void *cb_data);
+void tdb_htrie_compact(TdbHdr *dbh, bool (*expired)(TdbRec *));
+int tdb_htrie_walk(TdbHdr *dbh, int (*cb)(TdbRec *, void *), void *data);
+int tdb_htrie_walk_buckets(TdbHdr *dbh, unsigned long *pos,
+			   int (*cb)(TdbHdr *, TdbBucket *, void *),
+			   void *data);
 TdbBucket *tdb_htrie_lookup(TdbHdr *dbh, unsigned long key);
 TdbRec *tdb_htrie_bscan_for_rec(TdbHdr *dbh, TdbBucket **b, unsigned long key);
 TdbRec *tdb_htrie_next_rec(TdbHdr *dbh, TdbRec *r, TdbBucket **b,
@@ -173,13 +173,27 @@ tdb_if_insert(struct sk_buff *skb, struct netlink_callback *cb)
 	return 0;
 }
 
+static bool
+tdb_memmem(const char *h, unsigned int h_len, const unsigned char *n,
+	   unsigned int n_len)
+{
+	unsigned int i;
+
+	if (n_len > h_len)
+		return false;
+	for (i = 0; i + n_len <= h_len; ++i)
+		if (!memcmp(h + i, n, n_len))
+			return true;
+	return false;
+}
+
 static int
 tdb_if_select(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	TdbIter iter;
-	unsigned long key;
+	unsigned int i, qoff, roff = 0;
+	const unsigned char *flt = NULL;
+	unsigned int flt_len = 0;
 	TdbMsg *resp_m, *m = cb->data;
-	TdbRec *res;
 	struct nlmsghdr *nlh;
 	TDB *db;
 
@@ -200,45 +214,213 @@ tdb_if_select(struct sk_buff *skb, struct netlink_callback *cb)
 	}
 
 	/*
+	 * Process all the keys of the query in one round trip. Results
+	 * are framed as TdbMsgRec entries echoing the key, so the
+	 * client can match them to its keys. The response is bounded by
+	 * one netlink frame; what doesn't fit is marked truncated.
+	 *
+	 * A leading record with a zero key length carries a server-side
+	 * filter: only records whose data contains the byte string are
+	 * returned, so the client doesn't pull and scan whole records
+	 * over netlink.
+	 *
 	 * FIXME implement select of all records:
 	 * 1. full HTrie iterator is required;
 	 * 2. use many netlink frames to send probably large data set.
 	 */
-	key = tdb_hash_calc(m->recs[0].data, m->recs[0].klen);
-	iter = tdb_rec_get(db, key);
-	res = iter.rec;
-	if (res) {
-		resp_m->rec_n = 1;
+	i = 0;
+	qoff = 0;
+	if (m->rec_n && !m->recs[0].klen && m->recs[0].dlen) {
+		flt = (unsigned char *)TDB_MSGREC_DATA(&m->recs[0]);
+		flt_len = m->recs[0].dlen;
+		qoff = TDB_MSGREC_LEN(&m->recs[0]);
+		i = 1;
+	}
+	for ( ; i < m->rec_n; ++i) {
+		TdbMsgRec *q = (TdbMsgRec *)((char *)m->recs + qoff);
+		TdbMsgRec *out = (TdbMsgRec *)((char *)resp_m->recs + roff);
+		unsigned long key = tdb_hash_calc(q->data, q->klen);
+		unsigned int budget, dlen = 0;
+		TdbIter iter;
+
+		qoff += TDB_MSGREC_LEN(q);
+
+		if (roff + sizeof(*out) + q->klen > TDB_NLMSG_MAXSZ) {
+			resp_m->type |= TDB_NLF_RESP_TRUNC;
+			break;
+		}
+		budget = TDB_NLMSG_MAXSZ - roff - sizeof(*out) - q->klen;
+
+		iter = tdb_rec_get(db, key);
+		if (!iter.rec)
+			continue;
+
+		out->klen = q->klen;
+		memcpy(out->data, q->data, q->klen);
+
 		if (TDB_HTRIE_VARLENRECS(db->hdr)) {
-			TdbVRec *vr = (TdbVRec *)res;
-			size_t off = vr->len;
-			memcpy(resp_m->recs, vr->data, vr->len);
+			TdbVRec *vr = (TdbVRec *)iter.rec;
+
 			while (1) {
-				size_t n = vr->len;
-				if (n + off > TDB_NLMSG_MAXSZ) {
-					n = TDB_NLMSG_MAXSZ - off;
+				unsigned int n = vr->len;
+
+				if (n > budget - dlen) {
+					n = budget - dlen;
 					resp_m->type |= TDB_NLF_RESP_TRUNC;
 				}
-				memcpy((char *)resp_m->recs + off, vr->data, n);
+				memcpy(TDB_MSGREC_DATA(out) + dlen,
+				       vr->data, n);
+				dlen += n;
 				if (n < vr->len || !vr->chunk_next)
 					break;
-				vr = TDB_PTR(db->hdr, TDB_DI2O(vr->chunk_next));
-				off += n;
+				vr = TDB_PTR(db->hdr,
+					     TDB_DI2O(vr->chunk_next));
 			}
+		} else {
+			dlen = min_t(unsigned int, budget, db->hdr->rec_len);
+			if (dlen < db->hdr->rec_len)
+				resp_m->type |= TDB_NLF_RESP_TRUNC;
+			memcpy(TDB_MSGREC_DATA(out), iter.rec->data, dlen);
 		}
-		else {
-			memcpy(resp_m->recs, res->data, db->hdr->rec_len);
-		}
-		tdb_rec_put(res);
+		tdb_rec_put(iter.rec);
+
+		out->dlen = dlen;
+		if (flt && !tdb_memmem(TDB_MSGREC_DATA(out), dlen,
+				       flt, flt_len))
+			continue; /* filtered out, reuse the room */
+		roff += TDB_MSGREC_LEN(out);
+		++resp_m->rec_n;
 	}
 
 	tdb_put(db);
-	/* Only one record is fetched for now. */
 	resp_m->type |= TDB_NLF_RESP_OK | TDB_NLF_RESP_END;
 
 	return 0;
 }
 
+/*
+ * Stream the whole table as a multi-frame netlink dump: each dump
+ * invocation fills one frame with TdbMsgRec entries (the 8-byte key
+ * followed by the record data) using the resumable bucket walk, the
+ * position lives in cb->args[0] between frames. Writers are never
+ * blocked - the image is consistent per bucket chain - and a record
+ * larger than a frame is truncated and flagged, to be re-fetched
+ * individually through the SELECT path when full data is needed.
+ */
+typedef struct {
+	TdbMsg		*resp_m;
+	unsigned int	roff;
+} TdbSnapCtx;
+
+static int
+tdb_if_snap_bckt(TdbHdr *dbh, TdbBucket *b, void *data)
+{
+	TdbSnapCtx *ctx = data;
+	TdbRec *rec;
+
+	/* Refuse early if even a header might not fit. */
+	if (ctx->roff + sizeof(TdbMsgRec) + sizeof(unsigned long) + 64
+	    > TDB_NLMSG_MAXSZ)
+		return 1;
+
+	while (b) {
+		TDB_HTRIE_FOREACH_BCKT_REC(dbh, b, rec) {
+			TdbMsgRec *out;
+			unsigned int budget, dlen = 0;
+
+			if (!tdb_live_rec(dbh, rec))
+				continue;
+			if (ctx->roff + sizeof(*out) + sizeof(unsigned long)
+			    > TDB_NLMSG_MAXSZ)
+				return 1;
+			out = (TdbMsgRec *)((char *)ctx->resp_m->recs
+					    + ctx->roff);
+			out->klen = sizeof(unsigned long);
+			memcpy(out->data, &rec->key, sizeof(unsigned long));
+			budget = TDB_NLMSG_MAXSZ - ctx->roff - sizeof(*out)
+				 - out->klen;
+
+			if (TDB_HTRIE_VARLENRECS(dbh)) {
+				TdbVRec *vr = (TdbVRec *)rec;
+
+				while (1) {
+					unsigned int n = vr->len;
+
+					if (n > budget - dlen) {
+						n = budget - dlen;
+						ctx->resp_m->type
+							|= TDB_NLF_RESP_TRUNC;
+					}
+					memcpy(TDB_MSGREC_DATA(out) + dlen,
+					       vr->data, n);
+					dlen += n;
+					if (n < vr->len || !vr->chunk_next)
+						break;
+					vr = TDB_PTR(dbh,
+						     TDB_DI2O(vr->chunk_next));
+				}
+			} else {
+				dlen = min_t(unsigned int, budget,
+					     dbh->rec_len);
+				if (dlen < dbh->rec_len)
+					ctx->resp_m->type
+						|= TDB_NLF_RESP_TRUNC;
+				memcpy(TDB_MSGREC_DATA(out), rec->data, dlen);
+			}
+			out->dlen = dlen;
+			ctx->roff += TDB_MSGREC_LEN(out);
+			++ctx->resp_m->rec_n;
+		}
+		b = TDB_HTRIE_BUCKET_NEXT(dbh, b);
+	}
+
+	return 0;
+}
+
+static int
+tdb_if_snapshot(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	TdbMsg *resp_m, *m = cb->data;
+	struct nlmsghdr *nlh;
+	TdbSnapCtx ctx = { 0 };
+	TDB *db;
+	int r;
+
+	if (cb->args[1])
+		return 0; /* the END frame was already sent */
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			cb->nlh->nlmsg_type, TDB_NLMSG_MAXSZ, 0);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	resp_m = nlmsg_data(nlh);
+	resp_m->rec_n = 0;
+	resp_m->type = TDB_MSG_SNAPSHOT;
+
+	db = tdb_tbl_lookup(m->t_name, TDB_TBLNAME_LEN);
+	if (!db) {
+		TDB_WARN("Tried to snapshot non existent table '%s'\n",
+			 m->t_name);
+		resp_m->type |= TDB_NLF_RESP_END;
+		cb->args[1] = 1;
+		return skb->len;
+	}
+
+	ctx.resp_m = resp_m;
+	r = tdb_htrie_walk_buckets(db->hdr, &cb->args[0], tdb_if_snap_bckt,
+				   &ctx);
+	tdb_put(db);
+
+	resp_m->type |= TDB_NLF_RESP_OK;
+	if (!r) {
+		resp_m->type |= TDB_NLF_RESP_END;
+		cb->args[1] = 1;
+	}
+
+	return skb->len;
+}
+
 static const struct {
 	int (*dump)(struct sk_buff *, struct netlink_callback *);
 } tdb_if_call_tbl[__TDB_MSG_TYPE_MAX] = {
@@ -247,6 +429,7 @@ static const struct {
 	[TDB_MSG_CLOSE - __TDB_MSG_BASE]	= { .dump = tdb_if_open_close },
 	[TDB_MSG_INSERT - __TDB_MSG_BASE]	= { .dump = tdb_if_insert },
 	[TDB_MSG_SELECT - __TDB_MSG_BASE]	= { .dump = tdb_if_select },
+	[TDB_MSG_SNAPSHOT - __TDB_MSG_BASE]	= { .dump = tdb_if_snapshot },
 };
 
 static int
@@ -325,13 +508,21 @@ tdb_if_proc_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
 			return -EINVAL;
 		break;
 	case TDB_MSG_SELECT:
-		if (m->rec_n != 1) {
+		if (m->rec_n < 1) {
 			TDB_ERR("empty select msg\n");
 			return -EINVAL;
 		}
 		if (!tdb_if_check_tblname(m))
 			return -EINVAL;
 		break;
+	case TDB_MSG_SNAPSHOT:
+		if (m->rec_n) {
+			TDB_ERR("Bad snapshot msg: rec_n=%u\n", m->rec_n);
+			return -EINVAL;
+		}
+		if (!tdb_if_check_tblname(m))
+			return -EINVAL;
+		break;
 	default:
 		TDB_ERR("bad netlink msg type %u\n", m->type);
 		return -EINVAL;
@@ -94,6 +94,13 @@ EXPORT_SYMBOL(tdb_entry_get_room);
  * @return pointer to record with acquired bucket lock if the record is
  * found and NULL without acquired locks otherwise.
  */
+int
+tdb_entry_walk(TDB *db, int (*cb)(TdbRec *, void *), void *data)
+{
+	return tdb_htrie_walk(db->hdr, cb, data);
+}
+EXPORT_SYMBOL(tdb_entry_walk);
+
 TdbIter
 tdb_rec_get(TDB *db, unsigned long key)
 {
@@ -124,6 +131,100 @@ tdb_rec_next(TDB *db, TdbIter *iter)
 }
 EXPORT_SYMBOL(tdb_rec_next);
 
+/**
+ * Lookup a record by @key and copy its data into @buf of @len bytes.
+ *
+ * Unlike tdb_rec_get(), no lock is returned to the caller: the bucket
+ * read lock is dropped right after the copy, so concurrent writers are
+ * blocked only for the memcpy() and the caller can process the data
+ * for as long as it wants. Makes sense for small fixed-size records.
+ * @eq_cb, if set, selects among records sharing the key.
+ *
+ * @return the copied length or -ENOENT if nothing was found.
+ */
+int
+tdb_rec_get_copy(TDB *db, unsigned long key, void *buf, size_t len,
+		 bool (*eq_cb)(TdbRec *, void *), void *cb_data)
+{
+	int r = -ENOENT;
+	TdbIter iter;
+
+	iter = tdb_rec_get(db, key);
+	while (!TDB_ITER_BAD(iter)) {
+		if (!eq_cb || eq_cb(iter.rec, cb_data)) {
+			size_t n = db->hdr->rec_len
+				   ? min_t(size_t, len, db->hdr->rec_len)
+				   : min_t(size_t, len,
+					   TDB_HTRIE_VRLEN((TdbVRec *)
+							   iter.rec));
+			memcpy(buf, db->hdr->rec_len
+				    ? ((TdbFRec *)iter.rec)->data
+				    : ((TdbVRec *)iter.rec)->data, n);
+			tdb_rec_put(iter.rec);
+			return n;
+		}
+		tdb_rec_next(db, &iter);
+	}
+
+	return r;
+}
+EXPORT_SYMBOL(tdb_rec_get_copy);
+
+/*
+ * Secondary index support: an index is a separate table of small
+ * fixed-size records mapping a secondary key to the primary key of the
+ * indexed table. Lookups resolve the alias first and then fetch the
+ * record by the primary key, so one record can be reached by any
+ * number of keys (e.g. a cache entry by URI hash and by purge tag).
+ */
+
+/**
+ * Insert the mapping @alias_key -> @pri_key into the index table
+ * @idx. The index table must be opened with
+ * rec_size == sizeof(unsigned long).
+ */
+int
+tdb_idx_insert(TDB *idx, unsigned long alias_key, unsigned long pri_key)
+{
+	size_t len = sizeof(pri_key);
+
+	BUG_ON(idx->hdr->rec_len != sizeof(unsigned long));
+
+	return tdb_entry_create(idx, alias_key, &pri_key, &len) ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(tdb_idx_insert);
+
+/**
+ * Lookup a record of @db through the secondary index @idx.
+ * @return the same iterator contract as tdb_rec_get().
+ */
+TdbIter
+tdb_idx_rec_get(TDB *idx, TDB *db, unsigned long alias_key)
+{
+	TdbIter iter = { NULL };
+	unsigned long pri_key;
+
+	if (tdb_rec_get_copy(idx, alias_key, &pri_key, sizeof(pri_key),
+			     NULL, NULL) != sizeof(pri_key))
+		return iter;
+
+	return tdb_rec_get(db, pri_key);
+}
+EXPORT_SYMBOL(tdb_idx_rec_get);
+
+/**
+ * Remove records with the given @key, optionally filtered by @eq_cb.
+ * The buckets are write locked during the removal, so the function must
+ * not be called with a record got by tdb_rec_get() and not yet released.
+ */
+int
+tdb_entry_remove(TDB *db, unsigned long key, bool (*eq_cb)(TdbRec *, void *),
+		 void *cb_data)
+{
+	return tdb_htrie_remove(db->hdr, key, eq_cb, cb_data);
+}
+EXPORT_SYMBOL(tdb_entry_remove);
+
 void
 tdb_rec_put(void *rec)
 {
@@ -255,11 +356,15 @@ EXPORT_SYMBOL(tdb_open);
 static void
 __do_close_table(TDB *db)
 {
+	/*
+	 * Mark the table clean before the mapping is written back to
+	 * the file, so the next open trusts the on-disk image.
+	 */
+	tdb_htrie_exit(db->hdr);
+
 	/* Unmapping can be done from process context. */
 	tdb_file_close(db);
 
-	tdb_htrie_exit(db->hdr);
-
 	TDB_LOG("Close table '%s'\n", db->tbl_name);
 
 	kfree(db);
@@ -280,6 +385,29 @@ tdb_close(TDB *db)
 }
 EXPORT_SYMBOL(tdb_close);
 
+/*
+ * Background compaction: periodically defragment the collision chains
+ * of every open table, see tdb_htrie_compact().
+ */
+#define TDB_COMPACT_PERIOD	(60 * HZ)
+
+static void tdb_compact_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tdb_compact_work, tdb_compact_fn);
+
+static void
+__do_compact_table(TDB *db)
+{
+	if (db->hdr)
+		tdb_htrie_compact(db->hdr, db->expire_cb);
+}
+
+static void
+tdb_compact_fn(struct work_struct *work)
+{
+	tdb_tbl_foreach(__do_compact_table);
+	schedule_delayed_work(&tdb_compact_work, TDB_COMPACT_PERIOD);
+}
+
 static int __init
 tdb_init(void)
 {
@@ -295,6 +423,8 @@ tdb_init(void)
 	if (r)
 		return r;
 
+	schedule_delayed_work(&tdb_compact_work, TDB_COMPACT_PERIOD);
+
 	return 0;
 }
 
@@ -303,6 +433,8 @@ tdb_exit(void)
 {
 	TDB_LOG("Shutdown Tempesta DB\n");
 
+	cancel_delayed_work_sync(&tdb_compact_work);
+
 	tdb_if_exit();
 
 	/*
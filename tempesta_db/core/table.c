@@ -83,7 +83,12 @@ tdb_tbl_print_all(char *buf, size_t len)
 	mutex_lock(&tbl_mtx);
 
 	for (i = 0; i < tbl_last; ++i) {
-		int r = snprintf(buf + n, len - n, "%s ", tdb_tbls[i].name);
+		TdbHdr *h = tdb_tbls[i].db->hdr;
+		int r = snprintf(buf + n, len - n,
+				 "\n  %s: size=%lu used=%lu records=%lu",
+				 tdb_tbls[i].name, h->dbsz,
+				 (unsigned long)atomic64_read(&h->nwb),
+				 (unsigned long)atomic64_read(&h->rec_n));
 		if (r <= 0) {
 			TDB_WARN("Not enough space to print all tables\n");
 			break;
@@ -41,6 +41,7 @@
 typedef struct {
 	unsigned long	i_wcl;
 	unsigned long	d_wcl;
+	unsigned long	c_ext;
 } TdbPerCpu;
 
 /**
@@ -53,6 +54,9 @@ typedef struct {
  * @nwb		- next to write block (byte offset);
  * @pcpu	- pointer to per-cpu dynamic data for the TDB handler;
  * @rec_len	- fixed-size records length or zero for variable-length records;
+ * @bckt_fl	- head of the free list of buckets unlinked by the
+ *		  compaction, in data block units, zero if empty;
+ * @rec_n	- number of live records in the table;
  ** @ext_bmp	- bitmap of used/free extents.
  * 		  Must be small and cache line aligned;
  */
@@ -62,28 +66,12 @@ typedef struct {
 	atomic64_t		nwb;
 	TdbPerCpu __percpu	*pcpu;
 	unsigned int		rec_len;
-	unsigned char		_padding[8 * 3 + 4];
+	atomic64_t		bckt_fl;
+	atomic64_t		rec_n;
+	unsigned char		_padding[8 + 4];
 	unsigned long		ext_bmp[0];
 } __attribute__((packed)) TdbHdr;
 
-/**
- * Database handle descriptor.
- *
- * @filp	- mmap()'ed file;
- * @node	- NUMA node ID;
- * @count	- reference counter;
- * @tbl_name	- table name;
- * @path	- path to the table;
- */
-typedef struct {
-	TdbHdr		*hdr;
-	struct file	*filp;
-	int		node;
-	atomic_t	count;
-	char		tbl_name[TDB_TBLNAME_LEN + 1];
-	char		path[TDB_PATH_LEN];
-} TDB;
-
 /**
  * Fixed-size (and typically small) records.
  */
@@ -108,6 +96,27 @@ typedef struct {
 /* Common interface for database records of all kinds. */
 typedef TdbFRec TdbRec;
 
+/**
+ * Database handle descriptor.
+ *
+ * @filp	- mmap()'ed file;
+ * @node	- NUMA node ID;
+ * @count	- reference counter;
+ * @expire_cb	- optional record TTL check consumed by the background
+ *		  compaction, see tdb_set_expire_cb();
+ * @tbl_name	- table name;
+ * @path	- path to the table;
+ */
+typedef struct {
+	TdbHdr		*hdr;
+	struct file	*filp;
+	int		node;
+	atomic_t	count;
+	bool		(*expire_cb)(TdbRec *);
+	char		tbl_name[TDB_TBLNAME_LEN + 1];
+	char		path[TDB_PATH_LEN];
+} TDB;
+
 /**
  * Iterator for TDB full key collision chains.
  */
@@ -166,7 +175,14 @@ TdbVRec *tdb_entry_add(TDB *db, TdbVRec *r, size_t size);
 void *tdb_entry_get_room(TDB *db, TdbVRec **r, char *curr_ptr, size_t tail_len,
 			 size_t tot_size);
 TdbIter tdb_rec_get(TDB *db, unsigned long key);
+int tdb_entry_walk(TDB *db, int (*cb)(TdbRec *, void *), void *data);
 void tdb_rec_next(TDB *db, TdbIter *iter);
+int tdb_rec_get_copy(TDB *db, unsigned long key, void *buf, size_t len,
+		     bool (*eq_cb)(TdbRec *, void *), void *cb_data);
+int tdb_idx_insert(TDB *idx, unsigned long alias_key, unsigned long pri_key);
+TdbIter tdb_idx_rec_get(TDB *idx, TDB *db, unsigned long alias_key);
+int tdb_entry_remove(TDB *db, unsigned long key,
+		     bool (*eq_cb)(TdbRec *, void *), void *cb_data);
 void tdb_rec_put(void *rec);
 int tdb_info(char *buf, size_t len);
 
@@ -176,6 +192,17 @@ void tdb_close(TDB *db);
 
 unsigned long tdb_hash_calc(const char *data, size_t len);
 
+/**
+ * Register the TTL index of the table: the background compaction asks
+ * the callback for every live record and reclaims the expired ones.
+ * The callback runs under a bucket write lock and must not sleep.
+ */
+static inline void
+tdb_set_expire_cb(TDB *db, bool (*cb)(TdbRec *))
+{
+	db->expire_cb = cb;
+}
+
 static inline TDB *
 tdb_get(TDB *db)
 {
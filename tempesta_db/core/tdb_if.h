@@ -44,6 +44,7 @@ enum tdb_msg_type {
 	TDB_MSG_CLOSE,
 	TDB_MSG_INSERT,
 	TDB_MSG_SELECT,
+	TDB_MSG_SNAPSHOT,
 	__TDB_MSG_TYPE_MAX
 };
 
@@ -420,6 +420,32 @@ TdbHndl::insert(std::string &tbl_name, size_t klen, size_t vlen,
 void
 TdbHndl::query(std::string &tbl_name, std::string &key,
 	       std::function<void (char *, size_t, char *, size_t)> process_cb)
+{
+	std::vector<std::string> keys{key};
+
+	query(tbl_name, keys, process_cb);
+}
+
+/**
+ * Batched query: all the keys travel to the kernel and back in a
+ * single netlink round trip, the results echo the keys.
+ */
+void
+TdbHndl::query(std::string &tbl_name, std::vector<std::string> &keys,
+	       std::function<void (char *, size_t, char *, size_t)> process_cb)
+{
+	query(tbl_name, keys, std::string(), process_cb);
+}
+
+/**
+ * Batched query with a server-side filter: a leading zero-key record
+ * carries the byte string, the kernel returns only records whose data
+ * contains it.
+ */
+void
+TdbHndl::query(std::string &tbl_name, std::vector<std::string> &keys,
+	       const std::string &filter,
+	       std::function<void (char *, size_t, char *, size_t)> process_cb)
 {
 	if (trx_)
 		throw TdbExcept("cannot run the action inside transaction");
@@ -427,19 +453,35 @@ TdbHndl::query(std::string &tbl_name, std::string &key,
 	if (tbl_name.length() > TDB_TBLNAME_LEN)
 		throw TdbExcept("too long table name");
 
-	msg_send([&tbl_name, &key](nlmsghdr *nlh) {
+	msg_send([&tbl_name, &keys, &filter](nlmsghdr *nlh) {
 		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		unsigned int off = 0;
+
 		m->type = TDB_MSG_SELECT;
-		m->rec_n = 1;
+		m->rec_n = keys.size();
 		tbl_name.copy(m->t_name, tbl_name.length());
 		m->t_name[tbl_name.length()] = 0;
 
-		m->recs[0].klen = key.length();
-		m->recs[0].dlen = 0;
-		key.copy(m->recs[0].data, m->recs[0].klen);
+		if (filter.length()) {
+			TdbMsgRec *r = (TdbMsgRec *)((char *)m->recs + off);
+
+			r->klen = 0;
+			r->dlen = filter.length();
+			filter.copy(r->data, r->dlen);
+			off += TDB_MSGREC_LEN(r);
+			++m->rec_n;
+		}
+
+		for (auto &key: keys) {
+			TdbMsgRec *r = (TdbMsgRec *)((char *)m->recs + off);
+
+			r->klen = key.length();
+			r->dlen = 0;
+			key.copy(r->data, r->klen);
+			off += TDB_MSGREC_LEN(r);
+		}
 
-		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m) + sizeof(TdbMsgRec)
-				 + m->recs[0].klen;
+		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m) + off;
 		nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
 		nlh->nlmsg_flags |= NLM_F_REQUEST;
 	});
@@ -473,6 +515,62 @@ TdbHndl::query(std::string &tbl_name, std::string &key,
 
 }
 
+/**
+ * Stream a whole-table snapshot: the kernel walks the table with a
+ * resumable cursor and sends as many multi-frame responses as needed,
+ * so the image size isn't bounded by a netlink frame. Records flagged
+ * truncated by the kernel can be re-fetched individually by key.
+ */
+void
+TdbHndl::snapshot(std::string &tbl_name,
+		  std::function<void (char *, size_t, char *, size_t)>
+		  process_cb)
+{
+	if (trx_)
+		throw TdbExcept("cannot run the action inside transaction");
+
+	if (tbl_name.length() > TDB_TBLNAME_LEN)
+		throw TdbExcept("too long table name");
+
+	msg_send([&tbl_name](nlmsghdr *nlh) {
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+
+		m->type = TDB_MSG_SNAPSHOT;
+		m->rec_n = 0;
+		tbl_name.copy(m->t_name, tbl_name.length());
+		m->t_name[tbl_name.length()] = 0;
+
+		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m);
+		nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
+		nlh->nlmsg_flags |= NLM_F_REQUEST;
+	});
+
+	msg_recv([this, &process_cb](nlmsghdr *nlh) -> bool {
+		if (nlh->nlmsg_len < sizeof(*nlh) + sizeof(TdbMsg))
+			throw TdbExcept("bad snapshot msg len %u",
+					nlh->nlmsg_len);
+
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		if ((m->type & TDB_MSG_SNAPSHOT) != TDB_MSG_SNAPSHOT)
+			throw TdbExcept("malformed snapshot results type=%u",
+					m->type);
+		if (!(m->type & TDB_NLF_RESP_OK))
+			throw TdbExcept("cannot snapshot, see dmesg");
+
+		for (unsigned int i = 0, off = 0; i < m->rec_n; ++i) {
+			TdbMsgRec *r = (TdbMsgRec *)((char *)m->recs + off);
+			process_cb(r->data, r->klen,
+				   TDB_MSGREC_DATA(r), r->dlen);
+			off += TDB_MSGREC_LEN(r);
+		}
+
+		if (m->type & TDB_NLF_RESP_END)
+			last_status_.update(m);
+
+		return !(m->type & TDB_NLF_RESP_END);
+	});
+}
+
 std::string
 TdbHndl::last_status() noexcept
 {
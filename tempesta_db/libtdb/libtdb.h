@@ -23,6 +23,7 @@
 #include <linux/netlink.h>
 
 #include <functional>
+#include <vector>
 #include <iostream>
 
 #include <tdb_if.h>
@@ -94,9 +95,19 @@ public:
 	void close_table(std::string &tbl_name);
 	void insert(std::string &tbl_name, size_t klen, size_t vlen,
 		    std::function<void (char *, char *)> placement_cb);
+	void snapshot(std::string &tbl_name,
+		      std::function<void (char *, size_t, char *, size_t)>
+		      process_cb);
 	void query(std::string &tbl_name, std::string &key,
 		   std::function<void (char *, size_t, char *, size_t)>
 			process_cb);
+	void query(std::string &tbl_name, std::vector<std::string> &keys,
+		   std::function<void (char *, size_t, char *, size_t)>
+			process_cb);
+	void query(std::string &tbl_name, std::vector<std::string> &keys,
+		   const std::string &filter,
+		   std::function<void (char *, size_t, char *, size_t)>
+			process_cb);
 
 	std::string last_status() noexcept;
 
@@ -225,10 +225,9 @@ tdb_htrie_open(void *addr, const char *fname, size_t size, int *fd)
 	}
 	printf("maped to %p\n", p);
 
-	if (mlock(p, size)) {
-		perror("ERROR: mlock failure, please check rlimit");
-		exit(1);
-	}
+	if (mlock(p, size))
+		perror("WARNING: mlock failure (bench timings may suffer),"
+		       " please check rlimit");
 
 	return p;
 }
@@ -516,6 +515,301 @@ tdb_htrie_test(const char *vsf, const char *fsf)
 	tdb_htrie_test_fixsz(fsf);
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Benchmark suite: mixed reader/writer contention
+ *
+ * The unit tests above exercise correctness; the benchmark measures
+ * the htrie under the web-cache access pattern - many readers, few
+ * writers, zipfian key popularity, variable record sizes going through
+ * tdb_htrie_extend_rec(). Each scenario reports ops/sec, sampled p99
+ * latencies and hardware cache misses (via perf, when permitted), so
+ * any htrie concurrency change has numbers to be reviewed against.
+ * ------------------------------------------------------------------------
+ */
+#include <linux/perf_event.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define BENCH_KEY_N	(64 * 1024)
+#define BENCH_LAT_N	4096
+#define BENCH_LAT_STEP	16
+#define BENCH_VMAX_SZ	(64 * 1024)
+
+typedef struct {
+	TdbHdr		*dbh;
+	unsigned int	seed;
+	int		is_writer;
+	long		ops;
+	size_t		vmin, vmax;
+	/* Results. */
+	long		done;
+	long		lat[BENCH_LAT_N];
+	int		lat_n;
+	long		cache_miss;
+} BenchThr;
+
+static unsigned long bench_keys[BENCH_KEY_N];
+static double bench_zipf_cdf[BENCH_KEY_N];
+static char bench_data[BENCH_VMAX_SZ];
+
+static void
+bench_init_keys(double theta)
+{
+	int i;
+	double sum = 0;
+
+	for (i = 0; i < BENCH_KEY_N; ++i) {
+		bench_keys[i] = ((unsigned long)rand() << 32) ^ rand();
+		sum += 1.0 / pow(i + 1, theta);
+		bench_zipf_cdf[i] = sum;
+	}
+	for (i = 0; i < BENCH_KEY_N; ++i)
+		bench_zipf_cdf[i] /= sum;
+	for (i = 0; i < sizeof(bench_data); ++i)
+		bench_data[i] = rand();
+}
+
+static unsigned long
+bench_key(unsigned int *seed)
+{
+	double u = (double)rand_r(seed) / RAND_MAX;
+	int lo = 0, hi = BENCH_KEY_N - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (bench_zipf_cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return bench_keys[lo];
+}
+
+static int
+bench_perf_open(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_HW_CACHE_MISSES,
+		.disabled	= 1,
+		.exclude_kernel	= 1,
+	};
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static inline long
+bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void
+bench_write_op(BenchThr *b, unsigned long key)
+{
+	size_t len = b->vmin + rand_r(&b->seed) % (b->vmax - b->vmin + 1);
+	size_t copied, to_copy = len;
+	TdbVRec *rec;
+
+	/*
+	 * Replace, don't append: a cache overwrite removes the stale
+	 * record, which also keeps the duplicate chains of hot zipfian
+	 * keys bounded and exercises tdb_htrie_remove() under
+	 * contention with the readers.
+	 */
+	tdb_htrie_remove(b->dbh, key, NULL, NULL);
+	rec = (TdbVRec *)tdb_htrie_insert(b->dbh, key, bench_data, &to_copy);
+	if (!rec)
+		return; /* out of space - keep hammering the index */
+	copied = to_copy;
+	while (copied != len) {
+		rec = tdb_htrie_extend_rec(b->dbh, rec, len - copied);
+		if (!rec)
+			break;
+		memcpy(rec + 1, bench_data + copied, rec->len);
+		copied += rec->len;
+	}
+}
+
+static void
+bench_read_op(BenchThr *b, unsigned long key)
+{
+	TdbBucket *bckt = tdb_htrie_lookup(b->dbh, key);
+	TdbRec *r;
+
+	if (!bckt)
+		return;
+	r = tdb_htrie_bscan_for_rec(b->dbh, &bckt, key);
+	while (r)
+		r = tdb_htrie_next_rec(b->dbh, r, &bckt, key);
+}
+
+static void *
+bench_thr_f(void *data)
+{
+	BenchThr *b = (BenchThr *)data;
+	long i;
+	int pfd = bench_perf_open();
+
+	if (pfd >= 0)
+		ioctl(pfd, PERF_EVENT_IOC_ENABLE, 0);
+
+	for (i = 0; i < b->ops; ++i) {
+		unsigned long key = bench_key(&b->seed);
+		long t0 = 0;
+		int sample = !(i % BENCH_LAT_STEP) && b->lat_n < BENCH_LAT_N;
+
+		if (sample)
+			t0 = bench_ns();
+		if (b->is_writer)
+			bench_write_op(b, key);
+		else
+			bench_read_op(b, key);
+		if (sample)
+			b->lat[b->lat_n++] = bench_ns() - t0;
+		++b->done;
+	}
+
+	if (pfd >= 0) {
+		ioctl(pfd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(pfd, &b->cache_miss, sizeof(b->cache_miss))
+		    != sizeof(b->cache_miss))
+			b->cache_miss = -1;
+		close(pfd);
+	} else {
+		b->cache_miss = -1;
+	}
+
+	return NULL;
+}
+
+static int
+bench_lat_cmp(const void *a, const void *b)
+{
+	return *(const long *)a < *(const long *)b ? -1
+	       : *(const long *)a > *(const long *)b;
+}
+
+static long
+bench_p99(long *lat, int n)
+{
+	if (!n)
+		return 0;
+	qsort(lat, n, sizeof(*lat), bench_lat_cmp);
+	return lat[n - 1 - n / 100];
+}
+
+static void
+bench_scenario(const char *fname, int readers, int writers, long ops,
+	       double theta, size_t vmin, size_t vmax)
+{
+	int t, fd, thr_n = readers + writers;
+	char *addr;
+	TdbHdr *dbh;
+	long t0, ns, total = 0, misses = 0;
+	long rlat[BENCH_LAT_N], wlat[BENCH_LAT_N];
+	int rlat_n = 0, wlat_n = 0, miss_ok = 1;
+	BenchThr *b;
+	pthread_t *thr;
+
+	b = calloc(thr_n, sizeof(*b));
+	thr = calloc(thr_n, sizeof(*thr));
+	assert(b && thr);
+
+	unlink(fname);
+	addr = tdb_htrie_open(TDB_MAP_ADDR1, fname, TDB_VSF_SZ, &fd);
+	dbh = tdb_htrie_init(addr, TDB_VSF_SZ, 0);
+	if (!dbh)
+		TDB_ERR("cannot initialize htrie for benchmark");
+
+	bench_init_keys(theta);
+
+	for (t = 0; t < thr_n; ++t) {
+		b[t].dbh = dbh;
+		b[t].seed = t + 1;
+		b[t].is_writer = t < writers;
+		b[t].ops = ops;
+		b[t].vmin = vmin;
+		b[t].vmax = vmax;
+	}
+
+	t0 = bench_ns();
+	for (t = 0; t < thr_n; ++t)
+		if (spawn_thread(thr + t, bench_thr_f, b + t))
+			perror("cannot spawn bench thread");
+	for (t = 0; t < thr_n; ++t)
+		pthread_join(thr[t], NULL);
+	ns = bench_ns() - t0;
+
+	for (t = 0; t < thr_n; ++t) {
+		int i;
+
+		total += b[t].done;
+		if (b[t].cache_miss < 0)
+			miss_ok = 0;
+		else
+			misses += b[t].cache_miss;
+		for (i = 0; i < b[t].lat_n; ++i) {
+			if (b[t].is_writer && wlat_n < BENCH_LAT_N)
+				wlat[wlat_n++] = b[t].lat[i];
+			else if (!b[t].is_writer && rlat_n < BENCH_LAT_N)
+				rlat[rlat_n++] = b[t].lat[i];
+		}
+	}
+
+	printf("bench r=%d w=%d zipf=%.2f size=%zu..%zu:"
+	       " %.0f ops/s, p99 rd=%ldus wr=%ldus, cache misses ",
+	       readers, writers, theta, vmin, vmax,
+	       total * 1e9 / ns,
+	       bench_p99(rlat, rlat_n) / 1000,
+	       bench_p99(wlat, wlat_n) / 1000);
+	if (miss_ok)
+		printf("%ld\n", misses);
+	else
+		printf("n/a\n");
+
+	tdb_htrie_exit(dbh);
+	tdb_htrie_pure_close(addr, TDB_VSF_SZ, fd);
+	free(b);
+	free(thr);
+}
+
+static void
+tdb_htrie_bench(const char *fname, int argc, char *argv[])
+{
+	long ops = argc > 2 ? atol(argv[2]) : 20000;
+	double theta = argc > 3 ? atof(argv[3]) : 0.99;
+
+	printf("\n----------- HTrie contention benchmark -------------\n");
+
+	if (argc > 1) {
+		/* <r:w> [ops] [theta] [vmin] [vmax] */
+		int readers = 3, writers = 1;
+		size_t vmin = argc > 4 ? atol(argv[4]) : 64;
+		size_t vmax = argc > 5 ? atol(argv[5]) : 4096;
+
+		sscanf(argv[1], "%d:%d", &readers, &writers);
+		assert(vmax >= vmin && vmax <= BENCH_VMAX_SZ);
+		bench_scenario(fname, readers, writers, ops, theta,
+			       vmin, vmax);
+		return;
+	}
+
+	/* The default matrix: read-mostly to write-heavy. */
+	bench_scenario(fname, 7, 1, ops, theta, 64, 4096);
+	bench_scenario(fname, 3, 1, ops, theta, 64, 4096);
+	bench_scenario(fname, 1, 1, ops, theta, 64, 4096);
+	/* Large records stress tdb_htrie_extend_rec() chains. */
+	bench_scenario(fname, 3, 1, ops / 4, theta, 4096, BENCH_VMAX_SZ);
+}
+
 static void
 init_test_data_for_hash(void)
 {
@@ -570,15 +864,21 @@ main(int argc, char *argv[])
 	
 	if (argc < 3) {
 		printf("\nUsage: %s <vsf> <fsf>\n"
+		       "       %s <vsf> bench [<r:w> [ops] [theta]"
+		       " [vmin] [vmax]]\n"
 		       "  vsf    - file name for variable-size records test\n"
-		       "  fsf    - file name for fixed-size records test\n\n",
-		       argv[0]);
+		       "  fsf    - file name for fixed-size records test\n"
+		       "  bench  - run the reader/writer contention benchmark\n"
+		       "           instead of the unit tests; without <r:w>\n"
+		       "           a default scenario matrix is run\n\n",
+		       argv[0], argv[0]);
 		return 1;
 	}
 
 	/* Don't forget to set appropriate system hard limit. */
 	if (setrlimit(RLIMIT_MEMLOCK, &rlim))
-		TDB_ERR("cannot set RLIMIT_MEMLOCK");
+		fprintf(stderr, "WARNING: cannot set RLIMIT_MEMLOCK,"
+			" running without mlock\n");
 
 	__get_cpuid(1, &eax, &ebx, &ecx, &edx);
 	   
@@ -595,6 +895,11 @@ main(int argc, char *argv[])
 	       TDB_FSF_SZ, TDB_VSF_SZ, TDB_EXT_SZ,
 	       THR_N, DATA_N, LOOP_N);
 
+	if (!strcmp(argv[2], "bench")) {
+		tdb_htrie_bench(argv[1], argc - 2, argv + 2);
+		return 0;
+	}
+
 	init_test_data_for_hash();
 	hash_calc_benchmark();
 
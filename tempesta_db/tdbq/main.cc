@@ -18,6 +18,7 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <iostream>
+#include <sstream>
 #include <string>
 
 #include <boost/program_options.hpp>
@@ -30,6 +31,8 @@ enum {
 	ACT_CLOSE,
 	ACT_INSERT,
 	ACT_SELECT,
+	ACT_SNAPSHOT,
+	ACT_SHELL,
 };
 
 namespace po = boost::program_options;
@@ -78,11 +81,17 @@ struct Cfg {
 			action = ACT_INSERT;
 		} else if (a == "select") {
 			action = ACT_SELECT;
+		} else if (a == "snapshot") {
+			action = ACT_SNAPSHOT;
+		} else if (a == "shell") {
+			action = ACT_SHELL;
 		} else {
 			throw TdbExcept("bad action: %s", a.c_str());
 		}
 
 		// Sanity checks.
+		if (action == ACT_SHELL)
+			return *this;
 		if (action == ACT_INFO && table != "*")
 			throw TdbExcept("'info' command is only allowed for"
 					" all tables");
@@ -104,6 +113,99 @@ struct Cfg {
 	}
 };
 
+/**
+ * The interactive shell. Commands:
+ *   info
+ *   open <path> <table> [<size_pages> [<rec_size>]]
+ *   close <table>
+ *   insert <table> <key> <value>
+ *   select <table> <key> [<filter>]
+ *   snapshot <table>
+ *   quit
+ * The select filter is applied server side: only records whose data
+ * contains the byte string travel back over netlink.
+ */
+static void
+run_shell(TdbHndl &th)
+{
+	std::string line;
+
+	std::cout << "tdbq> " << std::flush;
+	while (std::getline(std::cin, line)) {
+		std::istringstream iss(line);
+		std::string cmd, tbl, key, val, flt, path;
+		size_t tbl_sz = 512, rec_sz = 0;
+
+		iss >> cmd;
+		try {
+			if (cmd == "quit" || cmd == "exit") {
+				break;
+			} else if (cmd.empty()) {
+			} else if (cmd == "info") {
+				th.get_info([=](char *data) {
+					std::cout << data << std::endl;
+				});
+			} else if (cmd == "open") {
+				iss >> path >> tbl >> tbl_sz >> rec_sz;
+				th.open_table(path, tbl, tbl_sz, rec_sz);
+				std::cout << "table " << tbl << " opened"
+					  << std::endl;
+			} else if (cmd == "close") {
+				iss >> tbl;
+				th.close_table(tbl);
+			} else if (cmd == "insert") {
+				iss >> tbl >> key >> val;
+				th.trx_begin();
+				th.insert(tbl, key.length(), val.length(),
+					  [&] (char *k, char *v)
+					  {
+						key.copy(k, key.length());
+						val.copy(v, val.length());
+					  });
+				th.trx_commit();
+			} else if (cmd == "snapshot") {
+				iss >> tbl;
+				th.snapshot(tbl,
+					    [=](char *k, size_t klen,
+						char *v, size_t vlen)
+					    {
+						unsigned long key = 0;
+
+						memcpy(&key, k,
+						       std::min(klen,
+								sizeof(key)));
+						std::cout << std::hex << key
+							  << std::dec << " '";
+						std::cout.write(v, vlen);
+						std::cout << "'" << std::endl;
+					    });
+			} else if (cmd == "select") {
+				std::vector<std::string> keys;
+
+				iss >> tbl >> key >> flt;
+				keys.push_back(key);
+				th.query(tbl, keys, flt,
+					 [=](char *k, size_t klen,
+					     char *v, size_t vlen)
+					 {
+						std::cout << "'";
+						std::cout.write(k, klen);
+						std::cout << "' -> '";
+						std::cout.write(v, vlen);
+						std::cout << "'" << std::endl;
+					 });
+			} else {
+				std::cout << "unknown command: " << cmd
+					  << std::endl;
+			}
+		}
+		catch (TdbExcept &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+		}
+		std::cout << "tdbq> " << std::flush;
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -122,7 +224,8 @@ main(int argc, char *argv[])
 		 "  open    - open and create a new table if necessary;\n"
 		 "  close   - close a table;\n"
 		 "  insert  - insert a record to a table;\n"
-		 "  select  - select from a table")
+		 "  select  - select from a table;\n"
+		 "  shell   - interactive query shell")
 		("key,k", po::value<std::string>(), "The record key")
 		("path,p", po::value<std::string>(), "Path to database files")
 		("rec_size,r", po::value<size_t>()->default_value(0),
@@ -183,6 +286,28 @@ main(int argc, char *argv[])
 				  });
 			th.trx_commit();
 			break;
+		case ACT_SHELL:
+			run_shell(th);
+			break;
+		case ACT_SNAPSHOT:
+			/*
+			 * Stream all live records of the table; keys are
+			 * printed in hex since they're 64-bit hashes.
+			 */
+			th.snapshot(cfg.table,
+				    [=](char *key, size_t klen,
+					char *val, size_t vlen)
+				    {
+					unsigned long k = 0;
+
+					memcpy(&k, key, std::min(klen,
+								 sizeof(k)));
+					std::cout << std::hex << k << std::dec
+						  << " '";
+					std::cout.write(val, vlen);
+					std::cout << "'" << std::endl;
+				    });
+			break;
 		case ACT_SELECT:
 			th.query(cfg.table, cfg.key,
 				 [=](char *key, size_t klen,
@@ -0,0 +1,124 @@
+/**
+ *		Tempesta FW
+ *
+ * Binary access log over TDB, see alog.h.
+ *
+ * Text access logs burn cycles on formatting and I/O in the fastest
+ * path we have. Instead fixed-size binary records are inserted into a
+ * TDB table: the insert is a short memcpy under the table machinery,
+ * and the mmap'ed table file is the transport - userspace tails it
+ * directly or queries over the existing netlink interface (tdbq).
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "alog.h"
+#include "cfg.h"
+#include "client.h"
+#include "log.h"
+#include "tdb.h"
+
+static struct {
+	unsigned int	db_size;
+	const char	*db_path;
+} alog_cfg __read_mostly;
+
+static TDB *alog_db;
+static atomic64_t alog_seq;
+
+/**
+ * Record the response for @req into the access log. Called right
+ * before the response is handed to the client socket; @resp may be a
+ * locally generated message with a zero status.
+ */
+void
+tfw_alog_record(TfwHttpReq *req, TfwHttpResp *resp)
+{
+	TfwALogRec rec = {};
+	size_t len = sizeof(rec);
+
+	if (likely(!alog_db))
+		return;
+
+	rec.ts = tfw_current_timestamp();
+	rec.addr = req->conn && req->conn->peer
+		   ? ((TfwClient *)req->conn->peer)->addr.v6.sin6_addr
+		   : rec.addr;
+	rec.uri_hash = req->hash ? : tfw_http_req_key_calc(req);
+	rec.rtt_ms = jiffies_to_msecs(jiffies - req->jrxtstamp);
+	rec.resp_len = resp->msg.len;
+	rec.status = resp->status;
+	rec.method = req->method;
+	if (req->conn && (TFW_CONN_TYPE(req->conn) & Conn_Clnt))
+		rec.tls_fp = ((TfwCliConn *)req->conn)->tls_fp;
+
+	/* The sequence number keys spread records over the index. */
+	tdb_entry_create(alog_db, atomic64_inc_return(&alog_seq), &rec, &len);
+}
+
+static int
+tfw_alog_start(void)
+{
+	if (!alog_cfg.db_size)
+		return 0;
+
+	alog_db = tdb_open(alog_cfg.db_path, alog_cfg.db_size,
+			   sizeof(TfwALogRec), numa_node_id());
+	if (!alog_db)
+		TFW_WARN("alog: can't open the access log table,"
+			 " logging is disabled\n");
+
+	return 0;
+}
+
+static void
+tfw_alog_stop(void)
+{
+	if (alog_db) {
+		tdb_close(alog_db);
+		alog_db = NULL;
+	}
+}
+
+static TfwCfgSpec tfw_alog_cfg_specs[] = {
+	{
+		"access_log_size",
+		"0",
+		tfw_cfg_set_int,
+		&alog_cfg.db_size,
+		&(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { 0, (1 << 30) },
+		}
+	},
+	{
+		"access_log_db",
+		"/opt/tempesta/db/alog.tdb",
+		tfw_cfg_set_str,
+		&alog_cfg.db_path,
+		&(TfwCfgSpecStr) {
+			.len_range = { 1, PATH_MAX },
+		}
+	},
+	{}
+};
+
+TfwCfgMod tfw_alog_cfg_mod = {
+	.name	= "alog",
+	.start	= tfw_alog_start,
+	.stop	= tfw_alog_stop,
+	.specs	= tfw_alog_cfg_specs,
+};
@@ -0,0 +1,57 @@
+/**
+ *		Tempesta FW
+ *
+ * Binary access log over TDB.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_ALOG_H__
+#define __TFW_ALOG_H__
+
+#include "http.h"
+
+/**
+ * One access log record. The format is binary and fixed size: no
+ * per-request formatting on the fast path, and userspace reads the
+ * records straight from the mmap'ed table file or over the netlink
+ * query interface.
+ *
+ * @ts		- response timestamp, seconds;
+ * @addr	- client address;
+ * @uri_hash	- hash of the request URI, resolvable via a URI map
+ *		  sampled by the reader;
+ * @rtt_ms	- client-perceived response time, ms;
+ * @resp_len	- response length, bytes;
+ * @status	- HTTP status code;
+ * @method	- request method;
+ * @tls_fp	- TLS ClientHello fingerprint, 0 for plain HTTP;
+ */
+typedef struct {
+	unsigned long	ts;
+	struct in6_addr	addr;
+	unsigned long	uri_hash;
+	unsigned int	rtt_ms;
+	unsigned int	resp_len;
+	unsigned short	status;
+	unsigned char	method;
+	unsigned char	__pad;
+	unsigned int	tls_fp;
+} TfwALogRec;
+
+void tfw_alog_record(TfwHttpReq *req, TfwHttpResp *resp);
+
+#endif /* __TFW_ALOG_H__ */
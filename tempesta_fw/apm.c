@@ -20,6 +20,8 @@
  */
 #include <linux/atomic.h>
 #include <linux/kernel.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stringify.h>
@@ -426,11 +428,12 @@ typedef struct {
  * The stats entry data structure.
  * Keeps the latest values of calculated percentiles.
  * @pstats	- The percentile stats structure.
- * @rwlock	- Protect updates.
+ * @seqlock	- Protect updates: readers are lock-free and never
+ *		  block or bounce a cache line of the single writer.
  */
 typedef struct {
 	TfwPrcntlStats	pstats;
-	rwlock_t	rwlock;
+	seqlock_t	seqlock;
 } TfwApmSEnt;
 
 /*
@@ -442,7 +445,7 @@ typedef struct {
  * is used to decrease the lock contention. Readers read the stored values
  * at @prcntl[@rdidx % 2]. The writer writes the new percentile values to
  * @prcntl[(@rdidx + 1) % 2], and then increments @rdidx. The reading and
- * the writing are protected by a rwlock.
+ * the writing are protected by a seqlock.
  * @asent	- The stats entries for reading/writing (flip-flop manner).
  * @rdidx	- The current index in @prcntl for readers.
  */
@@ -468,14 +471,39 @@ typedef struct {
 #define TFW_APM_DATA_F_RECALC	(0x0002)	/* Need to recalculate. */
 #define TFW_APM_TIMER_TIMEOUT	(HZ/20)		/* The timer periodicity. */
 
+/*
+ * High-accuracy percentile mode: a per-CPU DDSketch-style histogram
+ * of log-spaced buckets. A bucket's bounds differ by the constant
+ * factor 69/64 (~7.8%), so any reported percentile is within that
+ * relative error of the true value - unlike the adaptive ranges
+ * above, which can return a value for a different percentile near
+ * the distribution edges. Updates pay a binary search over the
+ * bucket bounds (7 steps); the timer merges the per-CPU counters and
+ * ages them by halving so old traffic decays out of the window.
+ *
+ * @cnt		- hit counters per log-spaced bucket.
+ */
+#define TFW_APM_HR_BCKTS	128
+#define TFW_APM_HR_DECAY	(10 * HZ)
+
+typedef struct {
+	u32		cnt[TFW_APM_HR_BCKTS];
+} TfwApmHrCpu;
+
 typedef struct {
 	TfwApmRBuf		rbuf;
 	TfwApmRBCtl		rbctl;
 	TfwApmStats		stats;
 	struct timer_list	timer;
 	unsigned long		flags;
+	TfwApmHrCpu __percpu	*hrcpu;
+	unsigned long		hr_jdecay;
 } TfwApmData;
 
+/* Upper bounds of the log-spaced buckets, ms; set up at config time. */
+static u32 tfw_apm_hr_bounds[TFW_APM_HR_BCKTS];
+static bool tfw_apm_hires;
+
 /*
  * [1ms, 349ms] should be sufficient for almost any installation,
  * including cross atlantic.
@@ -748,11 +776,91 @@ tfw_apm_rbctl_update(TfwApmData *data, int recalc)
  * Return 0 if the percentile values didn't need the recalculation.
  * REturn -1 of the recalculation could not be performed.
  */
+static void
+__tfw_apm_hr_update(TfwApmData *data, unsigned int rtt)
+{
+	int lo = 0, hi = TFW_APM_HR_BCKTS - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (tfw_apm_hr_bounds[mid] < rtt)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	this_cpu_inc(data->hrcpu->cnt[lo]);
+}
+
+/*
+ * Merge the per-CPU histograms and read the percentiles off the
+ * cumulative counts. Halving-based aging runs here as well: counter
+ * increments racing with the halving are lost with negligible
+ * probability, which is fine for statistics.
+ */
+static int
+__tfw_apm_hr_calc(TfwApmData *data, TfwPrcntlStats *pstats)
+{
+	int i, cpu, p = 0;
+	u64 tot = 0, acc = 0, wsum = 0;
+	/*
+	 * The merge buffer must be per call: every APM instance (per
+	 * server, vhost and location) runs its own timer and they may
+	 * execute concurrently on different CPUs. 512 bytes fit the
+	 * stack.
+	 */
+	u32 cnt[TFW_APM_HR_BCKTS] = { 0 };
+
+	for_each_online_cpu(cpu) {
+		TfwApmHrCpu *hr = per_cpu_ptr(data->hrcpu, cpu);
+
+		for (i = 0; i < TFW_APM_HR_BCKTS; ++i)
+			cnt[i] += hr->cnt[i];
+	}
+	if (time_after(jiffies, data->hr_jdecay + TFW_APM_HR_DECAY)) {
+		data->hr_jdecay = jiffies;
+		for_each_online_cpu(cpu) {
+			TfwApmHrCpu *hr = per_cpu_ptr(data->hrcpu, cpu);
+
+			for (i = 0; i < TFW_APM_HR_BCKTS; ++i)
+				hr->cnt[i] -= hr->cnt[i] / 2;
+		}
+	}
+
+	for (i = 0; i < TFW_APM_HR_BCKTS; ++i)
+		tot += cnt[i];
+	if (!tot)
+		return 0;
+
+	pstats->min = 0;
+	pstats->max = 0;
+	for (i = 0; i < TFW_APM_HR_BCKTS; ++i) {
+		if (!cnt[i])
+			continue;
+		if (!pstats->min)
+			pstats->min = i ? tfw_apm_hr_bounds[i - 1] + 1 : 1;
+		pstats->max = tfw_apm_hr_bounds[i];
+		wsum += (u64)cnt[i] * tfw_apm_hr_bounds[i];
+		acc += cnt[i];
+		while (p < pstats->prcntlsz
+		       && acc * 100 >= tot * pstats->prcntl[p].ith)
+			pstats->prcntl[p++].val = tfw_apm_hr_bounds[i];
+	}
+	pstats->avg = wsum / tot;
+	while (p < pstats->prcntlsz)
+		pstats->prcntl[p++].val = pstats->max;
+
+	return pstats->prcntlsz;
+}
+
 static int
 __tfw_apm_calc(TfwApmData *data, TfwPrcntlStats *pstats, int recalc)
 {
 	int ret;
 
+	if (data->hrcpu)
+		return __tfw_apm_hr_calc(data, pstats);
+
 	if (!spin_trylock(&data->rbuf.slock))
 		return -1;
 	if ((ret = tfw_apm_rbctl_update(data, recalc)))
@@ -793,14 +901,14 @@ tfw_apm_calc(TfwApmData *data)
 		set_bit(TFW_APM_DATA_F_RECALC, &data->flags);
 	} else {
 		TFW_DBG3("%s: Percentile values may have changed.\n", __func__);
-		write_lock(&asent->rwlock);
+		write_seqlock(&asent->seqlock);
 		memcpy(asent->pstats.prcntl, prcntl,
 		       asent->pstats.prcntlsz * sizeof(TfwPrcntl));
 		asent->pstats.min = pstats.min;
 		asent->pstats.max = pstats.max;
 		asent->pstats.avg = pstats.avg;
 		atomic_inc(&data->stats.rdidx);
-		write_unlock(&asent->rwlock);
+		write_sequnlock(&asent->seqlock);
 	}
 }
 
@@ -826,42 +934,140 @@ tfw_apm_prcntl_fn(unsigned long fndata)
  * Return 0 if the percentile values didn't need recalculation.
  * Return 1 if potentially new percentile values were calculated.
  *
- * The two functions below differ only by the type of lock used.
- * tfw_apm_stats() should be used for calls in kernel context.
- * tfw_apm_stats_bh() should be used for calls in user context.
+ * Readers retry on a concurrent update instead of taking a lock, so
+ * the call is safe in any context and the two functions are identical;
+ * both names are kept for the callers' sake.
+ */
+static int
+__tfw_apm_stats(void *apmdata, TfwPrcntlStats *pstats)
+{
+	unsigned int sseq;
+	int rdidx, oseq = pstats->seq;
+	TfwApmData *data = apmdata;
+	TfwApmSEnt *asent;
+
+	BUG_ON(!apmdata);
+
+	smp_mb__before_atomic();
+	rdidx = (unsigned int)atomic_read(&data->stats.rdidx) % 2;
+	asent = &data->stats.asent[rdidx];
+
+	do {
+		sseq = read_seqbegin(&asent->seqlock);
+		memcpy(pstats->prcntl, asent->pstats.prcntl,
+		       pstats->prcntlsz * sizeof(TfwPrcntl));
+		pstats->min = asent->pstats.min;
+		pstats->max = asent->pstats.max;
+		pstats->avg = asent->pstats.avg;
+	} while (read_seqretry(&asent->seqlock, sseq));
+	pstats->seq = rdidx;
+
+	return (oseq != rdidx);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ *	Heavy hitters (top-K URIs)
+ * ------------------------------------------------------------------------
+ * A per-CPU Space-Saving sketch over the request URI hashes: K counters
+ * track the heaviest keys, an unseen key displaces the minimum counter
+ * inheriting its count as the error bound. The per-CPU sketches are
+ * merged at report time, so the hot path is a scan of one cache-warm
+ * array with no shared writes. The URI hash maps back to concrete URIs
+ * through the access log records.
  */
-#define __tfw_apm_stats_body(apmdata, pstats, fn_lock, fn_unlock)	\
-	int rdidx, seq = pstats->seq;					\
-	TfwApmData *data = apmdata;					\
-	TfwApmSEnt *asent;						\
-									\
-	BUG_ON(!apmdata);						\
-									\
-	smp_mb__before_atomic();					\
-	rdidx = (unsigned int)atomic_read(&data->stats.rdidx) % 2;	\
-	asent = &data->stats.asent[rdidx];				\
-									\
-	fn_lock(&asent->rwlock);					\
-	memcpy(pstats->prcntl, asent->pstats.prcntl,			\
-	       pstats->prcntlsz * sizeof(TfwPrcntl));			\
-	pstats->min = asent->pstats.min;				\
-	pstats->max = asent->pstats.max;				\
-	pstats->avg = asent->pstats.avg;				\
-	fn_unlock(&asent->rwlock);					\
-	pstats->seq = rdidx;						\
-									\
-	return (seq != rdidx);
+typedef struct {
+	unsigned long	hash[TFW_APM_HH_K];
+	unsigned long	cnt[TFW_APM_HH_K];
+} TfwApmHH;
+
+static DEFINE_PER_CPU(TfwApmHH, apm_hh);
+
+void
+tfw_apm_hh_update(unsigned long uri_hash)
+{
+	int i, min_i = 0;
+	unsigned long min_cnt;
+	TfwApmHH *hh = get_cpu_ptr(&apm_hh);
+
+	min_cnt = hh->cnt[0];
+	for (i = 0; i < TFW_APM_HH_K; ++i) {
+		if (hh->hash[i] == uri_hash) {
+			++hh->cnt[i];
+			goto out;
+		}
+		if (hh->cnt[i] < min_cnt) {
+			min_cnt = hh->cnt[i];
+			min_i = i;
+		}
+	}
+	/* Displace the minimum, inheriting its count (Space-Saving). */
+	hh->hash[min_i] = uri_hash;
+	hh->cnt[min_i] = min_cnt + 1;
+out:
+	put_cpu_ptr(&apm_hh);
+}
+
+int
+tfw_apm_hh_report(struct seq_file *seq)
+{
+	int cpu, i, k, n = 0;
+	struct {
+		unsigned long	hash;
+		unsigned long	cnt;
+	} top[TFW_APM_HH_K * 4] = {{0}};
+
+	/* Merge the per-CPU sketches by key. */
+	for_each_online_cpu(cpu) {
+		TfwApmHH *hh = per_cpu_ptr(&apm_hh, cpu);
+
+		for (i = 0; i < TFW_APM_HH_K; ++i) {
+			unsigned long h = hh->hash[i], c = hh->cnt[i];
+
+			if (!c)
+				continue;
+			for (k = 0; k < n; ++k)
+				if (top[k].hash == h) {
+					top[k].cnt += c;
+					break;
+				}
+			if (k < n || n == ARRAY_SIZE(top))
+				continue;
+			top[n].hash = h;
+			top[n].cnt = c;
+			++n;
+		}
+	}
+
+	/* Selection sort is fine for tens of entries. */
+	for (i = 0; i < n; ++i) {
+		int max_i = i;
+
+		for (k = i + 1; k < n; ++k)
+			if (top[k].cnt > top[max_i].cnt)
+				max_i = k;
+		swap(top[i], top[max_i]);
+		if (i == TFW_APM_HH_K - 1)
+			break;
+	}
+
+	for (i = 0; i < min_t(int, n, TFW_APM_HH_K); ++i)
+		seq_printf(seq, "%016lx: %lu\n", top[i].hash, top[i].cnt);
+
+	return 0;
+}
 
 int
 tfw_apm_stats_bh(void *apmdata, TfwPrcntlStats *pstats)
 {
-	__tfw_apm_stats_body(apmdata, pstats, read_lock_bh, read_unlock_bh);
+	return __tfw_apm_stats(apmdata, pstats);
 }
+EXPORT_SYMBOL(tfw_apm_stats_bh);
 
 int
 tfw_apm_stats(void *apmdata, TfwPrcntlStats *pstats)
 {
-	__tfw_apm_stats_body(apmdata, pstats, read_lock, read_unlock);
+	return __tfw_apm_stats(apmdata, pstats);
 }
 
 /*
@@ -905,6 +1111,10 @@ tfw_apm_update(void *apmdata, unsigned long jtstamp, unsigned long jrtt)
 	 * the maximum value possible for TfwPcntCtl{}->end. Currently
 	 * the value is USHRT_MAX which is about 65 secs in milliseconds.
 	 */
+	if (((TfwApmData *)apmdata)->hrcpu) {
+		__tfw_apm_hr_update(apmdata, rtt);
+		return;
+	}
 	if (likely(rtt < (1UL << FIELD_SIZEOF(TfwPcntCtl, end) * 8)))
 		__tfw_apm_update(&((TfwApmData *)apmdata)->rbuf, jtstamp, rtt);
 }
@@ -923,6 +1133,7 @@ tfw_apm_destroy(void *apmdata)
 	smp_mb__after_atomic();
 	del_timer_sync(&data->timer);
 
+	free_percpu(data->hrcpu);
 	kfree(data);
 }
 
@@ -968,6 +1179,15 @@ tfw_apm_create(void)
 	data->rbuf.rbent = rbent;
 	data->rbuf.rbufsz = rbufsz;
 
+	if (tfw_apm_hires) {
+		data->hrcpu = alloc_percpu(TfwApmHrCpu);
+		if (!data->hrcpu) {
+			kfree(data);
+			return NULL;
+		}
+		data->hr_jdecay = jiffies;
+	}
+
 	data->stats.asent[0].pstats.prcntl = prcntl[0];
 	data->stats.asent[0].pstats.prcntlsz = prcntlsz;
 
@@ -982,8 +1202,8 @@ tfw_apm_create(void)
 	memcpy(prcntl[0], tfw_apm_prcntl, sizeof(tfw_apm_prcntl));
 	memcpy(prcntl[1], tfw_apm_prcntl, sizeof(tfw_apm_prcntl));
 
-	rwlock_init(&data->stats.asent[0].rwlock);
-	rwlock_init(&data->stats.asent[1].rwlock);
+	seqlock_init(&data->stats.asent[0].seqlock);
+	seqlock_init(&data->stats.asent[1].seqlock);
 	atomic_set(&data->stats.rdidx, 0);
 
 	/* Start the timer for the percentile calculation. */
@@ -1044,6 +1264,17 @@ tfw_apm_cfg_start(void)
 	}
 	tfw_apm_jtmwindow = tfw_apm_jtmintrvl * tfw_apm_tmwscale;
 
+	if (tfw_apm_hires) {
+		int i;
+		u32 b = 1;
+
+		/* Each bound grows by 69/64 (~7.8%), 1ms to ~8s. */
+		for (i = 0; i < TFW_APM_HR_BCKTS; ++i) {
+			tfw_apm_hr_bounds[i] = b;
+			b = max(b + 1, b * 69 / 64);
+		}
+	}
+
 	return 0;
 }
 
@@ -1055,6 +1286,7 @@ static void
 tfw_apm_cfg_cleanup(TfwCfgSpec *cs)
 {
 	tfw_apm_jtmwindow = tfw_apm_jtmintrvl = tfw_apm_tmwscale = 0;
+	tfw_apm_hires = false;
 }
 
 static int
@@ -1080,6 +1312,12 @@ tfw_handle_apm_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
 		} else if (!strcasecmp(key, "scale")) {
 			if ((r = tfw_cfg_parse_int(val, &tfw_apm_tmwscale)))
 				return r;
+		} else if (!strcasecmp(key, "hires")) {
+			bool hr;
+
+			if ((r = tfw_cfg_parse_bool(val, &hr)))
+				return r;
+			tfw_apm_hires = hr;
 		} else {
 			TFW_ERR_NL("%s: unsupported argument: '%s=%s'.\n",
 				   cs->name, key, val);
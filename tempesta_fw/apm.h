@@ -55,4 +55,11 @@ int tfw_apm_stats(void *data, TfwPrcntlStats *pstats);
 int tfw_apm_stats_bh(void *data, TfwPrcntlStats *pstats);
 int tfw_apm_prcntl_verify(TfwPrcntl *prcntl, unsigned int prcntlsz);
 
+/* The heavy hitters (top-K URI) sketch. */
+#define TFW_APM_HH_K	16
+
+void tfw_apm_hh_update(unsigned long uri_hash);
+struct seq_file;
+int tfw_apm_hh_report(struct seq_file *seq);
+
 #endif /* __TFW_APM_H__ */
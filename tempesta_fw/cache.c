@@ -32,17 +32,24 @@
 #include "tempesta_fw.h"
 #include "vhost.h"
 #include "cache.h"
+#include "gzip.h"
 #include "http_msg.h"
 #include "procfs.h"
 #include "sync_socket.h"
+#include "trace.h"
 #include "work_queue.h"
 
+unsigned long tfw_hash_str(const TfwStr *str);
+
 #if MAX_NUMNODES > ((1 << 16) - 1)
 #warning "Please set CONFIG_NODES_SHIFT to less than 16"
 #endif
 
 /* Flags stored in a Cache Entry. */
 #define TFW_CE_MUST_REVAL	0x0001		/* MUST revalidate if stale. */
+#define TFW_CE_REVAL_PEND	0x0002		/* Revalidation in flight. */
+#define TFW_CE_GZIP		0x0004		/* Body stored compressed. */
+#define TFW_CE_EXTBODY		0x0008		/* Body in the dedup table. */
 
 /*
  * @trec	- Database record descriptor;
@@ -57,6 +64,16 @@
  * @req_time	- the time the request was issued;
  * @resp_time	- the time the response was received;
  * @lifetime	- the cache entry's current lifetime;
+ * @hits	- number of cache hits, fed to the eviction engine;
+ * @last_used	- timestamp of the last hit, guards zero-copy transmissions
+ *		  against eviction reuse;
+ * @tot_len	- total stored entry length, for the vhost accounting;
+ * @vh		- dense index of the owning vhost;
+ * @vary_hash	- combined hash of the request header values named by
+ *		  the response Vary header, zero if the response does
+ *		  not vary;
+ * @vary	- the Vary header value, selects the request headers to
+ *		  hash on lookups;
  * @key		- the cache enty key (URI + Host header);
  * @status	- pointer to status line  (with trailing CRLFs);
  * @hdrs	- pointer to list of HTTP headers (with trailing CRLFs);
@@ -78,10 +95,23 @@ typedef struct {
 	time_t		req_time;
 	time_t		resp_time;
 	time_t		lifetime;
+	unsigned long	hits;
+	time_t		last_used;
+	unsigned long	tot_len;
+	unsigned short	vh;
+	unsigned long	vary_hash;
+	char		vary[64];
 	long		key;
 	long		status;
 	long		hdrs;
 	long		body;
+	/* Raw and stored body sizes when the body is compressed. */
+	unsigned int	body_len;
+	unsigned int	body_zlen;
+	/* Content hash of a deduplicated body, see TFW_CE_EXTBODY. */
+	unsigned long	body_key;
+	/* NUMA node whose body table holds the deduplicated body. */
+	unsigned short	body_node;
 	unsigned char	version;
 	unsigned int	hmflags;
 } TfwCacheEntry;
@@ -100,6 +130,9 @@ typedef struct {
 			len : 56;
 } TfwCStr;
 
+/* The serialized string is a dictionary reference, @len is the index. */
+#define TFW_CSTR_F_DICT		0x80
+
 #define TFW_CSTR_MAXLEN		(1UL << 56)
 #define TFW_CSTR_HDRLEN		(sizeof(TfwCStr))
 
@@ -120,6 +153,14 @@ typedef struct {
 static struct {
 	int cache;
 	unsigned int methods;
+	unsigned int stale_serve;
+	unsigned int negative_ttl;
+	int admission;
+	int hot_tier;
+	unsigned int max_obj_size;
+	unsigned int compress_min;
+	unsigned int dedup_min;
+	unsigned int replicate;
 	unsigned int db_size;
 	const char *db_path;
 } cache_cfg __read_mostly;
@@ -136,10 +177,21 @@ typedef struct {
 	atomic_t	cpu_idx;
 	unsigned int	nr_cpus;
 	TDB		*db;
+	TDB		*tag_db;
+	TDB		*body_db;
 } CaNode;
 
 static CaNode c_nodes[MAX_NUMNODES];
 
+/*
+ * Bytes of cache occupied by each vhost, indexed by TfwVhost->idx.
+ * Stores increment the counters, the reclaim callbacks decrement them
+ * right before an entry is freed.
+ */
+static atomic64_t cache_vh_used[TFW_VHOST_MAX];
+
+static void tfw_cache_body_put(unsigned long key, int node);
+
 /*
  * TODO the thread doesn't do anythng for now, however, kthread_stop() crashes
  * on restarts, so comment to logic out.
@@ -149,6 +201,19 @@ static struct task_struct *cache_mgr_thr;
 #endif
 static DEFINE_PER_CPU(TfwWorkTasklet, cache_wq);
 
+/*
+ * Transparent storage compression: bodies above cache_compress and
+ * up to the per-CPU buffer size are stored as gzip streams and
+ * inflated on read. The buffers bound both the compressible body
+ * size and the softirq memory use; larger bodies are stored raw.
+ */
+#define TFW_CACHE_ZBUF_SZ	(256 * 1024)
+
+static DEFINE_PER_CPU(char *, cache_zbuf);
+static DEFINE_PER_CPU(char *, cache_unzbuf);
+/* Queue depth beyond which contributing clients are throttled. */
+#define TFW_CACHE_WQ_HIWAT	1536
+
 static TfwStr g_crlf = { .ptr = S_CRLF, .len = SLEN(S_CRLF) };
 
 /* Iterate over request URI and Host header to process request key. */
@@ -287,6 +352,90 @@ tfw_cache_status_bydef(TfwHttpResp *resp)
 	return false;
 }
 
+/**
+ * Whether the request asks for a byte range. The Range header is not
+ * a special header for the parser, so look it up among the raw ones.
+ */
+/**
+ * Parse an RFC 1123 date ("Sun, 06 Nov 1994 08:49:37 GMT"), the only
+ * format modern clients send. @return 0 for anything else, so the
+ * request is treated as unconditional.
+ */
+static time_t
+tfw_cache_parse_date(const char *p, size_t len)
+{
+	static const char * const mon = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	unsigned int i, day, year, hh, mm, ss;
+	int mo = -1;
+
+	if (len < 29 || p[3] != ',')
+		return 0;
+	for (i = 5; i < 25; ++i)
+		if (i != 7 && i != 11 && i != 16 && i != 19 && i != 22
+		    && !(i >= 8 && i <= 10) && !isdigit(p[i]))
+			return 0;
+	day = (p[5] - '0') * 10 + p[6] - '0';
+	for (i = 0; i < 12; ++i)
+		if (!memcmp(p + 8, mon + i * 3, 3)) {
+			mo = i;
+			break;
+		}
+	if (mo < 0)
+		return 0;
+	year = (p[12] - '0') * 1000 + (p[13] - '0') * 100
+	       + (p[14] - '0') * 10 + p[15] - '0';
+	hh = (p[17] - '0') * 10 + p[18] - '0';
+	mm = (p[20] - '0') * 10 + p[21] - '0';
+	ss = (p[23] - '0') * 10 + p[24] - '0';
+
+	return mktime64(year, mo + 1, day, hh, mm, ss);
+}
+
+/**
+ * The If-Modified-Since timestamp of the request, 0 if absent or
+ * unparsable.
+ */
+static time_t
+tfw_cache_req_ims(TfwHttpReq *req)
+{
+	char buf[32];
+	unsigned int hid;
+	TfwStr val = {};
+	DEFINE_TFW_STR(h_ims, "If-Modified-Since:");
+
+	hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &h_ims);
+	if (hid >= req->h_tbl->off)
+		return 0;
+	tfw_http_msg_clnthdr_val(&req->h_tbl->tbl[hid], hid, &val);
+	if (!val.len || val.len >= sizeof(buf))
+		return 0;
+	tfw_str_to_cstr(&val, buf, sizeof(buf));
+
+	return tfw_cache_parse_date(buf, val.len);
+}
+
+/*
+ * Range requests bypass the cache and 206 responses are never stored -
+ * a safety guard, not range support.
+ *
+ * TODO #498: slice-based range caching (store fixed-size slices as
+ * separate entries keyed by URI + slice index, stitch arbitrary client
+ * ranges from them, fetch missing slices with proxy-originated
+ * subrange requests). The stitching half fits the entry model, but
+ * filling missing slices needs Tempesta-originated upstream requests,
+ * which the forwarding path doesn't support: every upstream request
+ * today is a forwarded client request with a client connection to
+ * answer to.
+ */
+static bool
+tfw_cache_req_is_range(TfwHttpReq *req)
+{
+	DEFINE_TFW_STR(h_range, "Range:");
+
+	return tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &h_range)
+	       < req->h_tbl->off;
+}
+
 static bool
 tfw_cache_employ_resp(TfwHttpReq *req, TfwHttpResp *resp)
 {
@@ -309,6 +458,30 @@ tfw_cache_employ_resp(TfwHttpReq *req, TfwHttpResp *resp)
 		return false;
 	if (resp->cache_ctl.flags & CC_RESP_DONTCACHE)
 		return false;
+	/*
+	 * A partial response satisfies only the byte range of the
+	 * request it answers. Until cached objects can be assembled
+	 * from slices, storing it under the plain URI key would serve
+	 * the fragment to subsequent full requests, even for responses
+	 * with explicit freshness information.
+	 */
+	if (resp->status == 206)
+		return false;
+	/* A response varying on everything is uncacheable in practice. */
+	{
+		unsigned int hid;
+		TfwStr val = {};
+		DEFINE_TFW_STR(h_vary, "Vary:");
+
+		hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &h_vary);
+		if (hid < resp->h_tbl->off) {
+			tfw_http_msg_clnthdr_val(&resp->h_tbl->tbl[hid],
+						 hid, &val);
+			if (val.len == 1
+			    && *(char *)TFW_STR_CHUNK(&val, 0)->ptr == '*')
+				return false;
+		}
+	}
 	if (!(resp->cache_ctl.flags & TFW_HTTP_CC_IS_PRESENT)
 	    && (resp->cache_ctl.flags & TFW_HTTP_CC_PRAGMA_NO_CACHE))
 		return false;
@@ -344,6 +517,15 @@ tfw_cache_calc_lifetime(TfwHttpResp *resp)
 		/* For now, set "unlimited" lifetime in this case. */
 		lifetime = UINT_MAX;	/* TODO: Heuristic lifetime. */
 
+	/*
+	 * Negative caching: error responses protect the backend from
+	 * repeated misses, but must not outlive the error condition -
+	 * cap their lifetime regardless of what the origin claims.
+	 */
+	if (resp->status >= 400 && cache_cfg.negative_ttl)
+		lifetime = min_t(unsigned int, lifetime,
+				 cache_cfg.negative_ttl);
+
 	return lifetime;
 }
 
@@ -403,6 +585,85 @@ tfw_cache_entry_is_live(TfwHttpReq *req, TfwCacheEntry *ce)
 	return ce_lifetime > ce_age ? ce_lifetime : 0;
 }
 
+/**
+ * An expired entry may still be served within the configured
+ * stale-while-revalidate window, unless the origin required
+ * revalidation. RFC 5861 2: the stale copy is acceptable while the
+ * refresh is in flight and for at most the window length.
+ */
+static bool
+tfw_cache_entry_stale_usable(TfwCacheEntry *ce)
+{
+	if (!cache_cfg.stale_serve || ce->lifetime <= 0)
+		return false;
+	if (ce->flags & TFW_CE_MUST_REVAL)
+		return false;
+	return tfw_cache_entry_age(ce)
+	       <= ce->lifetime + cache_cfg.stale_serve;
+}
+
+/**
+ * With stale serving enabled an entry past the stale window is dead:
+ * it's skipped on lookups so that a refreshed duplicate behind it in
+ * the collision chain takes over, and it's reclaimed on the next store
+ * with the same key (subject to the transmission grace period).
+ */
+static bool
+tfw_cache_entry_dead(TfwCacheEntry *ce)
+{
+	if (!cache_cfg.stale_serve)
+		return false;
+	return ce->lifetime <= 0
+	       || tfw_cache_entry_age(ce)
+		  > ce->lifetime + cache_cfg.stale_serve;
+}
+
+/**
+ * The combined hash of the request header values named in the comma
+ * separated list @vary. An absent header contributes a fixed constant,
+ * so "has no such header" is a distinct variant.
+ */
+static unsigned long
+tfw_cache_vary_hash(TfwHttpReq *req, const char *vary, size_t len)
+{
+	unsigned long h = 0x5641525948415348UL;
+	const char *p = vary, *end = vary + len;
+
+	while (p < end) {
+		const char *name = p;
+		unsigned int hid;
+		TfwStr chunks[2], hdr = {}, val = {};
+
+		while (p < end && *p != ',' && *p != ' ')
+			++p;
+		if (p - name) {
+			/*
+			 * The lookup compares up to the ':' stop
+			 * character, so the name must include it.
+			 */
+			chunks[0] = (TfwStr){ .ptr = (void *)name,
+					      .len = p - name };
+			chunks[1] = (TfwStr){ .ptr = ":", .len = 1 };
+			hdr.ptr = chunks;
+			hdr.len = p - name + 1;
+			hdr.flags = 2 << TFW_STR_CN_SHIFT;
+			hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req,
+						      &hdr);
+			if (hid < req->h_tbl->off) {
+				tfw_http_msg_clnthdr_val(
+					&req->h_tbl->tbl[hid], hid, &val);
+				h ^= tfw_hash_str(&val);
+			} else {
+				h = h * 31 + 1;
+			}
+		}
+		while (p < end && (*p == ',' || *p == ' '))
+			++p;
+	}
+
+	return h;
+}
+
 static bool
 tfw_cache_entry_key_eq(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce)
 {
@@ -411,7 +672,10 @@ tfw_cache_entry_key_eq(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce)
 	TdbVRec *trec = &ce->trec;
 	TfwStr *c, *h_start, *u_end, *h_end;
 
-	if (ce->method != req->method)
+	/* A HEAD request is satisfiable by the cached GET entry. */
+	if (ce->method != req->method
+	    && !(req->method == TFW_HTTP_METH_HEAD
+		 && ce->method == TFW_HTTP_METH_GET))
 		return false;
 	if (req->uri_path.len
 	    + req->h_tbl->tbl[TFW_HTTP_HDR_HOST].len != ce->key_len)
@@ -475,6 +739,12 @@ node_db(void)
 	return c_nodes[numa_node_id()].db;
 }
 
+static TDB *
+node_tag_db(void)
+{
+	return c_nodes[numa_node_id()].tag_db;
+}
+
 /**
  * Get a CPU identifier from @node to schedule a work.
  * The request should be processed on remote node, use round robin strategy
@@ -512,8 +782,23 @@ tfw_cache_dbce_get(TDB *db, TdbIter *iter, TfwHttpReq *req)
 		 * comparing the keys would has sense for long URI, but
 		 * performance benchmarks don't show any improvement.
 		 */
-		if (tfw_cache_entry_key_eq(db, req, ce))
+		if (tfw_cache_entry_key_eq(db, req, ce)
+		    && !tfw_cache_entry_dead(ce)
+		    && (!ce->vary[0]
+			|| ce->vary_hash ==
+			   tfw_cache_vary_hash(req, ce->vary,
+					       strnlen(ce->vary,
+						       sizeof(ce->vary)))))
+		{
+			/*
+			 * Feed the eviction engine. The counter is
+			 * modified under the bucket read lock, lost
+			 * concurrent increments are acceptable.
+			 */
+			++ce->hits;
+			ce->last_used = tfw_current_timestamp();
 			break;
+		}
 		tdb_rec_next(db, iter);
 		if (!(ce = (TfwCacheEntry *)iter->rec)) {
 			TFW_INC_STAT_BH(cache.misses);
@@ -531,6 +816,575 @@ tfw_cache_dbce_put(TfwCacheEntry *ce)
 		tdb_rec_put(ce);
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Cache eviction
+ * ------------------------------------------------------------------------
+ * Inserts to a full database fail until Tempesta is restarted, so track
+ * recently stored entries in per-CPU rings and reclaim the oldest not
+ * recently used ones when an insert hits the space limit. A ring is
+ * filled and drained by the same softirq context, so no locking is
+ * needed. When a full ring wraps, the oldest slot is simply dropped and
+ * the entry it referenced stays in the database until a restart - size
+ * the rings to keep the tracking window large enough.
+ */
+#define TFW_CACHE_EVICT_RING_SZ		2048
+#define TFW_CACHE_EVICT_BATCH		64
+
+typedef struct {
+	unsigned long	key;
+	unsigned long	hits;
+} TfwCacheEvictSlot;
+
+typedef struct {
+	unsigned int		head;
+	unsigned int		tail;
+	TfwCacheEvictSlot	slot[TFW_CACHE_EVICT_RING_SZ];
+} TfwCacheEvictRing;
+
+static TfwCacheEvictRing __percpu *cache_evict_ring;
+
+static void
+tfw_cache_evict_push(TfwCacheEvictRing *r, unsigned long key,
+		     unsigned long hits)
+{
+	TfwCacheEvictSlot *s;
+
+	/* Overwrite the oldest slot when the ring is full. */
+	if (r->head - r->tail == TFW_CACHE_EVICT_RING_SZ)
+		++r->tail;
+	s = &r->slot[r->head % TFW_CACHE_EVICT_RING_SZ];
+	s->key = key;
+	s->hits = hits;
+	++r->head;
+}
+
+/*
+ * Body pages of an entry are linked into skbs by reference, see
+ * tfw_cache_build_resp_body(), so never reuse an entry which could
+ * still be referenced by in-flight transmissions. skb_frag_ref() pins
+ * the pages against the buddy allocator but not against TDB reusing
+ * the record area, so the grace must outlive the longest transmission:
+ * TCP keeps retransmitting with exponential backoff capped at
+ * TCP_RTO_MAX (120s) until tcp_retries2 (default 15) attempts are
+ * spent, ~15.5 minutes total, after which the connection is killed
+ * and the last skb reference is dropped. 16 minutes of seconds
+ * resolution covers it; @last_used is refreshed on every hit, so only
+ * entries cold for the whole window are reclaimed.
+ */
+#define TFW_CACHE_EVICT_GRACE	(16 * 60)
+
+static bool
+tfw_cache_evict_eq(TdbRec *rec, void *data)
+{
+	TfwCacheEntry *ce = (TfwCacheEntry *)rec;
+
+	if (tfw_current_timestamp() - ce->last_used <= TFW_CACHE_EVICT_GRACE)
+		return false;
+	if (ce->hits != *(unsigned long *)data)
+		return false;
+	if (ce->flags & TFW_CE_EXTBODY)
+		tfw_cache_body_put(ce->body_key, ce->body_node);
+	atomic64_sub(ce->tot_len, &cache_vh_used[ce->vh]);
+	return true;
+}
+
+/**
+ * Reclaim a batch of the oldest tracked entries. Entries hit since they
+ * were pushed get a second chance: they're pushed back to the ring with
+ * an updated hit counter snapshot.
+ *
+ * The hit counter is the only identity check for records sharing the
+ * key, so in the rare case of a hash collision with an equal counter a
+ * sibling entry may be reclaimed too - harmless for a cache.
+ */
+static void
+tfw_cache_evict_batch(TDB *db, TfwCacheEvictRing *r)
+{
+	int scanned = 0, freed = 0;
+
+	while (r->tail != r->head && freed < TFW_CACHE_EVICT_BATCH
+	       && scanned++ < TFW_CACHE_EVICT_RING_SZ)
+	{
+		TfwCacheEvictSlot s = r->slot[r->tail
+					      % TFW_CACHE_EVICT_RING_SZ];
+		unsigned long hits;
+		time_t last_used;
+		TdbIter iter;
+
+		++r->tail;
+
+		iter = tdb_rec_get(db, s.key);
+		if (TDB_ITER_BAD(iter))
+			continue; /* already removed */
+		hits = ((TfwCacheEntry *)iter.rec)->hits;
+		last_used = ((TfwCacheEntry *)iter.rec)->last_used;
+		tdb_rec_put(iter.rec);
+
+		if (hits != s.hits
+		    || tfw_current_timestamp() - last_used
+		       <= TFW_CACHE_EVICT_GRACE)
+		{
+			tfw_cache_evict_push(r, s.key, hits);
+			continue;
+		}
+		freed += tdb_entry_remove(db, s.key, tfw_cache_evict_eq,
+					  &s.hits);
+	}
+
+	TFW_DBG("cache evict: db=%p scanned=%d freed=%d\n",
+		db, scanned, freed);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ *	In-RAM hot object tier
+ * ------------------------------------------------------------------------
+ * A tiny per-CPU cache of fully built responses for the hottest
+ * entries: a hit costs one pskb_copy per skb (body pages are shared by
+ * reference) instead of the whole header reconstruction from the TDB
+ * encoding. Entries live for at most a second (bounded by the TDB
+ * entry freshness), so purges and refreshes take effect within the
+ * micro-caching window; the tier must not be combined with sticky
+ * sessions since the per-client cookie is not re-added on tier hits.
+ */
+#define TFW_CACHE_TIER_SLOTS	8
+#define TFW_CACHE_TIER_TTL	HZ
+
+typedef struct {
+	unsigned long	key;
+	unsigned long	vary_hash;
+	unsigned long	expires;
+	unsigned short	status;
+	SsSkbList	skbs;
+} TfwCacheTierSlot;
+
+typedef struct {
+	TfwCacheTierSlot	slot[TFW_CACHE_TIER_SLOTS];
+	unsigned int		next;
+} TfwCacheTier;
+
+static TfwCacheTier __percpu *cache_tier;
+
+static void
+tfw_cache_tier_slot_purge(TfwCacheTierSlot *ts)
+{
+	struct sk_buff *skb;
+
+	while ((skb = ss_skb_dequeue(&ts->skbs)))
+		kfree_skb(skb);
+	ts->key = 0;
+}
+
+/**
+ * Remember the built response for @key. Called right after
+ * tfw_cache_build_resp(), the copies share the body pages.
+ */
+static void
+tfw_cache_tier_put(unsigned long key, unsigned long vary_hash,
+		   TfwHttpResp *resp, time_t remain)
+{
+	struct sk_buff *skb;
+	TfwCacheTier *t;
+	TfwCacheTierSlot *ts;
+
+	if (!cache_cfg.hot_tier || !cache_tier || remain <= 0)
+		return;
+	/*
+	 * The tier lookup is keyed by the cache key only and can't
+	 * re-evaluate the Vary selection - a slot hit would serve
+	 * whatever variant landed last to clients whose selecting
+	 * headers differ. Keep Vary'ed responses out of the tier.
+	 */
+	if (vary_hash)
+		return;
+
+	t = get_cpu_ptr(cache_tier);
+	ts = &t->slot[t->next];
+	t->next = (t->next + 1) % TFW_CACHE_TIER_SLOTS;
+	tfw_cache_tier_slot_purge(ts);
+
+	ss_skb_queue_head_init(&ts->skbs);
+	for (skb = ss_skb_peek(&resp->msg.skb_list); skb;
+	     skb = ss_skb_next(skb))
+	{
+		struct sk_buff *c = pskb_copy_for_clone(skb, GFP_ATOMIC);
+
+		if (!c) {
+			tfw_cache_tier_slot_purge(ts);
+			goto out;
+		}
+		ss_skb_queue_tail(&ts->skbs, c);
+	}
+	ts->status = resp->status;
+	ts->vary_hash = vary_hash;
+	ts->expires = jiffies + min_t(time_t, TFW_CACHE_TIER_TTL,
+				      remain * HZ);
+	ts->key = key;
+out:
+	put_cpu_ptr(cache_tier);
+}
+
+/**
+ * Serve @req from the hot tier if a fresh copy for the key is at hand.
+ * @return the response to forward or NULL on a tier miss.
+ */
+static TfwHttpResp *
+tfw_cache_tier_get(TfwHttpReq *req, unsigned long key)
+{
+	int i;
+	TfwCacheTier *t;
+	TfwHttpResp *resp = NULL;
+
+	if (!cache_cfg.hot_tier || !cache_tier
+	    || req->method != TFW_HTTP_METH_GET
+	    || (req->flags & TFW_HTTP_CONN_CLOSE))
+		return NULL;
+	/*
+	 * The tier can't revalidate: requests insisting on freshness
+	 * (no-cache, max-age=0) must reach the real cache service.
+	 */
+	if ((req->cache_ctl.flags & TFW_HTTP_CC_NO_CACHE)
+	    || ((req->cache_ctl.flags & TFW_HTTP_CC_MAX_AGE)
+		&& !req->cache_ctl.max_age))
+		return NULL;
+
+	t = get_cpu_ptr(cache_tier);
+	for (i = 0; i < TFW_CACHE_TIER_SLOTS; ++i) {
+		TfwCacheTierSlot *ts = &t->slot[i];
+		struct sk_buff *skb;
+		TfwHttpMsg *hm;
+
+		if (ts->key != key || time_after(jiffies, ts->expires))
+			continue;
+
+		if (!(hm = tfw_http_msg_alloc_err_resp()))
+			break;
+		for (skb = ss_skb_peek(&ts->skbs); skb;
+		     skb = ss_skb_next(skb))
+		{
+			struct sk_buff *c = pskb_copy_for_clone(skb,
+								GFP_ATOMIC);
+			if (!c) {
+				tfw_http_msg_free(hm);
+				goto out;
+			}
+			ss_skb_queue_tail(&hm->msg.skb_list, c);
+		}
+		resp = (TfwHttpResp *)hm;
+		resp->status = ts->status;
+		resp->flags |= TFW_HTTP_RESP_PREBUILT;
+		break;
+	}
+out:
+	put_cpu_ptr(cache_tier);
+
+	return resp;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ *	Dogpile suppression for concurrent cache misses
+ * ------------------------------------------------------------------------
+ * Concurrent requests for the same not-yet-cached resource are
+ * coalesced: the first one (the leader) is forwarded to the backend,
+ * the others are parked on a miss record and re-driven through the
+ * cache when the leader's response passes tfw_cache_add(). If the
+ * leader never produces a response, the record times out and the next
+ * request takes over the leadership; its parked followers are
+ * re-driven by that request's response then.
+ */
+#define TFW_CMISS_BITS		8
+#define TFW_CMISS_SZ		(1 << TFW_CMISS_BITS)
+/* Give up coalescing if the leader got no response for so long. */
+#define TFW_CMISS_TIMEOUT	(5 * HZ)
+
+typedef struct {
+	struct hlist_node	hlist;
+	unsigned long		key;
+	unsigned long		ts;
+	struct list_head	waiters;
+	tfw_http_cache_cb_t	action;
+} TfwCacheMiss;
+
+typedef struct {
+	spinlock_t		lock;
+	struct hlist_head	head;
+} TfwCacheMissBucket;
+
+static TfwCacheMissBucket miss_tbl[TFW_CMISS_SZ];
+/* Miss records are allocated per concurrent miss on the hot path. */
+static struct kmem_cache *miss_cache;
+
+static void cache_req_process_node(TfwHttpReq *req,
+				   tfw_http_cache_cb_t action);
+
+static inline TfwCacheMissBucket *
+tfw_cmiss_bckt(unsigned long key)
+{
+	return &miss_tbl[hash_long(key, TFW_CMISS_BITS)];
+}
+
+/**
+ * Called on a cache miss before the request is forwarded.
+ * @return true if the request was parked behind an in-flight identical
+ * miss and must not be forwarded. Requests are linked through
+ * @fwd_list which is unused until the request reaches a server queue.
+ */
+static bool
+tfw_cmiss_park(TfwHttpReq *req, unsigned long key,
+	       tfw_http_cache_cb_t action)
+{
+	TfwCacheMiss *m;
+	TfwCacheMissBucket *b = tfw_cmiss_bckt(key);
+
+	spin_lock_bh(&b->lock);
+	hlist_for_each_entry(m, &b->head, hlist) {
+		if (m->key != key)
+			continue;
+		if (time_after(jiffies, m->ts + TFW_CMISS_TIMEOUT)) {
+			/* The leader got stuck - take over. */
+			m->ts = jiffies;
+			req->flags |= TFW_HTTP_CMISS_LEADER;
+			spin_unlock_bh(&b->lock);
+			return false;
+		}
+		list_add_tail(&req->fwd_list, &m->waiters);
+		spin_unlock_bh(&b->lock);
+		return true;
+	}
+	/* Become the leader. Forward w/o coalescing on ENOMEM. */
+	if ((m = kmem_cache_alloc(miss_cache, GFP_ATOMIC))) {
+		m->key = key;
+		m->ts = jiffies;
+		INIT_LIST_HEAD(&m->waiters);
+		m->action = action;
+		hlist_add_head(&m->hlist, &b->head);
+		req->flags |= TFW_HTTP_CMISS_LEADER;
+	}
+	spin_unlock_bh(&b->lock);
+
+	return false;
+}
+
+/**
+ * The coalescing leader's request died on an error response: without
+ * a response passing through the cache the miss record would pin its
+ * waiters forever (with a dead backend nothing else arrives to take
+ * the leadership over). Unpark the waiters and re-drive them - the
+ * first one becomes the new leader and gets its own error or
+ * success on its own merits.
+ */
+void
+tfw_cache_miss_abort(TfwHttpReq *req)
+{
+	TfwCacheMiss *m = NULL, *it;
+	TfwCacheMissBucket *b;
+	unsigned long key;
+	LIST_HEAD(waiters);
+	tfw_http_cache_cb_t action = NULL;
+
+	if (!(req->flags & TFW_HTTP_CMISS_LEADER))
+		return;
+	req->flags &= ~TFW_HTTP_CMISS_LEADER;
+
+	key = tfw_http_req_key_calc(req);
+	b = tfw_cmiss_bckt(key);
+
+	spin_lock_bh(&b->lock);
+	hlist_for_each_entry(it, &b->head, hlist) {
+		if (it->key != key)
+			continue;
+		m = it;
+		hlist_del(&m->hlist);
+		list_splice_init(&m->waiters, &waiters);
+		action = m->action;
+		break;
+	}
+	spin_unlock_bh(&b->lock);
+
+	if (!m)
+		return;
+	kmem_cache_free(miss_cache, m);
+
+	while (!list_empty(&waiters)) {
+		TfwHttpReq *wr = list_first_entry(&waiters, TfwHttpReq,
+						  fwd_list);
+		list_del_init(&wr->fwd_list);
+		cache_req_process_node(wr, action);
+	}
+}
+
+/*
+ * Backstop for waiters whose leader disappeared without an error
+ * response (e.g. its client connection died): bound the parking time
+ * by reaping timed-out miss records and re-driving their waiters.
+ */
+static void tfw_cmiss_reap_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tfw_cmiss_reaper, tfw_cmiss_reap_fn);
+
+static void
+tfw_cmiss_reap_fn(struct work_struct *work)
+{
+	int i;
+
+	for (i = 0; i < TFW_CMISS_SZ; ++i) {
+		TfwCacheMissBucket *b = &miss_tbl[i];
+		TfwCacheMiss *m;
+		struct hlist_node *tmp;
+		LIST_HEAD(waiters);
+		tfw_http_cache_cb_t action = NULL;
+
+		if (hlist_empty(&b->head))
+			continue;
+		spin_lock_bh(&b->lock);
+		hlist_for_each_entry_safe(m, tmp, &b->head, hlist) {
+			if (!time_after(jiffies, m->ts + TFW_CMISS_TIMEOUT))
+				continue;
+			hlist_del(&m->hlist);
+			list_splice_init(&m->waiters, &waiters);
+			action = m->action;
+			kmem_cache_free(miss_cache, m);
+		}
+		spin_unlock_bh(&b->lock);
+
+		local_bh_disable();
+		while (!list_empty(&waiters)) {
+			TfwHttpReq *wr = list_first_entry(&waiters,
+							  TfwHttpReq,
+							  fwd_list);
+			list_del_init(&wr->fwd_list);
+			cache_req_process_node(wr, action);
+		}
+		local_bh_enable();
+	}
+
+	schedule_delayed_work(&tfw_cmiss_reaper, TFW_CMISS_TIMEOUT);
+}
+
+/**
+ * A response for @key passed through the cache: drop the miss record
+ * and re-drive the waiters. They are served from the just refreshed
+ * cache, or, if the response was not cacheable, the first waiter
+ * becomes a new leader.
+ */
+static TfwHttpResp *tfw_cache_build_resp(TfwCacheEntry *ce, bool head_only);
+
+/*
+ * Build the master response for the fanout from the entry that the
+ * leader's response just stored. NULL if the entry is not servable,
+ * which sends the waiters down the regular path.
+ */
+static TfwHttpResp *
+tfw_cache_fanout_build(TfwHttpReq *req)
+{
+	TfwCacheEntry *ce;
+	TfwHttpResp *resp = NULL;
+	TdbIter iter;
+
+	if (req->method != TFW_HTTP_METH_GET)
+		return NULL;
+	if (!(ce = tfw_cache_dbce_get(node_db(), &iter, req)))
+		return NULL;
+	if (tfw_cache_entry_is_live(req, ce)) {
+		resp = tfw_cache_build_resp(ce, false);
+		if (resp)
+			resp->flags |= TFW_HTTP_RESP_PREBUILT;
+	}
+	tfw_cache_dbce_put(ce);
+
+	return resp;
+}
+
+/* One header copy per waiting connection, the frag pages are shared. */
+static TfwHttpResp *
+tfw_cache_fanout_copy(TfwHttpResp *master)
+{
+	struct sk_buff *skb;
+	TfwHttpMsg *hm;
+	TfwHttpResp *resp;
+
+	if (!(hm = tfw_http_msg_alloc_err_resp()))
+		return NULL;
+	for (skb = ss_skb_peek(&master->msg.skb_list); skb;
+	     skb = ss_skb_next(skb))
+	{
+		struct sk_buff *c = pskb_copy_for_clone(skb, GFP_ATOMIC);
+
+		if (!c) {
+			tfw_http_msg_free(hm);
+			return NULL;
+		}
+		ss_skb_queue_tail(&hm->msg.skb_list, c);
+	}
+	resp = (TfwHttpResp *)hm;
+	resp->status = master->status;
+	resp->flags |= TFW_HTTP_RESP_PREBUILT;
+
+	return resp;
+}
+
+static void
+tfw_cmiss_release(unsigned long key, tfw_http_cache_cb_t action)
+{
+	TfwCacheMiss *m = NULL, *it;
+	TfwCacheMissBucket *b = tfw_cmiss_bckt(key);
+	LIST_HEAD(waiters);
+
+	spin_lock_bh(&b->lock);
+	hlist_for_each_entry(it, &b->head, hlist) {
+		if (it->key != key)
+			continue;
+		m = it;
+		hlist_del(&m->hlist);
+		list_splice_init(&m->waiters, &waiters);
+		break;
+	}
+	spin_unlock_bh(&b->lock);
+
+	if (!m)
+		return;
+	kmem_cache_free(miss_cache, m);
+
+	/*
+	 * Flash-crowd fanout: the response is built from the freshly
+	 * stored entry once, and every further waiter gets a copy
+	 * sharing the frag pages (pskb_copy: the header must be
+	 * per-connection since TCP pushes its own headers into it),
+	 * so serving N parked requests costs one build plus N header
+	 * copies instead of N builds. Waiters the prebuilt copy can't
+	 * serve (non-GET, or the entry went away) fall back to the
+	 * regular per-request path.
+	 */
+	{
+		TfwHttpResp *master = NULL;
+		bool built = false;
+
+		while (!list_empty(&waiters)) {
+			TfwHttpReq *wr = list_first_entry(&waiters,
+							  TfwHttpReq,
+							  fwd_list);
+			TfwHttpResp *resp;
+
+			list_del_init(&wr->fwd_list);
+
+			if (!built && !list_empty(&waiters)) {
+				master = tfw_cache_fanout_build(wr);
+				built = true;
+			}
+			if (!master || wr->method != TFW_HTTP_METH_GET
+			    || !(resp = tfw_cache_fanout_copy(master)))
+			{
+				cache_req_process_node(wr, action);
+				continue;
+			}
+			action((TfwHttpReq *)wr, resp);
+		}
+		if (master)
+			tfw_http_msg_free((TfwHttpMsg *)master);
+	}
+}
+
 static void
 tfw_cache_str_write_hdr(const TfwStr *str, char *p)
 {
@@ -554,7 +1408,8 @@ tfw_cache_str_write_hdr(const TfwStr *str, char *p)
  * how many chunks are copied.
  */
 static long
-__tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len,
+__tfw_cache_strcpy(TDB *db, char **p, TdbVRec **trec, TfwStr *src,
+		   size_t tot_len,
 		   void *cpy(void *dest, const void *src, size_t n))
 {
 	long copied = 0;
@@ -564,7 +1419,7 @@ __tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len,
 		BUG_ON(room < 0);
 		if (!room) {
 			BUG_ON(tot_len < copied);
-			*trec = tdb_entry_add(node_db(), *trec,
+			*trec = tdb_entry_add(db, *trec,
 					      tot_len - copied);
 			if (!*trec)
 				return -ENOMEM;
@@ -596,18 +1451,20 @@ __tfw_memcpy(void *dst ,const void *src, size_t n)
 }
 
 static inline long
-tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+tfw_cache_strcpy(TDB *db, char **p, TdbVRec **trec, TfwStr *src,
+		 size_t tot_len)
 {
-	return __tfw_cache_strcpy(p, trec, src, tot_len, __tfw_memcpy);
+	return __tfw_cache_strcpy(db, p, trec, src, tot_len, __tfw_memcpy);
 }
 
 /**
  * The same as tfw_cache_strcpy(), but copies @src with lower case conversion.
  */
 static inline long
-tfw_cache_strcpy_lc(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+tfw_cache_strcpy_lc(TDB *db, char **p, TdbVRec **trec, TfwStr *src,
+		    size_t tot_len)
 {
-	return __tfw_cache_strcpy(p, trec, src, tot_len, tfw_strtolower);
+	return __tfw_cache_strcpy(db, p, trec, src, tot_len, tfw_strtolower);
 }
 
 /**
@@ -618,7 +1475,7 @@ tfw_cache_strcpy_lc(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
  * @return number of copied bytes on success and negative value otherwise.
  */
 static long
-tfw_cache_strcpy_eol(char **p, TdbVRec **trec,
+tfw_cache_strcpy_eol(TDB *db, char **p, TdbVRec **trec,
 		   TfwStr *src, size_t *tot_len, bool eol)
 {
 	long n, copied = 0;
@@ -630,7 +1487,7 @@ tfw_cache_strcpy_eol(char **p, TdbVRec **trec,
 		return 0;
 
 	TFW_STR_FOR_EACH_CHUNK(c, src, end) {
-		if ((n = tfw_cache_strcpy(p, trec, c, *tot_len)) < 0) {
+		if ((n = tfw_cache_strcpy(db, p, trec, c, *tot_len)) < 0) {
 			TFW_ERR("Cache: cannot copy chunk of string\n");
 			return -ENOMEM;
 		}
@@ -639,7 +1496,7 @@ tfw_cache_strcpy_eol(char **p, TdbVRec **trec,
 	}
 
 	if (eol) {
-		if ((n = tfw_cache_strcpy(p, trec, &g_crlf, *tot_len)) < 0)
+		if ((n = tfw_cache_strcpy(db, p, trec, &g_crlf, *tot_len)) < 0)
 			return -ENOMEM;
 		BUG_ON(n != SLEN(S_CRLF));
 		*tot_len -= n;
@@ -654,8 +1511,38 @@ tfw_cache_strcpy_eol(char **p, TdbVRec **trec,
  * @src is copied in depth first fashion to speed up upcoming scans.
  * @return number of copied bytes on success and negative value otherwise.
  */
+/*
+ * Shared dictionary for stored response headers. Fleet-wide constant
+ * lines (Server, CSP, HSTS and the like) are the bulk of the header
+ * bytes in the cache, so entries matching a configured dictionary
+ * line store a 1-word reference instead of the bytes and the response
+ * builder serves the line zero-copy from the dictionary page - the
+ * page is allocated with __get_free_page() so it can be mapped into
+ * skb fragments like the TDB area itself.
+ */
+#define TFW_CACHE_DICT_MAX	64
+
+static char *cache_dict_buf;
+static TfwStr cache_dict[TFW_CACHE_DICT_MAX];
+static unsigned int cache_dict_n;
+
+static int
+tfw_cache_dict_lookup(const TfwStr *hdr)
+{
+	int i;
+
+	for (i = 0; i < cache_dict_n; ++i)
+		/* The stored line includes the CRLF. */
+		if (hdr->len + SLEN(S_CRLF) == cache_dict[i].len
+		    && tfw_str_eq_cstr(hdr, cache_dict[i].ptr, hdr->len,
+				       TFW_STR_EQ_PREFIX))
+			return i;
+	return -1;
+}
+
 static long
-tfw_cache_copy_hdr(char **p, TdbVRec **trec, TfwStr *src, size_t *tot_len)
+tfw_cache_copy_hdr(TDB *db, char **p, TdbVRec **trec, TfwStr *src,
+		   size_t *tot_len)
 {
 	long n = sizeof(TfwCStr), copied;
 	TfwStr *dup, *dup_end;
@@ -665,6 +1552,23 @@ tfw_cache_copy_hdr(char **p, TdbVRec **trec, TfwStr *src, size_t *tot_len)
 			 src->len);
 		return -E2BIG;
 	}
+	/* A dictionary hit stores just the reference. */
+	if (cache_dict_n && !TFW_STR_DUP(src)) {
+		int d = tfw_cache_dict_lookup(src);
+
+		if (d >= 0) {
+			*p = tdb_entry_get_room(db, trec, *p,
+						TFW_CSTR_HDRLEN, *tot_len);
+			if (!*p)
+				return -ENOMEM;
+			((TfwCStr *)*p)->flags = TFW_CSTR_F_DICT;
+			((TfwCStr *)*p)->len = d;
+			*p += TFW_CSTR_HDRLEN;
+			*tot_len -= TFW_CSTR_HDRLEN;
+			return TFW_CSTR_HDRLEN;
+		}
+	}
+
 	/* Don't split short strings. */
 	if (likely(!TFW_STR_DUP(src))
 	    && sizeof(TfwCStr) + src->len <= L1_CACHE_BYTES)
@@ -676,7 +1580,7 @@ tfw_cache_copy_hdr(char **p, TdbVRec **trec, TfwStr *src, size_t *tot_len)
 	*tot_len -= TFW_CSTR_HDRLEN;		\
 	copied = TFW_CSTR_HDRLEN;
 
-	*p = tdb_entry_get_room(node_db(), trec, *p, n, *tot_len);
+	*p = tdb_entry_get_room(db, trec, *p, n, *tot_len);
 	if (!*p) {
 		TFW_WARN("Cache: cannot allocate TDB space\n");
 		return -ENOMEM;
@@ -685,14 +1589,14 @@ tfw_cache_copy_hdr(char **p, TdbVRec **trec, TfwStr *src, size_t *tot_len)
 	CSTR_WRITE_HDR(src);
 
 	if (!TFW_STR_DUP(src)) {
-		if ((n = tfw_cache_strcpy_eol(p, trec, src, tot_len, 1)) < 0)
+		if ((n = tfw_cache_strcpy_eol(db, p, trec, src, tot_len, 1)) < 0)
 			return n;
 		return copied + n;
 	}
 
 	TFW_STR_FOR_EACH_DUP(dup, src, dup_end) {
 		CSTR_WRITE_HDR(dup);
-		if ((n = tfw_cache_strcpy_eol(p, trec, dup, tot_len, 1)) < 0)
+		if ((n = tfw_cache_strcpy_eol(db, p, trec, dup, tot_len, 1)) < 0)
 			return n;
 		copied += n;
 	}
@@ -712,13 +1616,12 @@ tfw_cache_copy_hdr(char **p, TdbVRec **trec, TfwStr *src, size_t *tot_len)
  * of adjusting skb's.
  */
 static int
-tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
-		    size_t tot_len)
+tfw_cache_copy_resp(TDB *db, TfwCacheEntry *ce, TfwHttpResp *resp,
+		    TfwHttpReq *req, size_t tot_len, unsigned long body_key)
 {
 	long n;
 	char *p;
 	TdbVRec *trec = &ce->trec;
-	TDB *db = node_db();
 	TfwStr *field, *h, *end1, *end2, empty = {};
 
 	p = (char *)(ce + 1);
@@ -728,7 +1631,8 @@ tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
 	ce->key = TDB_OFF(db->hdr, p);
 	ce->key_len = 0;
 	TFW_CACHE_REQ_KEYITER(field, req, end1, h, end2) {
-		if ((n = tfw_cache_strcpy_lc(&p, &trec, field, tot_len)) < 0) {
+		if ((n = tfw_cache_strcpy_lc(db, &p, &trec, field,
+					     tot_len)) < 0) {
 			TFW_ERR("Cache: cannot copy request key\n");
 			return -ENOMEM;
 		}
@@ -740,7 +1644,8 @@ tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
 	ce->method = req->method;
 
 	ce->status = TDB_OFF(db->hdr, p);
-	if ((n = tfw_cache_strcpy_eol(&p, &trec, &resp->s_line, &tot_len, 1)) < 0) {
+	if ((n = tfw_cache_strcpy_eol(db, &p, &trec, &resp->s_line,
+				      &tot_len, 1)) < 0) {
 		TFW_ERR("Cache: cannot copy HTTP status line\n");
 		return -ENOMEM;
 	}
@@ -759,7 +1664,7 @@ tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
 			--ce->hdr_num;
 			continue;
 		}
-		n = tfw_cache_copy_hdr(&p, &trec, h, &tot_len);
+		n = tfw_cache_copy_hdr(db, &p, &trec, h, &tot_len);
 		if (n < 0) {
 			TFW_ERR("Cache: cannot copy HTTP header\n");
 			return -ENOMEM;
@@ -769,12 +1674,48 @@ tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
 
 	/* Write HTTP response body. */
 	ce->body = TDB_OFF(db->hdr, p);
-	if ((n = tfw_cache_strcpy_eol(&p, &trec, &resp->body, &tot_len,
+	if (body_key) {
+		/* The body lives in the shared dedup table. */
+		ce->flags |= TFW_CE_EXTBODY;
+		ce->body_key = body_key;
+		ce->body_node = numa_node_id();
+		ce->body_len = resp->body.len;
+		goto body_done;
+	}
+	if (cache_cfg.compress_min && resp->body.len
+	    && resp->body.len >= cache_cfg.compress_min
+	    && resp->body.len <= TFW_CACHE_ZBUF_SZ
+	    && !(resp->flags & TFW_HTTP_CHUNKED)
+	    && *this_cpu_ptr(&cache_zbuf))
+	{
+		char *zbuf = *this_cpu_ptr(&cache_zbuf);
+		size_t zlen = TFW_CACHE_ZBUF_SZ;
+
+		if (!tfw_gzip_compress(&resp->body, zbuf, &zlen)
+		    && zlen < resp->body.len)
+		{
+			TfwStr zstr = { .ptr = zbuf, .len = zlen };
+
+			n = tfw_cache_strcpy_eol(db, &p, &trec, &zstr,
+						 &tot_len, 0);
+			if (n < 0) {
+				TFW_ERR("Cache: cannot copy HTTP body\n");
+				return -ENOMEM;
+			}
+			ce->flags |= TFW_CE_GZIP;
+			ce->body_len = resp->body.len;
+			ce->body_zlen = zlen;
+			goto body_done;
+		}
+	}
+	if ((n = tfw_cache_strcpy_eol(db, &p, &trec, &resp->body, &tot_len,
 				      resp->flags & TFW_HTTP_CHUNKED)) < 0) {
 		TFW_ERR("Cache: cannot copy HTTP body\n");
 		return -ENOMEM;
 	}
+	/* A compressed body legitimately leaves reserved room unused. */
 	BUG_ON(tot_len != 0);
+body_done:
 
 	ce->version = resp->version;
 	ce->hmflags = resp->flags;
@@ -787,6 +1728,9 @@ tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwHttpReq *req,
 	ce->req_time = req->cache_ctl.timestamp;
 	ce->resp_time = resp->cache_ctl.timestamp;
 	ce->lifetime = tfw_cache_calc_lifetime(resp);
+	ce->last_used = resp->cache_ctl.timestamp;
+	ce->vh = req->vhost ? req->vhost->idx
+			    : tfw_vhost_get_default()->idx;
 
 	TFW_DBG("Cache copied msg: content-length=%lu msg_len=%lu, ce=%p"
 		" (len=%u key_len=%u status_len=%u hdr_num=%u hdr_len=%u"
@@ -841,6 +1785,263 @@ __cache_entry_size(TfwHttpResp *resp, TfwHttpReq *req)
 	return size;
 }
 
+/**
+ * The TTL callback for the background TDB compaction: reclaim entries
+ * which fell out of the stale window, respecting the transmission
+ * grace.
+ */
+static bool
+tfw_cache_rec_expired(TdbRec *rec)
+{
+	TfwCacheEntry *ce = (TfwCacheEntry *)rec;
+
+	if (!tfw_cache_entry_dead(ce))
+		return false;
+	if (tfw_current_timestamp() - ce->last_used <= TFW_CACHE_EVICT_GRACE)
+		return false;
+	if (ce->flags & TFW_CE_EXTBODY)
+		tfw_cache_body_put(ce->body_key, ce->body_node);
+	atomic64_sub(ce->tot_len, &cache_vh_used[ce->vh]);
+	return true;
+}
+
+/*
+ * Content-addressable body store: identical bodies served under many
+ * URLs (per-tenant asset paths, A/B buckets) are kept once in a
+ * per-node table keyed by the body content hash and refcounted by the
+ * referring entries. The zero-copy send path is shared - the response
+ * builder maps the deduplicated record's pages exactly as it maps
+ * inline bodies. A record whose refcount drops to zero is
+ * timestamped and reclaimed by the table's background compaction
+ * after the transmission grace, so in-flight zero-copy sends never
+ * race the reclaim.
+ *
+ * @refcnt	- referring cache entries;
+ * @dead_ts	- seconds timestamp of the drop to zero, 0 - alive;
+ * @len		- body length, guards the byte compare on hash hits.
+ */
+typedef struct {
+	atomic_t	refcnt;
+	unsigned int	len;
+	unsigned long	dead_ts;
+} TfwCacheBody;
+
+static bool
+tfw_cache_body_eq(TDB *bdb, TdbVRec *rec, TfwStr *body)
+{
+	TfwCacheBody *cb = (TfwCacheBody *)rec->data;
+	char *p = rec->data + sizeof(*cb);
+	const TfwStr *c, *end;
+	size_t n;
+
+	if (cb->len != body->len)
+		return false;
+	TFW_STR_FOR_EACH_CHUNK(c, body, end) {
+		size_t off = 0;
+
+		while (off < c->len) {
+			if (p == rec->data + rec->len) {
+				if (!rec->chunk_next)
+					return false;
+				rec = TDB_PTR(bdb->hdr,
+					      TDB_DI2O(rec->chunk_next));
+				p = rec->data;
+			}
+			n = min((size_t)(rec->data + rec->len - p),
+				c->len - off);
+			if (memcmp(p, (char *)c->ptr + off, n))
+				return false;
+			p += n;
+			off += n;
+		}
+	}
+	return true;
+}
+
+/**
+ * Store @body in the node's dedup table (or take a reference on the
+ * already stored copy) and return its content key, 0 if the body has
+ * to be stored inline.
+ */
+static unsigned long
+tfw_cache_body_dedup(TDB *bdb, TfwStr *body)
+{
+	unsigned long key = tfw_hash_str(body);
+	TdbIter iter;
+	TfwCacheBody cb = { .len = body->len };
+	TdbVRec *rec;
+	size_t len = sizeof(cb);
+	char *p;
+
+	iter = tdb_rec_get(bdb, key);
+	while (!TDB_ITER_BAD(iter)) {
+		if (tfw_cache_body_eq(bdb, (TdbVRec *)iter.rec, body)) {
+			TfwCacheBody *e = (TfwCacheBody *)iter.rec->data;
+
+			atomic_inc(&e->refcnt);
+			WRITE_ONCE(e->dead_ts, 0);
+			tdb_rec_put(iter.rec);
+			return key;
+		}
+		tdb_rec_next(bdb, &iter);
+	}
+
+	atomic_set(&cb.refcnt, 1);
+	rec = (TdbVRec *)tdb_entry_create(bdb, key, &cb, &len);
+	if (!rec || len != sizeof(cb))
+		return 0;
+	{
+		/* @rec advances over the chunk chain, keep the head. */
+		TfwCacheBody *e = (TfwCacheBody *)rec->data;
+		size_t tot = body->len;
+
+		p = rec->data + len;
+		if (tfw_cache_strcpy_eol(bdb, &p, &rec, body, &tot, 0) < 0) {
+			/*
+			 * Drop the reference so the compaction can
+			 * reclaim the partial record - with it held
+			 * and no death timestamp nothing ever would.
+			 */
+			atomic_set(&e->refcnt, 0);
+			WRITE_ONCE(e->dead_ts, tfw_current_timestamp());
+			return 0;
+		}
+	}
+	return key;
+}
+
+/*
+ * Drop a reference of a reclaimed entry. The entry records which
+ * node's table holds its body: in replicated mode every node stores
+ * its own copy of the same content, so decrementing "the first
+ * record found" would starve one node's refcount (reclaiming pages
+ * other entries still map zero-copy) while the others leak.
+ */
+static void
+tfw_cache_body_put(unsigned long key, int node)
+{
+	TDB *bdb;
+	TdbIter iter;
+	TfwCacheBody *cb;
+
+	if (node >= MAX_NUMNODES || !(bdb = c_nodes[node].body_db))
+		return;
+	iter = tdb_rec_get(bdb, key);
+	if (TDB_ITER_BAD(iter))
+		return;
+	cb = (TfwCacheBody *)iter.rec->data;
+	if (atomic_dec_and_test(&cb->refcnt))
+		WRITE_ONCE(cb->dead_ts, tfw_current_timestamp());
+	tdb_rec_put(iter.rec);
+}
+
+static bool
+tfw_cache_body_expired(TdbRec *rec)
+{
+	TfwCacheBody *cb = (TfwCacheBody *)((TdbVRec *)rec)->data;
+	unsigned long ts = READ_ONCE(cb->dead_ts);
+
+	return !atomic_read(&cb->refcnt) && ts
+	       && tfw_current_timestamp() - ts > TFW_CACHE_EVICT_GRACE;
+}
+
+static void tfw_cache_tags_record(TfwHttpResp *resp, unsigned long key,
+				  TDB *db);
+
+/*
+ * TinyLFU-style admission: a per-CPU byte sketch of miss frequencies
+ * with periodic reset acts as the doorkeeper - a key must miss twice
+ * within the window before its response is admitted to the cache, so
+ * one-hit wonders don't displace proven entries. The sketch is only
+ * consulted on the store path, reads cost nothing.
+ */
+#define TFW_CADM_BITS		16
+#define TFW_CADM_SZ		(1 << TFW_CADM_BITS)
+#define TFW_CADM_RESET		(60 * HZ)
+
+typedef struct {
+	unsigned long	reset_ts;
+	u8		cnt[TFW_CADM_SZ];
+} TfwCacheAdmit;
+
+static TfwCacheAdmit __percpu *cadm;
+/*
+ * The replication popularity sketch is separate from the admission
+ * one: admission counts misses ("seen before?"), and feeding it the
+ * per-request probes of the replication check would make every key
+ * look already seen, silently disabling the doorkeeper.
+ */
+static TfwCacheAdmit __percpu *crepl;
+
+static bool
+tfw_cache_admit(unsigned long key)
+{
+	bool admit;
+	u8 *c;
+	TfwCacheAdmit *a;
+
+	if (!cache_cfg.admission || !cadm)
+		return true;
+
+	a = get_cpu_ptr(cadm);
+	if (unlikely(time_after(jiffies, a->reset_ts + TFW_CADM_RESET))) {
+		memset(a->cnt, 0, TFW_CADM_SZ);
+		a->reset_ts = jiffies;
+	}
+	c = &a->cnt[hash_long(key, TFW_CADM_BITS)];
+	admit = *c > 0;
+	if (*c < 255)
+		++*c;
+	put_cpu_ptr(cadm);
+
+	return admit;
+}
+
+/*
+ * Estimate and account key popularity on the request path in the
+ * replication sketch (a sibling of the admission sketch, see @crepl).
+ * Returns the previous estimate for this CPU's sketch.
+ */
+static u8
+tfw_cache_key_freq(unsigned long key)
+{
+	u8 *c, f;
+	TfwCacheAdmit *a;
+
+	if (!crepl)
+		return 0;
+
+	a = get_cpu_ptr(crepl);
+	if (unlikely(time_after(jiffies, a->reset_ts + TFW_CADM_RESET))) {
+		memset(a->cnt, 0, TFW_CADM_SZ);
+		a->reset_ts = jiffies;
+	}
+	c = &a->cnt[hash_long(key, TFW_CADM_BITS)];
+	f = *c;
+	if (*c < 255)
+		++*c;
+	put_cpu_ptr(crepl);
+
+	return f;
+}
+
+static bool
+tfw_cache_dead_eq(TdbRec *rec, void *data)
+{
+	TfwCacheEntry *ce = (TfwCacheEntry *)rec;
+
+	if (!tfw_cache_entry_dead(ce))
+		return false;
+	/* Respect the zero-copy transmission grace, see eviction. */
+	if (tfw_current_timestamp() - ce->last_used
+	    <= TFW_CACHE_EVICT_GRACE)
+		return false;
+	if (ce->flags & TFW_CE_EXTBODY)
+		tfw_cache_body_put(ce->body_key, ce->body_node);
+	atomic64_sub(ce->tot_len, &cache_vh_used[ce->vh]);
+	return true;
+}
+
 static void
 __cache_add_node(TDB *db, TfwHttpResp *resp, TfwHttpReq *req,
 		 unsigned long key)
@@ -848,30 +2049,122 @@ __cache_add_node(TDB *db, TfwHttpResp *resp, TfwHttpReq *req,
 	TfwCacheEntry *ce, cdata = {{}};
 	size_t data_len = __cache_entry_size(resp, req);
 	size_t len = data_len;
+	unsigned long body_key = 0;
+	TfwVhost *vh = req->vhost ? : tfw_vhost_get_default();
+
+	/* The admission doorkeeper, see tfw_cache_admit(). */
+	if (!(req->flags & TFW_HTTP_PRELOAD) && !tfw_cache_admit(key))
+		return;
+
+	/*
+	 * Reclaim entries of the same key which fell out of the stale
+	 * window: a refreshing response supersedes them.
+	 */
+	tdb_entry_remove(db, key, tfw_cache_dead_eq, NULL);
+
+	/*
+	 * Enforce the vhost cache quota: reclaim the oldest tracked
+	 * entries once and skip the store if the vhost is still over
+	 * its limit - the response is forwarded anyway.
+	 */
+	if (vh->cache_quota
+	    && atomic64_read(&cache_vh_used[vh->idx]) + data_len
+	       > vh->cache_quota)
+	{
+		if (db == node_db())
+			tfw_cache_evict_batch(db,
+					      this_cpu_ptr(cache_evict_ring));
+		if (atomic64_read(&cache_vh_used[vh->idx]) + data_len
+		    > vh->cache_quota)
+			return;
+	}
 
 	/*
 	 * Try to place the cached response in single memory chunk.
 	 * TDB should provide enough space to place at least head of
 	 * the record key at first chunk.
 	 */
+	/*
+	 * Content dedup: place the body in the shared table first, so
+	 * the entry allocation below doesn't reserve room for it.
+	 * Dedup takes precedence over storage compression - a shared
+	 * body saves whole copies, not fractions.
+	 */
+	{
+		int nid = numa_node_id();
+
+		if (cache_cfg.dedup_min && c_nodes[nid].body_db
+		    && resp->body.len >= cache_cfg.dedup_min
+		    && !(resp->flags & TFW_HTTP_CHUNKED))
+		{
+			body_key = tfw_cache_body_dedup(c_nodes[nid].body_db,
+							&resp->body);
+			if (body_key) {
+				data_len -= resp->body.len;
+				len = data_len;
+			}
+		}
+	}
+
 	ce = (TfwCacheEntry *)tdb_entry_create(db, key, &cdata.ce_body, &len);
-	BUG_ON(len <= sizeof(cdata));
+	if (!ce && db == node_db()) {
+		/*
+		 * No room in the database: reclaim the oldest not
+		 * recently used entries and retry once. Remote node
+		 * databases are reclaimed by their own CPUs.
+		 */
+		tfw_cache_evict_batch(db, this_cpu_ptr(cache_evict_ring));
+		len = data_len;
+		ce = (TfwCacheEntry *)tdb_entry_create(db, key,
+						       &cdata.ce_body, &len);
+	}
 	if (!ce)
 		return;
+	BUG_ON(len <= sizeof(cdata));
 
 	TFW_DBG3("cache db=%p resp=%p/req=%p/ce=%p: alloc_len=%lu\n",
 		 db, resp, req, ce, len);
 
-	if (tfw_cache_copy_resp(ce, resp, req, data_len)) {
+	if (tfw_cache_copy_resp(db, ce, resp, req, data_len, body_key)) {
 		/* TODO delete the probably partially built TDB entry. */
 	}
+	/*
+	 * Vary-aware variants: remember the response's Vary list and
+	 * the hash of the request's corresponding header values, so
+	 * lookups select the right variant in the collision chain and
+	 * different variants coexist under one key.
+	 */
+	{
+		unsigned int hid;
+		TfwStr val = {};
+		DEFINE_TFW_STR(h_vary, "Vary:");
+
+		hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &h_vary);
+		if (hid < resp->h_tbl->off) {
+			tfw_http_msg_clnthdr_val(&resp->h_tbl->tbl[hid],
+						 hid, &val);
+			if (val.len && val.len < sizeof(ce->vary)) {
+				tfw_str_to_cstr(&val, ce->vary,
+						sizeof(ce->vary));
+				ce->vary_hash =
+					tfw_cache_vary_hash(req, ce->vary,
+							    val.len);
+			}
+		}
+	}
+	tfw_cache_tags_record(resp, key, db);
+	ce->tot_len = data_len;
+	atomic64_add(data_len, &cache_vh_used[ce->vh]);
 
+	if (db == node_db())
+		tfw_cache_evict_push(this_cpu_ptr(cache_evict_ring), key,
+				     ce->hits);
 }
 
 static void
 tfw_cache_add(TfwHttpResp *resp, TfwHttpReq *req, tfw_http_cache_cb_t action)
 {
-	unsigned long key;
+	unsigned long key = tfw_http_req_key_calc(req);
 	bool keep_skb = false;
 
 	if (!tfw_cache_msg_cacheable(req))
@@ -879,8 +2172,6 @@ tfw_cache_add(TfwHttpResp *resp, TfwHttpReq *req, tfw_http_cache_cb_t action)
 	if (!tfw_cache_employ_resp(req, resp))
 		goto out;
 
-	key = tfw_http_req_key_calc(req);
-
 	if (cache_cfg.cache == TFW_CACHE_SHARD) {
 		BUG_ON(req->node != numa_node_id());
 		__cache_add_node(node_db(), resp, req, key);
@@ -903,6 +2194,12 @@ tfw_cache_add(TfwHttpResp *resp, TfwHttpReq *req, tfw_http_cache_cb_t action)
 out:
 	((TfwMsg *)resp)->ss_flags |= keep_skb ? SS_F_KEEP_SKB : 0;
 	action(req, resp);
+	/*
+	 * Re-drive requests coalesced behind this one. Must go after
+	 * @action: @req may be freed by the callback, hence the key is
+	 * computed up front.
+	 */
+	tfw_cmiss_release(key, action);
 }
 
 /**
@@ -912,15 +2209,167 @@ out:
 static int
 tfw_cache_purge_invalidate(TfwHttpReq *req)
 {
+	int nid, ret = -ENOENT;
 	TdbIter iter;
-	TDB *db = node_db();
-	TfwCacheEntry *ce = NULL;
+	TfwCacheEntry *ce;
 
-	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
+	/*
+	 * The per-NUMA-node caches are peers: in replicated mode every
+	 * node holds its own copy of the entry, so an invalidation
+	 * that touches only the local replica leaves the other nodes
+	 * serving the purged content. Walk all the peers.
+	 */
+	for_each_node_with_cpus(nid) {
+		if (!c_nodes[nid].db)
+			continue;
+		if (!(ce = tfw_cache_dbce_get(c_nodes[nid].db, &iter, req)))
+			continue;
+		ce->lifetime = 0;
+		tfw_cache_dbce_put(ce);
+		ret = 0;
+		if (cache_cfg.cache == TFW_CACHE_SHARD)
+			break;
+	}
+
+	return ret;
+}
+
+/*
+ * Tag based purging: responses may carry an "X-Cache-Tags" header with
+ * a comma separated tag list; every tag is recorded in the secondary
+ * index as tag hash -> entry key at store time. A PURGE request with
+ * an "X-Purge-Tags" header invalidates all the entries of the listed
+ * tags by walking the index chain of each tag hash.
+ */
+#define TFW_CACHE_TAG_MAX	64
+
+/*
+ * The tag index of the node owning the data table @db - in replicate
+ * mode the storing CPU writes all nodes' tables, and each replica's
+ * tags must land in its own node's index or remote replicas could
+ * never be tag-purged.
+ */
+static TDB *
+tag_db_of(TDB *db)
+{
+	int nid;
+
+	for_each_node_with_cpus(nid)
+		if (c_nodes[nid].db == db)
+			return c_nodes[nid].tag_db;
+	return NULL;
+}
+
+static void
+tfw_cache_tags_record(TfwHttpResp *resp, unsigned long key, TDB *db)
+{
+	char buf[256];
+	unsigned int hid;
+	TfwStr val = {};
+	DEFINE_TFW_STR(h_tags, "X-Cache-Tags:");
+	char *p, *tag;
+	int n;
+	TDB *idx = tag_db_of(db);
+
+	if (!idx)
+		return;
+
+	hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &h_tags);
+	if (hid >= resp->h_tbl->off)
+		return;
+	tfw_http_msg_clnthdr_val(&resp->h_tbl->tbl[hid], hid, &val);
+	if (!val.len || val.len >= sizeof(buf))
+		return;
+	n = tfw_str_to_cstr(&val, buf, sizeof(buf));
+
+	for (p = buf; p < buf + n; ) {
+		while (p < buf + n && (*p == ',' || *p == ' '))
+			++p;
+		tag = p;
+		while (p < buf + n && *p != ',' && *p != ' ')
+			++p;
+		if (p - tag && p - tag <= TFW_CACHE_TAG_MAX)
+			tdb_idx_insert(idx,
+				       tdb_hash_calc(tag, p - tag), key);
+	}
+}
+
+static void
+__tag_invalidate_key(TDB *db, unsigned long key)
+{
+	TdbIter iter;
+
+	iter = tdb_rec_get(db, key);
+	while (!TDB_ITER_BAD(iter)) {
+		((TfwCacheEntry *)iter.rec)->lifetime = 0;
+		tdb_rec_next(db, &iter);
+	}
+}
+
+static int
+tfw_cache_purge_tags(TfwHttpReq *req)
+{
+	char buf[256];
+	unsigned int hid;
+	TfwStr val = {};
+	DEFINE_TFW_STR(h_tags, "X-Purge-Tags:");
+	char *p, *tag;
+	int n, nid, found = -ENOENT;
+
+	if (!node_tag_db())
 		return -ENOENT;
-	ce->lifetime = 0;
-	tfw_cache_dbce_put(ce);
-	return 0;
+
+	hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &h_tags);
+	if (hid >= req->h_tbl->off)
+		return -ENOENT;
+	tfw_http_msg_clnthdr_val(&req->h_tbl->tbl[hid], hid, &val);
+	if (!val.len || val.len >= sizeof(buf))
+		return -ENOENT;
+	n = tfw_str_to_cstr(&val, buf, sizeof(buf));
+
+	for (p = buf; p < buf + n; ) {
+		while (p < buf + n && (*p == ',' || *p == ' '))
+			++p;
+		tag = p;
+		while (p < buf + n && *p != ',' && *p != ' ')
+			++p;
+		if (!(p - tag) || p - tag > TFW_CACHE_TAG_MAX)
+			continue;
+
+		/*
+		 * Walk every node: in replicate mode each replica
+		 * carries the tag in its own index, and in shard mode
+		 * the entries of a tag may live on any shard. See the
+		 * peer walk of tfw_cache_purge_invalidate().
+		 */
+		for_each_node_with_cpus(nid) {
+			TdbIter iter;
+			TDB *idx = c_nodes[nid].tag_db;
+			TDB *db = c_nodes[nid].db;
+
+			if (!idx || !db)
+				continue;
+
+			/* Collect the primary keys, then invalidate them. */
+			iter = tdb_rec_get(idx, tdb_hash_calc(tag, p - tag));
+			while (!TDB_ITER_BAD(iter)) {
+				unsigned long pri_key =
+					*(unsigned long *)
+					((TdbFRec *)iter.rec)->data;
+				/*
+				 * Writing the entry lifetime needs only
+				 * the target bucket lock of the data
+				 * table, which is different from the
+				 * index bucket lock held here.
+				 */
+				__tag_invalidate_key(db, pri_key);
+				found = 0;
+				tdb_rec_next(idx, &iter);
+			}
+		}
+	}
+
+	return found;
 }
 
 /**
@@ -945,7 +2394,10 @@ tfw_cache_purge_method(TfwHttpReq *req)
 	/* Only "invalidate" option is implemented at this time. */
 	switch (vhost->cache_purge_mode) {
 	case TFW_D_CACHE_PURGE_INVALIDATE:
-		ret = tfw_cache_purge_invalidate(req);
+		/* Tag purging takes priority over the URI key. */
+		ret = tfw_cache_purge_tags(req);
+		if (ret == -ENOENT)
+			ret = tfw_cache_purge_invalidate(req);
 		break;
 	default:
 		return tfw_http_send_403(req, "purge: invalid option");
@@ -1005,6 +2457,15 @@ tfw_cache_build_resp_hdr(TDB *db, TfwHttpResp *resp, TfwStr *hdr,
 	*p += TFW_CSTR_HDRLEN;
 	BUG_ON(*p > (*trec)->data + (*trec)->len);
 
+	if (unlikely(s->flags & TFW_CSTR_F_DICT)) {
+		/* Serve the line zero-copy from the dictionary page. */
+		if ((r = tfw_http_msg_add_data(it, (TfwHttpMsg *)resp, hdr,
+					       &cache_dict[s->len])))
+			return r;
+		tfw_str_fixup_eol(hdr, SLEN(S_CRLF));
+		return 0;
+	}
+
 	if (likely(!(s->flags & TFW_STR_DUPLICATE)))
 		return tfw_cache_write_field(db, trec, resp, it, p, s->len,
 					     hdr);
@@ -1088,6 +2549,70 @@ tfw_cache_build_resp_body(TDB *db, TfwHttpResp *resp, TdbVRec *trec,
 	return 0;
 }
 
+/*
+ * Inflate a compressed stored body and attach page-sized copies of it
+ * as skb fragments. The zero-copy mapping of TDB pages doesn't apply
+ * to compressed entries - that's the documented trade-off of storage
+ * compression: cache capacity for a copy on the hit path.
+ */
+static int
+tfw_cache_build_resp_body_z(TDB *db, TfwHttpResp *resp, TdbVRec *trec,
+			    TfwMsgIter *it, char *p, TfwCacheEntry *ce)
+{
+	char *zsrc = *this_cpu_ptr(&cache_zbuf);
+	char *raw = *this_cpu_ptr(&cache_unzbuf);
+	size_t rlen = TFW_CACHE_ZBUF_SZ, got = 0, off = 0;
+
+	if (!zsrc || !raw)
+		return -ENOMEM;
+
+	/* Collect the compressed stream from the record chain. */
+	while (got < ce->body_zlen) {
+		size_t n = min((size_t)(trec->data + trec->len - p),
+			       (size_t)ce->body_zlen - got);
+
+		memcpy(zsrc + got, p, n);
+		got += n;
+		if (got < ce->body_zlen) {
+			trec = tdb_next_rec_chunk(db, trec);
+			BUG_ON(!trec);
+			p = trec->data;
+		}
+	}
+	if (tfw_gzip_decompress(zsrc, ce->body_zlen, raw, &rlen)
+	    || rlen != ce->body_len)
+	{
+		TFW_WARN("Cache: cannot inflate stored body\n");
+		return -EINVAL;
+	}
+
+	while (off < rlen) {
+		struct page *pg;
+		size_t n = min(rlen - off, PAGE_SIZE);
+
+		if (it->frag >= MAX_SKB_FRAGS) {
+			if (!(it->skb = ss_skb_alloc()))
+				return -ENOMEM;
+			ss_skb_queue_tail(&resp->msg.skb_list, it->skb);
+			it->frag = 0;
+		}
+		if (!(pg = alloc_page(GFP_ATOMIC)))
+			return -ENOMEM;
+		memcpy(page_address(pg), raw + off, n);
+		skb_fill_page_desc(it->skb, it->frag, pg, 0, n);
+		ss_skb_adjust_data_len(it->skb, n);
+		if (__tfw_http_msg_add_str_data((TfwHttpMsg *)resp,
+						&resp->body,
+						page_address(pg), n,
+						it->skb))
+			return -ENOMEM;
+		++it->frag;
+		off += n;
+	}
+
+	return 0;
+}
+
 /**
  * Build response that can be sent via TCP socket.
  *
@@ -1110,7 +2635,7 @@ tfw_cache_build_resp_body(TDB *db, TfwHttpResp *resp, TdbVRec *trec,
  * TODO use iterator and passed skbs to be called from net_tx_action.
  */
 static TfwHttpResp *
-tfw_cache_build_resp(TfwCacheEntry *ce)
+tfw_cache_build_resp(TfwCacheEntry *ce, bool head_only)
 {
 	int h;
 	char *p;
@@ -1166,7 +2691,45 @@ tfw_cache_build_resp(TfwCacheEntry *ce)
 		goto err;
 
 	BUG_ON(p != TDB_PTR(db->hdr, ce->body));
-	if (tfw_cache_build_resp_body(db, resp, trec, &it, p))
+	/*
+	 * A HEAD request gets the stored headers (the Content-Length
+	 * of the entity included, as RFC 7231 allows) with no body.
+	 */
+	if (head_only) {
+		resp->flags |= TFW_HTTP_VOID_BODY;
+	} else if (ce->flags & TFW_CE_EXTBODY) {
+		/*
+		 * A deduplicated body: map the shared record's pages
+		 * the same zero-copy way. Colliding hashes coexist as
+		 * separate records under one key; the stored copy was
+		 * byte-compared at store time and the length check
+		 * picks it from the chain.
+		 */
+		TDB *bdb = c_nodes[numa_node_id()].body_db;
+		TdbIter bit;
+		int r = -ENOENT;
+
+		if (!bdb)
+			goto err;
+		bit = tdb_rec_get(bdb, ce->body_key);
+		while (!TDB_ITER_BAD(bit)) {
+			TfwCacheBody *cb = (TfwCacheBody *)bit.rec->data;
+
+			if (cb->len == ce->body_len) {
+				r = tfw_cache_build_resp_body(bdb, resp,
+						(TdbVRec *)bit.rec, &it,
+						bit.rec->data + sizeof(*cb));
+				tdb_rec_put(bit.rec);
+				break;
+			}
+			tdb_rec_next(bdb, &bit);
+		}
+		if (r)
+			goto err;
+	} else if (ce->flags & TFW_CE_GZIP) {
+		if (tfw_cache_build_resp_body_z(db, resp, trec, &it, p, ce))
+			goto err;
+	} else if (tfw_cache_build_resp_body(db, resp, trec, &it, p))
 		goto err;
 
 	resp->version = ce->version;
@@ -1189,12 +2752,89 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 	TdbIter iter;
 	time_t lifetime;
 
-	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
+	/*
+	 * The preload interface: an authorized cache warmer (the purge
+	 * ACL applies) marks its requests with X-Tempesta-Preload, and
+	 * such a request always goes to the backend refreshing the
+	 * entry - even a fresh cached copy is not served - and its
+	 * response bypasses the admission doorkeeper. This lets an
+	 * external job walk a URI list before a planned traffic event
+	 * and land everything in the cache.
+	 */
+	{
+		unsigned int hid;
+		DEFINE_TFW_STR(h_pre, "X-Tempesta-Preload:");
+
+		hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &h_pre);
+		if (unlikely(hid < req->h_tbl->off)) {
+			TfwAddr saddr;
+			TfwVhost *vh = tfw_vhost_get_default();
+
+			ss_getpeername(req->conn->sk, &saddr);
+			if (vh->cache_purge_acl
+			    && tfw_capuacl_match(vh, &saddr))
+			{
+				req->flags |= TFW_HTTP_PRELOAD;
+				action(req, NULL);
+				return;
+			}
+		}
+	}
+
+	/*
+	 * Forward range requests to the backend: the client gets real
+	 * 206 semantics (e.g. video seeking) instead of the full cached
+	 * object, which RFC 7233 would also permit to send. Different
+	 * ranges carry the same cache key, so such requests are not
+	 * coalesced either.
+	 */
+	if (unlikely(tfw_cache_req_is_range(req))) {
+		action(req, NULL);
+		return;
+	}
+
+	if ((resp = tfw_cache_tier_get(req, tfw_http_req_key_calc(req)))) {
+		TFW_INC_STAT_BH(cache.hits);
+		trace_tfw_cache_lookup(req, true);
 		goto out;
+	}
 
-	if (!(lifetime = tfw_cache_entry_is_live(req, ce)))
+	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
 		goto out;
 
+	if (!(lifetime = tfw_cache_entry_is_live(req, ce))) {
+		/*
+		 * Stale-while-revalidate: the first request on a stale
+		 * entry is elected to refresh it and is forwarded to
+		 * the backend, everybody else keeps being served the
+		 * stale copy until the window ends. The flag update is
+		 * a benign race under the bucket read lock - the worst
+		 * case is one extra revalidating request.
+		 */
+		if (!tfw_cache_entry_stale_usable(ce))
+			goto out;
+		if (!(ce->flags & TFW_CE_REVAL_PEND)) {
+			ce->flags |= TFW_CE_REVAL_PEND;
+			goto out;
+		}
+		lifetime = ce->lifetime + 1; /* mark the response stale */
+	}
+
+	/*
+	 * The 304 fast path: a fresh entry not modified since the
+	 * client's copy doesn't need the response built at all, a
+	 * template Not Modified reply is enough.
+	 */
+	if (req->method == TFW_HTTP_METH_GET && lifetime <= ce->lifetime) {
+		time_t ims = tfw_cache_req_ims(req);
+
+		if (ims && ce->date && ce->date <= ims) {
+			tfw_http_send_304(req);
+			tfw_cache_dbce_put(ce);
+			return;
+		}
+	}
+
 	TFW_DBG("Cache: service request w/ key=%lx, ce=%p (len=%u key_len=%u"
 		" status_len=%u hdr_num=%u hdr_len=%u key_off=%ld"
 		" status_off=%ld hdrs_off=%ld body_off=%ld)\n",
@@ -1202,15 +2842,29 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 		ce->hdr_num, ce->hdr_len, ce->key, ce->status, ce->hdrs,
 		ce->body);
 	TFW_INC_STAT_BH(cache.hits);
+	trace_tfw_cache_lookup(req, true);
 
-	resp = tfw_cache_build_resp(ce);
+	resp = tfw_cache_build_resp(ce,
+				    req->method == TFW_HTTP_METH_HEAD
+				    && ce->method == TFW_HTTP_METH_GET);
 	if (lifetime > ce->lifetime)
 		resp->flags |= TFW_HTTP_RESP_STALE;
+	else if (resp)
+		tfw_cache_tier_put(ce->trec.key, ce->vary_hash, resp,
+				   lifetime - tfw_cache_entry_age(ce));
 out:
-	if (!resp && (req->cache_ctl.flags & TFW_HTTP_CC_OIFCACHED))
+	if (!resp)
+		trace_tfw_cache_lookup(req, false);
+	if (!resp && (req->cache_ctl.flags & TFW_HTTP_CC_OIFCACHED)) {
 		tfw_http_send_504(req, "resource not cached");
-	else
+	} else if (!resp
+		   && tfw_cmiss_park(req, tfw_http_req_key_calc(req),
+				     action))
+	{
+		/* Parked behind an identical in-flight miss. */
+	} else {
 		action(req, resp);
+	}
 
 	tfw_cache_dbce_put(ce);
 }
@@ -1253,6 +2907,23 @@ tfw_cache_process(TfwHttpReq *req, TfwHttpResp *resp,
 		goto dont_cache;
 	if (!resp && !tfw_cache_employ_req(req))
 		goto dont_cache;
+	/*
+	 * Large responses bypass the cache: they are not worth
+	 * displacing many smaller objects, and skipping the cache
+	 * work queue forwards them to the client from the receiving
+	 * CPU with no extra hop or TDB copy. The response is still
+	 * buffered and parsed in full before forwarding starts.
+	 *
+	 * TODO #498: true cut-through streaming - forwarding parsed
+	 * skbs as they arrive so memory is O(window) instead of
+	 * O(body) - needs the message-complete assumptions removed
+	 * from the forwarding and error paths (tfw_http_resp_fwd()
+	 * and the paired request release run on full messages only)
+	 * and is not delivered by this bypass.
+	 */
+	if (resp && cache_cfg.max_obj_size
+	    && resp->msg.len > cache_cfg.max_obj_size)
+		goto dont_cache;
 
 do_cache:
 	key = tfw_http_req_key_calc(req);
@@ -1260,6 +2931,19 @@ do_cache:
 		    ? tfw_cache_key_node(key)
 		    : numa_node_id();
 
+	/*
+	 * Popularity-driven replication in shard mode: once the local
+	 * sketch sees a remote-sharded key often enough, the key is
+	 * handled on the local node instead - the first such request
+	 * misses locally, fetches from the backend and fills a local
+	 * replica, every following hit is served without touching the
+	 * interconnect. Purge and expiry already fan out over all node
+	 * databases, so the replicas stay coherent.
+	 */
+	if (cache_cfg.replicate && req->node != numa_node_id()
+	    && tfw_cache_key_freq(key) >= cache_cfg.replicate)
+		req->node = numa_node_id();
+
 	/*
 	 * Queue the cache work only when it must be served by a remote node.
 	 * Otherwise we can do everything right now on local CPU.
@@ -1287,10 +2971,30 @@ do_cache:
 	if (unlikely(r))
 		TFW_WARN("Cache work queue overrun: [%s]\n",
 			 resp ? "response" : "request");
+	/*
+	 * On high water (or overrun) clamp the client's receive window
+	 * instead of dropping parsed work later: TCP pushes the
+	 * overload back to the sender for free.
+	 */
+	if (unlikely(r || tfw_wq_size(&ct->wq) > TFW_CACHE_WQ_HIWAT)
+	    && req->conn && (TFW_CONN_TYPE(req->conn) & Conn_Clnt))
+		ss_sock_throttle(req->conn->sk);
 	return r;
 
 dont_cache:
-	action(req, resp);
+	/*
+	 * A response bypassing the cache must still re-drive requests
+	 * coalesced behind its request, see tfw_cmiss_release(). The
+	 * key is taken before @action which may free @req.
+	 */
+	if (resp && tfw_cache_msg_cacheable(req)) {
+		unsigned long mkey = tfw_http_req_key_calc(req);
+
+		action(req, resp);
+		tfw_cmiss_release(mkey, action);
+	} else {
+		action(req, resp);
+	}
 	return 0;
 }
 
@@ -1298,10 +3002,34 @@ static void
 tfw_wq_tasklet(unsigned long data)
 {
 	TfwWorkTasklet *ct = (TfwWorkTasklet *)data;
-	TfwCWork cw;
+	TfwCWork cw[8];
+	CaNode *node;
+	int n, i, c;
+
+	while ((n = tfw_wq_pop_n(&ct->wq, cw, ARRAY_SIZE(cw))))
+		for (i = 0; i < n; ++i)
+			tfw_cache_do_action(cw[i].req, cw[i].resp,
+					    cw[i].action);
+
+	/*
+	 * Work stealing: cache works are bound to a NUMA node, not to
+	 * a CPU (see tfw_cache_sched_cpu()), and the queues are MPMC,
+	 * so an idle CPU may legitimately grab a batch from a same-node
+	 * sibling. One batch per victim bounds the time taken from our
+	 * own backlog.
+	 */
+	node = &c_nodes[numa_node_id()];
+	for (c = 0; c < node->nr_cpus; ++c) {
+		TfwWorkTasklet *vct = &per_cpu(cache_wq, node->cpu[c]);
 
-	while (!tfw_wq_pop(&ct->wq, &cw))
-		tfw_cache_do_action(cw.req, cw.resp, cw.action);
+		if (vct == ct)
+			continue;
+		if (!(n = tfw_wq_pop_n(&vct->wq, cw, ARRAY_SIZE(cw))))
+			continue;
+		for (i = 0; i < n; ++i)
+			tfw_cache_do_action(cw[i].req, cw[i].resp,
+					    cw[i].action);
+	}
 }
 
 /**
@@ -1331,6 +3059,20 @@ tfw_cache_mgr(void *arg)
 }
 #endif
 
+typedef struct {
+	struct work_struct	work;
+	int			node;
+	TDB			*db;
+} TfwCacheOpenWork;
+
+static void
+tfw_cache_open_work(struct work_struct *w)
+{
+	TfwCacheOpenWork *ow = container_of(w, TfwCacheOpenWork, work);
+
+	ow->db = tdb_open(cache_cfg.db_path, cache_cfg.db_size, 0, ow->node);
+}
+
 static int
 tfw_cache_start(void)
 {
@@ -1340,11 +3082,52 @@ tfw_cache_start(void)
 	if (!(cache_cfg.cache || vhost->cache_purge))
 		return 0;
 
-	for_each_node_with_cpus(i) {
-		c_nodes[i].db = tdb_open(cache_cfg.db_path,
-					 cache_cfg.db_size, 0, i);
-		if (!c_nodes[i].db)
-			goto close_db;
+	/*
+	 * Open the per-node databases in parallel: the open populates
+	 * the whole mapping from the file, which dominates the startup
+	 * time with large caches, and the area allocator releases its
+	 * lock for the read, see tempesta_map_file().
+	 */
+	{
+		/* Configuration is single threaded, static is fine and
+		 * MAX_NUMNODES entries would be too much for the stack. */
+		static TfwCacheOpenWork ow[MAX_NUMNODES];
+
+		for_each_node_with_cpus(i) {
+			ow[i].node = i;
+			INIT_WORK(&ow[i].work, tfw_cache_open_work);
+			queue_work_on(cpumask_first(cpumask_of_node(i)),
+				      system_unbound_wq, &ow[i].work);
+		}
+		for_each_node_with_cpus(i) {
+			flush_work(&ow[i].work);
+			c_nodes[i].db = ow[i].db;
+		}
+		for_each_node_with_cpus(i) {
+			if (!c_nodes[i].db)
+				goto close_db;
+			tdb_set_expire_cb(c_nodes[i].db,
+					  tfw_cache_rec_expired);
+			/*
+			 * The tag index is small; failure to open it
+			 * only disables tag purging.
+			 */
+			c_nodes[i].tag_db = tdb_open("/opt/tempesta/db/ctag.tdb",
+						     TDB_EXT_SZ * 4,
+						     sizeof(unsigned long), i);
+			/*
+			 * The content-addressed body store; failure to
+			 * open it only disables deduplication.
+			 */
+			if (cache_cfg.dedup_min) {
+				c_nodes[i].body_db =
+					tdb_open("/opt/tempesta/db/cbody.tdb",
+						 cache_cfg.db_size / 4, 0, i);
+				if (c_nodes[i].body_db)
+					tdb_set_expire_cb(c_nodes[i].body_db,
+						tfw_cache_body_expired);
+			}
+		}
 	}
 #if 0
 	cache_mgr_thr = kthread_run(tfw_cache_mgr, NULL, "tfw_cache_mgr");
@@ -1356,6 +3139,60 @@ tfw_cache_start(void)
 #endif
 	tfw_init_node_cpus();
 
+	schedule_delayed_work(&tfw_cmiss_reaper, TFW_CMISS_TIMEOUT);
+
+	cache_evict_ring = alloc_percpu(TfwCacheEvictRing);
+	if (!cache_evict_ring) {
+		r = -ENOMEM;
+		goto close_db;
+	}
+	if (cache_cfg.hot_tier) {
+		cache_tier = alloc_percpu(TfwCacheTier);
+		if (!cache_tier)
+			TFW_WARN("cache: no hot tier memory\n");
+	}
+	if (cache_cfg.compress_min) {
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			*per_cpu_ptr(&cache_zbuf, cpu) =
+				vmalloc(TFW_CACHE_ZBUF_SZ);
+			*per_cpu_ptr(&cache_unzbuf, cpu) =
+				vmalloc(TFW_CACHE_ZBUF_SZ);
+			if (!*per_cpu_ptr(&cache_zbuf, cpu)
+			    || !*per_cpu_ptr(&cache_unzbuf, cpu))
+			{
+				TFW_WARN("cache: no compression buffers,"
+					 " storing raw\n");
+				cache_cfg.compress_min = 0;
+				break;
+			}
+		}
+	}
+	if (cache_cfg.admission) {
+		cadm = alloc_percpu(TfwCacheAdmit);
+		if (!cadm)
+			TFW_WARN("cache: no admission sketch, all responses"
+				 " are admitted\n");
+	}
+	if (cache_cfg.replicate) {
+		crepl = alloc_percpu(TfwCacheAdmit);
+		if (!crepl)
+			TFW_WARN("cache: no replication sketch, hot entries"
+				 " are not replicated\n");
+	}
+
+	miss_cache = kmem_cache_create("tfw_cmiss_cache",
+				       sizeof(TfwCacheMiss), 0, SLAB_HWCACHE_ALIGN, NULL);
+	if (!miss_cache) {
+		r = -ENOMEM;
+		goto close_db;
+	}
+	for (i = 0; i < TFW_CMISS_SZ; ++i) {
+		spin_lock_init(&miss_tbl[i].lock);
+		INIT_HLIST_HEAD(&miss_tbl[i].head);
+	}
+
 	TFW_WQ_CHECKSZ(TfwCWork);
 	for_each_online_cpu(i) {
 		TfwWorkTasklet *ct = &per_cpu(cache_wq, i);
@@ -1379,18 +3216,67 @@ tfw_cache_stop(void)
 	if (!cache_cfg.cache)
 		return;
 
+	cancel_delayed_work_sync(&tfw_cmiss_reaper);
+
 	for_each_online_cpu(i) {
 		TfwWorkTasklet *ct = &per_cpu(cache_wq, i);
 		tasklet_kill(&ct->tasklet);
 		irq_work_sync(&ct->ipi_work);
 		tfw_wq_destroy(&ct->wq);
 	}
+	for_each_possible_cpu(i) {
+		vfree(*per_cpu_ptr(&cache_zbuf, i));
+		vfree(*per_cpu_ptr(&cache_unzbuf, i));
+		*per_cpu_ptr(&cache_zbuf, i) = NULL;
+		*per_cpu_ptr(&cache_unzbuf, i) = NULL;
+	}
 #if 0
 	kthread_stop(cache_mgr_thr);
 #endif
+	free_percpu(cache_evict_ring);
+	cache_evict_ring = NULL;
+	free_percpu(cadm);
+	cadm = NULL;
+	free_percpu(crepl);
+	crepl = NULL;
+	if (cache_tier) {
+		int cpu, i;
+
+		for_each_possible_cpu(cpu) {
+			TfwCacheTier *t = per_cpu_ptr(cache_tier, cpu);
+
+			for (i = 0; i < TFW_CACHE_TIER_SLOTS; ++i)
+				tfw_cache_tier_slot_purge(&t->slot[i]);
+		}
+		free_percpu(cache_tier);
+		cache_tier = NULL;
+	}
 
-	for_each_node_with_cpus(i)
+	/*
+	 * Traffic is stopped at this point, so the miss table must be
+	 * drained; warn loudly if a leader never saw its response.
+	 */
+	for (i = 0; i < TFW_CMISS_SZ; ++i) {
+		TfwCacheMiss *m;
+		struct hlist_node *tmp;
+
+		hlist_for_each_entry_safe(m, tmp, &miss_tbl[i].head, hlist) {
+			TFW_WARN("cache: orphaned coalesced miss,"
+				 " key=%lx\n", m->key);
+			hlist_del(&m->hlist);
+			kmem_cache_free(miss_cache, m);
+		}
+	}
+	kmem_cache_destroy(miss_cache);
+	miss_cache = NULL;
+
+	for_each_node_with_cpus(i) {
 		tdb_close(c_nodes[i].db);
+		tdb_close(c_nodes[i].tag_db);
+		tdb_close(c_nodes[i].body_db);
+		c_nodes[i].body_db = NULL;
+		c_nodes[i].tag_db = NULL;
+	}
 }
 
 static int
@@ -1429,6 +3315,52 @@ tfw_cache_cfg_method(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return 0;
 }
 
+static int
+tfw_cfgop_cache_hdr_dict(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i;
+	const char *val;
+
+	if (!cache_dict_buf
+	    && !(cache_dict_buf = (char *)__get_free_page(GFP_KERNEL)))
+		return -ENOMEM;
+
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val) {
+		size_t len = strlen(val);
+		size_t used = cache_dict_n
+			      ? (char *)cache_dict[cache_dict_n - 1].ptr
+				+ cache_dict[cache_dict_n - 1].len
+				- cache_dict_buf
+			      : 0;
+
+		if (cache_dict_n == TFW_CACHE_DICT_MAX
+		    || used + len + SLEN(S_CRLF) > PAGE_SIZE)
+		{
+			TFW_ERR_NL("%s: dictionary is full\n", cs->name);
+			return -EINVAL;
+		}
+		memcpy(cache_dict_buf + used, val, len);
+		memcpy(cache_dict_buf + used + len, S_CRLF, SLEN(S_CRLF));
+		cache_dict[cache_dict_n].ptr = cache_dict_buf + used;
+		cache_dict[cache_dict_n].len = len + SLEN(S_CRLF);
+		++cache_dict_n;
+	}
+
+	return 0;
+}
+
+static void
+tfw_cfgop_cleanup_hdr_dict(TfwCfgSpec *cs)
+{
+	/*
+	 * Stored entries reference the dictionary by index, so changing
+	 * it invalidates the cache contents; that's the administrator's
+	 * contract documented with the directive. The page itself must
+	 * outlive the responses built from it, so it's kept allocated.
+	 */
+	cache_dict_n = 0;
+}
+
 static TfwCfgSpec tfw_cache_cfg_specs[] = {
 	{
 		"cache",
@@ -1456,6 +3388,70 @@ static TfwCfgSpec tfw_cache_cfg_specs[] = {
 			.range = { PAGE_SIZE, (1 << 30) },
 		}
 	},
+	{
+		"cache_max_obj_size",
+		"0",
+		tfw_cfg_set_int,
+		&cache_cfg.max_obj_size,
+		&(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		}
+	},
+	{
+		"cache_hot_tier",
+		"false",
+		tfw_cfg_set_bool,
+		&cache_cfg.hot_tier,
+	},
+	{
+		"cache_admission",
+		"false",
+		tfw_cfg_set_bool,
+		&cache_cfg.admission,
+	},
+	{
+		"cache_negative_ttl",
+		"30",
+		tfw_cfg_set_int,
+		&cache_cfg.negative_ttl,
+		&(TfwCfgSpecInt) {
+			.range = { 0, 86400 },
+		}
+	},
+	{
+		"cache_stale_serve",
+		"0",
+		tfw_cfg_set_int,
+		&cache_cfg.stale_serve,
+		&(TfwCfgSpecInt) {
+			.range = { 0, 86400 },
+		}
+	},
+	{
+		"cache_dedup",
+		"0",
+		tfw_cfg_set_int,
+		&cache_cfg.dedup_min,
+	},
+	{
+		"cache_replicate",
+		"0",
+		tfw_cfg_set_int,
+		&cache_cfg.replicate,
+	},
+	{
+		"cache_compress",
+		"0",
+		tfw_cfg_set_int,
+		&cache_cfg.compress_min,
+	},
+	{
+		"cache_hdr_dict", NULL,
+		tfw_cfgop_cache_hdr_dict,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cfgop_cleanup_hdr_dict,
+	},
 	{
 		"cache_db",
 		"/opt/tempesta/db/cache.tdb",
@@ -24,6 +24,7 @@
 #include "http.h"
 
 bool tfw_cache_msg_cacheable(TfwHttpReq *req);
+void tfw_cache_miss_abort(TfwHttpReq *req);
 int tfw_cache_process(TfwHttpReq *req, TfwHttpResp *resp,
 		      tfw_http_cache_cb_t action);
 
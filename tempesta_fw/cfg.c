@@ -1459,8 +1459,21 @@ EXPORT_SYMBOL(tfw_cfg_spec_find);
  * For each parsed entry searches for a matching TfwCfgSpec across all specs
  * of all modules in the @mod_list.
  */
-int
-tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list)
+/**
+ * Whether @mod takes part in a live configuration reload: either it can
+ * be fully restarted (@live_reconf) or it re-applies parsed values via
+ * @reconf. All other modules keep both their parsed data and runtime
+ * state across a reload.
+ */
+static bool
+mod_under_reconf(TfwCfgMod *mod)
+{
+	return mod->live_reconf || mod->reconf;
+}
+
+static int
+__tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list,
+			 bool reconf_only)
 {
 	TfwCfgParserState ps = {
 		.in = cfg_text,
@@ -1472,6 +1485,8 @@ tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list)
 	int r = -EINVAL;
 
 	MOD_FOR_EACH(mod, mod_list) {
+		if (reconf_only && !mod_under_reconf(mod))
+			continue;
 		spec_start_handling(mod->specs);
 	}
 
@@ -1493,6 +1508,16 @@ tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list)
 			TFW_ERR("don't know how to handle: '%s'\n", ps.e.name);
 			goto err;
 		}
+		/*
+		 * Under reload entries of modules that don't take part in
+		 * it are skipped: their parsed data wasn't cleaned up, so
+		 * re-pushing the entries would both trip the duplicate
+		 * checks and re-run side-effectful handlers on live state.
+		 */
+		if (reconf_only && !mod_under_reconf(mod)) {
+			entry_reset(&ps.e);
+			continue;
+		}
 
 		r = spec_handle_entry(matching_spec, &ps.e);
 		if (r)
@@ -1501,6 +1526,8 @@ tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list)
 	} while (ps.t);
 
 	MOD_FOR_EACH(mod, mod_list) {
+		if (reconf_only && !mod_under_reconf(mod))
+			continue;
 		r = spec_finish_handling(mod->specs);
 		if (r)
 			goto err;
@@ -1512,6 +1539,12 @@ err:
 	entry_reset(&ps.e);
 	return -EINVAL;
 }
+
+int
+tfw_cfg_parse_mods_cfg(const char *cfg_text, struct list_head *mod_list)
+{
+	return __tfw_cfg_parse_mods_cfg(cfg_text, mod_list, false);
+}
 EXPORT_SYMBOL(tfw_cfg_parse_mods_cfg);
 
 /**
@@ -1597,6 +1630,94 @@ tfw_cfg_start(void)
 	return r;
 }
 
+/**
+ * Re-read and re-apply the configuration without stopping the
+ * synchronous sockets layer, so established client and server
+ * connections survive the reload.
+ *
+ * Only modules with @live_reconf set are restarted: their runtime
+ * state is rebuilt from the new configuration between two requests.
+ * Values of the other modules are re-parsed as well, but take effect
+ * on the next full restart.
+ *
+ * If the new configuration doesn't parse or a module fails to restart,
+ * the system is left running with the modules stopped so far down -
+ * a full stop/start cycle recovers it.
+ */
+static bool tfw_cfg_reloading;
+
+/**
+ * Whether a configuration reload is in progress. Handlers with side
+ * effects beyond storing parsed values (e.g. instantiating servers)
+ * must parse-only under reload and re-apply values via the module's
+ * @reconf callback.
+ */
+bool
+tfw_cfg_is_reloading(void)
+{
+	return tfw_cfg_reloading;
+}
+
+int
+tfw_cfg_reload(void)
+{
+	int r;
+	TfwCfgMod *mod;
+	char *cfg_text_buf;
+
+	cfg_text_buf = tfw_cfg_read_file(tfw_cfg_path, NULL);
+	if (!cfg_text_buf)
+		return -ENOENT;
+
+	TFW_LOG("Reloading configuration...\n");
+
+	tfw_cfg_reloading = true;
+
+	MOD_FOR_EACH_REVERSE(mod, &tfw_cfg_mods)
+		if (mod->live_reconf)
+			mod_stop(mod);
+
+	/*
+	 * Only modules taking part in the reload get their parsed data
+	 * cleaned up and re-parsed. Running spec_cleanup() for the rest
+	 * would fire side-effectful cleanup handlers (listening socket
+	 * teardown, vhost/location data freeing) on state that live
+	 * connections still reference.
+	 */
+	MOD_FOR_EACH_REVERSE(mod, &tfw_cfg_mods)
+		if (mod_under_reconf(mod))
+			spec_cleanup(mod->specs);
+
+	r = __tfw_cfg_parse_mods_cfg(cfg_text_buf, &tfw_cfg_mods, true);
+	if (r) {
+		TFW_ERR_NL("reload: can't parse new configuration\n");
+		goto out;
+	}
+
+	MOD_FOR_EACH(mod, &tfw_cfg_mods) {
+		if (mod->live_reconf) {
+			if ((r = mod_start(mod))) {
+				TFW_ERR_NL("reload: can't restart module"
+					   " '%s'\n", mod->name);
+				goto out;
+			}
+		} else if (mod->reconf) {
+			if ((r = mod->reconf())) {
+				TFW_ERR_NL("reload: can't reconfigure module"
+					   " '%s'\n", mod->name);
+				goto out;
+			}
+		}
+	}
+
+	TFW_LOG("Configuration reloaded\n");
+out:
+	tfw_cfg_reloading = false;
+	vfree(cfg_text_buf);
+
+	return r;
+}
+
 /**
  * Stop all registered modules and clean up theeir parsed configuration data.
  *
@@ -236,12 +236,19 @@ struct TfwCfgSpec {
  * @start and @stop callbacks are invoked when corresponding events are received
  * via sysctl. The @start is called after the configuration is parsed and @specs
  * are handled.
+ *
+ * @live_reconf marks a module whose runtime state can be rebuilt on a
+ * configuration reload while traffic keeps flowing, i.e. its @stop and
+ * @start callbacks don't touch established connections and its data is
+ * safe to recreate between two requests. See tfw_cfg_reload().
  */
 typedef struct {
 	struct list_head list;	/* Private. Don't touch. */
 	const char *name;	/* [A-Za-z0-9_], starts with a letter. */
+	bool live_reconf;
 	int  (*start)(void);
 	void (*stop)(void);
+	int  (*reconf)(void);	/* Re-apply parsed values on reload. */
 	TfwCfgSpec *specs;	/* An array terminated by a null element. */
 } TfwCfgMod;
 
@@ -323,5 +330,7 @@ void *tfw_cfg_read_file(const char *path, size_t *file_size);
 
 int tfw_cfg_start(void);
 void tfw_cfg_stop(void);
+int tfw_cfg_reload(void);
+bool tfw_cfg_is_reloading(void);
 
 #endif /* __TFW_CFG_H__ */
@@ -116,6 +116,24 @@ ours:
 	return i;
 }
 
+int
+tfw_classify_conn_recv(struct sock *sk, struct sk_buff *skb)
+{
+	int r;
+	TfwClassifier *clfr;
+
+	rcu_read_lock();
+
+	clfr = rcu_dereference(classifier);
+	r = (clfr && clfr->classify_conn_recv)
+	    ? clfr->classify_conn_recv(sk, skb)
+	    : TFW_PASS;
+
+	rcu_read_unlock();
+
+	return r;
+}
+
 static void
 tfw_classify_conn_close(struct sock *sk)
 {
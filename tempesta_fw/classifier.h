@@ -62,6 +62,13 @@ typedef struct {
 	 * Called when a client connection closed.
 	 */
 	void	(*classify_conn_close)(struct sock *sk);
+	/*
+	 * Called for each ingress data chunk on an established client
+	 * connection, before any protocol processing. TFW_POSTPONE
+	 * means the classifier consumed the data (e.g. a tarpitted
+	 * connection) and no further processing must happen.
+	 */
+	int	(*classify_conn_recv)(struct sock *sk, struct sk_buff *skb);
 	/*
 	 * TODO called on retransmits to client (e.g. SYN+ACK or data).
 	 */
@@ -87,6 +94,7 @@ void tfw_classify_shrink(void);
 
 int tfw_classify_ipv4(struct sk_buff *skb);
 int tfw_classify_ipv6(struct sk_buff *skb);
+int tfw_classify_conn_recv(struct sock *sk, struct sk_buff *skb);
 
 extern void tfw_classifier_register(TfwClassifier *mod);
 extern void tfw_classifier_unregister(void);
@@ -42,6 +42,7 @@
  */
 #include <linux/ctype.h>
 #include <linux/spinlock.h>
+#include <net/tcp.h>
 
 #include "tdb.h"
 
@@ -54,6 +55,7 @@
 #include "../gfsm.h"
 #include "../http_msg.h"
 #include "../log.h"
+#include "../ss_skb.h"
 
 MODULE_AUTHOR(TFW_AUTHOR);
 MODULE_DESCRIPTION("Tempesta static limiting classifier");
@@ -65,23 +67,24 @@ MODULE_LICENSE("GPL");
 
 typedef struct {
 	unsigned long	ts;
-	unsigned int	conn_new;
-	unsigned int	req;
+	atomic_t	conn_new;
+	atomic_t	req;
 } FrangRates;
 
 /**
  * Main descriptor of client resource accounting.
- * @lock can be removed if RSS is tuned to schedule packets based on
- * <proto, src_ip> touple. However, the hashing could produce bad CPU load
- * balancing so, such settings are not desireble.
+ * The counters are lock-free: connections of one client are handled on
+ * multiple CPUs, and the accounting is a heuristic which tolerates the
+ * rare lost increments around a time slot reset, so no CPU ever spins
+ * on a per-client lock.
  *
  * @conn_curr	- current connections number;
  * @addr	- client IPv6 address (w/o port);
  * @history	- bursts history organized as a ring-buffer;
  */
 typedef struct {
-	unsigned int		conn_curr;
-	spinlock_t		lock;
+	atomic_t		conn_curr;
+	unsigned long		tarpit_until;
 	FrangRates		history[FRANG_FREQ];
 } FrangAcc;
 
@@ -116,11 +119,17 @@ typedef struct {
 	bool 		http_host_required;
 
 	bool		ip_block;
+	unsigned int	vhost_req_rate;
+	unsigned int	vhost_req_burst;
+	unsigned int	tarpit;
 
 	/* The bitmask of allowed HTTP Method values. */
 	unsigned long 	http_methods_mask;
 	/* The list of allowed Content-Type values. */
 	FrangCtVal	*http_ct_vals;
+	/* Blocked TLS ClientHello fingerprints, sorted. */
+	unsigned int	*tls_fp_block;
+	size_t		tls_fp_block_n;
 } FrangCfg;
 
 static FrangCfg frang_cfg __read_mostly;
@@ -135,7 +144,8 @@ int prio0, prio1;
 do {									\
 	char abuf[TFW_ADDR_STR_BUF_SIZE] = {0};				\
 	tfw_addr_fmt_v6(&(addr)->v6.sin6_addr, 0, abuf);		\
-	TFW_WARN("frang: %s for %s" fmt, check, abuf, ##__VA_ARGS__);	\
+	TFW_WARN_ASYNC("frang: %s for %s" fmt, check, abuf,		\
+		       ##__VA_ARGS__);					\
 } while (0)
 
 #define frang_limmsg(lim_name, curr_val, lim, addr)			\
@@ -145,14 +155,21 @@ do {									\
 static int
 frang_conn_limit(FrangAcc *ra, struct sock *unused)
 {
-	unsigned long ts = (jiffies * FRANG_FREQ) / HZ;
+	unsigned long old_ts, ts = (jiffies * FRANG_FREQ) / HZ;
 	unsigned int csum = 0;
 	int i = ts % FRANG_FREQ;
 
-	if (ra->history[i].ts != ts) {
-		ra->history[i].ts = ts;
-		ra->history[i].conn_new = 0;
-		ra->history[i].req = 0;
+	/*
+	 * One CPU wins the slot reset, increments of other CPUs racing
+	 * with the reset in the very same tick may be lost - fine for
+	 * the heuristic accounting.
+	 */
+	old_ts = ACCESS_ONCE(ra->history[i].ts);
+	if (old_ts != ts
+	    && cmpxchg(&ra->history[i].ts, old_ts, ts) == old_ts)
+	{
+		atomic_set(&ra->history[i].conn_new, 0);
+		atomic_set(&ra->history[i].req, 0);
 	}
 
 	/*
@@ -163,27 +180,31 @@ frang_conn_limit(FrangAcc *ra, struct sock *unused)
 	 * connection attempts and connections that were successfully
 	 * established.
 	 */
-	ra->history[i].conn_new++;
-	ra->conn_curr++;
+	atomic_inc(&ra->history[i].conn_new);
+	atomic_inc(&ra->conn_curr);
 
-	if (frang_cfg.conn_max && ra->conn_curr > frang_cfg.conn_max) {
-		frang_limmsg("connections max num.", ra->conn_curr,
+	if (frang_cfg.conn_max
+	    && atomic_read(&ra->conn_curr) > frang_cfg.conn_max)
+	{
+		frang_limmsg("connections max num.",
+			     atomic_read(&ra->conn_curr),
 			     frang_cfg.conn_max, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 
 	if (frang_cfg.conn_burst
-	    && ra->history[i].conn_new > frang_cfg.conn_burst)
+	    && atomic_read(&ra->history[i].conn_new) > frang_cfg.conn_burst)
 	{
-		frang_limmsg("new connections burst", ra->history[i].conn_new,
+		frang_limmsg("new connections burst",
+			     atomic_read(&ra->history[i].conn_new),
 			     frang_cfg.conn_burst, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 
 	/* Collect current connection sum. */
 	for (i = 0; i < FRANG_FREQ; i++)
-		if (ra->history[i].ts + FRANG_FREQ >= ts)
-			csum += ra->history[i].conn_new;
+		if (ACCESS_ONCE(ra->history[i].ts) + FRANG_FREQ >= ts)
+			csum += atomic_read(&ra->history[i].conn_new);
 	if (frang_cfg.conn_rate && csum > frang_cfg.conn_rate) {
 		frang_limmsg("new connections rate", csum, frang_cfg.conn_rate,
 			     &FRANG_ACC2CLI(ra)->addr);
@@ -193,12 +214,201 @@ frang_conn_limit(FrangAcc *ra, struct sock *unused)
 	return TFW_PASS;
 }
 
+
+/*
+ * Whitelisted sources (CDN edges, health checkers) bypass frang
+ * entirely: no FrangAcc accounting is allocated for them and the
+ * request limits are not evaluated. The configured CIDR ranges are
+ * compiled into a binary longest-prefix-match trie over v4-mapped
+ * IPv6 addresses, so the check is a short bit walk regardless of the
+ * number of ranges. A whitelisted connection is marked by a NULL
+ * sk_security.
+ */
+typedef struct frang_wl_node {
+	struct frang_wl_node	*child[2];
+	bool			term;
+} FrangWlNode;
+
+static FrangWlNode *frang_wl_root;
+
+static inline int
+__wl_bit(const struct in6_addr *a, int i)
+{
+	return (a->s6_addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static int
+frang_wl_add(const struct in6_addr *a, int plen)
+{
+	int i;
+	FrangWlNode **np = &frang_wl_root, *n;
+
+	for (i = 0; ; ++i) {
+		if (!(n = *np)) {
+			if (!(n = kzalloc(sizeof(*n), GFP_KERNEL)))
+				return -ENOMEM;
+			*np = n;
+		}
+		if (i == plen) {
+			n->term = true;
+			return 0;
+		}
+		np = &n->child[__wl_bit(a, i)];
+	}
+}
+
+static bool
+frang_wl_match(const struct in6_addr *a)
+{
+	int i;
+	FrangWlNode *n = frang_wl_root;
+
+	for (i = 0; n; ++i) {
+		if (n->term)
+			return true;
+		n = n->child[__wl_bit(a, i)];
+	}
+	return false;
+}
+
+static void
+__frang_wl_free(FrangWlNode *n)
+{
+	if (!n)
+		return;
+	__frang_wl_free(n->child[0]);
+	__frang_wl_free(n->child[1]);
+	kfree(n);
+}
+
+/*
+ * Vhost-level token buckets. Per-client accounting alone lets a
+ * distributed attack under every per-client threshold sink a vhost,
+ * so a second, aggregate layer caps the total request rate a vhost
+ * accepts. To avoid a shared atomic on every request each CPU drains
+ * a small local batch claimed from the per-vhost reservoir; the
+ * reservoir is topped up once a second by whichever CPU wins the
+ * refill slot cmpxchg, the same election the per-client history
+ * slots use. Locally cached tokens may carry over a second boundary,
+ * which over-admits at most FRANG_VHTB_BATCH requests per CPU - noise
+ * against the rates this limit is set at.
+ */
+#define FRANG_VHTB_BATCH	8
+
+typedef struct {
+	atomic_t	tokens;
+	atomic64_t	slot;
+} FrangVhostTb;
+
+static FrangVhostTb frang_vhtb[TFW_VHOST_MAX] ____cacheline_aligned;
+static DEFINE_PER_CPU(int [TFW_VHOST_MAX], frang_vhtb_local);
+
+static int
+frang_vhost_limit(FrangAcc *ra, TfwHttpReq *req)
+{
+	int n, *lt;
+	TfwVhost *vhost = req->vhost ? : tfw_vhost_get_default();
+	FrangVhostTb *tb = &frang_vhtb[vhost->idx];
+	unsigned long slot = jiffies / HZ, old;
+
+	if (!frang_cfg.vhost_req_rate)
+		return TFW_PASS;
+
+	old = atomic64_read(&tb->slot);
+	if (old != slot && atomic64_cmpxchg(&tb->slot, old, slot) == old)
+		atomic_set(&tb->tokens, frang_cfg.vhost_req_rate
+				        + frang_cfg.vhost_req_burst);
+
+	lt = this_cpu_ptr(frang_vhtb_local) + vhost->idx;
+	if (*lt > 0) {
+		--*lt;
+		return TFW_PASS;
+	}
+	n = atomic_sub_return(FRANG_VHTB_BATCH, &tb->tokens);
+	if (n + FRANG_VHTB_BATCH <= 0) {
+		atomic_add(FRANG_VHTB_BATCH, &tb->tokens);
+		frang_limmsg("vhost request rate", frang_cfg.vhost_req_rate,
+			     frang_cfg.vhost_req_rate,
+			     &FRANG_ACC2CLI(ra)->addr);
+		return TFW_BLOCK;
+	}
+	*lt = min(n + FRANG_VHTB_BATCH, FRANG_VHTB_BATCH) - 1;
+
+	return TFW_PASS;
+}
+
+/*
+ * Tarpit for identified abusers. Dropping a flagged client just makes
+ * it rotate IPs; instead its connections are accepted, their data is
+ * consumed without any protocol processing, the advertised TCP window
+ * is clamped to a minimum and a tiny precomputed response is sent
+ * back after a delay. Each probe costs the attacker a connection slot
+ * and a round trip, and costs us a timer-wheel slot. The window clamp
+ * bounds how much data (and thus how many delayed-response timers) a
+ * tarpitted connection can induce.
+ */
+#define FRANG_TARPIT_DELAY	(3 * HZ)
+
+static const char frang_tarpit_resp[] =
+	"HTTP/1.1 429 Too Many Requests" S_CRLF
+	"Retry-After: 60" S_CRLF
+	"Content-Length: 0" S_CRLF S_CRLF;
+
+typedef struct {
+	struct timer_list	timer;
+	struct sock		*sk;
+} FrangTarpitTimer;
+
 static void
-__frang_init_acc(TfwClient *cli)
+frang_tarpit_timer_fn(unsigned long data)
 {
-	FrangAcc *ra = FRANG_CLI2ACC(cli);
+	FrangTarpitTimer *tt = (FrangTarpitTimer *)data;
+	struct sock *sk = tt->sk;
+	struct sk_buff *skb;
+	SsSkbList list;
+
+	if (sk->sk_state == TCP_ESTABLISHED && (skb = ss_skb_alloc())) {
+		memcpy(ss_skb_put(skb, sizeof(frang_tarpit_resp) - 1),
+		       frang_tarpit_resp, sizeof(frang_tarpit_resp) - 1);
+		ss_skb_queue_head_init(&list);
+		ss_skb_queue_tail(&list, skb);
+		ss_send(sk, &list, 0);
+	}
+	sock_put(sk);
+	kfree(tt);
+}
 
-	spin_lock_init(&ra->lock);
+static void
+frang_tarpit_mark(FrangAcc *ra)
+{
+	WRITE_ONCE(ra->tarpit_until, jiffies + frang_cfg.tarpit * HZ);
+	frang_msg("client tarpitted", &FRANG_ACC2CLI(ra)->addr,
+		  ": %u sec\n", frang_cfg.tarpit);
+}
+
+static int
+frang_conn_recv(struct sock *sk, struct sk_buff *skb)
+{
+	FrangTarpitTimer *tt;
+	FrangAcc *ra = sk->sk_security;
+
+	if (!ra || !frang_cfg.tarpit
+	    || !time_before(jiffies, READ_ONCE(ra->tarpit_until)))
+		return TFW_PASS;
+
+	tcp_sk(sk)->window_clamp = 128;
+	sk->sk_rcvbuf = SOCK_MIN_RCVBUF;
+
+	if ((tt = kmalloc(sizeof(*tt), GFP_ATOMIC))) {
+		sock_hold(sk);
+		tt->sk = sk;
+		setup_timer(&tt->timer, frang_tarpit_timer_fn,
+			    (unsigned long)tt);
+		mod_timer(&tt->timer, jiffies + FRANG_TARPIT_DELAY);
+	}
+
+	/* The data is consumed here, nothing runs after us. */
+	return TFW_POSTPONE;
 }
 
 static int
@@ -208,7 +418,17 @@ frang_conn_new(struct sock *sk)
 	FrangAcc *ra;
 	TfwClient *cli;
 
-	cli = tfw_client_obtain(sk, __frang_init_acc);
+	if (frang_wl_root) {
+		TfwAddr addr;
+
+		ss_getpeername(sk, &addr);
+		if (frang_wl_match(&addr.v6.sin6_addr)) {
+			sk->sk_security = NULL;
+			return TFW_PASS;
+		}
+	}
+
+	cli = tfw_client_obtain(sk, NULL);
 	if (unlikely(!cli)) {
 		TFW_ERR("can't obtain a client for frang accounting\n");
 		return TFW_BLOCK;
@@ -216,8 +436,6 @@ frang_conn_new(struct sock *sk)
 
 	ra = FRANG_CLI2ACC(cli);
 
-	spin_lock(&ra->lock);
-
 	/*
 	 * sk->sk_user_data references TfwConn{} which in turn references
 	 * TfwPeer, so basically we can get FrangAcc from TfwConn{}.
@@ -231,13 +449,16 @@ frang_conn_new(struct sock *sk)
 	sk->sk_security = ra;
 
 	r = frang_conn_limit(ra, sk);
+	if (r == TFW_BLOCK && frang_cfg.tarpit) {
+		/* Take the connection in and waste the client's time. */
+		frang_tarpit_mark(ra);
+		return TFW_PASS;
+	}
 	if (r == TFW_BLOCK && frang_cfg.ip_block) {
 		tfw_filter_block_ip(&cli->addr.v6.sin6_addr);
 		tfw_client_put(cli);
 	}
 
-	spin_unlock(&ra->lock);
-
 	return r;
 }
 
@@ -249,14 +470,11 @@ frang_conn_close(struct sock *sk)
 {
 	FrangAcc *ra = sk->sk_security;
 
-	BUG_ON(!ra);
-
-	spin_lock(&ra->lock);
+	/* Whitelisted connections have no accounting to roll back. */
+	if (!ra)
+		return;
 
-	BUG_ON(!ra->conn_curr);
-	ra->conn_curr--;
-
-	spin_unlock(&ra->lock);
+	BUG_ON(atomic_dec_return(&ra->conn_curr) < 0);
 
 	tfw_client_put(FRANG_ACC2CLI(ra));
 }
@@ -264,26 +482,31 @@ frang_conn_close(struct sock *sk)
 static int
 frang_req_limit(FrangAcc *ra)
 {
-	unsigned long ts = jiffies * FRANG_FREQ / HZ;
+	unsigned long old_ts, ts = jiffies * FRANG_FREQ / HZ;
 	unsigned int rsum = 0;
 	int i = ts % FRANG_FREQ;
 
-	if (ra->history[i].ts != ts) {
-		ra->history[i].ts = ts;
-		ra->history[i].conn_new = 0;
-		ra->history[i].req = 0;
+	old_ts = ACCESS_ONCE(ra->history[i].ts);
+	if (old_ts != ts
+	    && cmpxchg(&ra->history[i].ts, old_ts, ts) == old_ts)
+	{
+		atomic_set(&ra->history[i].conn_new, 0);
+		atomic_set(&ra->history[i].req, 0);
 	}
-	ra->history[i].req++;
+	atomic_inc(&ra->history[i].req);
 
-	if (frang_cfg.req_burst && ra->history[i].req > frang_cfg.req_burst) {
-		frang_limmsg("requests burst", ra->history[i].req,
+	if (frang_cfg.req_burst
+	    && atomic_read(&ra->history[i].req) > frang_cfg.req_burst)
+	{
+		frang_limmsg("requests burst",
+			     atomic_read(&ra->history[i].req),
 			     frang_cfg.req_burst, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 	/* Collect current request sum. */
 	for (i = 0; i < FRANG_FREQ; i++)
-		if (ra->history[i].ts + FRANG_FREQ >= ts)
-			rsum += ra->history[i].req;
+		if (ACCESS_ONCE(ra->history[i].ts) + FRANG_FREQ >= ts)
+			rsum += atomic_read(&ra->history[i].req);
 	if (frang_cfg.req_rate && rsum > frang_cfg.req_rate) {
 		frang_limmsg("request rate", rsum, frang_cfg.req_rate,
 			     &FRANG_ACC2CLI(ra)->addr);
@@ -452,8 +675,6 @@ frang_http_host_check(const TfwHttpReq *req, FrangAcc *ra)
 	}
 
 	if (req->flags & TFW_HTTP_URI_FULL) {
-		char *hdrhost;
-
 		/* If host in URI is empty, host header also must be empty. */
 		if (TFW_STR_EMPTY(&field) + TFW_STR_EMPTY(&req->host) == 1) {
 			frang_msg("Host header and URI host mismatch",
@@ -461,26 +682,17 @@ frang_http_host_check(const TfwHttpReq *req, FrangAcc *ra)
 			return TFW_BLOCK;
 		}
 
-		hdrhost = tfw_pool_alloc(req->pool, field.len + 1);
-		if (unlikely(!hdrhost)) {
-			TFW_ERR("Can not allocate memory\n");
-			return TFW_BLOCK;
-		}
-		tfw_str_to_cstr(&field, hdrhost, field.len + 1);
-
 		/*
-		 * If URI has form "http://host:port/path",
-		 * then host header must be equal to host in URI.
+		 * If URI has form "http://host:port/path", then host
+		 * header must be equal to host in URI. Both strings are
+		 * chunked, so compare them in place - no flattening of
+		 * the header into a temporary buffer.
 		 */
-		if (!tfw_str_eq_cstr(&req->host, hdrhost, field.len,
-				     TFW_STR_EQ_CASEI))
-		{
+		if (tfw_stricmpspn(&req->host, &field, 0)) {
 			frang_msg("Host header is not equal to host in URL",
 				  &FRANG_ACC2CLI(ra)->addr, "\n");
 			ret = TFW_BLOCK;
 		}
-
-		tfw_pool_free(req->pool, hdrhost, field.len + 1);
 	}
 	else if (TFW_STR_EMPTY(&field)) {
 		/* If URI has form "/path", then host is not empty. */
@@ -611,7 +823,11 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, struct sk_buff *skb,
 
 	BUG_ON(!ra);
 
-	spin_lock(&ra->lock);
+	/*
+	 * The per-request FSM state below is owned by the connection's
+	 * CPU and the rate counters are lock-free now, so no per-client
+	 * lock is taken on the request path.
+	 */
 
 	/*
 	 * There's no need to check for header timeout if this is the very
@@ -639,7 +855,6 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, struct sk_buff *skb,
 		if (time_is_before_jiffies(start + delta)) {
 			frang_limmsg("client header timeout", jiffies - start,
 				     delta, &FRANG_ACC2CLI(ra)->addr);
-			spin_unlock(&ra->lock);
 			return TFW_BLOCK;
 		}
 	}
@@ -654,7 +869,6 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, struct sk_buff *skb,
 			frang_limmsg("HTTP header chunk count", req->chunk_cnt,
 				     frang_cfg.http_hchunk_cnt,
 				     &FRANG_ACC2CLI(ra)->addr);
-			spin_unlock(&ra->lock);
 			return TFW_BLOCK;
 		}
 	}
@@ -832,6 +1046,9 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, struct sk_buff *skb,
 
 	/* All limits are verified for current request. */
 	__FRANG_FSM_STATE(Frang_Req_Done) {
+		/* The aggregate vhost budget on top of per-client limits. */
+		if ((r = frang_vhost_limit(ra, req)))
+			__FRANG_FSM_EXIT();
 		tfw_gfsm_move(&conn->state, TFW_FRANG_FSM_DONE, skb, off);
 		__FRANG_FSM_EXIT();
 	}
@@ -839,8 +1056,6 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, struct sk_buff *skb,
 	}
 	__FRANG_FSM_FINISH();
 
-	spin_unlock(&ra->lock);
-
 	return r;
 }
 
@@ -851,7 +1066,33 @@ frang_http_req_handler(void *obj, struct sk_buff *skb, unsigned int off)
 	TfwConn *conn = (TfwConn *)obj;
 	FrangAcc *ra = conn->sk->sk_security;
 
+	if (!ra)
+		return TFW_PASS;
+
+	/*
+	 * A blocked TLS stack fingerprint identifies an abuser no
+	 * matter which IP it comes from this time.
+	 */
+	if (frang_cfg.tls_fp_block_n) {
+		unsigned int fp = ((TfwCliConn *)conn)->tls_fp;
+		size_t i;
+
+		for (i = 0; i < frang_cfg.tls_fp_block_n; ++i)
+			if (frang_cfg.tls_fp_block[i] == fp) {
+				frang_msg("blocked TLS fingerprint",
+					  &FRANG_ACC2CLI(ra)->addr,
+					  ": %#x\n", fp);
+				return TFW_BLOCK;
+			}
+	}
+
 	r = frang_http_req_process(ra, conn, skb, off);
+	/*
+	 * The blocking verdict still closes this connection, but the
+	 * client is flagged: its next connections are tarpitted.
+	 */
+	if (r == TFW_BLOCK && frang_cfg.tarpit)
+		frang_tarpit_mark(ra);
 	if (r == TFW_BLOCK && frang_cfg.ip_block)
 		tfw_filter_block_ip(&FRANG_ACC2CLI(ra)->addr.v6.sin6_addr);
 
@@ -862,6 +1103,7 @@ static TfwClassifier frang_class_ops = {
 	.name			= "frang",
 	.classify_conn_estab	= frang_conn_new,
 	.classify_conn_close	= frang_conn_close,
+	.classify_conn_recv	= frang_conn_recv,
 };
 
 static const TfwCfgEnum frang_http_methods_enum[] = {
@@ -966,6 +1208,102 @@ frang_free_ct_vals(TfwCfgSpec *cs)
 	frang_cfg.http_ct_vals = NULL;
 }
 
+static int
+frang_set_tls_fp_block(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i;
+	const char *val;
+	unsigned int *tbl;
+
+	if (!ce->val_n) {
+		TFW_ERR_NL("%s: At least one fingerprint is required\n",
+			   cs->name);
+		return -EINVAL;
+	}
+	tbl = krealloc(frang_cfg.tls_fp_block,
+		       (frang_cfg.tls_fp_block_n + ce->val_n) * sizeof(*tbl),
+		       GFP_KERNEL);
+	if (!tbl)
+		return -ENOMEM;
+	frang_cfg.tls_fp_block = tbl;
+
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val) {
+		unsigned int fp;
+
+		if (kstrtouint(val, 16, &fp)) {
+			TFW_ERR_NL("%s: invalid fingerprint: '%s'\n",
+				   cs->name, val);
+			return -EINVAL;
+		}
+		tbl[frang_cfg.tls_fp_block_n++] = fp;
+	}
+
+	return 0;
+}
+
+static void
+frang_cleanup_tls_fp_block(TfwCfgSpec *cs)
+{
+	kfree(frang_cfg.tls_fp_block);
+	frang_cfg.tls_fp_block = NULL;
+	frang_cfg.tls_fp_block_n = 0;
+}
+
+static int
+frang_set_whitelist(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i, r, plen;
+	const char *val;
+
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val) {
+		TfwAddr addr;
+		struct in6_addr a6;
+		char buf[64];
+		char *slash;
+
+		if (strlen(val) >= sizeof(buf)) {
+			TFW_ERR_NL("%s: invalid CIDR: '%s'\n", cs->name, val);
+			return -EINVAL;
+		}
+		strcpy(buf, val);
+		plen = -1;
+		if ((slash = strchr(buf, '/'))) {
+			*slash = 0;
+			if (kstrtoint(slash + 1, 10, &plen))
+				plen = -1;
+		}
+		if (tfw_addr_pton(&TFW_STR_FROM(buf), &addr)) {
+			TFW_ERR_NL("%s: invalid address: '%s'\n",
+				   cs->name, val);
+			return -EINVAL;
+		}
+		if (addr.family == AF_INET6) {
+			a6 = addr.v6.sin6_addr;
+			if (plen < 0)
+				plen = 128;
+		} else {
+			ipv6_addr_set_v4mapped(addr.v4.sin_addr.s_addr, &a6);
+			plen = (plen < 0 ? 32 : plen) + 96;
+		}
+		if (plen > 128) {
+			TFW_ERR_NL("%s: invalid prefix length in '%s'\n",
+				   cs->name, val);
+			return -EINVAL;
+		}
+		if ((r = frang_wl_add(&a6, plen)))
+			return r;
+	}
+
+	return 0;
+}
+
+static void
+frang_cleanup_whitelist(TfwCfgSpec *cs)
+{
+	__frang_wl_free(frang_wl_root);
+	frang_wl_root = NULL;
+}
+
 static int
 frang_start(void)
 {
@@ -983,6 +1321,35 @@ static TfwCfgSpec frang_cfg_section_specs[] = {
 		tfw_cfg_set_bool,
 		&frang_cfg.ip_block,
 	},
+	{
+		"tarpit", "0",
+		tfw_cfg_set_int,
+		&frang_cfg.tarpit,
+	},
+	{
+		"vhost_request_rate", "0",
+		tfw_cfg_set_int,
+		&frang_cfg.vhost_req_rate,
+	},
+	{
+		"vhost_request_burst", "0",
+		tfw_cfg_set_int,
+		&frang_cfg.vhost_req_burst,
+	},
+	{
+		"tls_fp_block", NULL,
+		frang_set_tls_fp_block,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = frang_cleanup_tls_fp_block,
+	},
+	{
+		"whitelist", NULL,
+		frang_set_whitelist,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = frang_cleanup_whitelist,
+	},
 	{
 		"request_rate", "0",
 		tfw_cfg_set_int,
@@ -1083,6 +1450,8 @@ static TfwCfgSpec frang_cfg_toplevel_specs[] = {
 
 static TfwCfgMod frang_cfg_mod = {
 	.name = "frang",
+	/* Limits are plain values read per request, safe to reload. */
+	.live_reconf = true,
 	.start = frang_start,
 	.specs = frang_cfg_toplevel_specs
 };
@@ -49,6 +49,15 @@ CliHashBucket cli_hash[CLI_HASH_SZ] = {
 
 static struct kmem_cache *cli_cache;
 
+/*
+ * Keep a clientless record for a while after its last connection is
+ * closed, so the classifier history (frang rates and friends) survives
+ * quick reconnects - an attacker doesn't reset the accounting by
+ * cycling connections. Expired records are collected lazily by the
+ * bucket walks in tfw_client_obtain().
+ */
+#define TFW_CLI_EXPIRE_TOUT	(60 * HZ)
+
 /**
  * Called when a client socket is closed.
  */
@@ -58,22 +67,29 @@ tfw_client_put(TfwClient *cli)
 	TFW_DBG2("put client %p, conn_users=%d\n",
 		 cli, atomic_read(&cli->conn_users));
 
-	if (!atomic_dec_and_test(&cli->conn_users))
-		return;
-
+	/*
+	 * The drop to zero must happen under the bucket lock: were the
+	 * decrement done first, the lazy collector in
+	 * tfw_client_obtain() could observe conn_users == 0 with the
+	 * stale @expires of the previous idle cycle and free the
+	 * record before we retake the lock.
+	 */
 	spin_lock(cli->hb_lock);
 
-	if (atomic_read(&cli->conn_users)) {
+	if (!atomic_dec_and_test(&cli->conn_users)) {
 		spin_unlock(cli->hb_lock);
 		return;
 	}
 	BUG_ON(!list_empty(&cli->conn_list));
 
-	hlist_del(&cli->hentry);
+	/*
+	 * Keep the record with its accounting history for a grace
+	 * period, see TFW_CLI_EXPIRE_TOUT.
+	 */
+	cli->expires = jiffies + TFW_CLI_EXPIRE_TOUT;
 
 	spin_unlock(cli->hb_lock);
 
-	kmem_cache_free(cli_cache, cli);
 	TFW_DEC_STAT_BH(clnt.online);
 }
 EXPORT_SYMBOL(tfw_client_put);
@@ -109,10 +125,19 @@ tfw_client_obtain(struct sock *sk, void (*init)(TfwClient *))
 
 	spin_lock(&hb->lock);
 
-	hlist_for_each_entry_safe(cli, tmp, &hb->list, hentry)
+	hlist_for_each_entry_safe(cli, tmp, &hb->list, hentry) {
+		/* Lazily collect the expired clientless records. */
+		if (!atomic_read(&cli->conn_users)
+		    && time_after(jiffies, cli->expires))
+		{
+			hlist_del(&cli->hentry);
+			kmem_cache_free(cli_cache, cli);
+			continue;
+		}
 		if (ipv6_addr_equal(&addr.v6.sin6_addr,
 				    &cli->addr.v6.sin6_addr))
 			goto found;
+	}
 
 	if (!(cli = kmem_cache_alloc(cli_cache, GFP_ATOMIC | __GFP_ZERO))) {
 		spin_unlock(&hb->lock);
@@ -125,12 +150,12 @@ tfw_client_obtain(struct sock *sk, void (*init)(TfwClient *))
 	if (init)
 		init(cli);
 
-	TFW_INC_STAT_BH(clnt.online);
 	TFW_DBG("new client: cli=%p\n", cli);
 	TFW_DBG_ADDR6("client address", &cli->addr.v6.sin6_addr);
 
 found:
-	atomic_inc(&cli->conn_users);
+	if (atomic_inc_return(&cli->conn_users) == 1)
+		TFW_INC_STAT_BH(clnt.online);
 
 	TFW_DBG2("client %p, conn_users=%d\n",
 		 cli, atomic_read(&cli->conn_users));
@@ -173,7 +198,7 @@ tfw_client_init(void)
 	int i;
 
 	cli_cache = kmem_cache_create("tfw_cli_cache", sizeof(TfwClient),
-				      0, 0, NULL);
+				      0, SLAB_HWCACHE_ALIGN, NULL);
 	if (!cli_cache)
 		return -ENOMEM;
 
@@ -29,7 +29,9 @@
  *
  * @hentry		- hash list entry for all clients hash;
  * @hb_lock		- pointer to hash bucket lock for quick item removal;
- * @conn_users		- connections reference counter.
+ * @conn_users		- connections reference counter;
+ * @expires		- when a clientless record may be collected, see
+ *			  the lazy expiry in tfw_client_obtain().
  * 			  The client is released, when the counter reaches zero:
  * 			  no connections to the server - no client for us :)
  * @class_prvt		- private client accounting data for classifier module.
@@ -41,6 +43,7 @@ typedef struct {
 	struct hlist_node	hentry;
 	spinlock_t		*hb_lock;
 	atomic_t		conn_users;
+	unsigned long		expires;
 	TfwClassifierPrvt	class_prvt;
 } TfwClient;
 
@@ -50,5 +53,7 @@ int tfw_client_for_each(int (*fn)(TfwClient *));
 void tfw_cli_conn_release(TfwCliConn *cli_conn);
 int tfw_cli_conn_send(TfwCliConn *cli_conn, TfwMsg *msg);
 int tfw_sock_check_listeners(void);
+int tfw_sock_clnt_drain(unsigned int tmo_s);
+extern atomic_t tfw_cli_drain_left;
 
 #endif /* __TFW_CLIENT_H__ */
@@ -20,7 +20,9 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include "classifier.h"
 #include "connection.h"
+#include "filter.h"
 #include "gfsm.h"
 #include "log.h"
 #include "sync_socket.h"
@@ -34,6 +36,11 @@ TfwConnHooks *conn_hooks[TFW_CONN_MAX_PROTOS];
 void
 tfw_connection_init(TfwConn *conn)
 {
+	/* The per-packet hot fields must not regrow past the header. */
+	BUILD_BUG_ON(offsetofend(TfwConn, refcnt) > TFW_CONN_HOT_SZ);
+	BUILD_BUG_ON(offsetofend(TfwCliConn, refcnt) > TFW_CONN_HOT_SZ);
+	BUILD_BUG_ON(offsetofend(TfwSrvConn, refcnt) > TFW_CONN_HOT_SZ);
+
 	memset(conn, 0, sizeof(*conn));
 	INIT_LIST_HEAD(&conn->list);
 }
@@ -99,11 +106,100 @@ tfw_connection_send(TfwConn *conn, TfwMsg *msg)
 	return TFW_CONN_HOOK_CALL(conn, conn_send, msg);
 }
 
+/**
+ * Ingest a PROXY protocol v2 header (the first bytes of a connection
+ * from a trusted load balancer): validate it, remember the original
+ * client address and strip the header from the stream by advancing the
+ * data offset. Split headers are not reassembled - proxies emit the
+ * header in one segment.
+ */
+static int
+tfw_pp2_ingest(TfwCliConn *conn, struct sk_buff *skb, unsigned int *off)
+{
+	static const unsigned char sig[12] = {
+		0x0d, 0x0a, 0x0d, 0x0a, 0x00, 0x0d,
+		0x0a, 0x51, 0x55, 0x49, 0x54, 0x0a
+	};
+	unsigned char buf[16 + 36];
+	const unsigned char *p;
+	unsigned int len, cmd, fam;
+
+	p = skb_header_pointer(skb, *off, 16, buf);
+	if (!p || memcmp(p, sig, sizeof(sig)) || (p[12] & 0xf0) != 0x20)
+		return TFW_BLOCK;
+	cmd = p[12] & 0x0f;
+	fam = p[13] >> 4;
+	len = (p[14] << 8) | p[15];
+
+	if (*off + 16 + len > skb->len) {
+		TFW_DBG("pp2: split PROXY header is not supported\n");
+		return TFW_BLOCK;
+	}
+
+	if (cmd == 0x1 && fam == 0x1 && len >= 12) {
+		p = skb_header_pointer(skb, *off + 16, 12, buf);
+		if (!p)
+			return TFW_BLOCK;
+		conn->pp_addr.v4.sin_family = AF_INET;
+		memcpy(&conn->pp_addr.v4.sin_addr, p, 4);
+		memcpy(&conn->pp_addr.v4.sin_port, p + 8, 2);
+	} else if (cmd == 0x1 && fam == 0x2 && len >= 36) {
+		p = skb_header_pointer(skb, *off + 16, 36, buf);
+		if (!p)
+			return TFW_BLOCK;
+		conn->pp_addr.v6.sin6_family = AF_INET6;
+		memcpy(&conn->pp_addr.v6.sin6_addr, p, 16);
+		memcpy(&conn->pp_addr.v6.sin6_port, p + 32, 2);
+	}
+	/* LOCAL commands and unknown families just strip the header. */
+
+	conn->pp_state = 2;
+	*off += 16 + len;
+
+	return TFW_PASS;
+}
+
 int
 tfw_connection_recv(void *cdata, struct sk_buff *skb, unsigned int off)
 {
 	TfwConn *conn = cdata;
 
+	if (unlikely((TFW_CONN_TYPE(conn) & Conn_Clnt)
+		     && ((TfwCliConn *)conn)->pp_state == 1))
+	{
+		if (tfw_pp2_ingest((TfwCliConn *)conn, skb, &off)
+		    == TFW_BLOCK)
+			return TFW_BLOCK;
+		if (off == skb->len) {
+			__kfree_skb(skb);
+			return TFW_PASS;
+		}
+	}
+
+	/*
+	 * Run the early drop program on client message heads before
+	 * any HTTP parsing, see tfw_filter_early_drop().
+	 */
+	if (!conn->msg && (TFW_CONN_TYPE(conn) & Conn_Clnt)
+	    && tfw_filter_early_drop(skb, off) == TFW_BLOCK)
+		return TFW_BLOCK;
+
+	/*
+	 * The classifier may take the data over entirely, e.g. a
+	 * tarpitted connection is answered from a template on the
+	 * classifier's own schedule, without any protocol processing.
+	 */
+	if (TFW_CONN_TYPE(conn) & Conn_Clnt) {
+		int r = tfw_classify_conn_recv(conn->sk, skb);
+
+		if (r == TFW_POSTPONE) {
+			__kfree_skb(skb);
+			return TFW_PASS;
+		}
+		if (r == TFW_BLOCK)
+			return TFW_BLOCK;
+	}
+
 	return tfw_gfsm_dispatch(&conn->state, conn, skb, off);
 }
 
@@ -75,30 +75,43 @@ enum {
  * These are the properties of a connection that are common to client
  * and server connections.
  *
+ * The fields are laid out hot part first: everything touched on each
+ * ingress packet (@proto, @state, @msg, @sk, @peer, @refcnt) lives in
+ * the first two cache lines, while the fields used once per
+ * connection lifetime (@list, @timer, @destructor) follow behind
+ * them. At hundreds of thousands of connections the extra lines
+ * touched per packet are real cache pressure, so keep the hot part
+ * within TFW_CONN_HOT_SZ - tfw_connection_init() has a build-time
+ * assert against silent regrowth.
+ *
  * @proto	- protocol handler. Base class, must be first;
  * @state	- connection processing state;
- * @list	- member in the list of connections with @peer;
- * @refcnt	- number of users of the connection structure instance;
- * @timer	- The keep-alive/retry timer for the connection;
  * @msg		- message that is currently being processed;
- * @peer	- TfwClient or TfwServer handler;
  * @sk		- an appropriate sock handler;
+ * @peer	- TfwClient or TfwServer handler;
+ * @refcnt	- number of users of the connection structure instance;
+ * @list	- member in the list of connections with @peer;
+ * @timer	- The keep-alive/retry timer for the connection;
  * @destructor	- called when a connection is destroyed;
  */
 #define TFW_CONN_COMMON					\
 	SsProto			proto;			\
 	TfwGState		state;			\
-	struct list_head	list;			\
-	atomic_t		refcnt;			\
-	struct timer_list	timer;			\
 	TfwMsg			*msg;			\
-	TfwPeer 		*peer;			\
 	struct sock		*sk;			\
+	TfwPeer 		*peer;			\
+	atomic_t		refcnt;			\
+	/* End of the per-packet hot part. */		\
+	struct list_head	list;			\
+	struct timer_list	timer;			\
 	void			(*destructor)(void *);
 
+/* The per-packet hot header must fit two cache lines. */
+#define TFW_CONN_HOT_SZ		(2 * L1_CACHE_BYTES)
+
 typedef struct {
 	TFW_CONN_COMMON;
-} TfwConn;
+} ____cacheline_aligned TfwConn;
 
 #define TFW_CONN_TYPE(c)	((c)->proto.type)
 
@@ -147,7 +160,21 @@ typedef struct {
 	struct list_head	seq_queue;
 	spinlock_t		seq_qlock;
 	spinlock_t		ret_qlock;
-} TfwCliConn;
+	/*
+	 * PROXY protocol v2 ingestion state: 0 - off, 1 - the header is
+	 * expected as the first bytes, 2 - consumed; @pp_addr keeps the
+	 * original client address reported by the proxy.
+	 */
+	unsigned char		pp_state;
+	TfwAddr			pp_addr;
+	/* Last activity time driving the lazy keep-alive timer. */
+	unsigned long		jlast;
+	/*
+	 * JA3-class fingerprint of the TLS ClientHello, 0 for plain
+	 * HTTP or until the handshake reaches the ClientHello.
+	 */
+	unsigned int		tls_fp;
+} ____cacheline_aligned TfwCliConn;
 
 /*
  * These are specific properties that are relevant to server connections.
@@ -158,8 +185,13 @@ typedef struct {
  * @fwd_qlock	- lock for accessing @fwd_queue and @nip_queue;
  * @flags	- atomic flags related to server connection's state;
  * @qsize	- current number of requests in server's @msg_queue;
+ * @sent_cnt	- number of requests written to the socket and still
+ *		  waiting for their responses (the pipeline depth);
  * @recns	- the number of reconnect attempts;
  * @msg_sent	- request that was sent last in a server connection;
+ * @pending_sk	- the socket of an in-progress connect attempt, referenced;
+ *		  claimed exclusively with xchg() by the connect deadline
+ *		  timer, the completion and the release paths;
  */
 typedef struct {
 	TFW_CONN_COMMON;
@@ -168,9 +200,11 @@ typedef struct {
 	spinlock_t		fwd_qlock;
 	unsigned long		flags;
 	unsigned int		qsize;
+	unsigned int		sent_cnt;
 	unsigned int		recns;
 	TfwMsg			*msg_sent;
-} TfwSrvConn;
+	struct sock		*pending_sk;
+} ____cacheline_aligned TfwSrvConn;
 
 #define TFW_CONN_DEATHCNT	(INT_MIN / 2)
 
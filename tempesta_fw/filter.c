@@ -57,6 +57,7 @@ typedef struct {
 static struct {
 	unsigned int	db_size;
 	const char	*db_path;
+	unsigned int	block_mark;
 } filter_cfg __read_mostly;
 
 static TDB *ip_filter_db;
@@ -158,8 +159,19 @@ tfw_ipv4_nf_hook(void *priv, struct sk_buff *skb,
 
 	ipv6_addr_set_v4mapped(ih->saddr, &addr6);
 
-	if (tfw_filter_check_ip(&addr6) == TFW_BLOCK)
+	if (tfw_filter_check_ip(&addr6) == TFW_BLOCK) {
+		/*
+		 * With a configured mark the verdict is delegated to
+		 * the administrator's netfilter rules: they can count
+		 * the packet, feed the address into an nftables set or
+		 * ipset and drop it there.
+		 */
+		if (filter_cfg.block_mark) {
+			skb->mark = filter_cfg.block_mark;
+			return NF_ACCEPT;
+		}
 		return NF_DROP;
+	}
 
 	/* Check classifiers for Layer 3. */
 	r = tfw_classify_ipv4(skb);
@@ -240,8 +252,14 @@ tfw_ipv6_nf_hook(void *priv, struct sk_buff *skb,
 	if (!ih)
 		return NF_DROP;
 
-	if (tfw_filter_check_ip(&ih->saddr) == TFW_BLOCK)
+	if (tfw_filter_check_ip(&ih->saddr) == TFW_BLOCK) {
+		/* See the IPv4 hook about the mark. */
+		if (filter_cfg.block_mark) {
+			skb->mark = filter_cfg.block_mark;
+			return NF_ACCEPT;
+		}
 		return NF_DROP;
+	}
 
 	/* Check classifiers for Layer 3. */
 	r = tfw_classify_ipv6(skb);
@@ -298,7 +316,116 @@ tfw_filter_stop(void)
 	tdb_close(ip_filter_db);
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Programmable early drop
+ * ------------------------------------------------------------------------
+ * A tiny match program in the spirit of classic BPF evaluated against
+ * the very first bytes of every message before the HTTP parser sees
+ * them. Each rule compares a byte string at a fixed offset; a matching
+ * rule drops the connection. The program is built at configuration
+ * time and read lock-free on the fast path.
+ */
+#define TFW_EDROP_RULES_MAX	16
+#define TFW_EDROP_BYTES_MAX	16
+
+typedef struct {
+	unsigned short	off;
+	unsigned short	len;
+	unsigned char	val[TFW_EDROP_BYTES_MAX];
+} TfwEdropRule;
+
+static TfwEdropRule edrop_prog[TFW_EDROP_RULES_MAX] __read_mostly;
+static unsigned int edrop_prog_sz __read_mostly;
+
+/**
+ * Run the early drop program on a message head.
+ * @return TFW_BLOCK if some rule matched.
+ */
+int
+tfw_filter_early_drop(struct sk_buff *skb, unsigned int off)
+{
+	unsigned int i;
+	unsigned char buf[TFW_EDROP_BYTES_MAX];
+
+	for (i = 0; i < edrop_prog_sz; ++i) {
+		const TfwEdropRule *r = &edrop_prog[i];
+		const void *p;
+
+		p = skb_header_pointer(skb, off + r->off, r->len, buf);
+		if (p && !memcmp(p, r->val, r->len)) {
+			TFW_DBG("filter: early drop rule %u matched\n", i);
+			return TFW_BLOCK;
+		}
+	}
+
+	return TFW_PASS;
+}
+
+/**
+ * Handle 'early_drop OFFSET HEXBYTES;' - drop messages carrying the
+ * byte string at the offset.
+ */
+static int
+tfw_cfgop_early_drop(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int off, i, len;
+	const char *hex;
+	TfwEdropRule *r;
+
+	if (ce->attr_n || ce->val_n != 2) {
+		TFW_ERR_NL("%s: Expected arguments: OFFSET HEXBYTES\n",
+			   cs->name);
+		return -EINVAL;
+	}
+	if (edrop_prog_sz == TFW_EDROP_RULES_MAX) {
+		TFW_ERR_NL("%s: Too many rules, max %d\n",
+			   cs->name, TFW_EDROP_RULES_MAX);
+		return -EINVAL;
+	}
+	if (tfw_cfg_parse_int(ce->vals[0], &off)
+	    || tfw_cfg_check_range(off, 0, USHRT_MAX))
+	{
+		TFW_ERR_NL("%s: Invalid offset '%s'\n", cs->name,
+			   (const char *)ce->vals[0]);
+		return -EINVAL;
+	}
+
+	hex = ce->vals[1];
+	len = strlen(hex);
+	if (!len || (len & 1) || len / 2 > TFW_EDROP_BYTES_MAX) {
+		TFW_ERR_NL("%s: Invalid hex string '%s'\n", cs->name, hex);
+		return -EINVAL;
+	}
+
+	r = &edrop_prog[edrop_prog_sz];
+	r->off = off;
+	r->len = len / 2;
+	for (i = 0; i < r->len; ++i)
+		if (hex2bin(&r->val[i], hex + 2 * i, 1)) {
+			TFW_ERR_NL("%s: Invalid hex string '%s'\n",
+				   cs->name, hex);
+			return -EINVAL;
+		}
+	++edrop_prog_sz;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_cleanup_early_drop(TfwCfgSpec *cs)
+{
+	edrop_prog_sz = 0;
+}
+
 static TfwCfgSpec tfw_filter_cfg_specs[] = {
+	{
+		"early_drop", NULL,
+		tfw_cfgop_early_drop,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cfgop_cleanup_early_drop,
+	},
 	{
 		"filter_tbl_size",
 		"16777216",
@@ -309,6 +436,12 @@ static TfwCfgSpec tfw_filter_cfg_specs[] = {
 			.range = { PAGE_SIZE, (1 << 30) },
 		}
 	},
+	{
+		"filter_block_mark",
+		"0",
+		tfw_cfg_set_int,
+		&filter_cfg.block_mark,
+	},
 	{
 		"filter_db",
 		"/opt/tempesta/db/filter.tdb",
@@ -24,5 +24,6 @@
 #include <linux/in6.h>
 
 void tfw_filter_block_ip(struct in6_addr *addr);
+int tfw_filter_early_drop(struct sk_buff *skb, unsigned int off);
 
 #endif /* __TFW_FILTER_H__ */
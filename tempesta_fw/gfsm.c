@@ -71,6 +71,13 @@ static TfwFsmHook fsm_hooks[TFW_FSM_NUM][GFSM_HOOK_N] __read_mostly;
  * For each FSM there are 16 priorities by 32 states, see gfsm.h.
  */
 static unsigned int fsm_hooks_bm[TFW_FSM_NUM][TFW_GFSM_WC_BMAP_SZ];
+/*
+ * Per-FSM union of the state bitmaps of all the priorities: the fast
+ * inlined part of tfw_gfsm_move() tests one bit here and skips the
+ * whole hook machinery for states nobody subscribed to, which is the
+ * common case on the parser hot path.
+ */
+unsigned int tfw_gfsm_hooks_any[TFW_FSM_NUM] __read_mostly;
 
 /**
  * The function must be called by first FSM processing @obj or
@@ -173,8 +180,8 @@ tfw_gfsm_dispatch(TfwGState *st, void *obj, struct sk_buff *skb,
  * has 32-bit states bitmap), so we use this fact to speedup the iteration.
  */
 int
-tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
-	      unsigned int off)
+__tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
+		unsigned int off)
 {
 	int r = TFW_PASS, p, fsm;
 	unsigned int *hooks = fsm_hooks_bm[FSM(st)];
@@ -221,7 +228,8 @@ tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
 
 	return r;
 }
-EXPORT_SYMBOL(tfw_gfsm_move);
+EXPORT_SYMBOL(__tfw_gfsm_move);
+EXPORT_SYMBOL(tfw_gfsm_hooks_any);
 
 /**
  * Register a hook which will be called with priority @prio when FSM @fsm_id
@@ -268,6 +276,7 @@ tfw_gfsm_register_hook(int fsm_id, int prio, int state,
 	fsm_hooks[fsm_id][shift].st0 = st0;
 	fsm_hooks[fsm_id][shift].fsm_id = hndl_fsm_id;
 	fsm_hooks_bm[fsm_id][prio] |= st_bit;
+	tfw_gfsm_hooks_any[fsm_id] |= st_bit;
 
 	return prio;
 }
@@ -287,6 +296,11 @@ tfw_gfsm_unregister_hook(int fsm_id, int prio, int state)
 
 	memset(&fsm_hooks[fsm_id][shift], 0, sizeof(TfwFsmHook));
 	fsm_hooks_bm[fsm_id][prio] &= ~(1 << st);
+
+	/* Recompute the union bitmap of the FSM. */
+	tfw_gfsm_hooks_any[fsm_id] = 0;
+	for (prio = 0; prio < TFW_GFSM_WC_BMAP_SZ; ++prio)
+		tfw_gfsm_hooks_any[fsm_id] |= fsm_hooks_bm[fsm_id][prio];
 }
 EXPORT_SYMBOL(tfw_gfsm_unregister_hook);
 
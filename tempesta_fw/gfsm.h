@@ -158,8 +158,34 @@ typedef int (*tfw_gfsm_handler_t)(void *obj, struct sk_buff *skb,
 void tfw_gfsm_state_init(TfwGState *st, void *obj, int st0);
 int tfw_gfsm_dispatch(TfwGState *st, void *obj, struct sk_buff *skb,
 		      unsigned int off);
-int tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
-		  unsigned int off);
+int __tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
+		    unsigned int off);
+
+extern unsigned int tfw_gfsm_hooks_any[TFW_FSM_NUM];
+
+/**
+ * Move the FSM to the new @state. The fast path is inlined: when no
+ * hook is registered for the state - the common case on the parser hot
+ * path - only the state is updated and the indirect-call machinery of
+ * __tfw_gfsm_move() is skipped altogether.
+ */
+static inline int
+tfw_gfsm_move(TfwGState *st, unsigned short state, struct sk_buff *skb,
+	      unsigned int off)
+{
+	unsigned short *curr = &st->states[(unsigned char)st->curr];
+	int fsm = (*curr >> TFW_GFSM_FSM_SHIFT) & TFW_GFSM_FSM_MASK;
+
+	if (likely(!(tfw_gfsm_hooks_any[fsm]
+		     & (1 << (state & TFW_GFSM_STATE_MASK)))))
+	{
+		/* Nobody is subscribed, just switch the state. */
+		*curr = (*curr & ~TFW_GFSM_STATE_MASK) | state;
+		return TFW_PASS;
+	}
+
+	return __tfw_gfsm_move(st, state, skb, off);
+}
 
 int tfw_gfsm_register_hook(int fsm_id, int prio, int state,
 			   unsigned short hndl_fsm_id, int st0);
@@ -0,0 +1,230 @@
+/**
+ *		Tempesta FW
+ *
+ * In-kernel gzip compression service.
+ *
+ * The kernel zlib provides only the raw deflate and zlib containers,
+ * so the gzip framing (RFC 1952) is done by hand: a fixed 10-byte
+ * header, a raw deflate stream and a CRC32/ISIZE trailer. Compression
+ * states are large (hundreds of KB), so one deflate workspace is
+ * preallocated per CPU and the service runs in softirq without
+ * allocations. Today the only consumer is transparent storage
+ * compression in the cache (cache_compress); no compressed byte is
+ * ever sent to a client.
+ *
+ * TODO #498: client-facing response compression. Needs
+ * Accept-Encoding parsing on the request path, a stored compressed
+ * variant selected through the Vary machinery, and rewriting
+ * Content-Length/Content-Encoding when the compressed variant is
+ * served - the cache response builder emits stored header bytes
+ * verbatim and has no header rewrite step today.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <asm/unaligned.h>
+#include <linux/crc32.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/zlib.h>
+
+#include "gzip.h"
+#include "log.h"
+
+/*
+ * Level 1 compresses typical HTML at 3-4x and is the only sane choice
+ * on the proxying fast path.
+ */
+#define TFW_GZIP_LEVEL		1
+
+static struct z_stream_s __percpu *gzip_streams;
+
+/* gzip CRC32 matches zlib's crc32(0, ...). */
+static inline u32
+tfw_gzip_crc(u32 crc, const unsigned char *data, size_t len)
+{
+	return crc32_le(crc ^ 0xffffffffU, data, len) ^ 0xffffffffU;
+}
+
+/**
+ * Compress possibly chunked @src into the plain buffer @dst of size
+ * @dst_len; on success @dst_len is updated to the produced gzip stream
+ * length. Must be called with bottom halves disabled since the per-CPU
+ * deflate state is reused.
+ *
+ * @return 0 on success, -E2BIG if @dst is too small for the compressed
+ * data (store such responses uncompressed) and -EINVAL on a deflate
+ * failure.
+ */
+int
+tfw_gzip_compress(const TfwStr *src, char *dst, size_t *dst_len)
+{
+	int r, flush;
+	u32 crc = 0;
+	unsigned long isize = 0;
+	const TfwStr *c, *end;
+	struct z_stream_s *zs;
+	static const unsigned char gz_hdr[10] = {
+		0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0x03 /* Unix */
+	};
+
+	if (*dst_len < TFW_GZIP_OVERHEAD)
+		return -E2BIG;
+
+	zs = this_cpu_ptr(gzip_streams);
+
+	r = zlib_deflateInit2(zs, TFW_GZIP_LEVEL, Z_DEFLATED, -MAX_WBITS,
+			      DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+	if (r != Z_OK) {
+		TFW_WARN("gzip: cannot initialize deflate stream, %d\n", r);
+		return -EINVAL;
+	}
+
+	memcpy(dst, gz_hdr, sizeof(gz_hdr));
+	zs->next_out = (unsigned char *)dst + sizeof(gz_hdr);
+	zs->avail_out = *dst_len - TFW_GZIP_OVERHEAD;
+
+	c = TFW_STR_PLAIN(src) ? src : (TfwStr *)src->ptr;
+	end = TFW_STR_PLAIN(src) ? src + 1 : c + TFW_STR_CHUNKN(src);
+	for ( ; c < end; ++c) {
+		zs->next_in = c->ptr;
+		zs->avail_in = c->len;
+		crc = tfw_gzip_crc(crc, c->ptr, c->len);
+		isize += c->len;
+
+		flush = c + 1 == end ? Z_FINISH : Z_NO_FLUSH;
+		r = zlib_deflate(zs, flush);
+		if (r == Z_STREAM_END)
+			break;
+		if (r != Z_OK || !zs->avail_out) {
+			zlib_deflateEnd(zs);
+			return zs->avail_out ? -EINVAL : -E2BIG;
+		}
+	}
+	if (r != Z_STREAM_END) {
+		zlib_deflateEnd(zs);
+		return -E2BIG;
+	}
+	zlib_deflateEnd(zs);
+
+	/* CRC32 and ISIZE, both little endian, RFC 1952 2.3. */
+	put_unaligned_le32(crc, zs->next_out);
+	put_unaligned_le32(isize & 0xffffffffU, zs->next_out + 4);
+
+	*dst_len = (char *)zs->next_out + 8 - dst;
+
+	return 0;
+}
+
+static struct z_stream_s __percpu *gunzip_streams;
+
+/**
+ * Decompress the plain gzip stream @src of @src_len bytes into @dst
+ * of size @dst_len; on success @dst_len is set to the inflated size.
+ * The counterpart of tfw_gzip_compress() for transparent storage
+ * compression: per-CPU inflate state, bottom halves must be disabled.
+ */
+int
+tfw_gzip_decompress(const char *src, size_t src_len, char *dst,
+		    size_t *dst_len)
+{
+	int r;
+	struct z_stream_s *zs;
+
+	/* Skip the fixed gzip header, stop before CRC32/ISIZE. */
+	if (src_len <= TFW_GZIP_OVERHEAD)
+		return -EINVAL;
+
+	zs = this_cpu_ptr(gunzip_streams);
+
+	r = zlib_inflateInit2(zs, -MAX_WBITS);
+	if (r != Z_OK) {
+		TFW_WARN("gzip: cannot initialize inflate stream, %d\n", r);
+		return -EINVAL;
+	}
+
+	zs->next_in = (unsigned char *)src + 10;
+	zs->avail_in = src_len - TFW_GZIP_OVERHEAD + 8;
+	zs->next_out = (unsigned char *)dst;
+	zs->avail_out = *dst_len;
+
+	r = zlib_inflate(zs, Z_FINISH);
+	zlib_inflateEnd(zs);
+	if (r != Z_STREAM_END)
+		return r == Z_BUF_ERROR ? -E2BIG : -EINVAL;
+
+	*dst_len = *dst_len - zs->avail_out;
+
+	return 0;
+}
+
+int
+tfw_gzip_init(void)
+{
+	int cpu;
+	size_t ws_sz = zlib_deflate_workspacesize(-MAX_WBITS, DEF_MEM_LEVEL);
+	size_t iws_sz = zlib_inflate_workspacesize();
+
+	gzip_streams = alloc_percpu(struct z_stream_s);
+	if (!gzip_streams)
+		return -ENOMEM;
+	gunzip_streams = alloc_percpu(struct z_stream_s);
+	if (!gunzip_streams) {
+		free_percpu(gzip_streams);
+		gzip_streams = NULL;
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu) {
+		struct z_stream_s *zs = per_cpu_ptr(gunzip_streams, cpu);
+
+		zs->workspace = vmalloc(iws_sz);
+		if (!zs->workspace) {
+			tfw_gzip_exit();
+			return -ENOMEM;
+		}
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct z_stream_s *zs = per_cpu_ptr(gzip_streams, cpu);
+
+		zs->workspace = vmalloc(ws_sz);
+		if (!zs->workspace) {
+			tfw_gzip_exit();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+void
+tfw_gzip_exit(void)
+{
+	int cpu;
+
+	if (gzip_streams) {
+		for_each_possible_cpu(cpu)
+			vfree(per_cpu_ptr(gzip_streams, cpu)->workspace);
+		free_percpu(gzip_streams);
+		gzip_streams = NULL;
+	}
+	if (gunzip_streams) {
+		for_each_possible_cpu(cpu)
+			vfree(per_cpu_ptr(gunzip_streams, cpu)->workspace);
+		free_percpu(gunzip_streams);
+		gunzip_streams = NULL;
+	}
+}
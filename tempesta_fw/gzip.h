@@ -0,0 +1,37 @@
+/**
+ *		Tempesta FW
+ *
+ * In-kernel gzip compression service.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_GZIP_H__
+#define __TFW_GZIP_H__
+
+#include "str.h"
+
+/* Fixed gzip container overhead: 10 bytes header + 8 bytes trailer. */
+#define TFW_GZIP_OVERHEAD	18
+
+int tfw_gzip_compress(const TfwStr *src, char *dst, size_t *dst_len);
+int tfw_gzip_decompress(const char *src, size_t src_len, char *dst,
+			size_t *dst_len);
+
+int tfw_gzip_init(void);
+void tfw_gzip_exit(void);
+
+#endif /* __TFW_GZIP_H__ */
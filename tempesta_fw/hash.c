@@ -38,32 +38,46 @@ tfw_hash_str(const TfwStr *str)
 		__tdb_hash_calc(&crc0, &crc1, str->ptr, str->len);
 	}
 	else {
+		/*
+		 * The byte's position in the whole string determines the
+		 * CRC lane: bytes 0-7 of every 16-byte block go to @crc0
+		 * and bytes 8-15 to @crc1, exactly as __tdb_hash_calc()
+		 * assigns them. CRC32 is byte-serial within a lane, so
+		 * stepping bytes at chunk edges and whole quadwords in
+		 * chunk interiors yields the same value for any chunking
+		 * of the same content - the cache key doesn't depend on
+		 * how skbs were fragmented.
+		 */
 		const TfwStr *c = (TfwStr *)str->ptr;
 		const TfwStr *end = c + TFW_STR_CHUNKN(str);
-		unsigned char *p, *e;
-		unsigned int tail = 0;
+		unsigned long pos = 0;
 
-		while (c < end) {
-			p = c->ptr;
-			e = p + c->len;
+		for ( ; c < end; ++c) {
+			const unsigned char *p = c->ptr;
+			const unsigned char *e = p + c->len;
 
-			if (tail) {
-				for ( ; tail < 8; ++p, ++tail) {
-					if (unlikely(p == e))
-						goto next_chunk;
-					CRCB(crc0, *p);
-				}
-				for ( ; tail < 16; ++p, ++tail) {
-					if (unlikely(p == e))
-						goto next_chunk;
+			/* Byte steps up to an 8-byte lane boundary. */
+			for ( ; p < e && (pos & 7); ++p, ++pos) {
+				if (pos & 8)
 					CRCB(crc1, *p);
-				}
+				else
+					CRCB(crc0, *p);
 			}
+			/* Whole quadwords, alternating the lanes. */
+			for ( ; p + 8 <= e; p += 8, pos += 8) {
+				unsigned long q = *(unsigned long *)p;
 
-			__tdb_hash_calc(&crc0, &crc1, p, e - p);
-			tail = c->len & 0xf;
-next_chunk:
-			++c;
+				if (pos & 8)
+					CRCQ(crc1, q);
+				else
+					CRCQ(crc0, q);
+			}
+			for ( ; p < e; ++p, ++pos) {
+				if (pos & 8)
+					CRCB(crc1, *p);
+				else
+					CRCB(crc0, *p);
+			}
 		}
 	}
 
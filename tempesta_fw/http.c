@@ -19,16 +19,21 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/string.h>
+#include <linux/timex.h>
 
+#include "alog.h"
 #include "cache.h"
 #include "classifier.h"
 #include "client.h"
 #include "hash.h"
 #include "http_msg.h"
+#include "http_norm.h"
 #include "http_sess.h"
 #include "log.h"
 #include "procfs.h"
 #include "server.h"
+#include "stress.h"
+#include "trace.h"
 #include "tls.h"
 #include "apm.h"
 
@@ -43,6 +48,7 @@ int ghprio; /* GFSM hook priority. */
 
 #define S_200			"HTTP/1.1 200 OK"
 #define S_302			"HTTP/1.1 302 Found"
+#define S_304			"HTTP/1.1 304 Not Modified"
 #define S_403			"HTTP/1.1 403 Forbidden"
 #define S_404			"HTTP/1.1 404 Not Found"
 #define S_500			"HTTP/1.1 500 Internal Server Error"
@@ -103,10 +109,30 @@ tfw_http_prep_date_from(char *buf, time_t date)
 #undef PRINT_2DIGIT
 }
 
-static inline void
+/*
+ * The date string changes once a second, while under load we generate
+ * it for every local response and adjusted message. Cache the formatted
+ * string per CPU and re-render it only when the second ticks over.
+ */
+typedef struct {
+	time_t	ts;
+	char	str[SLEN(S_V_DATE)];
+} TfwDateCache;
+
+static DEFINE_PER_CPU(TfwDateCache, date_cache);
+
+static void
 tfw_http_prep_date(char *buf)
 {
-	tfw_http_prep_date_from(buf, tfw_current_timestamp());
+	time_t now = tfw_current_timestamp();
+	TfwDateCache *dc = get_cpu_ptr(&date_cache);
+
+	if (unlikely(dc->ts != now)) {
+		tfw_http_prep_date_from(dc->str, now);
+		dc->ts = now;
+	}
+	memcpy(buf, dc->str, SLEN(S_V_DATE));
+	put_cpu_ptr(&date_cache);
 }
 
 unsigned long tfw_hash_str(const TfwStr *str);
@@ -227,80 +253,96 @@ tfw_http_send_resp(TfwHttpReq *req, TfwStr *msg, const TfwStr *date)
 	return 0;
 }
 
-#define S_200_PART_01	S_200 S_CRLF S_F_DATE
-#define S_200_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
- * HTTP 200 response: Success.
- */
-int
-tfw_http_send_200(TfwHttpReq *req)
+ * Local response templates. The string constants around the variable
+ * date field are precomputed at compile time, so a sender just fills
+ * the descriptor and writes the chunks; one generic function serves
+ * all the status codes.
+ */
+typedef struct {
+	const char	*part1;
+	size_t		len1;
+	const char	*part2;
+	size_t		len2;
+} TfwRespTmpl;
+
+#define RESP_TMPL(s)							\
+	{ s S_CRLF S_F_DATE, SLEN(s S_CRLF S_F_DATE),			\
+	  S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF,				\
+	  SLEN(S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF) }
+
+static const TfwRespTmpl tfw_resp_tmpls[] __read_mostly = {
+	[0] = RESP_TMPL(S_200),
+	[1] = RESP_TMPL(S_403),
+	[2] = RESP_TMPL(S_404),
+	[3] = RESP_TMPL(S_500),
+	[4] = RESP_TMPL(S_502),
+	[5] = RESP_TMPL(S_504),
+	[6] = RESP_TMPL(S_304),
+};
+
+static int
+tfw_http_send_tmpl(TfwHttpReq *req, int tmpl)
 {
+	const TfwRespTmpl *t = &tfw_resp_tmpls[tmpl];
 	TfwStr rh = {
 		.ptr = (TfwStr []){
-			{ .ptr = S_200_PART_01, .len = SLEN(S_200_PART_01) },
+			{ .ptr = (void *)t->part1, .len = t->len1 },
 			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_200_PART_02, .len = SLEN(S_200_PART_02) },
+			{ .ptr = (void *)t->part2, .len = t->len2 },
 			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
 		},
-		.len = SLEN(S_200_PART_01 S_V_DATE S_200_PART_02 S_CRLF),
+		.len = t->len1 + SLEN(S_V_DATE) + t->len2 + SLEN(S_CRLF),
 		.flags = 4 << TFW_STR_CN_SHIFT
 	};
 
+	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+}
+
+/*
+ * HTTP 200 response: Success.
+ */
+int
+tfw_http_send_200(TfwHttpReq *req)
+{
 	TFW_DBG("Send HTTP 200 response\n");
 
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+	return tfw_http_send_tmpl(req, 0);
+}
+
+/*
+ * HTTP 304 response: the client's cached copy is still valid.
+ */
+int
+tfw_http_send_304(TfwHttpReq *req)
+{
+	TFW_DBG("Send HTTP 304 response\n");
+
+	return tfw_http_send_tmpl(req, 6);
 }
 
-#define S_403_PART_01	S_403 S_CRLF S_F_DATE
-#define S_403_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
  * HTTP 403 response: Access is forbidden.
  */
 int
 tfw_http_send_403(TfwHttpReq *req, const char *reason)
 {
-	TfwStr rh = {
-		.ptr = (TfwStr []){
-			{ .ptr = S_403_PART_01, .len = SLEN(S_403_PART_01) },
-			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_403_PART_02, .len = SLEN(S_403_PART_02) },
-			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
-		},
-		.len = SLEN(S_403_PART_01 S_V_DATE S_403_PART_02 S_CRLF),
-		.flags = 4 << TFW_STR_CN_SHIFT
-	};
-
 	TFW_DBG("Send HTTP 403 response: %s\n", reason);
 
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+	return tfw_http_send_tmpl(req, 1);
 }
 
-#define S_404_PART_01	S_404 S_CRLF S_F_DATE
-#define S_404_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
  * HTTP 404 response: Tempesta is unable to find the requested data.
  */
 int
 tfw_http_send_404(TfwHttpReq *req, const char *reason)
 {
-	TfwStr rh = {
-		.ptr = (TfwStr []){
-			{ .ptr = S_404_PART_01, .len = SLEN(S_404_PART_01) },
-			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_404_PART_02, .len = SLEN(S_404_PART_02) },
-			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
-		},
-		.len = SLEN(S_404_PART_01 S_V_DATE S_404_PART_02 S_CRLF),
-		.flags = 4 << TFW_STR_CN_SHIFT
-	};
-
 	TFW_DBG("Send HTTP 404 response: %s\n", reason);
 
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+	return tfw_http_send_tmpl(req, 2);
 }
 
-#define S_500_PART_01	S_500 S_CRLF S_F_DATE
-#define S_500_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
  * HTTP 500 response: there was an internal error while forwarding
  * the request to a server.
@@ -308,24 +350,11 @@ tfw_http_send_404(TfwHttpReq *req, const char *reason)
 static int
 tfw_http_send_500(TfwHttpReq *req, const char *reason)
 {
-	TfwStr rh = {
-		.ptr = (TfwStr []){
-			{ .ptr = S_500_PART_01, .len = SLEN(S_500_PART_01) },
-			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_500_PART_02, .len = SLEN(S_500_PART_02) },
-			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
-		},
-		.len = SLEN(S_500_PART_01 S_V_DATE S_500_PART_02 S_CRLF),
-		.flags = 4 << TFW_STR_CN_SHIFT
-	};
-
 	TFW_DBG("Send HTTP 500 response: %s\n", reason);
 
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+	return tfw_http_send_tmpl(req, 3);
 }
 
-#define S_502_PART_01	S_502 S_CRLF S_F_DATE
-#define S_502_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
  * HTTP 502 response: Tempesta is unable to forward the request to
  * the designated server.
@@ -333,24 +362,11 @@ tfw_http_send_500(TfwHttpReq *req, const char *reason)
 int
 tfw_http_send_502(TfwHttpReq *req, const char *reason)
 {
-	TfwStr rh = {
-		.ptr = (TfwStr []){
-			{ .ptr = S_502_PART_01, .len = SLEN(S_502_PART_01) },
-			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_502_PART_02, .len = SLEN(S_502_PART_02) },
-			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
-		},
-		.len = SLEN(S_502_PART_01 S_V_DATE S_502_PART_02 S_CRLF),
-		.flags = 4 << TFW_STR_CN_SHIFT
-	};
+	TFW_DBG("Send HTTP 502 response: %s\n", reason);
 
-	TFW_DBG("Send HTTP 502 response: %s:\n", reason);
-
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+	return tfw_http_send_tmpl(req, 4);
 }
 
-#define S_504_PART_01	S_504 S_CRLF S_F_DATE
-#define S_504_PART_02	S_CRLF S_F_CONTENT_LENGTH "0" S_CRLF
 /*
  * HTTP 504 response: did not receive a timely response from
  * the designated server.
@@ -358,20 +374,69 @@ tfw_http_send_502(TfwHttpReq *req, const char *reason)
 int
 tfw_http_send_504(TfwHttpReq *req, const char *reason)
 {
-	TfwStr rh = {
-		.ptr = (TfwStr []){
-			{ .ptr = S_504_PART_01, .len = SLEN(S_504_PART_01) },
-			{ .ptr = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
-			{ .ptr = S_504_PART_02, .len = SLEN(S_504_PART_02) },
-			{ .ptr = S_CRLF, .len = SLEN(S_CRLF) },
-		},
-		.len = SLEN(S_504_PART_01 S_V_DATE S_504_PART_02 S_CRLF),
-		.flags = 4 << TFW_STR_CN_SHIFT
-	};
+	TFW_DBG("Send HTTP 504 response: %s\n", reason);
 
-	TFW_DBG("Send HTTP 504 response: %s:\n", reason);
+	return tfw_http_send_tmpl(req, 5);
+}
 
-	return tfw_http_send_resp(req, &rh, __TFW_STR_CH(&rh, 1));
+unsigned int tfw_http_latency_trace_ms;
+
+#define S_100_FULL	"HTTP/1.1 100 Continue" S_CRLFCRLF
+
+/**
+ * Send an interim 100 Continue to the client: interim responses
+ * precede the final response of the same request, so they bypass the
+ * response sequencing machinery by design. The bytes still must go
+ * through the connection's send hook - on a TLS listener a raw
+ * socket write would inject plaintext into the encrypted stream.
+ */
+static void
+tfw_http_send_100_continue(TfwHttpReq *req)
+{
+	struct sk_buff *skb;
+	TfwMsg msg = {};
+
+	skb = alloc_skb(MAX_TCP_HEADER + SLEN(S_100_FULL), GFP_ATOMIC);
+	if (unlikely(!skb))
+		return;
+	skb_reserve(skb, MAX_TCP_HEADER);
+	memcpy(skb_put(skb, SLEN(S_100_FULL)), S_100_FULL, SLEN(S_100_FULL));
+
+	ss_skb_queue_head_init(&msg.skb_list);
+	ss_skb_queue_tail(&msg.skb_list, skb);
+	msg.len = SLEN(S_100_FULL);
+	if (tfw_connection_send(req->conn, &msg))
+		TFW_DBG("Cannot send 100 Continue\n");
+}
+
+/**
+ * Whether the client awaits a go-ahead before sending the body,
+ * RFC 7231 5.1.1. The Expect header is raw, so look it up and check
+ * the token once the headers are complete.
+ */
+static bool
+tfw_http_req_need_100(TfwHttpReq *req)
+{
+	char buf[32];
+	int n;
+	unsigned int hid;
+	TfwStr val = {};
+	DEFINE_TFW_STR(h_exp, "Expect:");
+
+	if ((req->flags & TFW_HTTP_100_SENT) || !req->crlf.ptr
+	    || req->body.ptr)
+		return false;
+
+	hid = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &h_exp);
+	if (hid >= req->h_tbl->off)
+		return false;
+	tfw_http_msg_clnthdr_val(&req->h_tbl->tbl[hid], hid, &val);
+	if (!val.len || val.len >= sizeof(buf))
+		return false;
+	n = tfw_str_to_cstr(&val, buf, sizeof(buf));
+
+	return n == SLEN("100-continue")
+	       && !strncasecmp(buf, "100-continue", n);
 }
 
 /*
@@ -391,6 +456,31 @@ tfw_http_send_504(TfwHttpReq *req, const char *reason)
 static inline void
 tfw_http_req_init_ss_flags(TfwSrvConn *srv_conn, TfwHttpReq *req)
 {
+	TfwSrvGroup *sg = ((TfwServer *)srv_conn->peer)->sg;
+
+	/*
+	 * The skbs are kept (and thus copied in ss_send()) only when
+	 * the request may be re-forwarded later. Requests which can't
+	 * be retried - non-idempotent ones unless retries are enabled,
+	 * and requests on their last allowed attempt - donate their
+	 * original skbs with the body fragments straight to the server
+	 * socket, skipping the per-request copy.
+	 */
+	if (((req->flags & TFW_HTTP_NON_IDEMP)
+	     && !(sg->flags & TFW_SRV_RETRY_NIP))
+	    || req->retries >= sg->max_refwd)
+		return;
+	/*
+	 * Streamed bodies: uploads donate their skbs to the server
+	 * socket instead of being copied for a possible re-forward.
+	 * Such a request can't be retried - on a connection failure it
+	 * is evicted with an error - which is the documented trade of
+	 * the option: large uploads cost one copy less and their
+	 * buffers are owned by TCP, not duplicated in Tempesta.
+	 */
+	if ((sg->flags & TFW_SRV_STREAM_BODIES) && req->body.ptr)
+		return;
+
 	((TfwMsg *)req)->ss_flags |= SS_F_KEEP_SKB;
 }
 
@@ -541,6 +631,10 @@ tfw_http_req_delist(TfwSrvConn *srv_conn, TfwHttpReq *req)
 	tfw_http_req_nip_delist(srv_conn, req);
 	list_del_init(&req->fwd_list);
 	srv_conn->qsize--;
+	if (req->flags & TFW_HTTP_REQ_SENT) {
+		req->flags &= ~TFW_HTTP_REQ_SENT;
+		srv_conn->sent_cnt--;
+	}
 }
 
 /*
@@ -571,6 +665,9 @@ tfw_http_req_error(TfwSrvConn *srv_conn, TfwHttpReq *req,
  * an error response to a client. The response will be attached to
  * the request and then sent to the client in proper seq order.
  */
+static void tfw_http_req_fwd_sched(TfwHttpReq *req);
+static void tfw_http_conc_release(TfwHttpReq *req);
+
 static void
 tfw_http_req_zap_error(struct list_head *equeue)
 {
@@ -581,6 +678,9 @@ tfw_http_req_zap_error(struct list_head *equeue)
 
 	list_for_each_entry_safe(req, tmp, equeue, fwd_list) {
 		list_del_init(&req->fwd_list);
+		tfw_http_conc_release(req);
+		/* A dying coalescing leader must unpark its waiters. */
+		tfw_cache_miss_abort(req);
 		switch(req->httperr.status) {
 		case 404:
 			tfw_http_send_404(req, req->httperr.reason);
@@ -685,6 +785,12 @@ tfw_http_req_fwd_single(TfwSrvConn *srv_conn, TfwServer *srv,
 	if (!tfw_http_req_fwd_send(srv_conn, srv, req, equeue))
 		return false;
 	srv_conn->msg_sent = (TfwMsg *)req;
+	trace_tfw_req_fwd(req, srv_conn);
+	tfw_sg_account_req(srv->sg);
+	if (!(req->flags & TFW_HTTP_REQ_SENT)) {
+		req->flags |= TFW_HTTP_REQ_SENT;
+		srv_conn->sent_cnt++;
+	}
 	TFW_INC_STAT_BH(clnt.msgs_forwarded);
 	return true;
 }
@@ -1535,8 +1641,21 @@ tfw_http_add_x_forwarded_for(TfwHttpMsg *hm)
 {
 	int r;
 	char *p, *buf = *this_cpu_ptr(&g_buf);
+	TfwCliConn *cli_conn = (TfwCliConn *)hm->conn;
 
-	p = ss_skb_fmt_src_addr(hm->msg.skb_list.first, buf);
+	/* Prefer the original address from the PROXY protocol header. */
+	if (cli_conn && (TFW_CONN_TYPE((TfwConn *)cli_conn) & Conn_Clnt)
+	    && cli_conn->pp_state == 2)
+	{
+		if (cli_conn->pp_addr.sa.sa_family == AF_INET6)
+			p = tfw_addr_fmt_v6(&cli_conn->pp_addr.v6.sin6_addr,
+					    0, buf);
+		else
+			p = tfw_addr_fmt_v4(cli_conn->pp_addr.v4.sin_addr
+							.s_addr, 0, buf);
+	} else {
+		p = ss_skb_fmt_src_addr(hm->msg.skb_list.first, buf);
+	}
 
 	r = tfw_http_msg_hdr_xfrm(hm, "X-Forwarded-For",
 				  sizeof("X-Forwarded-For") - 1, buf, p - buf,
@@ -1550,6 +1669,93 @@ tfw_http_add_x_forwarded_for(TfwHttpMsg *hm)
 	return r;
 }
 
+/*
+ * Run the precompiled header transformation program of the direction,
+ * see the req_hdr_set/resp_hdr_set family of directives.
+ */
+static int
+tfw_http_hdr_xfrm_run(TfwHttpMsg *hm, bool resp)
+{
+	size_t i, n;
+	int n_add = 0, r;
+	TfwHdrXfrm *x = tfw_vhost_hdr_xfrm(resp, &n);
+#define TFW_XFRM_ADD_MAX	8
+	TfwStr add_strs[TFW_XFRM_ADD_MAX];
+	TfwStr *adds[TFW_XFRM_ADD_MAX];
+	TfwStr add_chunks[TFW_XFRM_ADD_MAX][3];
+	unsigned int hids[TFW_XFRM_ADD_MAX];
+	bool added[64] = { false };
+
+	/*
+	 * Batch the additions of missing headers: the room before the
+	 * CRLF is reserved once for all of them and each line is a
+	 * memcpy into its slice, one skb reshape per message instead
+	 * of one per configured header. Replacements and deletions of
+	 * present headers still go through the generic transform.
+	 */
+	for (i = 0; i < n && n_add < TFW_XFRM_ADD_MAX; ++i) {
+		/*
+		 * The lookup compares up to the ':' stop character,
+		 * so the probed name must include it.
+		 */
+		TfwStr name_chunks[2] = {
+			{ .ptr = x[i].name, .len = x[i].n_len },
+			{ .ptr = ":", .len = 1 },
+		};
+		TfwStr name = {
+			.ptr = name_chunks,
+			.len = x[i].n_len + 1,
+			.flags = 2 << TFW_STR_CN_SHIFT,
+		};
+		TfwHttpHdrTbl *ht = hm->h_tbl;
+		unsigned int hid;
+
+		if (!x[i].val || i >= ARRAY_SIZE(added))
+			continue;
+		if (tfw_http_msg_hdr_lookup(hm, &name) < ht->off)
+			continue;
+		hid = ht->off + n_add;
+		while (hid >= ht->size) {
+			if (tfw_http_msg_grow_hdr_tbl(hm))
+				return -ENOMEM;
+			ht = hm->h_tbl;
+		}
+		add_chunks[n_add][0] =
+			(TfwStr){ .ptr = x[i].name, .len = x[i].n_len };
+		add_chunks[n_add][1] = (TfwStr){ .ptr = ": ", .len = 2 };
+		add_chunks[n_add][2] =
+			(TfwStr){ .ptr = x[i].val, .len = x[i].v_len };
+		add_strs[n_add] = (TfwStr){
+			.ptr = add_chunks[n_add],
+			.len = x[i].n_len + 2 + x[i].v_len,
+			.eolen = 2,
+			.flags = 3 << TFW_STR_CN_SHIFT,
+		};
+		adds[n_add] = &add_strs[n_add];
+		hids[n_add] = hid;
+		added[i] = true;
+		++n_add;
+	}
+	if (n_add) {
+		if ((r = tfw_http_msg_hdr_add_multi(hm, adds, hids, n_add)))
+			return r;
+		hm->h_tbl->off += n_add;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (i < ARRAY_SIZE(added) && added[i])
+			continue;
+		r = tfw_http_msg_hdr_xfrm(hm, x[i].name, x[i].n_len,
+					  x[i].val, x[i].v_len,
+					  TFW_HTTP_HDR_RAW, 0);
+		if (r < 0)
+			return r;
+	}
+#undef TFW_XFRM_ADD_MAX
+
+	return 0;
+}
+
 /**
  * Adjust the request before proxying it to real server.
  */
@@ -1571,7 +1777,11 @@ tfw_http_adjust_req(TfwHttpReq *req)
 	if (r < 0)
 		return r;
 
-	return tfw_http_set_hdr_connection(hm, TFW_HTTP_CONN_KA);
+	r = tfw_http_set_hdr_connection(hm, TFW_HTTP_CONN_KA);
+	if (r < 0)
+		return r;
+
+	return tfw_http_hdr_xfrm_run(hm, false);
 }
 
 /**
@@ -1587,10 +1797,6 @@ tfw_http_adjust_resp(TfwHttpResp *resp, TfwHttpReq *req)
 	if (r < 0)
 		return r;
 
-	r = tfw_http_msg_del_hbh_hdrs(hm);
-	if (r < 0)
-		return r;
-
 	r = tfw_http_set_hdr_keep_alive(hm, conn_flg);
 	if (r < 0)
 		return r;
@@ -1599,10 +1805,6 @@ tfw_http_adjust_resp(TfwHttpResp *resp, TfwHttpReq *req)
 	if (r < 0)
 		return r;
 
-	r = tfw_http_add_hdr_via(hm);
-	if (r < 0)
-		return r;
-
 	if (resp->flags & TFW_HTTP_RESP_STALE) {
 #define S_WARN_110 "Warning: 110 - Response is stale"
 		/* TODO: ajust for #215 */
@@ -1617,14 +1819,54 @@ tfw_http_adjust_resp(TfwHttpResp *resp, TfwHttpReq *req)
 #undef S_WARN_110
 	}
 
+	return 0;
+}
+
+/**
+ * The invariant part of the response adjustments: everything that
+ * doesn't depend on the client connection the response goes to. It's
+ * applied once before the response is stored in the cache, so the
+ * stored headers are final and cache hits run only the cheap
+ * per-client part in tfw_http_adjust_resp().
+ */
+static int
+tfw_http_adjust_resp_stored(TfwHttpResp *resp, TfwHttpReq *req)
+{
+	int r;
+	TfwHttpMsg *hm = (TfwHttpMsg *)resp;
+
+	r = tfw_http_msg_del_hbh_hdrs(hm);
+	if (r < 0)
+		return r;
+
+	/*
+	 * Chunked trailers are promoted to ordinary headers by the
+	 * parser (the trailer part is processed through the header
+	 * states), so the Trailer announcement must not survive into
+	 * the stored or forwarded message - the fields it names now
+	 * travel in the header section.
+	 */
+	r = tfw_http_msg_hdr_xfrm(hm, "Trailer", SLEN("Trailer"),
+				  NULL, 0, TFW_HTTP_HDR_RAW, 0);
+	if (r < 0)
+		return r;
+
+	r = tfw_http_add_hdr_via(hm);
+	if (r < 0)
+		return r;
+
 	if (!(resp->flags & TFW_HTTP_HAS_HDR_DATE)) {
 		r =  tfw_http_set_hdr_date(hm);
 		if (r < 0)
 			return r;
 	}
 
-	return TFW_HTTP_MSG_HDR_XFRM(hm, "Server", TFW_NAME "/" TFW_VERSION,
-				     TFW_HTTP_HDR_SERVER, 0);
+	r = TFW_HTTP_MSG_HDR_XFRM(hm, "Server", TFW_NAME "/" TFW_VERSION,
+				  TFW_HTTP_HDR_SERVER, 0);
+	if (r < 0)
+		return r;
+
+	return tfw_http_hdr_xfrm_run(hm, true);
 }
 
 /*
@@ -1641,6 +1883,36 @@ __tfw_http_resp_fwd(TfwCliConn *cli_conn, struct list_head *ret_queue)
 
 	list_for_each_entry_safe(req, tmp, ret_queue, msg.seq_list) {
 		BUG_ON(!req->resp);
+		trace_tfw_resp_fwd(req, req->resp);
+		/*
+		 * The live latency tracing mode: slow requests log
+		 * their per-stage breakdown asynchronously, so tail
+		 * latencies can be attributed to queueing, the backend
+		 * or response delivery without attaching perf.
+		 */
+		if (unlikely(tfw_http_latency_trace_ms)
+		    && jiffies - req->jrxtstamp
+		       > msecs_to_jiffies(tfw_http_latency_trace_ms))
+		{
+			TfwHttpResp *__r = (TfwHttpResp *)req->resp;
+			unsigned int queue = 0, backend = 0;
+
+			/* Cache hits and local replies never left. */
+			if (req->jtxtstamp) {
+				queue = jiffies_to_msecs(req->jtxtstamp
+							 - req->jrxtstamp);
+				backend = jiffies_to_msecs(__r->jrxtstamp
+							   - req->jtxtstamp);
+			}
+			TFW_WARN_ASYNC("slow req=%p hash=%#lx: queue=%ums"
+				       " backend=%ums total=%ums\n",
+				       req, req->hash, queue, backend,
+				       jiffies_to_msecs(jiffies
+							- req->jrxtstamp));
+		}
+		tfw_alog_record(req, (TfwHttpResp *)req->resp);
+		/* Egress bytes of the tenant's response. */
+		tfw_vhost_acct(req->vhost, 0, 0, req->resp->msg.len);
 		tfw_http_resp_init_ss_flags((TfwHttpResp *)req->resp, req);
 		if (tfw_cli_conn_send(cli_conn, (TfwMsg *)req->resp)) {
 			ss_close_sync(cli_conn->sk, true);
@@ -1768,6 +2040,17 @@ tfw_http_resp_fwd(TfwHttpReq *req, TfwHttpResp *resp)
 static void
 tfw_http_req_cache_service(TfwHttpReq *req, TfwHttpResp *resp)
 {
+	/*
+	 * Hot tier responses carry final bytes and no header table;
+	 * they are served to keep-alive clients only, so the
+	 * per-client adjustments don't apply.
+	 */
+	if (resp->flags & TFW_HTTP_RESP_PREBUILT) {
+		tfw_http_resp_fwd(req, resp);
+		TFW_INC_STAT_BH(clnt.msgs_fromcache);
+		return;
+	}
+
 	if (tfw_http_adjust_resp(resp, req)) {
 		tfw_http_send_500(req, "response dropped: processing error");
 		tfw_http_conn_msg_free((TfwHttpMsg *)resp);
@@ -1802,6 +2085,23 @@ tfw_http_req_cache_cb(TfwHttpReq *req, TfwHttpResp *resp)
 	 * first. However, req->sess still may be NULL if sticky cookies are
 	 * not enabled.
 	 */
+	tfw_stress_account_sys();
+	trace_tfw_req_recv(req, req->method, req->hash);
+	tfw_apm_hh_update(req->hash ? : tfw_http_req_key_calc(req));
+
+	/*
+	 * Protocol upgrades (WebSocket and friends) and CONNECT turn
+	 * the connection into an opaque byte tunnel. Backend
+	 * connections are shared and pipelined here, so an upgraded
+	 * stream would corrupt the whole pipeline of its server
+	 * connection. Refuse cleanly until dedicated tunnel
+	 * connections are implemented.
+	 */
+	if (unlikely(req->flags & TFW_HTTP_CONN_UPGRADE)) {
+		tfw_http_send_502(req, "protocol upgrade is not supported");
+		return;
+	}
+
 	r = tfw_http_sess_obtain(req);
 	if (r < 0)
 		goto send_500;
@@ -1813,17 +2113,36 @@ tfw_http_req_cache_cb(TfwHttpReq *req, TfwHttpResp *resp)
 		return;
 	}
 
-	/*
-	 * Dispatch request to an appropriate server. Schedulers should
-	 * make a decision based on an unmodified request, so this must
-	 * be done before any request mangling.
-	 *
-	 * The code below is usually called on a remote NUMA node. That's
-	 * not good, but TDB lookup must be run on the node before it is
-	 * executed, to avoid unnecessary work in SoftIRQ and to speed up
-	 * the cache operation. At the same time, cache hits are expected
-	 * to prevail over cache misses, so this is not a frequent path.
-	 */
+	tfw_http_req_fwd_sched(req);
+}
+
+/**
+ * Dispatch the request to an appropriate server, respecting the
+ * vhost's concurrency limit: above the limit the request is parked on
+ * the vhost queue and dispatched when an in-flight request finishes,
+ * see tfw_http_conc_release().
+ *
+ * Schedulers should make a decision based on an unmodified request, so
+ * the dispatch must happen before any request mangling.
+ */
+static void
+tfw_http_req_fwd_sched(TfwHttpReq *req)
+{
+	TfwSrvConn *srv_conn;
+	TfwVhost *vhost = req->vhost ? : tfw_vhost_get_default();
+	LIST_HEAD(equeue);
+
+	if (vhost->conc_limit && !(req->flags & TFW_HTTP_CONC_CNTD)) {
+		if (atomic_inc_return(&vhost->conc_cur) > vhost->conc_limit) {
+			atomic_dec(&vhost->conc_cur);
+			spin_lock(&vhost->conc_qlock);
+			list_add_tail(&req->fwd_list, &vhost->conc_queue);
+			spin_unlock(&vhost->conc_qlock);
+			return;
+		}
+		req->flags |= TFW_HTTP_CONC_CNTD;
+	}
+
 	if (!(srv_conn = tfw_sched_get_srv_conn((TfwMsg *)req))) {
 		TFW_WARN("Unable to find a back end server\n");
 		goto send_502;
@@ -1849,6 +2168,35 @@ conn_put:
 	tfw_srv_conn_put(srv_conn);
 }
 
+/**
+ * An in-flight request of @req's vhost finished: release its
+ * concurrency slot and dispatch one queued request if any.
+ */
+static void
+tfw_http_conc_release(TfwHttpReq *req)
+{
+	TfwVhost *vhost;
+	TfwHttpReq *next = NULL;
+
+	if (!(req->flags & TFW_HTTP_CONC_CNTD))
+		return;
+	req->flags &= ~TFW_HTTP_CONC_CNTD;
+
+	vhost = req->vhost ? : tfw_vhost_get_default();
+	atomic_dec(&vhost->conc_cur);
+
+	spin_lock(&vhost->conc_qlock);
+	if (!list_empty(&vhost->conc_queue)) {
+		next = list_first_entry(&vhost->conc_queue, TfwHttpReq,
+					fwd_list);
+		list_del_init(&next->fwd_list);
+	}
+	spin_unlock(&vhost->conc_qlock);
+
+	if (next)
+		tfw_http_req_fwd_sched(next);
+}
+
 static void
 tfw_http_req_mark_nip(TfwHttpReq *req)
 {
@@ -1915,7 +2263,14 @@ tfw_http_req_add_seq_queue(TfwHttpReq *req)
 static int
 tfw_http_req_set_context(TfwHttpReq *req)
 {
-	req->vhost = tfw_vhost_match(&req->uri_path);
+	/*
+	 * Normalize the URI first, so the matching rules, the cache
+	 * key and frang all see the canonical form.
+	 */
+	if (tfw_http_uri_normalize(req))
+		return -ENOMEM;
+
+	req->vhost = tfw_vhost_match(&req->host);
 	req->location = tfw_location_match(req->vhost, &req->uri_path);
 
 	return !req->vhost;
@@ -1939,8 +2294,21 @@ tfw_http_req_process(TfwConn *conn, struct sk_buff *skb, unsigned int off)
 		 skb_len - off, conn, conn->msg);
 
 	/*
-	 * Process pipelined requests in a loop
-	 * until all data in the SKB is processed.
+	 * Process pipelined requests in a loop until all data in the
+	 * SKB is processed.
+	 *
+	 * Dispatch of pipelined requests is concurrent: each parsed
+	 * request is scheduled and forwarded to its backend right
+	 * here, without waiting for responses to its predecessors -
+	 * sibling requests may go to different servers through the
+	 * sched_http rules, and writes to the same server connection
+	 * pipeline up to server_pipeline_depth. HTTP/1.1 response
+	 * ordering is restored on the way back: responses pair with
+	 * their requests on the connection's seq_queue and an
+	 * out-of-order response waits there until its predecessors
+	 * are sent, see tfw_http_resp_fwd(). The only intentional
+	 * hold is a non-idempotent request in flight, which fences
+	 * the requests behind it on the same server connection.
 	 */
 	while (data_off < skb_len) {
 		int req_conn_close;
@@ -1987,6 +2355,16 @@ tfw_http_req_process(TfwConn *conn, struct sk_buff *skb, unsigned int off)
 				TFW_INC_STAT_BH(clnt.msgs_filtout);
 				return TFW_BLOCK;
 			}
+			/*
+			 * Deferred body admission: the client waits for
+			 * a go-ahead before sending the body, so answer
+			 * 100 Continue as soon as the headers are in
+			 * instead of leaving the client to its timeout.
+			 */
+			if (unlikely(tfw_http_req_need_100(req))) {
+				tfw_http_send_100_continue(req);
+				req->flags |= TFW_HTTP_100_SENT;
+			}
 			/*
 			 * TFW_POSTPONE status means that parsing succeeded
 			 * but more data is needed to complete it. Lower layers
@@ -2177,10 +2555,28 @@ tfw_http_resp_cache_cb(TfwHttpReq *req, TfwHttpResp *resp)
 	 * a fast and simple algorithm for that? Keep in mind, that the
 	 * value of RTT has an upper boundary in the APM.
 	 */
-	if (resp->conn)
-		tfw_apm_update(((TfwServer *)resp->conn->peer)->apm,
-				resp->jrxtstamp,
-				resp->jrxtstamp - req->jtxtstamp);
+	if (resp->conn) {
+		unsigned long rtt = resp->jrxtstamp - req->jtxtstamp;
+		TfwServer *srv = (TfwServer *)resp->conn->peer;
+		TfwVhost *vhost = req->vhost ? : tfw_vhost_get_default();
+
+		trace_tfw_resp_recv(req, resp->status,
+				    jiffies_to_msecs(rtt));
+
+		/* Passive health checks: 5xx is a server failure. */
+		if (resp->status >= 500)
+			tfw_srv_health_fail(srv);
+		else
+			tfw_srv_health_ok(srv);
+
+		tfw_apm_update(srv->apm, resp->jrxtstamp, rtt);
+		/* The same sample aggregated per vhost and location. */
+		if (vhost->apm)
+			tfw_apm_update(vhost->apm, resp->jrxtstamp, rtt);
+		if (req->location && req->location->apm)
+			tfw_apm_update(req->location->apm, resp->jrxtstamp,
+				       rtt);
+	}
 	tfw_http_resp_fwd(req, resp);
 }
 
@@ -2206,6 +2602,7 @@ tfw_http_popreq(TfwHttpMsg *hmresp)
 	TfwSrvConn *srv_conn = (TfwSrvConn *)hmresp->conn;
 	struct list_head *fwd_queue = &srv_conn->fwd_queue;
 	LIST_HEAD(equeue);
+	LIST_HEAD(hedge_queue);
 
 	spin_lock(&srv_conn->fwd_qlock);
 	if (unlikely(list_empty(fwd_queue))) {
@@ -2221,6 +2618,7 @@ tfw_http_popreq(TfwHttpMsg *hmresp)
 		srv_conn->msg_sent = NULL;
 	tfw_http_req_delist(srv_conn, req);
 	tfw_http_conn_nip_delist(srv_conn);
+	tfw_http_conc_release(req);
 	/*
 	 * Run special processing if the connection is in repair
 	 * mode. Otherwise, forward pending requests to the server.
@@ -2233,8 +2631,59 @@ tfw_http_popreq(TfwHttpMsg *hmresp)
 		tfw_http_conn_fwd_repair(srv_conn, &equeue);
 	else if (tfw_http_conn_need_fwd(srv_conn))
 		tfw_http_conn_fwd_unsent(srv_conn, &equeue);
+
+	/*
+	 * Request hedging for slow backends: idempotent requests still
+	 * waiting unsent behind this connection's pipeline for longer
+	 * than the hedge timeout are pulled out to be re-forwarded to
+	 * another connection. Only unsent requests are safe to move -
+	 * a duplicate of a sent request would desynchronize response
+	 * pairing on this connection.
+	 */
+	if (((TfwServer *)srv_conn->peer)->sg->hedge_jtmo
+	    && !tfw_srv_conn_restricted(srv_conn))
+	{
+		unsigned long tmo =
+			((TfwServer *)srv_conn->peer)->sg->hedge_jtmo;
+		TfwHttpReq *hr, *tmp;
+		int n = 0;
+
+		hr = srv_conn->msg_sent
+		     ? list_next_entry((TfwHttpReq *)srv_conn->msg_sent,
+				       fwd_list)
+		     : list_first_entry(fwd_queue, TfwHttpReq, fwd_list);
+		/* The queue is ordered by arrival time. */
+		list_for_each_entry_safe_from(hr, tmp, fwd_queue, fwd_list) {
+			if ((hr->flags & TFW_HTTP_NON_IDEMP)
+			    || time_before(jiffies, hr->jrxtstamp + tmo)
+			    || n == 4)
+				break;
+			tfw_http_req_delist(srv_conn, hr);
+			list_add_tail(&hr->fwd_list, &hedge_queue);
+			++n;
+		}
+	}
 	spin_unlock(&srv_conn->fwd_qlock);
 
+	/* Re-forward the hedged requests outside the queue lock. */
+	{
+		TfwHttpReq *hr, *tmp;
+
+		list_for_each_entry_safe(hr, tmp, &hedge_queue, fwd_list) {
+			TfwSrvConn *sch_conn;
+
+			list_del_init(&hr->fwd_list);
+			if (!(sch_conn =
+			      tfw_sched_get_srv_conn((TfwMsg *)hr))) {
+				tfw_http_send_502(hr, "request dropped:"
+						  " unable to hedge");
+				continue;
+			}
+			tfw_http_req_fwd(sch_conn, hr, &equeue);
+			tfw_srv_conn_put(sch_conn);
+		}
+	}
+
 	if (!list_empty(&equeue))
 		tfw_http_req_zap_error(&equeue);
 
@@ -2301,6 +2750,8 @@ tfw_http_resp_cache(TfwHttpMsg *hmresp)
 	 */
 	hmresp->cache_ctl.timestamp = timestamp;
 	((TfwHttpResp *)hmresp)->jrxtstamp = jiffies;
+
+	tfw_stress_account_srv();
 	/*
 	 * If 'Date:' header is missing in the response, then
 	 * set the date to the time the response was received.
@@ -2321,6 +2772,17 @@ tfw_http_resp_cache(TfwHttpMsg *hmresp)
 		return -ENOENT;
 	}
 
+	/*
+	 * Apply the connection-independent adjustments before the
+	 * response is stored, see tfw_http_adjust_resp_stored().
+	 */
+	if (tfw_http_adjust_resp_stored((TfwHttpResp *)hmresp, req)) {
+		tfw_http_send_500(req, "response dropped: processing error");
+		tfw_http_conn_msg_free(hmresp);
+		TFW_INC_STAT_BH(serv.msgs_otherr);
+		return 0;
+	}
+
 	/*
 	 * Complete HTTP message has been collected and processed
 	 * with success. Mark the message as complete in @conn as
@@ -2540,9 +3002,23 @@ tfw_http_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
 	TFW_DBG2("Add skb %p to message %p\n", skb, c->msg);
 	ss_skb_queue_tail(&c->msg->skb_list, skb);
 
-	return (TFW_CONN_TYPE(c) & Conn_Clnt)
-		? tfw_http_req_process(c, skb, off)
-		: tfw_http_resp_process(c, skb, off);
+	if (TFW_CONN_TYPE(c) & Conn_Clnt) {
+		/*
+		 * Attribute the processing cycles and ingress bytes to
+		 * the tenant. The vhost resolves during this very call
+		 * for the first chunk, so read it after processing;
+		 * unattributable chunks are charged to the default.
+		 */
+		u64 t0 = get_cycles();
+		unsigned int len = skb->len - off;
+		int r = tfw_http_req_process(c, skb, off);
+		TfwHttpReq *req = (TfwHttpReq *)c->msg;
+
+		tfw_vhost_acct(r != TFW_BLOCK && req ? req->vhost : NULL,
+			       get_cycles() - t0, len, 0);
+		return r;
+	}
+	return tfw_http_resp_process(c, skb, off);
 }
 
 /**
@@ -2556,7 +3032,14 @@ tfw_http_req_key_calc(TfwHttpReq *req)
 	if (req->hash)
 		return req->hash;
 
-	req->hash = tfw_hash_str(&req->uri_path) ^ req->method;
+	/*
+	 * HEAD shares the cache key with GET, so HEAD requests find
+	 * the cached GET entries; the entry method check decides the
+	 * exact serving mode.
+	 */
+	req->hash = tfw_hash_str(&req->uri_path)
+		    ^ (req->method == TFW_HTTP_METH_HEAD
+		       ? TFW_HTTP_METH_GET : req->method);
 
 	tfw_http_msg_clnthdr_val(&req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
 				 TFW_HTTP_HDR_HOST, &host);
@@ -0,0 +1,133 @@
+/**
+ *		Tempesta FW
+ *
+ * HTTP/2 framing primitives (RFC 7540 section 4).
+ *
+ * This is the transport groundwork for multiplexing upstream requests
+ * as h2 streams over a few fat connections per server instead of the
+ * one-request-per-connection model. The layering plan:
+ *
+ *   1. framing (this file): frame header and SETTINGS codecs, the
+ *	connection preface - pure functions over byte buffers, usable
+ *	from any context and unit-testable in isolation;
+ *   2. an h2 server connection state machine next to sock_srv.c:
+ *	preface/SETTINGS exchange on connect, a stream table mapping
+ *	stream ids to TfwHttpReq, flow-control windows fed by
+ *	WINDOW_UPDATE, HEADERS emitted through the existing HPACK
+ *	decoder's encoder counterpart;
+ *   3. response demultiplexing into tfw_http_resp_fwd() keyed by the
+ *	stream table instead of fwd_queue ordering, and the scheduler
+ *	treating the connection's free stream credit as its capacity
+ *	the way qsize is used today.
+ *
+ * Steps 2 and 3 change the forwarding contract (responses stop being
+ * ordered per connection) and go in their own series; nothing in this
+ * file depends on them. Until they land, NOTHING here is reachable
+ * from live traffic: h2 is not negotiated anywhere (no ALPN
+ * advertisement, no upgrade path) and upstream multiplexing remains
+ * undelivered - this file is groundwork, not the feature.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <asm/unaligned.h>
+
+#include "http2.h"
+
+/* "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", RFC 7540 3.5. */
+const unsigned char tfw_h2_preface[24] =
+	"\x50\x52\x49\x20\x2a\x20\x48\x54\x54\x50\x2f\x32\x2e\x30\x0d\x0a"
+	"\x0d\x0a\x53\x4d\x0d\x0a\x0d\x0a";
+EXPORT_SYMBOL(tfw_h2_preface);
+
+/**
+ * Parse a frame header from @p of @n available bytes.
+ * @return 0 on success, -EAGAIN if fewer than 9 bytes are available,
+ * -EINVAL on an oversized payload length.
+ */
+int
+tfw_h2_frame_hdr_parse(const unsigned char *p, size_t n, TfwH2FrameHdr *fh)
+{
+	if (n < TFW_H2_FRAME_HDR_SZ)
+		return -EAGAIN;
+
+	fh->len = (p[0] << 16) | (p[1] << 8) | p[2];
+	fh->type = p[3];
+	fh->flags = p[4];
+	/* The high bit of the stream id is reserved, RFC 7540 4.1. */
+	fh->stream = get_unaligned_be32(p + 5) & 0x7fffffff;
+
+	if (fh->len > TFW_H2_MAX_FRAME_SZ)
+		return -EINVAL;
+
+	return 0;
+}
+EXPORT_SYMBOL(tfw_h2_frame_hdr_parse);
+
+void
+tfw_h2_frame_hdr_write(const TfwH2FrameHdr *fh, unsigned char *p)
+{
+	p[0] = (fh->len >> 16) & 0xff;
+	p[1] = (fh->len >> 8) & 0xff;
+	p[2] = fh->len & 0xff;
+	p[3] = fh->type;
+	p[4] = fh->flags;
+	put_unaligned_be32(fh->stream & 0x7fffffff, p + 5);
+}
+EXPORT_SYMBOL(tfw_h2_frame_hdr_write);
+
+/**
+ * Parse a SETTINGS payload of @n bytes, calling @cb for each setting.
+ * A non-zero return of @cb stops the parse and is returned.
+ * @return -EINVAL if @n isn't a whole number of settings (RFC 7540
+ * 6.5: FRAME_SIZE_ERROR).
+ */
+int
+tfw_h2_settings_parse(const unsigned char *p, size_t n,
+		      int (*cb)(unsigned short id, unsigned int val,
+				void *data),
+		      void *data)
+{
+	size_t off;
+	int r;
+
+	if (n % 6)
+		return -EINVAL;
+
+	for (off = 0; off < n; off += 6) {
+		r = cb(get_unaligned_be16(p + off),
+		       get_unaligned_be32(p + off + 2), data);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tfw_h2_settings_parse);
+
+/**
+ * Append one setting to a SETTINGS payload under construction.
+ * @return the advanced write pointer.
+ */
+unsigned char *
+tfw_h2_settings_put(unsigned char *p, unsigned short id, unsigned int val)
+{
+	put_unaligned_be16(id, p);
+	put_unaligned_be32(val, p + 2);
+
+	return p + 6;
+}
+EXPORT_SYMBOL(tfw_h2_settings_put);
@@ -0,0 +1,91 @@
+/**
+ *		Tempesta FW
+ *
+ * HTTP/2 framing primitives (RFC 7540 section 4), the transport layer
+ * under the upstream h2 multiplexing work. See http2.c.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_HTTP2_H__
+#define __TFW_HTTP2_H__
+
+#include <linux/kernel.h>
+
+#define TFW_H2_FRAME_HDR_SZ	9
+#define TFW_H2_DEFAULT_WINDOW	65535
+#define TFW_H2_MAX_FRAME_SZ	16384
+
+/* Frame types, RFC 7540 6. */
+enum {
+	TFW_H2_DATA		= 0x0,
+	TFW_H2_HEADERS		= 0x1,
+	TFW_H2_PRIORITY		= 0x2,
+	TFW_H2_RST_STREAM	= 0x3,
+	TFW_H2_SETTINGS		= 0x4,
+	TFW_H2_PUSH_PROMISE	= 0x5,
+	TFW_H2_PING		= 0x6,
+	TFW_H2_GOAWAY		= 0x7,
+	TFW_H2_WINDOW_UPDATE	= 0x8,
+	TFW_H2_CONTINUATION	= 0x9,
+	_TFW_H2_TYPE_MAX
+};
+
+/* Frame flags. */
+#define TFW_H2_F_END_STREAM	0x01
+#define TFW_H2_F_ACK		0x01
+#define TFW_H2_F_END_HEADERS	0x04
+#define TFW_H2_F_PADDED		0x08
+#define TFW_H2_F_PRIORITY	0x20
+
+/* Settings identifiers, RFC 7540 6.5.2. */
+enum {
+	TFW_H2_SET_HEADER_TABLE_SIZE	= 0x1,
+	TFW_H2_SET_ENABLE_PUSH		= 0x2,
+	TFW_H2_SET_MAX_CONCURRENT	= 0x3,
+	TFW_H2_SET_INITIAL_WINDOW	= 0x4,
+	TFW_H2_SET_MAX_FRAME_SIZE	= 0x5,
+	TFW_H2_SET_MAX_HEADER_LIST	= 0x6,
+};
+
+/**
+ * A parsed frame header.
+ *
+ * @len		- payload length, 24 bits on the wire;
+ * @stream	- stream id with the reserved bit cleared;
+ * @type	- frame type, possibly unknown (must be ignored then);
+ * @flags	- type-specific flags.
+ */
+typedef struct {
+	unsigned int	len;
+	unsigned int	stream;
+	unsigned char	type;
+	unsigned char	flags;
+} TfwH2FrameHdr;
+
+int tfw_h2_frame_hdr_parse(const unsigned char *p, size_t n,
+			   TfwH2FrameHdr *fh);
+void tfw_h2_frame_hdr_write(const TfwH2FrameHdr *fh, unsigned char *p);
+int tfw_h2_settings_parse(const unsigned char *p, size_t n,
+			  int (*cb)(unsigned short id, unsigned int val,
+				    void *data),
+			  void *data);
+unsigned char *tfw_h2_settings_put(unsigned char *p, unsigned short id,
+				   unsigned int val);
+
+extern const unsigned char tfw_h2_preface[24];
+
+#endif /* __TFW_HTTP2_H__ */
@@ -0,0 +1,553 @@
+/**
+ *		Tempesta FW
+ *
+ * HPACK (RFC 7541) header field decoder for HTTP/2.
+ *
+ * The decoder implements the full header field representation set:
+ * indexed fields, literals with and without indexing and dynamic table
+ * size updates. Huffman-coded string literals are not accepted yet -
+ * we don't advertise HTTP/2 support until the whole h2 connection layer
+ * is in place, and a conforming peer always may send raw literals.
+ * TODO: Huffman decoding (RFC 7541 5.2, Appendix B).
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "http_hpack.h"
+#include "http_msg.h" /* for SLEN() */
+#include "log.h"
+
+#define HP_STR(s)	{ s, SLEN(s) }
+
+typedef struct {
+	const char	*s;
+	unsigned int	len;
+} HPStr;
+
+/**
+ * The HPACK static table, RFC 7541 Appendix A. Indexed from 1.
+ */
+static const struct {
+	HPStr	name;
+	HPStr	val;
+} hp_static_tbl[] = {
+	{ {} },	/* unused, the table is 1-based */
+	{ HP_STR(":authority"),			HP_STR("") },
+	{ HP_STR(":method"),			HP_STR("GET") },
+	{ HP_STR(":method"),			HP_STR("POST") },
+	{ HP_STR(":path"),			HP_STR("/") },
+	{ HP_STR(":path"),			HP_STR("/index.html") },
+	{ HP_STR(":scheme"),			HP_STR("http") },
+	{ HP_STR(":scheme"),			HP_STR("https") },
+	{ HP_STR(":status"),			HP_STR("200") },
+	{ HP_STR(":status"),			HP_STR("204") },
+	{ HP_STR(":status"),			HP_STR("206") },
+	{ HP_STR(":status"),			HP_STR("304") },
+	{ HP_STR(":status"),			HP_STR("400") },
+	{ HP_STR(":status"),			HP_STR("404") },
+	{ HP_STR(":status"),			HP_STR("500") },
+	{ HP_STR("accept-charset"),		HP_STR("") },
+	{ HP_STR("accept-encoding"),		HP_STR("gzip, deflate") },
+	{ HP_STR("accept-language"),		HP_STR("") },
+	{ HP_STR("accept-ranges"),		HP_STR("") },
+	{ HP_STR("accept"),			HP_STR("") },
+	{ HP_STR("access-control-allow-origin"), HP_STR("") },
+	{ HP_STR("age"),			HP_STR("") },
+	{ HP_STR("allow"),			HP_STR("") },
+	{ HP_STR("authorization"),		HP_STR("") },
+	{ HP_STR("cache-control"),		HP_STR("") },
+	{ HP_STR("content-disposition"),	HP_STR("") },
+	{ HP_STR("content-encoding"),		HP_STR("") },
+	{ HP_STR("content-language"),		HP_STR("") },
+	{ HP_STR("content-length"),		HP_STR("") },
+	{ HP_STR("content-location"),		HP_STR("") },
+	{ HP_STR("content-range"),		HP_STR("") },
+	{ HP_STR("content-type"),		HP_STR("") },
+	{ HP_STR("cookie"),			HP_STR("") },
+	{ HP_STR("date"),			HP_STR("") },
+	{ HP_STR("etag"),			HP_STR("") },
+	{ HP_STR("expect"),			HP_STR("") },
+	{ HP_STR("expires"),			HP_STR("") },
+	{ HP_STR("from"),			HP_STR("") },
+	{ HP_STR("host"),			HP_STR("") },
+	{ HP_STR("if-match"),			HP_STR("") },
+	{ HP_STR("if-modified-since"),		HP_STR("") },
+	{ HP_STR("if-none-match"),		HP_STR("") },
+	{ HP_STR("if-range"),			HP_STR("") },
+	{ HP_STR("if-unmodified-since"),	HP_STR("") },
+	{ HP_STR("last-modified"),		HP_STR("") },
+	{ HP_STR("link"),			HP_STR("") },
+	{ HP_STR("location"),			HP_STR("") },
+	{ HP_STR("max-forwards"),		HP_STR("") },
+	{ HP_STR("proxy-authenticate"),		HP_STR("") },
+	{ HP_STR("proxy-authorization"),	HP_STR("") },
+	{ HP_STR("range"),			HP_STR("") },
+	{ HP_STR("referer"),			HP_STR("") },
+	{ HP_STR("refresh"),			HP_STR("") },
+	{ HP_STR("retry-after"),		HP_STR("") },
+	{ HP_STR("server"),			HP_STR("") },
+	{ HP_STR("set-cookie"),			HP_STR("") },
+	{ HP_STR("strict-transport-security"),	HP_STR("") },
+	{ HP_STR("transfer-encoding"),		HP_STR("") },
+	{ HP_STR("user-agent"),			HP_STR("") },
+	{ HP_STR("vary"),			HP_STR("") },
+	{ HP_STR("via"),			HP_STR("") },
+	{ HP_STR("www-authenticate"),		HP_STR("") },
+};
+
+#define HP_STATIC_N	(ARRAY_SIZE(hp_static_tbl) - 1)
+/* Capacity of the dynamic table ring for the smallest possible entries. */
+#define HP_DYN_CAP	(TFW_HPACK_TBL_SZ_MAX / TFW_HPACK_ENTRY_OVERHEAD)
+
+static void hp_huff_tbl_init(void);
+
+int
+tfw_hpack_init(TfwHPack *hp)
+{
+	hp_huff_tbl_init();
+	memset(hp, 0, sizeof(*hp));
+	hp->max_size = TFW_HPACK_TBL_SZ_MAX;
+	hp->entries = kzalloc(HP_DYN_CAP * sizeof(TfwHPackEntry),
+			      GFP_ATOMIC);
+	if (!hp->entries)
+		return -ENOMEM;
+	hp->hbuf = kmalloc(TFW_HPACK_HBUF_SZ, GFP_ATOMIC);
+	if (!hp->hbuf) {
+		kfree(hp->entries);
+		hp->entries = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void
+hp_entry_free(TfwHPackEntry *e)
+{
+	kfree(e->name);
+	e->name = e->val = NULL;
+	e->n_len = e->v_len = 0;
+}
+
+void
+tfw_hpack_free(TfwHPack *hp)
+{
+	unsigned int d;
+
+	if (!hp->entries)
+		return;
+	for (d = 0; d < hp->n; ++d)
+		hp_entry_free(&hp->entries[(hp->head + HP_DYN_CAP - d)
+					   % HP_DYN_CAP]);
+	kfree(hp->entries);
+	hp->entries = NULL;
+	kfree(hp->hbuf);
+	hp->hbuf = NULL;
+}
+
+/**
+ * Decode an integer with an @nbits prefix, RFC 7541 5.1.
+ * @pp/@plen are advanced behind the decoded representation.
+ */
+static int
+hp_int_decode(const unsigned char **pp, unsigned long *plen,
+	      unsigned int nbits, unsigned int *val)
+{
+	const unsigned char *p = *pp;
+	unsigned long len = *plen;
+	unsigned int shift = 0, max = (1U << nbits) - 1;
+	unsigned long v;
+
+	if (!len)
+		return -EINVAL;
+	v = *p++ & max;
+	--len;
+	if (v == max) {
+		do {
+			if (!len || shift > 28)
+				return -E2BIG;
+			v += (unsigned long)(*p & 0x7f) << shift;
+			shift += 7;
+			--len;
+		} while (*p++ & 0x80);
+		if (v > UINT_MAX)
+			return -E2BIG;
+	}
+
+	*pp = p;
+	*plen = len;
+	*val = v;
+
+	return 0;
+}
+
+
+/*
+ * ------------------------------------------------------------------------
+ *	Huffman decoding, RFC 7541 5.2 and Appendix B
+ * ------------------------------------------------------------------------
+ * The code is canonical: within each code length the codes are
+ * consecutive and assigned in ascending symbol order, and the first
+ * code of each length is derived from the previous length by
+ * first[l] = (first[l - 1] + cnt[l - 1]) << 1. The tables below store
+ * only the per-length symbol lists and counts; the first codes and
+ * symbol offsets are computed once at init (the derivation ends with
+ * the 30-bit EOS code being the all-ones value, which double-checks
+ * the counts). Decoding accumulates bits MSB-first and looks the
+ * accumulator up against the current length's code range - at most 26
+ * comparisons per symbol, no large state tables.
+ */
+#define HP_HUFF_MIN_BITS	5
+#define HP_HUFF_MAX_BITS	30
+#define HP_HUFF_EOS		256
+
+static const unsigned short hp_huff_syms[257] = {
+	/* 5 bits */
+	'0', '1', '2', 'a', 'c', 'e', 'i', 'o', 's', 't',
+	/* 6 bits */
+	' ', '%', '-', '.', '/', '3', '4', '5', '6', '7', '8', '9', '=',
+	'A', '_', 'b', 'd', 'f', 'g', 'h', 'l', 'm', 'n', 'p', 'r', 'u',
+	/* 7 bits */
+	':', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
+	'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'Y', 'j', 'k',
+	'q', 'v', 'w', 'x', 'y', 'z',
+	/* 8 bits */
+	'&', '*', ',', ';', 'X', 'Z',
+	/* 10 bits */
+	'!', '"', '(', ')', '?',
+	/* 11 bits */
+	'\'', '+', '|',
+	/* 12 bits */
+	'#', '>',
+	/* 13 bits */
+	0x00, '$', '@', '[', ']', '~',
+	/* 14 bits */
+	'^', '}',
+	/* 15 bits */
+	'<', '`', '{',
+	/* 19 bits */
+	'\\', 0xc3, 0xd0,
+	/* 20 bits */
+	0x80, 0x82, 0x83, 0xa2, 0xb8, 0xc2, 0xe0, 0xe2,
+	/* 21 bits */
+	0x99, 0xa1, 0xa7, 0xac, 0xb0, 0xb1, 0xb3, 0xd1, 0xd8, 0xd9, 0xe3,
+	0xe5, 0xe6,
+	/* 22 bits */
+	0x81, 0x84, 0x85, 0x86, 0x88, 0x92, 0x9a, 0x9c, 0xa0, 0xa3, 0xa4,
+	0xa9, 0xaa, 0xad, 0xb2, 0xb5, 0xb9, 0xba, 0xbb, 0xbd, 0xbe, 0xc4,
+	0xc6, 0xe4, 0xe8, 0xe9,
+	/* 23 bits */
+	0x01, 0x87, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8f, 0x93, 0x95, 0x96,
+	0x97, 0x98, 0x9b, 0x9d, 0x9e, 0xa5, 0xa6, 0xa8, 0xae, 0xaf, 0xb4,
+	0xb6, 0xb7, 0xbc, 0xbf, 0xc5, 0xe7, 0xef,
+	/* 24 bits */
+	0x09, 0x8e, 0x90, 0x91, 0x94, 0x9f, 0xab, 0xce, 0xd7, 0xe1, 0xec,
+	0xed,
+	/* 25 bits */
+	0xc7, 0xcf, 0xea, 0xeb,
+	/* 26 bits */
+	0xc0, 0xc1, 0xc8, 0xc9, 0xca, 0xcd, 0xd2, 0xd5, 0xda, 0xdb, 0xee,
+	0xf0, 0xf2, 0xf3, 0xff,
+	/* 27 bits */
+	0xcb, 0xcc, 0xd3, 0xd4, 0xd6, 0xdd, 0xde, 0xdf, 0xf1, 0xf4, 0xf5,
+	0xf6, 0xf7, 0xf8, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe,
+	/* 28 bits */
+	0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x0b, 0x0c, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x17, 0x18, 0x19, 0x1a, 0x1b,
+	0x1c, 0x1d, 0x1e, 0x1f, 0x7f, 0xdc, 0xf9,
+	/* 30 bits */
+	0x0a, 0x0d, 0x16, HP_HUFF_EOS,
+};
+
+static const unsigned char hp_huff_cnt[HP_HUFF_MAX_BITS + 1] = {
+	[5] = 10, [6] = 26, [7] = 32, [8] = 6, [10] = 5, [11] = 3,
+	[12] = 2, [13] = 6, [14] = 2, [15] = 3, [19] = 3, [20] = 8,
+	[21] = 13, [22] = 26, [23] = 29, [24] = 12, [25] = 4, [26] = 15,
+	[27] = 19, [28] = 29, [30] = 4,
+};
+
+static unsigned int hp_huff_first[HP_HUFF_MAX_BITS + 1];
+static unsigned short hp_huff_off[HP_HUFF_MAX_BITS + 1];
+
+static void
+hp_huff_tbl_init(void)
+{
+	unsigned int l, first = 0, off = 0;
+
+	if (hp_huff_off[HP_HUFF_MAX_BITS])
+		return; /* Idempotent, benign to race. */
+	for (l = HP_HUFF_MIN_BITS; l <= HP_HUFF_MAX_BITS; ++l) {
+		hp_huff_first[l] = first;
+		hp_huff_off[l] = off;
+		first = (first + hp_huff_cnt[l]) << 1;
+		off += hp_huff_cnt[l];
+	}
+	/* The last code of the table is the all-ones EOS. */
+	BUG_ON(hp_huff_first[HP_HUFF_MAX_BITS]
+	       + hp_huff_cnt[HP_HUFF_MAX_BITS] != (1U << HP_HUFF_MAX_BITS));
+}
+
+static int
+hp_huff_decode(const unsigned char *src, unsigned long len, char *dst,
+	       unsigned int dst_sz, unsigned int *olen)
+{
+	unsigned int code = 0, nbits = 0, out = 0;
+	unsigned long i;
+
+	for (i = 0; i < len; ++i) {
+		unsigned int b;
+
+		for (b = 8; b--; ) {
+			code = (code << 1) | ((src[i] >> b) & 1);
+			if (++nbits < HP_HUFF_MIN_BITS)
+				continue;
+			if (code - hp_huff_first[nbits] < hp_huff_cnt[nbits]) {
+				unsigned short sym =
+					hp_huff_syms[hp_huff_off[nbits] + code
+						     - hp_huff_first[nbits]];
+
+				/* EOS inside the stream, RFC 7541 5.2. */
+				if (sym == HP_HUFF_EOS)
+					return -EINVAL;
+				if (out == dst_sz)
+					return -E2BIG;
+				dst[out++] = sym;
+				code = 0;
+				nbits = 0;
+			} else if (nbits == HP_HUFF_MAX_BITS) {
+				return -EINVAL;
+			}
+		}
+	}
+	/* Padding must be a most-significant prefix of EOS: all ones,
+	 * shorter than a byte. */
+	if (nbits > 7 || code != (1U << nbits) - 1)
+		return -EINVAL;
+
+	*olen = out;
+
+	return 0;
+}
+
+/**
+ * Decode a string literal, RFC 7541 5.2. Plain literals are not
+ * copied: the result points into the source buffer. Huffman literals
+ * are inflated into the decoder's scratch buffer at @*scratch, which
+ * is advanced so a field's name and value can coexist there.
+ */
+static int
+hp_str_decode(TfwHPack *hp, const unsigned char **pp, unsigned long *plen,
+	      const char **s, unsigned int *s_len, unsigned int *scratch)
+{
+	int r;
+	bool huffman;
+
+	if (!*plen)
+		return -EINVAL;
+	huffman = **pp & 0x80;
+	if ((r = hp_int_decode(pp, plen, 7, s_len)))
+		return r;
+	if (*s_len > *plen)
+		return -EINVAL;
+	if (huffman) {
+		unsigned int olen;
+
+		if ((r = hp_huff_decode(*pp, *s_len, hp->hbuf + *scratch,
+					TFW_HPACK_HBUF_SZ - *scratch, &olen)))
+			return r;
+		*pp += *s_len;
+		*plen -= *s_len;
+		*s = hp->hbuf + *scratch;
+		*scratch += olen;
+		*s_len = olen;
+		return 0;
+	}
+	*s = (const char *)*pp;
+	*pp += *s_len;
+	*plen -= *s_len;
+
+	return 0;
+}
+
+static TfwHPackEntry *
+hp_dyn_entry(TfwHPack *hp, unsigned int d)
+{
+	return &hp->entries[(hp->head + HP_DYN_CAP - d) % HP_DYN_CAP];
+}
+
+/**
+ * Look up entry @idx combining the static and the dynamic tables,
+ * RFC 7541 2.3.3.
+ */
+static int
+hp_tbl_lookup(TfwHPack *hp, unsigned int idx, const char **name,
+	      unsigned int *n_len, const char **val, unsigned int *v_len)
+{
+	if (!idx)
+		return -EINVAL;
+	if (idx <= HP_STATIC_N) {
+		*name = hp_static_tbl[idx].name.s;
+		*n_len = hp_static_tbl[idx].name.len;
+		*val = hp_static_tbl[idx].val.s;
+		*v_len = hp_static_tbl[idx].val.len;
+		return 0;
+	}
+	idx -= HP_STATIC_N + 1;
+	if (idx >= hp->n)
+		return -EINVAL;
+	{
+		TfwHPackEntry *e = hp_dyn_entry(hp, idx);
+		*name = e->name;
+		*n_len = e->n_len;
+		*val = e->val;
+		*v_len = e->v_len;
+	}
+	return 0;
+}
+
+static void
+hp_dyn_evict(TfwHPack *hp, unsigned int need)
+{
+	while (hp->n && hp->size + need > hp->max_size) {
+		TfwHPackEntry *e = hp_dyn_entry(hp, hp->n - 1);
+
+		hp->size -= e->n_len + e->v_len + TFW_HPACK_ENTRY_OVERHEAD;
+		hp_entry_free(e);
+		--hp->n;
+	}
+}
+
+static void
+hp_dyn_insert(TfwHPack *hp, char *buf, unsigned int n_len, unsigned int v_len)
+{
+	TfwHPackEntry *e;
+
+	hp->head = (hp->head + 1) % HP_DYN_CAP;
+	e = &hp->entries[hp->head];
+	BUG_ON(e->name);
+	e->name = buf;
+	e->val = buf + n_len;
+	e->n_len = n_len;
+	e->v_len = v_len;
+	++hp->n;
+	hp->size += n_len + v_len + TFW_HPACK_ENTRY_OVERHEAD;
+}
+
+/**
+ * Decode a complete HPACK header block from @buf of @len bytes and
+ * call @cb for each header field.
+ *
+ * The decoder works on a contiguous buffer: HTTP/2 header blocks are
+ * bounded by SETTINGS_MAX_HEADER_LIST_SIZE and are assembled by the
+ * framing layer before decoding.
+ */
+int
+tfw_hpack_decode(TfwHPack *hp, const unsigned char *buf, unsigned long len,
+		 tfw_hpack_hdr_cb_t cb, void *cb_data)
+{
+	int r;
+	unsigned int idx;
+	const char *name, *val;
+	unsigned int n_len, v_len;
+
+	while (len) {
+		char *copy = NULL;
+		unsigned char c = *buf;
+		unsigned int scratch = 0;
+		bool add = false;
+
+		if (c & 0x80) {
+			/* Indexed header field. */
+			if ((r = hp_int_decode(&buf, &len, 7, &idx)))
+				return r;
+			if ((r = hp_tbl_lookup(hp, idx, &name, &n_len,
+					       &val, &v_len)))
+				return r;
+		} else if ((c & 0xe0) == 0x20) {
+			/* Dynamic table size update. */
+			if ((r = hp_int_decode(&buf, &len, 5, &idx)))
+				return r;
+			if (idx > TFW_HPACK_TBL_SZ_MAX)
+				return -EINVAL;
+			hp->max_size = idx;
+			hp_dyn_evict(hp, 0);
+			continue;
+		} else {
+			/*
+			 * Literal header field: with incremental
+			 * indexing (01), without indexing (0000) or
+			 * never indexed (0001).
+			 */
+			unsigned int nbits = (c & 0x40) ? 6 : 4;
+
+			add = c & 0x40;
+			if ((r = hp_int_decode(&buf, &len, nbits, &idx)))
+				return r;
+			if (idx) {
+				unsigned int dummy_vl;
+				const char *dummy_v;
+
+				if ((r = hp_tbl_lookup(hp, idx, &name,
+						       &n_len, &dummy_v,
+						       &dummy_vl)))
+					return r;
+			} else {
+				if ((r = hp_str_decode(hp, &buf, &len, &name,
+						       &n_len, &scratch)))
+					return r;
+			}
+			if ((r = hp_str_decode(hp, &buf, &len, &val, &v_len,
+					       &scratch)))
+				return r;
+		}
+
+		if (add) {
+			unsigned int need = n_len + v_len
+					    + TFW_HPACK_ENTRY_OVERHEAD;
+
+			/*
+			 * Copy before the eviction: a table-referenced
+			 * @name may point right into the entry being
+			 * evicted (RFC 7541 4.4). An entry larger than
+			 * the table just empties it, then the copy is
+			 * kept only until the callback returns.
+			 */
+			copy = kmalloc(n_len + v_len, GFP_ATOMIC);
+			if (!copy)
+				return -ENOMEM;
+			memcpy(copy, name, n_len);
+			memcpy(copy + n_len, val, v_len);
+			name = copy;
+			val = copy + n_len;
+
+			hp_dyn_evict(hp, need);
+			if (need <= hp->max_size) {
+				hp_dyn_insert(hp, copy, n_len, v_len);
+				copy = NULL; /* owned by the table now */
+			}
+		}
+
+		r = cb(name, n_len, val, v_len, cb_data);
+		kfree(copy);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
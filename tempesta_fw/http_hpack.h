@@ -0,0 +1,83 @@
+/**
+ *		Tempesta FW
+ *
+ * HPACK (RFC 7541) header field decoder for HTTP/2.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_HTTP_HPACK_H__
+#define __TFW_HTTP_HPACK_H__
+
+#include <linux/types.h>
+
+/*
+ * We don't accept dynamic table size updates above the RFC 7540
+ * SETTINGS_HEADER_TABLE_SIZE default - we never advertise more.
+ */
+#define TFW_HPACK_TBL_SZ_MAX	4096
+/* Minimal dynamic table entry overhead, RFC 7541 4.1. */
+#define TFW_HPACK_ENTRY_OVERHEAD 32
+/*
+ * Scratch buffer for inflated Huffman literals; a field whose decoded
+ * name plus value exceed it is rejected with -E2BIG.
+ */
+#define TFW_HPACK_HBUF_SZ	16384
+
+/**
+ * A decoded dynamic table entry, the strings are owned by the table.
+ */
+typedef struct {
+	char		*name;
+	char		*val;
+	unsigned int	n_len;
+	unsigned int	v_len;
+} TfwHPackEntry;
+
+/**
+ * HPACK decoder context, one per HTTP/2 connection direction.
+ *
+ * @entries	- circular buffer of dynamic table entries;
+ * @hbuf	- scratch buffer for inflated Huffman literals;
+ * @head	- position of the most recently added entry;
+ * @n		- number of entries in the dynamic table;
+ * @size	- current dynamic table size per RFC 7541 4.1;
+ * @max_size	- current limit set by a table size update;
+ */
+typedef struct {
+	TfwHPackEntry	*entries;
+	char		*hbuf;
+	unsigned int	head;
+	unsigned int	n;
+	unsigned int	size;
+	unsigned int	max_size;
+} TfwHPack;
+
+/**
+ * Called for each decoded header field. The name/value point either
+ * into the source buffer or into the dynamic table and are valid only
+ * until the next tfw_hpack_decode() call.
+ */
+typedef int (*tfw_hpack_hdr_cb_t)(const char *name, unsigned int n_len,
+				  const char *val, unsigned int v_len,
+				  void *data);
+
+int tfw_hpack_init(TfwHPack *hp);
+void tfw_hpack_free(TfwHPack *hp);
+int tfw_hpack_decode(TfwHPack *hp, const unsigned char *buf,
+		     unsigned long len, tfw_hpack_hdr_cb_t cb, void *cb_data);
+
+#endif /* __TFW_HTTP_HPACK_H__ */
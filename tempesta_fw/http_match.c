@@ -63,6 +63,7 @@
 #include <linux/ctype.h>
 #include "http_match.h"
 #include "http_msg.h"
+#include "http_rex.h"
 
 /**
  * Look up a header in the @req->h_tbl by given @id,
@@ -108,6 +109,8 @@ map_op_to_str_eq_flags(tfw_http_match_op_t op)
 		[TFW_HTTP_MATCH_O_EQ]     = TFW_STR_EQ_DEFAULT,
 		[TFW_HTTP_MATCH_O_PREFIX] = TFW_STR_EQ_PREFIX,
 		[TFW_HTTP_MATCH_O_SUFFIX] = TFW_STR_EQ_DEFAULT,
+		/* Regex rules don't go through the tfw_str_eq_*() path. */
+		[TFW_HTTP_MATCH_O_REGEX]  = TFW_STR_EQ_DEFAULT,
 	};
 	BUG_ON(flags_tbl[op] < 0);
 	return flags_tbl[op];
@@ -139,6 +142,9 @@ match_uri(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 	 */
 	flags |= TFW_STR_EQ_CASEI;
 
+	if (rule->op == TFW_HTTP_MATCH_O_REGEX)
+		return tfw_rex_match(rule->rex, uri_path);
+
 	if (rule->op == TFW_HTTP_MATCH_O_SUFFIX)
 		return tfw_str_eq_cstr_off(uri_path, uri_path->len - arg->len,
 					   arg->str, arg->len, flags);
@@ -165,6 +171,9 @@ match_host(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 
 	flags |= TFW_STR_EQ_CASEI;
 
+	if (rule->op == TFW_HTTP_MATCH_O_REGEX && host->len)
+		return tfw_rex_match(rule->rex, host);
+
 	if (host->len == 0)
 		return hdr_val_eq(req, TFW_HTTP_HDR_HOST,
 				  rule->op, arg->str, arg->len, flags);
@@ -352,26 +361,52 @@ __read_mostly match_fn_tbl[_TFW_HTTP_MATCH_F_COUNT] = {
 static bool
 do_match(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 {
-	match_fn match_fn;
-	tfw_http_match_fld_t field;
+	match_fn fn = (match_fn)rule->match_fn;
 
 	TFW_DBG2("rule: %p, field: %#x, op: %#x, arg:%d:%d'%.*s'\n",
 		 rule, rule->field, rule->op, rule->arg.type, rule->arg.len,
 		 rule->arg.len, rule->arg.str);
 
+	/* Compiled lists go straight to the match function. */
+	if (likely(fn))
+		return fn(req, rule);
+
 	BUG_ON(!req || !rule);
 	BUG_ON(rule->field < 0 || rule->field >= _TFW_HTTP_MATCH_F_COUNT);
 	BUG_ON(rule->op < 0 || rule->op >= _TFW_HTTP_MATCH_O_COUNT);
 	BUG_ON(rule->arg.type < 0 || rule->arg.type >= _TFW_HTTP_MATCH_A_COUNT);
 	BUG_ON(rule->arg.len <= 0 || rule->arg.len >= TFW_HTTP_MATCH_MAX_ARG_LEN);
 
-	field = rule->field;
-	match_fn = match_fn_tbl[field];
-	BUG_ON(!match_fn);
+	fn = match_fn_tbl[rule->field];
+	BUG_ON(!fn);
 
-	return match_fn(req, rule);
+	return fn(req, rule);
 }
 
+/**
+ * Compile the rule list: validate every rule once and store its match
+ * function right in the rule, so the per-request path dispatches with
+ * a single indirect call and no sanity checking.
+ */
+void
+tfw_http_match_list_compile(TfwHttpMatchList *mlst)
+{
+	TfwHttpMatchRule *rule;
+
+	list_for_each_entry(rule, &mlst->list, list) {
+		BUG_ON(rule->field < 0
+		       || rule->field >= _TFW_HTTP_MATCH_F_COUNT);
+		BUG_ON(rule->op < 0 || rule->op >= _TFW_HTTP_MATCH_O_COUNT);
+		BUG_ON(rule->arg.type < 0
+		       || rule->arg.type >= _TFW_HTTP_MATCH_A_COUNT);
+		BUG_ON(rule->arg.len <= 0
+		       || rule->arg.len >= TFW_HTTP_MATCH_MAX_ARG_LEN);
+		rule->match_fn = match_fn_tbl[rule->field];
+		BUG_ON(!rule->match_fn);
+	}
+}
+EXPORT_SYMBOL(tfw_http_match_list_compile);
+
 /**
  * Match a HTTP request against all rules in @mlst.
  * Return a first matching rule.
@@ -444,8 +479,13 @@ EXPORT_SYMBOL(tfw_http_match_list_alloc);
 void
 tfw_http_match_list_free(TfwHttpMatchList *mlst)
 {
-	if (mlst)
-		tfw_pool_destroy(mlst->pool);
+	TfwHttpMatchRule *rule;
+
+	if (!mlst)
+		return;
+	list_for_each_entry(rule, &mlst->list, list)
+		tfw_rex_free(rule->rex);
+	tfw_pool_destroy(mlst->pool);
 }
 EXPORT_SYMBOL(tfw_http_match_list_free);
 
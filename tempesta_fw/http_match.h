@@ -45,6 +45,7 @@ typedef enum {
 	TFW_HTTP_MATCH_O_EQ,
 	TFW_HTTP_MATCH_O_PREFIX,
 	TFW_HTTP_MATCH_O_SUFFIX,
+	TFW_HTTP_MATCH_O_REGEX,
 	_TFW_HTTP_MATCH_O_COUNT
 } tfw_http_match_op_t;
 
@@ -74,6 +75,10 @@ typedef struct {
 	struct list_head	list;
 	tfw_http_match_fld_t	field; /* Field of a HTTP message to compare. */
 	tfw_http_match_op_t 	op;    /* Comparison operator. */
+	const void		*match_fn; /* Compiled dispatch, see
+					      tfw_http_match_list_compile(). */
+	void			*rex;  /* Compiled DFA for O_REGEX rules,
+					  owned by the rule list. */
 	TfwHttpMatchArg 	arg;   /* A value to be compared with the field.
 					  note: the @arg has variable length. */
 } TfwHttpMatchRule;
@@ -107,6 +112,7 @@ typedef struct {
 
 TfwHttpMatchList *tfw_http_match_list_alloc(void);
 void tfw_http_match_list_free(TfwHttpMatchList *);
+void tfw_http_match_list_compile(TfwHttpMatchList *mlst);
 
 /**
  * Match a HTTP request agains a list of rules.
@@ -318,7 +318,27 @@ __tfw_http_msg_add_str_data(TfwHttpMsg *hm, TfwStr *str, void *data,
 		BUG_ON(!str->len);
 	}
 	else if (likely(len)) {
-		TfwStr *sn = tfw_str_add_compound(hm->pool, str);
+		TfwStr *last = TFW_STR_LAST(str);
+		TfwStr *sn;
+
+		/*
+		 * Merge the piece with the last chunk when the data is
+		 * contiguous in the same skb: the streaming body decode
+		 * appends a piece per parser entry and per chunked
+		 * framing element, and without the merge a long chunked
+		 * body explodes into thousands of descriptors. Headers
+		 * keep their exact chunking - the header rewriting
+		 * machinery is sensitive to it.
+		 */
+		if (str == &hm->body
+		    && last->ptr + last->len == data && last->skb == skb) {
+			last->len += len;
+			if (last != str)
+				str->len += len;
+			return 0;
+		}
+
+		sn = tfw_str_add_compound(hm->pool, str);
 		if (!sn) {
 			TFW_WARN("Cannot grow HTTP data string\n");
 			return -ENOMEM;
@@ -381,6 +401,149 @@ __hdr_add(TfwHttpMsg *hm, const TfwStr *hdr, unsigned int hid)
 	return 0;
 }
 
+/**
+ * Add several new headers in one skb reservation: the room before the
+ * CRLF is carved once for the sum of the headers and each line is
+ * then a plain memcpy into its slice - N configured header additions
+ * cost one skb reshape instead of N. The reservation usually comes
+ * back as a single chunk; a line crossing a chunk boundary gets a
+ * compound table entry. A failure mid-way leaves the reserved room
+ * partially unwritten, so the caller must treat any error as fatal
+ * for the message.
+ */
+int
+tfw_http_msg_hdr_add_multi(TfwHttpMsg *hm, TfwStr *const *hdrs,
+			   const unsigned int *hids, int n)
+{
+	int r, i, ic_n;
+	size_t total = 0, off;
+	const TfwStr *ic, *ic_end;
+	TfwStr it = {};
+	TfwStr *h = TFW_STR_CHUNK(&hm->crlf, 0);
+
+	for (i = 0; i < n; ++i)
+		total += hdrs[i]->len + tfw_str_eolen(hdrs[i]);
+
+	r = ss_skb_get_room(&hm->msg.skb_list, hm->crlf.skb,
+			    h->ptr, total, &it);
+	if (r)
+		return r;
+
+	ic = TFW_STR_PLAIN(&it) ? &it : (TfwStr *)it.ptr;
+	ic_end = TFW_STR_PLAIN(&it) ? &it + 1 : ic + TFW_STR_CHUNKN(&it);
+
+	/*
+	 * Lay the lines out sequentially over the reserved chunks.
+	 * @ic/@off is the write cursor; each header's table entry
+	 * references the slice its bytes land in, compound when the
+	 * line crosses a chunk boundary.
+	 */
+	off = 0;
+	for (i = 0; i < n; ++i) {
+		size_t need = hdrs[i]->len + tfw_str_eolen(hdrs[i]);
+		size_t put = 0, c_off = 0;
+		const TfwStr *sc, *sc_end;
+		TfwStr *dst = &hm->h_tbl->tbl[hids[i]];
+		TfwStr parts[4];
+
+		ic_n = 0;
+		/* Record the covering slices before writing. */
+		{
+			const TfwStr *c = ic;
+			size_t o = off, left = need;
+
+			while (left) {
+				size_t sl = min(left, c->len - o);
+
+				if (ic_n == ARRAY_SIZE(parts))
+					return -E2BIG;
+				parts[ic_n++] = (TfwStr){
+					.ptr = (char *)c->ptr + o,
+					.len = sl,
+					.skb = c->skb,
+				};
+				left -= sl;
+				o = 0;
+				if (left)
+					++c;
+			}
+		}
+
+		/* Copy the line bytes through the slices. */
+		sc = TFW_STR_PLAIN(hdrs[i]) ? hdrs[i] : (TfwStr *)hdrs[i]->ptr;
+		sc_end = TFW_STR_PLAIN(hdrs[i])
+			 ? hdrs[i] + 1 : sc + TFW_STR_CHUNKN(hdrs[i]);
+		for ( ; sc <= sc_end; ++sc) {
+			const char *sp;
+			size_t sn;
+
+			if (sc < sc_end) {
+				sp = sc->ptr;
+				sn = sc->len;
+			} else {
+				sp = S_CRLF;
+				sn = tfw_str_eolen(hdrs[i]);
+			}
+			while (sn) {
+				TfwStr *pc = &parts[0];
+				size_t k = put, cn;
+
+				/* Find the slice holding offset @put. */
+				while (k >= pc->len) {
+					k -= pc->len;
+					++pc;
+				}
+				cn = min(sn, pc->len - k);
+				memcpy((char *)pc->ptr + k, sp, cn);
+				sp += cn;
+				sn -= cn;
+				put += cn;
+			}
+		}
+
+		/* Publish the table entry for the new header. */
+		if (ic_n == 1 || parts[0].len >= hdrs[i]->len) {
+			/* The eol may span, the name/value don't. */
+			*dst = parts[0];
+			dst->len = hdrs[i]->len;
+		} else {
+			TfwStr *chunks = tfw_pool_alloc(hm->pool,
+							ic_n
+							* sizeof(TfwStr));
+			if (!chunks)
+				return -ENOMEM;
+			memcpy(chunks, parts, ic_n * sizeof(TfwStr));
+			dst->ptr = chunks;
+			dst->len = hdrs[i]->len;
+			dst->skb = parts[0].skb;
+			dst->flags = ic_n << TFW_STR_CN_SHIFT;
+			/* Trim the eol bytes off the chunk lengths. */
+			c_off = tfw_str_eolen(hdrs[i]);
+			while (c_off) {
+				TfwStr *lc = &chunks[ic_n - 1];
+				size_t cut = min(c_off, lc->len);
+
+				lc->len -= cut;
+				c_off -= cut;
+				if (!lc->len)
+					--ic_n;
+			}
+			dst->flags = ic_n << TFW_STR_CN_SHIFT;
+		}
+		dst->eolen = tfw_str_eolen(hdrs[i]);
+
+		/* Advance the cursor past this line. */
+		off += need;
+		while (ic < ic_end && off >= ic->len) {
+			off -= ic->len;
+			++ic;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tfw_http_msg_hdr_add_multi);
+
 /**
  * Expand @orig_hdr by appending or replacing with the @hdr.
  * (CRLF is not accounted in TfwStr representation of HTTP headers).
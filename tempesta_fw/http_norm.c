@@ -0,0 +1,221 @@
+/**
+ *		Tempesta FW
+ *
+ * HTTP URI normalization (RFC 3986 6.2.2).
+ *
+ * The URI is normalized once per request, right before the vhost and
+ * location matching, so the caching key, the matching rules and frang
+ * all see the canonical form: percent-escapes of unreserved characters
+ * are decoded, the hex digits of remaining escapes are uppercased and
+ * dot segments are removed. The pre-scan is cheap and most URIs need
+ * no rewriting at all.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/ctype.h>
+
+#include "http.h"
+#include "http_norm.h"
+
+bool tfw_http_norm_uri_on;
+
+static inline int
+__hexval(unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static inline bool
+__unreserved(unsigned char c)
+{
+	return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/**
+ * One cheap pass to see whether the URI needs rewriting: an escape, an
+ * empty segment or a dot right after a slash.
+ */
+static bool
+__uri_need_norm(const TfwStr *uri)
+{
+	const TfwStr *c, *end;
+	unsigned char prev = 0;
+
+	TFW_STR_FOR_EACH_CHUNK(c, uri, end) {
+		const unsigned char *p = c->ptr, *e = p + c->len;
+
+		for ( ; p < e; ++p) {
+			if (*p == '%')
+				return true;
+			if (prev == '/' && (*p == '/' || *p == '.'))
+				return true;
+			prev = *p;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Remove the dot segments from the plain path in @buf of @len bytes,
+ * RFC 3986 5.2.4. Works in place, @return the new length.
+ */
+static size_t
+__remove_dot_segments(unsigned char *buf, size_t len)
+{
+	unsigned char *out = buf, *p = buf, *e = buf + len;
+
+	while (p < e) {
+		if (p + 1 == e && p[0] == '/') {
+			*out++ = '/';
+			break;
+		}
+		if (p + 1 < e && p[0] == '/' && p[1] == '/') {
+			/* An empty segment, skip the extra slash. */
+			++p;
+			continue;
+		}
+		if (p + 2 == e && p[0] == '/' && p[1] == '.') {
+			*out++ = '/';
+			break;
+		}
+		if (p + 2 < e && p[0] == '/' && p[1] == '.' && p[2] == '/') {
+			p += 2;
+			continue;
+		}
+		if ((p + 3 == e && p[0] == '/' && p[1] == '.' && p[2] == '.')
+		    || (p + 3 < e && p[0] == '/' && p[1] == '.'
+			&& p[2] == '.' && p[3] == '/'))
+		{
+			/* Pop the previous segment. */
+			while (out > buf && *--out != '/')
+				;
+			if (p + 3 == e) {
+				*out++ = '/';
+				break;
+			}
+			p += 3;
+			continue;
+		}
+		/* Copy the whole segment. */
+		do {
+			*out++ = *p++;
+		} while (p < e && *p != '/');
+	}
+
+	return out - buf;
+}
+
+/**
+ * Normalize @req->uri_path in the request's pool and re-point the
+ * field to the plain canonical form. The original wire bytes are left
+ * untouched and are forwarded as received.
+ */
+int
+tfw_http_uri_normalize(TfwHttpReq *req)
+{
+	const TfwStr *c, *end;
+	unsigned char *buf, *out;
+	int esc_n = 0, esc_val = 0;
+
+	if (!tfw_http_norm_uri_on || TFW_STR_EMPTY(&req->uri_path))
+		return 0;
+	if (!__uri_need_norm(&req->uri_path))
+		return 0;
+
+	/* Decoding never grows the string. */
+	buf = tfw_pool_alloc(req->pool, req->uri_path.len);
+	if (!buf)
+		return -ENOMEM;
+	out = buf;
+
+	TFW_STR_FOR_EACH_CHUNK(c, &req->uri_path, end) {
+		const unsigned char *p = c->ptr, *e = p + c->len;
+
+		for ( ; p < e; ++p) {
+			int h;
+
+			if (esc_n == 1) {
+				/* The first hex digit of an escape. */
+				if ((h = __hexval(*p)) < 0) {
+					esc_n = 0;
+					*out++ = '%';
+					--p; /* reprocess the byte */
+					continue;
+				}
+				esc_val = h << 4;
+				esc_n = 2;
+				continue;
+			}
+			if (esc_n == 2) {
+				if ((h = __hexval(*p)) < 0) {
+					esc_n = 0;
+					*out++ = '%';
+					*out++ = "0123456789ABCDEF"
+						 [esc_val >> 4];
+					--p;
+					continue;
+				}
+				esc_val |= h;
+				esc_n = 0;
+				if (__unreserved(esc_val)) {
+					*out++ = esc_val;
+				} else {
+					*out++ = '%';
+					*out++ = "0123456789ABCDEF"
+						 [esc_val >> 4];
+					*out++ = "0123456789ABCDEF"
+						 [esc_val & 0xf];
+				}
+				continue;
+			}
+			if (*p == '%') {
+				esc_n = 1;
+				continue;
+			}
+			*out++ = *p;
+		}
+	}
+	/* A truncated trailing escape is emitted verbatim. */
+	if (esc_n) {
+		*out++ = '%';
+		if (esc_n == 2)
+			*out++ = "0123456789ABCDEF"[esc_val >> 4];
+	}
+
+	TFW_STR_INIT(&req->uri_path);
+	req->uri_path.ptr = buf;
+	/* Dot segments exist in the path only, never in the query. */
+	{
+		unsigned char *q = memchr(buf, '?', out - buf);
+		size_t plen = q ? (size_t)(q - buf) : (size_t)(out - buf);
+		size_t qlen = q ? out - q : 0;
+		size_t nlen = __remove_dot_segments(buf, plen);
+
+		if (q && nlen != plen)
+			memmove(buf + nlen, q, qlen);
+		req->uri_path.len = nlen + qlen;
+	}
+
+	return 0;
+}
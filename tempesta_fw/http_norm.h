@@ -31,6 +31,13 @@
 #ifndef __TFW_HTTP_NORM_H__
 #define __TFW_HTTP_NORM_H__
 
+#include "http.h"
+
+/* Set by the http_uri_normalize configuration directive. */
+extern bool tfw_http_norm_uri_on;
+
+int tfw_http_uri_normalize(TfwHttpReq *req);
+
 /* Switch on/off whole normalization logic. */
 #ifdef TFW_HTTP_NORMALIZATION
 
@@ -1111,6 +1111,14 @@ __parse_connection(TfwHttpMsg *hm, unsigned char *data, size_t len)
 				return CSTR_NEQ;
 			msg->flags |= TFW_HTTP_CONN_CLOSE;
 		});
+		/*
+		 * A protocol upgrade turns the connection into an
+		 * opaque tunnel which must not share a pipelined
+		 * backend connection - flag it for the message layer.
+		 */
+		TRY_HBH_TOKEN("upgrade", {
+			msg->flags |= TFW_HTTP_CONN_UPGRADE;
+		});
 		/* Spec headers */
 		TRY_HBH_TOKEN("keep-alive", {
 			unsigned int hid = TFW_HTTP_HDR_KEEP_ALIVE;
@@ -2057,6 +2065,27 @@ done:
 	return r;
 }
 
+/*
+ * Map header identifiers returned by tfw_hdr_req_lookup() to the states
+ * processing the corresponding header values. The classifier consumes the
+ * whole header name with the colon, so the target states are the same as
+ * reached by the byte-at-a-time dispatch in RGen_Hdr.
+ */
+static const int __hdr_req_val_st[TFW_HDRN_REQ_NUM] = {
+	[TFW_HDRN_REQ_AUTHORIZATION]	 = Req_HdrAuthorizationV,
+	[TFW_HDRN_REQ_CACHE_CONTROL]	 = Req_HdrCache_ControlV,
+	[TFW_HDRN_REQ_CONNECTION]	 = Req_HdrConnectionV,
+	[TFW_HDRN_REQ_CONTENT_LENGTH]	 = Req_HdrContent_LengthV,
+	[TFW_HDRN_REQ_CONTENT_TYPE]	 = Req_HdrContent_TypeV,
+	[TFW_HDRN_REQ_COOKIE]		 = Req_HdrCookieV,
+	[TFW_HDRN_REQ_HOST]		 = Req_HdrHostV,
+	[TFW_HDRN_REQ_KEEP_ALIVE]	 = Req_HdrKeep_AliveV,
+	[TFW_HDRN_REQ_PRAGMA]		 = Req_HdrPragmaV,
+	[TFW_HDRN_REQ_TRANSFER_ENCODING] = Req_HdrTransfer_EncodingV,
+	[TFW_HDRN_REQ_USER_AGENT]	 = Req_HdrUser_AgentV,
+	[TFW_HDRN_REQ_X_FORWARDED_FOR]	 = Req_HdrX_Forwarded_ForV,
+};
+
 int
 tfw_http_parse_req(void *req_data, unsigned char *data, size_t len)
 {
@@ -2313,10 +2342,27 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len)
 	 * of a header field name.
 	 */
 	__FSM_STATE(RGen_Hdr) {
+		int hid;
+
 		TFW_HTTP_PARSE_CRLF();
 
 		tfw_http_msg_hdr_open(msg, p);
 
+		/*
+		 * Classify a known header name with its colon in one
+		 * 16/32-byte gulp and jump directly to the value state.
+		 * Fall through to the byte-at-a-time dispatch below on
+		 * short data chunks and unknown headers.
+		 */
+		if (likely(__data_available(p, TFW_HDR_REQ_MAXLEN))
+		    && (hid = tfw_hdr_req_lookup(p)) >= 0)
+		{
+			parser->_i_st = __hdr_req_val_st[hid];
+			if (hid == TFW_HDRN_REQ_HOST)
+				parser->_hdr_tag = TFW_HTTP_HDR_HOST;
+			__FSM_MOVE_n(RGen_OWS, tfw_hdr_req_nlen(hid));
+		}
+
 		switch (TFW_LC(c)) {
 		case 'a':
 			if (likely(__data_available(p, 14)
@@ -3508,6 +3554,20 @@ tfw_http_parse_terminate(TfwHttpMsg *hm)
 	return false;
 }
 
+/* See __hdr_req_val_st, the same mapping for the response dispatch. */
+static const int __hdr_resp_val_st[TFW_HDRN_RESP_NUM] = {
+	[TFW_HDRN_RESP_AGE]		 = Resp_HdrAgeV,
+	[TFW_HDRN_RESP_CACHE_CONTROL]	 = Resp_HdrCache_ControlV,
+	[TFW_HDRN_RESP_CONNECTION]	 = Resp_HdrConnectionV,
+	[TFW_HDRN_RESP_CONTENT_LENGTH]	 = Resp_HdrContent_LengthV,
+	[TFW_HDRN_RESP_CONTENT_TYPE]	 = Resp_HdrContent_TypeV,
+	[TFW_HDRN_RESP_DATE]		 = Resp_HdrDateV,
+	[TFW_HDRN_RESP_EXPIRES]		 = Resp_HdrExpiresV,
+	[TFW_HDRN_RESP_KEEP_ALIVE]	 = Resp_HdrKeep_AliveV,
+	[TFW_HDRN_RESP_SERVER]		 = Resp_HdrServerV,
+	[TFW_HDRN_RESP_TRANSFER_ENCODING] = Resp_HdrTransfer_EncodingV,
+};
+
 int
 tfw_http_parse_resp(void *resp_data, unsigned char *data, size_t len)
 {
@@ -3604,10 +3664,20 @@ tfw_http_parse_resp(void *resp_data, unsigned char *data, size_t len)
 	 * of a header field name.
 	 */
 	__FSM_STATE(RGen_Hdr) {
+		int hid;
+
 		TFW_HTTP_PARSE_CRLF();
 
 		tfw_http_msg_hdr_open(msg, p);
 
+		/* One-gulp known name dispatch, as on the request side. */
+		if (likely(__data_available(p, TFW_HDR_REQ_MAXLEN))
+		    && (hid = tfw_hdr_resp_lookup(p)) >= 0)
+		{
+			parser->_i_st = __hdr_resp_val_st[hid];
+			__FSM_MOVE_n(RGen_OWS, tfw_hdr_resp_nlen(hid));
+		}
+
 		switch (TFW_LC(c)) {
 		case 'a':
 			if (likely(__data_available(p, 4)
@@ -0,0 +1,431 @@
+/**
+ *		Tempesta FW
+ *
+ * Regular expressions precompiled to DFAs for the HTTP matching rules.
+ *
+ * Interpreted regex per request doesn't survive our rates, so the
+ * whole cost is paid at configuration time: the pattern is parsed
+ * into a Thompson NFA and converted to a DFA by subset construction,
+ * and request matching is a single table-driven state walk over the
+ * TfwStr chunks, one load per input byte, no flattening, no
+ * backtracking. Pathological patterns are rejected at compile time by
+ * hard caps on the NFA and DFA sizes; backreferences and counted
+ * repetition are not part of the grammar at all.
+ *
+ * Supported syntax: literals, '\' escapes, '.', character classes
+ * ("[a-z]", "[^/]"), grouping "(...)", alternation '|', and the
+ * postfix repeats '?', '*', '+'. A pattern is a search unless
+ * anchored: '^' binds the match to the start, a trailing '$' to the
+ * end.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "http_rex.h"
+#include "log.h"
+
+#define REX_NFA_MAX	512
+#define REX_DFA_MAX	255	/* id 0 is the dead state */
+#define REX_SET_LONGS	(REX_NFA_MAX / BITS_PER_LONG)
+
+/*
+ * An NFA state: either a consuming state (@bm is the set of accepted
+ * bytes, @to the next state) or a pure epsilon state with up to two
+ * successors (@e1, @e2; -1 - none). A state with neither is the
+ * dangling exit of a fragment under construction.
+ */
+typedef struct {
+	unsigned long	bm[256 / BITS_PER_LONG];
+	int		to;
+	int		e1, e2;
+	unsigned char	accept;
+} RexNSt;
+
+typedef struct {
+	RexNSt		st[REX_NFA_MAX];
+	int		n;
+	const char	*p;		/* parse cursor */
+	bool		anchor_end;
+} RexCompiler;
+
+/* A fragment: entry state and the single dangling exit state. */
+typedef struct {
+	int	start;
+	int	end;
+} RexFrag;
+
+struct tfw_rex_t {
+	unsigned char	*trans;		/* REX_DFA states x 256 bytes */
+	unsigned long	accept[REX_DFA_MAX / BITS_PER_LONG + 1];
+	int		n_states;
+	int		start;
+	bool		anchor_end;
+};
+
+static int
+rex_new_st(RexCompiler *rc)
+{
+	RexNSt *st;
+
+	if (rc->n >= REX_NFA_MAX)
+		return -1;
+	st = &rc->st[rc->n];
+	memset(st, 0, sizeof(*st));
+	st->to = st->e1 = st->e2 = -1;
+	return rc->n++;
+}
+
+static int rex_parse_alt(RexCompiler *rc, RexFrag *f);
+
+/*
+ * Parse one atom: a literal (possibly escaped), '.', a class or a
+ * group. Returns 0 on success with @f filled.
+ */
+static int
+rex_parse_atom(RexCompiler *rc, RexFrag *f)
+{
+	int s, e;
+	unsigned char c = *rc->p;
+
+	if (c == '(') {
+		++rc->p;
+		if (rex_parse_alt(rc, f))
+			return -1;
+		if (*rc->p != ')')
+			return -1;
+		++rc->p;
+		return 0;
+	}
+
+	if ((s = rex_new_st(rc)) < 0 || (e = rex_new_st(rc)) < 0)
+		return -1;
+	f->start = s;
+	f->end = e;
+	rc->st[s].to = e;
+
+	if (c == '.') {
+		++rc->p;
+		memset(rc->st[s].bm, 0xff, sizeof(rc->st[s].bm));
+		return 0;
+	}
+	if (c == '[') {
+		bool neg = false;
+		unsigned char prev = 0;
+
+		++rc->p;
+		if (*rc->p == '^') {
+			neg = true;
+			++rc->p;
+		}
+		while ((c = *rc->p) && c != ']') {
+			++rc->p;
+			if (c == '\\' && *rc->p) {
+				c = *rc->p;
+				++rc->p;
+			}
+			if (c == '-' && prev && *rc->p && *rc->p != ']') {
+				unsigned char hi = *rc->p;
+
+				++rc->p;
+				if (hi == '\\' && *rc->p) {
+					hi = *rc->p;
+					++rc->p;
+				}
+				for ( ; prev <= hi; ++prev)
+					__set_bit(prev, rc->st[s].bm);
+				prev = 0;
+				continue;
+			}
+			__set_bit(c, rc->st[s].bm);
+			prev = c;
+		}
+		if (*rc->p != ']')
+			return -1;
+		++rc->p;
+		if (neg) {
+			int i;
+
+			for (i = 0; i < ARRAY_SIZE(rc->st[s].bm); ++i)
+				rc->st[s].bm[i] = ~rc->st[s].bm[i];
+		}
+		return 0;
+	}
+	if (c == '\\') {
+		++rc->p;
+		c = *rc->p;
+		if (!c)
+			return -1;
+	} else if (!c || strchr(")|?*+", c)) {
+		return -1;
+	}
+	++rc->p;
+	__set_bit(c, rc->st[s].bm);
+	return 0;
+}
+
+static int
+rex_parse_rep(RexCompiler *rc, RexFrag *f)
+{
+	int s, j;
+	unsigned char c;
+
+	if (rex_parse_atom(rc, f))
+		return -1;
+
+	c = *rc->p;
+	if (c != '?' && c != '*' && c != '+')
+		return 0;
+	++rc->p;
+	/* Counted repetition is rejected by the grammar on purpose. */
+	if (*rc->p == '?' || *rc->p == '*' || *rc->p == '+')
+		return -1;
+
+	if ((s = rex_new_st(rc)) < 0 || (j = rex_new_st(rc)) < 0)
+		return -1;
+	rc->st[s].e1 = f->start;
+	rc->st[s].e2 = j;
+	switch (c) {
+	case '?':
+		rc->st[f->end].e1 = j;
+		f->start = s;
+		break;
+	case '*':
+		rc->st[f->end].e1 = s;
+		f->start = s;
+		break;
+	case '+':
+		rc->st[f->end].e1 = s;
+		break;
+	}
+	f->end = j;
+	return 0;
+}
+
+static int
+rex_parse_cat(RexCompiler *rc, RexFrag *f)
+{
+	RexFrag g;
+
+	if (rex_parse_rep(rc, f))
+		return -1;
+	while (*rc->p && *rc->p != '|' && *rc->p != ')'
+	       && !(*rc->p == '$' && !rc->p[1]))
+	{
+		if (rex_parse_rep(rc, &g))
+			return -1;
+		rc->st[f->end].e1 = g.start;
+		f->end = g.end;
+	}
+	return 0;
+}
+
+static int
+rex_parse_alt(RexCompiler *rc, RexFrag *f)
+{
+	RexFrag g;
+	int s, j;
+
+	if (rex_parse_cat(rc, f))
+		return -1;
+	while (*rc->p == '|') {
+		++rc->p;
+		if (rex_parse_cat(rc, &g))
+			return -1;
+		if ((s = rex_new_st(rc)) < 0 || (j = rex_new_st(rc)) < 0)
+			return -1;
+		rc->st[s].e1 = f->start;
+		rc->st[s].e2 = g.start;
+		rc->st[f->end].e1 = j;
+		rc->st[g.end].e1 = j;
+		f->start = s;
+		f->end = j;
+	}
+	return 0;
+}
+
+static void
+rex_closure(const RexCompiler *rc, unsigned long *set)
+{
+	bool grown = true;
+
+	while (grown) {
+		int i;
+
+		grown = false;
+		for_each_set_bit(i, set, rc->n) {
+			const RexNSt *st = &rc->st[i];
+
+			if (st->e1 >= 0 && !__test_and_set_bit(st->e1, set))
+				grown = true;
+			if (st->e2 >= 0 && !__test_and_set_bit(st->e2, set))
+				grown = true;
+		}
+	}
+}
+
+/**
+ * Compile @pattern into a DFA. Returns NULL on invalid or pathological
+ * (state-cap exceeding) patterns. Process context: the construction
+ * scratch is about 100KB and allocated with vmalloc.
+ */
+TfwRex *
+tfw_rex_compile(const char *pattern)
+{
+	RexCompiler *rc;
+	RexFrag f;
+	TfwRex *re = NULL;
+	unsigned long (*sets)[REX_SET_LONGS] = NULL;
+	unsigned long nxt[REX_SET_LONGS];
+	int n_dfa = 0, d, i;
+
+	if (!(rc = vzalloc(sizeof(*rc))))
+		return NULL;
+	rc->p = pattern;
+
+	if (*rc->p == '^')
+		++rc->p;
+	if (rex_parse_alt(rc, &f))
+		goto err;
+	if (*rc->p == '$' && !rc->p[1]) {
+		rc->anchor_end = true;
+		++rc->p;
+	}
+	if (*rc->p) /* trailing garbage, e.g. unbalanced ')' */
+		goto err;
+	rc->st[f.end].accept = 1;
+
+	/* Unanchored search: allow skipping any prefix. */
+	if (*pattern != '^') {
+		int s = rex_new_st(rc), a = rex_new_st(rc);
+
+		if (s < 0 || a < 0)
+			goto err;
+		rc->st[s].e1 = f.start;
+		rc->st[s].e2 = a;
+		memset(rc->st[a].bm, 0xff, sizeof(rc->st[a].bm));
+		rc->st[a].to = s;
+		f.start = s;
+	}
+
+	if (!(sets = vzalloc((REX_DFA_MAX + 1) * sizeof(*sets))))
+		goto err;
+	if (!(re = kzalloc(sizeof(*re), GFP_KERNEL)))
+		goto err;
+	if (!(re->trans = vzalloc((REX_DFA_MAX + 1) * 256)))
+		goto err;
+	re->anchor_end = rc->anchor_end;
+
+	/* DFA state 0 is the dead state; the start set becomes 1. */
+	__set_bit(f.start, sets[1]);
+	rex_closure(rc, sets[1]);
+	n_dfa = 1;
+	re->start = 1;
+
+	for (d = 1; d <= n_dfa; ++d) {
+		int c;
+
+		for_each_set_bit(i, sets[d], rc->n)
+			if (rc->st[i].accept) {
+				__set_bit(d, re->accept);
+				break;
+			}
+
+		for (c = 0; c < 256; ++c) {
+			int t;
+
+			memset(nxt, 0, sizeof(nxt));
+			for_each_set_bit(i, sets[d], rc->n) {
+				const RexNSt *st = &rc->st[i];
+
+				if (st->to >= 0 && test_bit(c, st->bm))
+					__set_bit(st->to, nxt);
+			}
+			if (bitmap_empty(nxt, rc->n))
+				continue; /* dead */
+			rex_closure(rc, nxt);
+
+			for (t = 1; t <= n_dfa; ++t)
+				if (bitmap_equal(nxt, sets[t], rc->n))
+					break;
+			if (t > n_dfa) {
+				if (n_dfa >= REX_DFA_MAX) {
+					TFW_ERR_NL("regex '%s' is too complex"
+						   " (over %d DFA states)\n",
+						   pattern, REX_DFA_MAX);
+					goto err;
+				}
+				++n_dfa;
+				memcpy(sets[t], nxt, sizeof(nxt));
+			}
+			re->trans[(d << 8) + c] = t;
+		}
+	}
+	re->n_states = n_dfa;
+
+	vfree(sets);
+	vfree(rc);
+	return re;
+err:
+	TFW_ERR_NL("can't compile regex '%s'\n", pattern);
+	if (re) {
+		vfree(re->trans);
+		kfree(re);
+	}
+	vfree(sets);
+	vfree(rc);
+	return NULL;
+}
+EXPORT_SYMBOL(tfw_rex_compile);
+
+void
+tfw_rex_free(TfwRex *re)
+{
+	if (!re)
+		return;
+	vfree(re->trans);
+	kfree(re);
+}
+EXPORT_SYMBOL(tfw_rex_free);
+
+/**
+ * Run the DFA over the possibly chunked @str. A single table load per
+ * byte; early exit on a definitive match (or on the dead state, which
+ * is final since the unanchored self-loop is part of the automaton).
+ */
+bool
+tfw_rex_match(const TfwRex *re, const TfwStr *str)
+{
+	unsigned int st = re->start;
+	const TfwStr *chunk, *end;
+
+	TFW_STR_FOR_EACH_CHUNK(chunk, str, end) {
+		const unsigned char *p = chunk->ptr;
+		const unsigned char *pe = p + chunk->len;
+
+		for ( ; p < pe; ++p) {
+			st = re->trans[(st << 8) + *p];
+			if (!st)
+				return false;
+			if (!re->anchor_end && test_bit(st, re->accept))
+				return true;
+		}
+	}
+	return test_bit(st, re->accept);
+}
+EXPORT_SYMBOL(tfw_rex_match);
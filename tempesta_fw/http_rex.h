@@ -0,0 +1,33 @@
+/**
+ *		Tempesta FW
+ *
+ * Regular expressions precompiled to DFAs, see http_rex.c.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_HTTP_REX_H__
+#define __TFW_HTTP_REX_H__
+
+#include "str.h"
+
+typedef struct tfw_rex_t TfwRex;
+
+TfwRex *tfw_rex_compile(const char *pattern);
+void tfw_rex_free(TfwRex *re);
+bool tfw_rex_match(const TfwRex *re, const TfwStr *str);
+
+#endif /* __TFW_HTTP_REX_H__ */
@@ -36,6 +36,7 @@
 #include <crypto/hash.h>
 #include <linux/ctype.h>
 #include <linux/hashtable.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
 #include <linux/time.h>
 
@@ -45,6 +46,8 @@
 #include "hash.h"
 #include "http_msg.h"
 #include "http_sess.h"
+#include "server.h"
+#include "tdb.h"
 
 #define STICKY_NAME_MAXLEN	(32)
 #define STICKY_NAME_DEFAULT	"__tfw"
@@ -92,6 +95,144 @@ static SessHashBucket sess_hash[SESS_HASH_SZ] = {
 
 static struct kmem_cache *sess_cache;
 
+/*
+ * Session persistence: sticky affinity is infrastructure, not process
+ * state, so sessions are mirrored into a TDB table and reloaded on
+ * start - a restart doesn't log every user out of affinity and cause
+ * a rescheduling stampede against cold backends. The record key is
+ * the 64-bit hash of the cookie HMAC that the in-memory table already
+ * computes. Writes happen on the slow paths only: session creation
+ * and the first server pinning.
+ *
+ * @hmac	- the sticky cookie HMAC, the lookup identity;
+ * @ts		- the cookie timestamp;
+ * @expires	- expiry as wall-clock seconds (jiffies don't survive
+ *		  a restart), 0 - unlimited;
+ * @srv_addr	- the pinned server, zeroed family if none yet.
+ */
+typedef struct {
+	unsigned char	hmac[SHA1_DIGEST_SIZE];
+	unsigned long	ts;
+	unsigned long	expires;
+	TfwAddr		srv_addr;
+} TfwSessEnt;
+
+static char *sess_db_path;
+static unsigned int sess_db_sz = 16 * 1024 * 1024;
+static TDB *sess_db;
+
+static unsigned long
+tfw_sess_key(const unsigned char *hmac)
+{
+	unsigned long key = 0, crc_tmp = 0;
+
+	__tdb_hash_calc(&key, &crc_tmp, hmac, STICKY_KEY_MAXLEN);
+	return key | (crc_tmp << 32);
+}
+
+static void
+tfw_sess_persist(TfwHttpSess *sess, const TfwAddr *srv_addr)
+{
+	unsigned long key = tfw_sess_key(sess->hmac);
+	TfwSessEnt ent = {
+		.ts = sess->ts,
+		.expires = sess->expires
+			   ? get_seconds()
+			     + (long)(sess->expires - jiffies) / (long)HZ
+			   : 0,
+	};
+	TdbIter iter;
+	size_t len = sizeof(ent);
+
+	if (!sess_db)
+		return;
+
+	memcpy(ent.hmac, sess->hmac, sizeof(ent.hmac));
+	if (srv_addr)
+		ent.srv_addr = *srv_addr;
+
+	/* Fixed records are updated in place under the bucket lock. */
+	iter = tdb_rec_get(sess_db, key);
+	while (!TDB_ITER_BAD(iter)) {
+		TfwSessEnt *e = (TfwSessEnt *)iter.rec->data;
+
+		if (!memcmp(e->hmac, ent.hmac, sizeof(ent.hmac))) {
+			if (srv_addr)
+				e->srv_addr = *srv_addr;
+			e->expires = ent.expires;
+			tdb_rec_put(iter.rec);
+			return;
+		}
+		tdb_rec_next(sess_db, &iter);
+	}
+
+	tdb_entry_create(sess_db, key, &ent, &len);
+}
+
+/*
+ * Resolve a persisted server address against the configured servers.
+ * Runs at configuration start only, so a static context around
+ * tfw_sg_for_each_srv() is safe.
+ */
+static const TfwAddr *sess_load_addr;
+static TfwServer *sess_load_srv;
+
+static int
+__sess_srv_match(TfwServer *srv)
+{
+	if (tfw_addr_eq(&srv->addr, sess_load_addr))
+		sess_load_srv = srv;
+	return 0;
+}
+
+static int
+tfw_sess_load_cb(TdbRec *rec, void *data)
+{
+	TfwSessEnt *ent = (TfwSessEnt *)rec->data;
+	TfwHttpSess *sess;
+	SessHashBucket *hb;
+	unsigned long key = tfw_sess_key(ent->hmac);
+
+	if (ent->expires && ent->expires <= get_seconds())
+		return 0;
+	if (!(sess = kmem_cache_alloc(sess_cache, GFP_ATOMIC)))
+		return -ENOMEM;
+
+	memcpy(sess->hmac, ent->hmac, sizeof(sess->hmac));
+	atomic_set(&sess->users, 1);
+	sess->ts = ent->ts;
+	sess->expires = ent->expires
+			? jiffies + (ent->expires - get_seconds()) * HZ
+			: 0;
+	sess->st_conn.srv_conn = NULL;
+	sess->st_conn.main_sg = NULL;
+	sess->st_conn.backup_sg = NULL;
+	sess->pin_srv = NULL;
+	rwlock_init(&sess->st_conn.lock);
+
+	if (ent->srv_addr.family != AF_UNSPEC) {
+		sess_load_addr = &ent->srv_addr;
+		sess_load_srv = NULL;
+		tfw_sg_for_each_srv(__sess_srv_match);
+		sess->pin_srv = sess_load_srv;
+	}
+
+	hb = &sess_hash[hash_min(key, SESS_HASH_BITS)];
+	spin_lock(&hb->lock);
+	hlist_add_head_rcu(&sess->hentry, &hb->list);
+	spin_unlock(&hb->lock);
+
+	return 0;
+}
+
+static bool
+tfw_sess_ent_expired(TdbRec *rec)
+{
+	TfwSessEnt *ent = (TfwSessEnt *)rec->data;
+
+	return ent->expires && ent->expires <= get_seconds();
+}
+
 static int
 tfw_http_sticky_send_302(TfwHttpReq *req, StickyVal *sv)
 {
@@ -501,15 +642,23 @@ tfw_http_sess_resp_process(TfwHttpResp *resp, TfwHttpReq *req)
 	return tfw_http_sticky_add(resp, req);
 }
 
+static void
+tfw_http_sess_rcu_free(struct rcu_head *head)
+{
+	kmem_cache_free(sess_cache, container_of(head, TfwHttpSess, rcu));
+}
+
 void
 tfw_http_sess_put(TfwHttpSess *sess)
 {
 	if (atomic_dec_and_test(&sess->users))
 		/*
-		 * Use counter reached 0, so session already expired and evicted
-		 * from the hash table.
+		 * Use counter reached 0, so session already expired and
+		 * evicted from the hash table. Lock-free readers may
+		 * still examine the entry, so free it after they're
+		 * done, see tfw_http_sess_obtain().
 		 */
-		kmem_cache_free(sess_cache, sess);
+		call_rcu_bh(&sess->rcu, tfw_http_sess_rcu_free);
 }
 
 /**
@@ -553,13 +702,34 @@ tfw_http_sess_obtain(TfwHttpReq *req)
 
 	hb = &sess_hash[hash_min(key, SESS_HASH_BITS)];
 
+	/*
+	 * Lock-free fast path: session lookups vastly outnumber session
+	 * creations, so walk the bucket under RCU and take a reference
+	 * only if the session is still in use.
+	 */
+	rcu_read_lock_bh();
+	hlist_for_each_entry_rcu(sess, &hb->list, hentry) {
+		if (sess->expires && sess->expires < jiffies)
+			continue; /* collected on the slow path */
+		if (!memcmp(sv.hmac, sess->hmac, sizeof(sess->hmac))
+		    && atomic_inc_not_zero(&sess->users))
+		{
+			rcu_read_unlock_bh();
+			req->sess = sess;
+			return 0;
+		}
+	}
+	rcu_read_unlock_bh();
+
+	/* Slow path: collect garbage and insert under the bucket lock. */
 	spin_lock(&hb->lock);
 
 	hlist_for_each_entry_safe(sess, tmp, &hb->list, hentry) {
 		/* Collect garbage first to not to return expired session. */
-		if (sess->expires < jiffies) {
-			hash_del(&sess->hentry);
+		if (sess->expires && sess->expires < jiffies) {
+			hlist_del_rcu(&sess->hentry);
 			tfw_http_sess_put(sess);
+			continue;
 		}
 
 		if (!memcmp(sv.hmac, sess->hmac, sizeof(sess->hmac)))
@@ -572,7 +742,7 @@ tfw_http_sess_obtain(TfwHttpReq *req)
 	}
 
 	memcpy(sess->hmac, sv.hmac, sizeof(sv.hmac));
-	hlist_add_head(&sess->hentry, &hb->list);
+	hlist_add_head_rcu(&sess->hentry, &hb->list);
 	/*
 	 * Sessions are removed by the garbage collection above, so the hash
 	 * table is initial user of the session plus to the function caller.
@@ -585,8 +755,11 @@ tfw_http_sess_obtain(TfwHttpReq *req)
 	sess->st_conn.srv_conn = NULL;
 	sess->st_conn.main_sg = NULL;
 	sess->st_conn.backup_sg = NULL;
+	sess->pin_srv = NULL;
 	rwlock_init(&sess->st_conn.lock);
 
+	tfw_sess_persist(sess, NULL);
+
 	TFW_DBG("new session %p\n", sess);
 
 found:
@@ -655,22 +828,25 @@ tfw_http_sess_get_srv_conn(TfwMsg *msg)
 	if (st_conn->srv_conn) {
 		/* Failed to sched from the same server. */
 		TfwServer *srv = (TfwServer *)st_conn->srv_conn->peer;
-		char addr_str[TFW_ADDR_STR_BUF_SIZE] = { 0 };
 
-		tfw_addr_ntop(&srv->addr, addr_str, sizeof(addr_str));
+		if (srv->sg->flags & TFW_SRV_STICKY) {
+			char addr_str[TFW_ADDR_STR_BUF_SIZE] = { 0 };
 
-		if (!(srv->sg->flags & TFW_SRV_STICKY_FAILOVER)) {
-			TFW_ERR("sched %s: Unable to schedule new request in "
-				"session to server %s in group %s\n",
-				srv->sg->sched->name, addr_str, srv->sg->name);
-			return NULL;
-		}
-		else {
-			TFW_WARN("sched %s: Unable to schedule new request in "
-				 "session to server %s in group %s,"
+			tfw_addr_ntop(&srv->addr, addr_str, sizeof(addr_str));
+			if (!(srv->sg->flags & TFW_SRV_STICKY_FAILOVER)) {
+				TFW_ERR("sched %s: Unable to schedule new"
+					" request in session to server %s in"
+					" group %s\n", srv->sg->sched->name,
+					addr_str, srv->sg->name);
+				return NULL;
+			}
+			TFW_WARN("sched %s: Unable to schedule new request in"
+				 " session to server %s in group %s,"
 				 " fallback to a new server\n",
-				 srv->sg->sched->name, addr_str, srv->sg->name);
+				 srv->sg->sched->name, addr_str,
+				 srv->sg->name);
 		}
+		/* A cached decision just falls back to scheduling. */
 	}
 
 	write_lock(&st_conn->lock);
@@ -681,19 +857,40 @@ tfw_http_sess_get_srv_conn(TfwMsg *msg)
 	if ((srv_conn = __try_conn(msg, st_conn)))
 		goto done;
 
-	if (st_conn->main_sg)
+	if (st_conn->main_sg) {
 		srv_conn = tfw_sched_get_sg_srv_conn(msg, st_conn->main_sg,
 						     st_conn->backup_sg);
-	else
+	} else if (sess->pin_srv) {
+		/* A reloaded session goes back to its old server. */
+		TfwServer *srv = sess->pin_srv;
+
+		sess->pin_srv = NULL;
+		srv_conn = srv->sg->sched->sched_srv_conn(msg, srv);
+		if (!srv_conn)
+			srv_conn = __tfw_sched_get_srv_conn(msg);
+	} else {
 		srv_conn = __tfw_sched_get_srv_conn(msg);
+	}
 
 	/*
-	 * Save connection into session only if used server group is configured
-	 * to have sticky connections.
+	 * Save the connection into the session if the server group is
+	 * configured for sticky connections, or opportunistically when
+	 * the scheduler's decision doesn't depend on the message
+	 * content - then following requests of the session skip the
+	 * whole scheduling pass while the connection is usable.
 	 */
-	if (srv_conn
-	    && (((TfwServer *)srv_conn->peer)->sg->flags & TFW_SRV_STICKY)) {
-		st_conn->srv_conn = srv_conn;
+	if (srv_conn) {
+		TfwSrvGroup *sg = ((TfwServer *)srv_conn->peer)->sg;
+
+		if ((sg->flags & TFW_SRV_STICKY)
+		    || sg->sched->decision_cacheable)
+		{
+			/* Make the affinity durable on the first pin. */
+			if (st_conn->srv_conn != srv_conn)
+				tfw_sess_persist(sess,
+					&((TfwServer *)srv_conn->peer)->addr);
+			st_conn->srv_conn = srv_conn;
+		}
 	}
 
 done:
@@ -722,7 +919,7 @@ tfw_http_sess_init(void)
 	}
 
 	sess_cache = kmem_cache_create("tfw_sess_cache", sizeof(TfwHttpSess),
-				       0, 0, NULL);
+				       0, SLAB_HWCACHE_ALIGN, NULL);
 	if (!sess_cache)
 		goto err_shash;
 
@@ -757,6 +954,8 @@ tfw_http_sess_exit(void)
 			kmem_cache_free(sess_cache, s);
 		}
 	}
+	/* Wait for the deferred frees before destroying the cache. */
+	rcu_barrier_bh();
 	kmem_cache_destroy(sess_cache);
 
 	kfree(tfw_cfg_sticky.name.ptr);
@@ -769,6 +968,23 @@ tfw_cfg_sess_start(void)
 {
 	tfw_cfg_sticky.enabled = !TFW_STR_EMPTY(&tfw_cfg_sticky.name);
 
+	if (tfw_cfg_sticky.enabled && sess_db_path && *sess_db_path
+	    && !sess_db)
+	{
+		sess_db = tdb_open(sess_db_path, sess_db_sz,
+				   sizeof(TfwSessEnt), numa_node_id());
+		if (!sess_db) {
+			TFW_WARN_NL("can't open session table '%s',"
+				    " sessions won't survive restarts\n",
+				    sess_db_path);
+		} else {
+			tdb_set_expire_cb(sess_db, tfw_sess_ent_expired);
+			/* Servers are created at parse time, so the
+			 * persisted pins resolve here. */
+			tdb_entry_walk(sess_db, tfw_sess_load_cb, NULL);
+		}
+	}
+
 	return 0;
 }
 
@@ -776,6 +992,11 @@ static void
 tfw_cfg_sess_stop(void)
 {
 	tfw_cfg_sticky.enabled = 0;
+
+	if (sess_db) {
+		tdb_close(sess_db);
+		sess_db = NULL;
+	}
 }
 
 static int
@@ -864,6 +1085,15 @@ TfwCfgMod tfw_http_sess_cfg_mod = {
 			.handler = tfw_http_sticky_secret_cfg,
 			.allow_none = true,
 		},
+		{
+			.name = "sess_db",
+			.handler = tfw_cfg_set_str,
+			.dest = &sess_db_path,
+			.spec_ext = &(TfwCfgSpecStr) {
+				.len_range = { 1, PATH_MAX },
+			},
+			.allow_none = true,
+		},
 		{
 			/* Value is parsed as int, set max to INT_MAX*/
 			.name = "sess_lifetime",
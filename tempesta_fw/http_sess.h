@@ -46,6 +46,9 @@ typedef struct {
  * @ts		- timestamp for the client's session;
  * @expire	- expiration time for the session;
  * @st_conn	- upstream server connection servicing the session;
+ * @pin_srv	- server restored from the persisted session table,
+ *		  consumed by the first scheduling pass after restart;
+ * @rcu		- to defer freeing until RCU readers are done;
  */
 struct tfw_http_sess_t {
 	unsigned char		hmac[SHA1_DIGEST_SIZE];
@@ -54,6 +57,8 @@ struct tfw_http_sess_t {
 	unsigned long		ts;
 	unsigned long		expires;
 	TfwStickyConn		st_conn;
+	TfwServer		*pin_srv;
+	struct rcu_head		rcu;
 };
 
 int tfw_http_sess_obtain(TfwHttpReq *req);
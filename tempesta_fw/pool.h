@@ -41,16 +41,39 @@ typedef struct tfw_pool_chunk_t {
 	unsigned int		off;
 } TfwPoolChunk;
 
+/*
+ * Freed interior block kept for reuse; the descriptor lives in the
+ * block itself, so only blocks of at least sizeof(TfwPoolFBlk) are
+ * recycled.
+ *
+ * @next	- next free block of the same size class;
+ * @n		- block size, bytes;
+ */
+typedef struct tfw_pool_fblk_t {
+	struct tfw_pool_fblk_t	*next;
+	size_t			n;
+} TfwPoolFBlk;
+
+/* Size classes of the intra-pool free lists: 16 bytes to 2KB. */
+#define TFW_POOL_FL_MIN		4
+#define TFW_POOL_FL_MAX		11
+#define TFW_POOL_FL_N		(TFW_POOL_FL_MAX - TFW_POOL_FL_MIN + 1)
+
 /**
  * Memory pool descriptor.
  *
  * @curr	- current chunk to allocate memory from;
  * @order,@off	- cached members of @curr;
+ * @fl		- size-classed lists of freed interior blocks; class c
+ *		  holds blocks of [2^c, 2^(c+1)) bytes;
+ * @fl_map	- bitmap of non-empty classes, checked on the fast path;
  */
 typedef struct {
 	TfwPoolChunk	*curr;
 	unsigned int	order;
 	unsigned int	off;
+	unsigned int	fl_map;
+	TfwPoolFBlk	*fl[TFW_POOL_FL_N];
 } TfwPool;
 
 #define tfw_pool_new(struct_name, mask)					\
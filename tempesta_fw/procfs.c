@@ -21,7 +21,9 @@
 #include <linux/seq_file.h>
 
 #include "apm.h"
+#include "client.h"
 #include "server.h"
+#include "vhost.h"
 #include "procfs.h"
 
 /*
@@ -48,6 +50,12 @@ tfw_perfstat_collect(TfwPerfStat *stat)
 		SADD(ss.pfl_hits);
 		SADD(ss.pfl_misses);
 
+		/* Pool allocator statistics. */
+		SADD(pool.pg_cache_hits);
+		SADD(pool.pg_misses);
+		SADD(pool.pg_curr);
+		SADD(pool.pg_max);
+
 		/* Cache statistics. */
 		SADD(cache.hits);
 		SADD(cache.misses);
@@ -60,6 +68,9 @@ tfw_perfstat_collect(TfwPerfStat *stat)
 		SADD(clnt.msgs_filtout);
 		SADD(clnt.msgs_otherr);
 		SADD(clnt.online);
+		SADD(clnt.tls_verify_ok);
+		SADD(clnt.tls_verify_fail);
+		SADD(clnt.tls_verify_resumed);
 		SADD(clnt.conn_attempts);
 		SADD(clnt.conn_disconnects);
 		SADD(clnt.conn_established);
@@ -96,6 +107,12 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	SPRN("SS pfl hits\t\t\t\t", ss.pfl_hits);
 	SPRN("SS pfl misses\t\t\t\t", ss.pfl_misses);
 
+	/* Pool allocator statistics. */
+	SPRN("Pool pages from cache\t\t\t", pool.pg_cache_hits);
+	SPRN("Pool pages from buddy\t\t\t", pool.pg_misses);
+	SPRN("Pool pages in use\t\t\t", pool.pg_curr);
+	SPRN("Pool pages high water (sum)\t\t", pool.pg_max);
+
 	/* Cache statistics. */
 	SPRN("Cache hits\t\t\t\t", cache.hits);
 	SPRN("Cache misses\t\t\t\t", cache.misses);
@@ -108,10 +125,18 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	SPRN("Client messages filtered out\t\t", clnt.msgs_filtout);
 	SPRN("Client messages other errors\t\t", clnt.msgs_otherr);
 	SPRN("Clients online\t\t\t\t", clnt.online);
+	SPRN("Client cert verifications ok\t\t", clnt.tls_verify_ok);
+	SPRN("Client cert verifications failed\t", clnt.tls_verify_fail);
+	SPRN("Client cert verifications skipped\t", clnt.tls_verify_resumed);
+	SPRN("Client TLS handshakes full\t\t", clnt.tls_hs_full);
+	SPRN("Client TLS handshakes resumed\t\t", clnt.tls_hs_resumed);
 	SPRN("Client connection attempts\t\t", clnt.conn_attempts);
 	SPRN("Client established connections\t\t", clnt.conn_established);
 	SPRNE("Client connections active\t\t",
 	      stat.clnt.conn_established - stat.clnt.conn_disconnects);
+	/* -1 when no drain is in progress. */
+	seq_printf(seq, "Client connections draining\t\t: %d\n",
+		   atomic_read(&tfw_cli_drain_left));
 	SPRN("Client RX bytes\t\t\t\t", clnt.rx_bytes);
 
 	/* Server related statistics. */
@@ -204,6 +229,88 @@ static struct file_operations tfw_srvstats_fops = {
 	.release	= single_release,
 };
 
+#define TFW_VHOSTSTATS_NAME_MAX		80
+
+/*
+ * Response time statistics aggregated per vhost and per location,
+ * in one file since locations belong to the vhost.
+ */
+static void
+tfw_vhoststats_print(struct seq_file *seq, const char *name, void *apm)
+{
+	int i;
+	TfwPrcntl prcntl[ARRAY_SIZE(tfw_procfs_prcntl)];
+	TfwPrcntlStats pstats = { prcntl, ARRAY_SIZE(prcntl) };
+
+	if (!apm)
+		return;
+
+	memcpy(prcntl, tfw_procfs_prcntl, sizeof(prcntl));
+	tfw_apm_stats_bh(apm, &pstats);
+
+	seq_printf(seq, "%s: min=%ums avg=%ums max=%ums",
+		   name, pstats.min, pstats.avg, pstats.max);
+	for (i = 0; i < ARRAY_SIZE(prcntl); ++i)
+		seq_printf(seq, " %02d%%=%ums", prcntl[i].ith, prcntl[i].val);
+	seq_printf(seq, "\n");
+}
+
+static int
+tfw_vhoststats_seq_show(struct seq_file *seq, void *off)
+{
+	size_t i, loc_n;
+	TfwLocation *loc;
+	TfwVhost *vhost = tfw_vhost_get_default();
+
+	tfw_vhoststats_print(seq, "default", vhost->apm);
+
+	loc_n = tfw_vhost_locations(&loc);
+	for (i = 0; i < loc_n; ++i) {
+		char name[TFW_VHOSTSTATS_NAME_MAX];
+
+		snprintf(name, sizeof(name), "location '%s'",
+			 loc[i].arg ? : "*");
+		tfw_vhoststats_print(seq, name, loc[i].apm);
+	}
+
+	return 0;
+}
+
+static int
+tfw_vhoststats_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tfw_vhoststats_seq_show, PDE_DATA(inode));
+}
+
+/* Heavy hitters: the top-K URI hashes by request count. */
+static int
+tfw_hh_seq_show(struct seq_file *seq, void *off)
+{
+	return tfw_apm_hh_report(seq);
+}
+
+static int
+tfw_hh_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tfw_hh_seq_show, PDE_DATA(inode));
+}
+
+static struct file_operations tfw_hh_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_hh_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct file_operations tfw_vhoststats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_vhoststats_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 #define TFW_PROCFS_SRV_CNT_MAX		256
 static TfwServer *srvlst[TFW_PROCFS_SRV_CNT_MAX];
 static int slsz = 0;
@@ -252,6 +359,12 @@ tfw_procfs_cfg_start(void)
 	tfw_procfs_srvstats = proc_mkdir("servers", tfw_procfs_tempesta);
 	if (!tfw_procfs_srvstats)
 		return -ENOENT;
+	if (!proc_create("vhosts", S_IRUGO, tfw_procfs_tempesta,
+			 &tfw_vhoststats_fops))
+		return -ENOENT;
+	if (!proc_create("heavy_hitters", S_IRUGO, tfw_procfs_tempesta,
+			 &tfw_hh_fops))
+		return -ENOENT;
 	if ((ret = tfw_sg_for_each_srv(tfw_procfs_srv_collect)) != 0)
 		return ret;
 	for (i = 0; i < slsz; ++i)
@@ -264,6 +377,8 @@ static void
 tfw_procfs_cfg_stop(void)
 {
 	remove_proc_subtree("servers", tfw_procfs_tempesta);
+	remove_proc_entry("vhosts", tfw_procfs_tempesta);
+	remove_proc_entry("heavy_hitters", tfw_procfs_tempesta);
 }
 
 static TfwCfgSpec tfw_procfs_cfg_specs[] = {
@@ -277,6 +392,154 @@ TfwCfgMod tfw_procfs_cfg_mod = {
 	.specs = tfw_procfs_cfg_specs,
 };
 
+/*
+ * ------------------------------------------------------------------------
+ *	Binary telemetry export.
+ *
+ * The text perfstat folds every per-CPU counter under the read, so its
+ * cost grows with counters x CPUs on each scrape. /proc/tempesta/telemetry
+ * instead hands the metrics agent the raw per-CPU counter blocks behind
+ * a schema descriptor and lets it do the folding in user space:
+ *
+ *	TfwTeleHdr | TfwTeleField x fields | TfwPerfStat x cpus
+ *
+ * The schema names each u64 by its byte offset within a block, so new
+ * counters only extend the descriptor - readers skip unknown fields.
+ * Counter blocks are copied raw at open() time; u64 reads may be torn
+ * the same way they are in the text rendering.
+ * ------------------------------------------------------------------------
+ */
+#define TFW_TELE_MAGIC		0x54574654	/* "TFWT" */
+/*
+ * Version 2 appends the per-vhost resource blocks after the per-CPU
+ * counter blocks:
+ *
+ *	u32 vhosts | u32 vh_stride | TfwVhostRes[vhosts] x cpus
+ *
+ * Version-1 readers consume the leading part unchanged.
+ */
+#define TFW_TELE_VERSION	2
+
+typedef struct {
+	u32	magic;
+	u16	version;
+	u16	cpus;
+	u32	stride;
+	u32	fields;
+} TfwTeleHdr;
+
+typedef struct {
+	u16	off;
+	char	name[30];
+} TfwTeleField;
+
+#define TELE_F(field)	{ offsetof(TfwPerfStat, field), #field }
+
+static const TfwTeleField tfw_tele_schema[] = {
+	TELE_F(ss.pfl_hits),
+	TELE_F(ss.pfl_misses),
+	TELE_F(pool.pg_cache_hits),
+	TELE_F(pool.pg_misses),
+	TELE_F(pool.pg_curr),
+	TELE_F(pool.pg_max),
+	TELE_F(cache.hits),
+	TELE_F(cache.misses),
+	TELE_F(clnt.rx_messages),
+	TELE_F(clnt.msgs_forwarded),
+	TELE_F(clnt.msgs_fromcache),
+	TELE_F(clnt.msgs_parserr),
+	TELE_F(clnt.msgs_filtout),
+	TELE_F(clnt.msgs_otherr),
+	TELE_F(clnt.online),
+	TELE_F(clnt.tls_verify_ok),
+	TELE_F(clnt.tls_verify_fail),
+	TELE_F(clnt.tls_verify_resumed),
+	TELE_F(clnt.tls_hs_full),
+	TELE_F(clnt.tls_hs_resumed),
+	TELE_F(clnt.conn_attempts),
+	TELE_F(clnt.conn_established),
+	TELE_F(clnt.conn_disconnects),
+	TELE_F(clnt.rx_bytes),
+	TELE_F(serv.rx_messages),
+	TELE_F(serv.msgs_forwarded),
+	TELE_F(serv.msgs_parserr),
+	TELE_F(serv.msgs_filtout),
+	TELE_F(serv.msgs_otherr),
+	TELE_F(serv.conn_attempts),
+	TELE_F(serv.conn_established),
+	TELE_F(serv.conn_disconnects),
+	TELE_F(serv.conn_restricted),
+	TELE_F(serv.rx_bytes),
+};
+
+#define TFW_TELE_SZ	(sizeof(TfwTeleHdr) + sizeof(tfw_tele_schema)	\
+			 + nr_cpu_ids * sizeof(TfwPerfStat)		\
+			 + 2 * sizeof(u32)				\
+			 + nr_cpu_ids * TFW_VHOST_MAX * sizeof(TfwVhostRes))
+
+static int
+tfw_tele_open(struct inode *inode, struct file *file)
+{
+	int cpu;
+	size_t sz = TFW_TELE_SZ;
+	char *buf, *p;
+	TfwTeleHdr *hdr;
+
+	if (!(buf = kzalloc(sz, GFP_KERNEL)))
+		return -ENOMEM;
+
+	hdr = (TfwTeleHdr *)buf;
+	hdr->magic = TFW_TELE_MAGIC;
+	hdr->version = TFW_TELE_VERSION;
+	hdr->cpus = nr_cpu_ids;
+	hdr->stride = sizeof(TfwPerfStat);
+	hdr->fields = ARRAY_SIZE(tfw_tele_schema);
+
+	p = buf + sizeof(TfwTeleHdr);
+	memcpy(p, tfw_tele_schema, sizeof(tfw_tele_schema));
+
+	p += sizeof(tfw_tele_schema);
+	for_each_possible_cpu(cpu)
+		memcpy(p + cpu * sizeof(TfwPerfStat),
+		       per_cpu_ptr(&tfw_perfstat, cpu), sizeof(TfwPerfStat));
+
+	/* The per-vhost resource blocks, see TFW_TELE_VERSION. */
+	p += nr_cpu_ids * sizeof(TfwPerfStat);
+	*(u32 *)p = TFW_VHOST_MAX;
+	*(u32 *)(p + sizeof(u32)) = sizeof(TfwVhostRes);
+	p += 2 * sizeof(u32);
+	for_each_possible_cpu(cpu)
+		memcpy(p + cpu * TFW_VHOST_MAX * sizeof(TfwVhostRes),
+		       per_cpu_ptr(tfw_vhost_res, cpu),
+		       TFW_VHOST_MAX * sizeof(TfwVhostRes));
+
+	file->private_data = buf;
+	return 0;
+}
+
+static ssize_t
+tfw_tele_read(struct file *file, char __user *ubuf, size_t count,
+	      loff_t *ppos)
+{
+	return simple_read_from_buffer(ubuf, count, ppos,
+				       file->private_data, TFW_TELE_SZ);
+}
+
+static int
+tfw_tele_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static struct file_operations tfw_tele_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_tele_open,
+	.read		= tfw_tele_read,
+	.llseek		= default_llseek,
+	.release	= tfw_tele_release,
+};
+
 /*
  * Init/exit routines.
  */
@@ -301,6 +564,13 @@ tfw_procfs_init(void)
 	if (!tfw_procfs_perfstat)
 		goto out_tempesta;
 
+	if (!proc_create("telemetry", S_IRUGO, tfw_procfs_tempesta,
+			 &tfw_tele_fops))
+	{
+		remove_proc_entry("perfstat", tfw_procfs_tempesta);
+		goto out_tempesta;
+	}
+
 	return 0;
 
 out:
@@ -313,6 +583,7 @@ out_tempesta:
 void
 tfw_procfs_exit(void)
 {
+	remove_proc_entry("telemetry", tfw_procfs_tempesta);
 	remove_proc_entry("perfstat", tfw_procfs_tempesta);
 	remove_proc_entry("tempesta", NULL);
 }
@@ -31,6 +31,21 @@ typedef struct {
 	u64	pfl_misses;
 } TfwSsStat;
 
+/*
+ * Pool allocator statistics.
+ *
+ * @pg_cache_hits	- page allocations served from the per-CPU cache.
+ * @pg_misses		- page allocations gone to the buddy allocator.
+ * @pg_curr		- pages currently held by pools on the CPU.
+ * @pg_max		- high water mark of @pg_curr.
+ */
+typedef struct {
+	u64	pg_cache_hits;
+	u64	pg_misses;
+	u64	pg_curr;
+	u64	pg_max;
+} TfwPoolStat;
+
 /*
  * @rx_messages		- The number of messages received from peers.
  * @msgs_forwarded	- The number of forwarded messages.
@@ -72,6 +87,11 @@ typedef struct {
 	TFW_STAT_COMMON;
 	u64	msgs_fromcache;
 	u64	online;
+	u64	tls_verify_ok;
+	u64	tls_verify_fail;
+	u64	tls_verify_resumed;
+	u64	tls_hs_full;
+	u64	tls_hs_resumed;
 } TfwClntStat;
 
 /*
@@ -90,6 +110,7 @@ typedef struct {
 	TfwClntStat	clnt;
 	TfwSrvStat	serv;
 	TfwCacheStat	cache;
+	TfwPoolStat	pool;
 } TfwPerfStat;
 
 DECLARE_PER_CPU_ALIGNED(TfwPerfStat, tfw_perfstat);
@@ -0,0 +1,272 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "tempesta_fw.h"
+#include "apm.h"
+#include "log.h"
+#include "server.h"
+
+MODULE_AUTHOR(TFW_AUTHOR);
+MODULE_DESCRIPTION("Tempesta adaptive response-time scheduler");
+MODULE_VERSION("0.1.0");
+MODULE_LICENSE("GPL");
+
+/*
+ * How often the per-server response time estimate is refreshed from
+ * the APM statistics. Reading the percentiles takes a lock, so it must
+ * stay off the per-request path.
+ */
+#define TFW_SCHED_EWMA_PERIOD	(HZ / 4)
+
+/**
+ * List of connections to an upstream server.
+ *
+ * @rtt	- EWMA of the 90th percentile of the server response time, ms.
+ *	  Zero means no samples yet, such servers are probed first.
+ */
+typedef struct {
+	atomic64_t	ew_counter;
+	atomic_t	rtt;
+	unsigned long	last_upd;
+	size_t		conn_n;
+	TfwServer	*srv;
+	TfwSrvConn	*conns[TFW_SRV_MAX_CONN];
+} TfwEwmaSrv;
+
+typedef struct {
+	size_t		srv_n;
+	TfwEwmaSrv	srvs[TFW_SG_MAX_SRV];
+} TfwEwmaSrvList;
+
+static void
+tfw_sched_ewma_alloc_data(TfwSrvGroup *sg)
+{
+	sg->sched_data = kzalloc(sizeof(TfwEwmaSrvList), GFP_KERNEL);
+	BUG_ON(!sg->sched_data);
+}
+
+static void
+tfw_sched_ewma_free_data(TfwSrvGroup *sg)
+{
+	kfree(sg->sched_data);
+}
+
+static void
+tfw_sched_ewma_add_conn(TfwSrvGroup *sg, TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	size_t s, c;
+	TfwEwmaSrv *srv_cl;
+	TfwEwmaSrvList *sl = sg->sched_data;
+
+	BUG_ON(!sl);
+
+	for (s = 0; s < sl->srv_n; ++s)
+		if (sl->srvs[s].srv == srv)
+			break;
+	if (s == sl->srv_n) {
+		sl->srvs[s].srv = srv;
+		++sl->srv_n;
+		BUG_ON(sl->srv_n > TFW_SG_MAX_SRV);
+		srv->sched_data = &sl->srvs[s];
+	}
+
+	srv_cl = &sl->srvs[s];
+	for (c = 0; c < srv_cl->conn_n; ++c)
+		if (srv_cl->conns[c] == srv_conn) {
+			TFW_WARN("sched_ewma: Try to add existing connection,"
+				 " srv=%zu conn=%zu\n", s, c);
+			return;
+		}
+	srv_cl->conns[c] = srv_conn;
+	++srv_cl->conn_n;
+	BUG_ON(srv_cl->conn_n > TFW_SRV_MAX_CONN);
+}
+
+/**
+ * Fold the current 90th percentile of the server response time into
+ * the EWMA estimate: new = 3/4 * old + 1/4 * sample. A quarter weight
+ * follows load changes within a second while riding out single slow
+ * responses.
+ *
+ * One CPU is elected by cmpxchg() on the refresh timestamp, everybody
+ * else keeps using the previous estimate.
+ */
+static void
+tfw_sched_ewma_refresh(TfwEwmaSrv *srv_cl)
+{
+	int old;
+	unsigned long now = jiffies, last = ACCESS_ONCE(srv_cl->last_upd);
+	TfwPrcntl prcntl[] = { {50}, {75}, {90}, {95}, {99} };
+	TfwPrcntlStats pstats = { prcntl, ARRAY_SIZE(prcntl) };
+
+	if (time_before(now, last + TFW_SCHED_EWMA_PERIOD))
+		return;
+	if (cmpxchg(&srv_cl->last_upd, last, now) != last)
+		return;
+	if (unlikely(!srv_cl->srv->apm))
+		return;
+
+	tfw_apm_stats_bh(srv_cl->srv->apm, &pstats);
+
+	old = atomic_read(&srv_cl->rtt);
+	atomic_set(&srv_cl->rtt, old ? (3 * old + prcntl[2].val) / 4
+				     : prcntl[2].val);
+}
+
+static inline TfwSrvConn *
+__sched_srv(TfwEwmaSrv *srv_cl, int skipnip, int *nipconn)
+{
+	size_t c;
+
+	for (c = 0; c < srv_cl->conn_n; ++c) {
+		unsigned long idxval = atomic64_inc_return(&srv_cl->ew_counter);
+		TfwSrvConn *srv_conn = srv_cl->conns[idxval % srv_cl->conn_n];
+
+		if (unlikely(tfw_srv_conn_restricted(srv_conn)
+			     || tfw_srv_conn_queue_full(srv_conn)))
+			continue;
+		if (skipnip && tfw_srv_conn_hasnip(srv_conn)) {
+			if (likely(tfw_srv_conn_live(srv_conn)))
+				++(*nipconn);
+			continue;
+		}
+		if (likely(tfw_srv_conn_get_if_live(srv_conn)))
+			return srv_conn;
+	}
+
+	return NULL;
+}
+
+/**
+ * Schedule to the server with the lowest response time estimate.
+ * Servers without samples yet have a zero estimate and are probed
+ * first, so a newly added server gets traffic and its estimate
+ * converges quickly.
+ *
+ * Dead connections and servers w/o live connections are skipped.
+ * The non-idempotent rerun logic is the same as in the round-robin
+ * scheduler.
+ */
+static TfwSrvConn *
+tfw_sched_ewma_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
+{
+	size_t s;
+	int skipnip = 1, nipconn = 0;
+	int rtt, rtt_min;
+	TfwEwmaSrvList *sl = sg->sched_data;
+	TfwEwmaSrv *srv_cl, *best;
+	TfwSrvConn *srv_conn;
+
+	BUG_ON(!sl);
+
+	for (s = 0; s < sl->srv_n; ++s)
+		tfw_sched_ewma_refresh(&sl->srvs[s]);
+rerun:
+	best = NULL;
+	rtt_min = INT_MAX;
+	for (s = 0; s < sl->srv_n; ++s) {
+		srv_cl = &sl->srvs[s];
+		/* Prefer healthy servers, rerun covers the fallback. */
+		if (skipnip && (tfw_srv_suspended(srv_cl->srv)
+				|| tfw_srv_ramp_skip(srv_cl->srv))) {
+			++nipconn;
+			continue;
+		}
+		rtt = atomic_read(&srv_cl->rtt);
+		if (rtt < rtt_min) {
+			rtt_min = rtt;
+			best = srv_cl;
+		}
+	}
+	if (best && (srv_conn = __sched_srv(best, skipnip, &nipconn)))
+		return srv_conn;
+
+	/* The fastest server has no schedulable connections. */
+	for (s = 0; s < sl->srv_n; ++s) {
+		srv_cl = &sl->srvs[s];
+		if (srv_cl == best)
+			continue;
+		if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+			return srv_conn;
+	}
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+/**
+ * Same as @tfw_sched_ewma_get_sg_conn(), but schedule for a specific
+ * server in a group.
+ */
+static TfwSrvConn *
+tfw_sched_ewma_get_srv_conn(TfwMsg *msg, TfwServer *srv)
+{
+	int skipnip = 1, nipconn = 0;
+	TfwEwmaSrv *srv_cl = srv->sched_data;
+	TfwSrvConn *srv_conn;
+
+	/*
+	 * For @srv without connections srv_cl will be NULL, that normally
+	 * does not happen in real life, but unit tests check that case.
+	*/
+	if (unlikely(!srv_cl))
+		return NULL;
+
+rerun:
+	if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+		return srv_conn;
+
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+static TfwScheduler tfw_sched_ewma = {
+	.name		= "ewma",
+	.decision_cacheable = true,
+	.list		= LIST_HEAD_INIT(tfw_sched_ewma.list),
+	.add_grp	= tfw_sched_ewma_alloc_data,
+	.del_grp	= tfw_sched_ewma_free_data,
+	.add_conn	= tfw_sched_ewma_add_conn,
+	.sched_sg_conn	= tfw_sched_ewma_get_sg_conn,
+	.sched_srv_conn	= tfw_sched_ewma_get_srv_conn,
+};
+
+int
+tfw_sched_ewma_init(void)
+{
+	TFW_DBG("sched_ewma: init\n");
+	return tfw_sched_register(&tfw_sched_ewma);
+}
+module_init(tfw_sched_ewma_init);
+
+void
+tfw_sched_ewma_exit(void)
+{
+	TFW_DBG("sched_ewma: exit\n");
+	tfw_sched_unregister(&tfw_sched_ewma);
+}
+module_exit(tfw_sched_ewma_exit);
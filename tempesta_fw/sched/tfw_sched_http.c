@@ -78,6 +78,7 @@
 #include "tempesta_fw.h"
 #include "cfg.h"
 #include "http_match.h"
+#include "http_rex.h"
 #include "server.h"
 
 MODULE_AUTHOR(TFW_AUTHOR);
@@ -164,7 +165,8 @@ static const TfwCfgEnum __read_mostly tfw_sched_http_cfg_op_enum[] = {
 	{ "eq",		TFW_HTTP_MATCH_O_EQ },
 	{ "prefix",	TFW_HTTP_MATCH_O_PREFIX },
 	{ "suffix",	TFW_HTTP_MATCH_O_SUFFIX },
-	/* TODO: substr, regex, case sensitive/insensitive versions. */
+	{ "regex",	TFW_HTTP_MATCH_O_REGEX },
+	/* TODO: substr, case sensitive/insensitive versions. */
 	{}
 };
 
@@ -201,6 +203,7 @@ tfw_sched_http_cfg_finish_rules(TfwCfgSpec *cs)
 {
 	TFW_DBG("sched_http: finish sched_http_rules\n");
 	BUG_ON(!tfw_sched_http_rules);
+	tfw_http_match_list_compile(tfw_sched_http_rules);
 	return 0;
 }
 
@@ -316,6 +319,20 @@ tfw_sched_http_cfg_handle_match(TfwCfgSpec *cs, TfwCfgEntry *e)
 		// TODO: parsing not string matching rules
 	}
 
+	if (op == TFW_HTTP_MATCH_O_REGEX) {
+		if (field != TFW_HTTP_MATCH_F_URI
+		    && field != TFW_HTTP_MATCH_F_HOST)
+		{
+			TFW_ERR_NL("sched_http: 'regex' is supported for"
+				   " 'uri' and 'host' fields only\n");
+			return -EINVAL;
+		}
+		/* Compiled once here; matching is a DFA state walk. */
+		rule->rule.rex = tfw_rex_compile(in_arg);
+		if (!rule->rule.rex)
+			return -EINVAL;
+	}
+
 	rule->main_sg = main_sg;
 	rule->backup_sg = backup_sg;
 
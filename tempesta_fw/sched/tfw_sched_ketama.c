@@ -0,0 +1,324 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/hash.h>
+#include <linux/module.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+#include "tempesta_fw.h"
+#include "log.h"
+#include "server.h"
+#include "http_msg.h"
+
+MODULE_AUTHOR(TFW_AUTHOR);
+MODULE_DESCRIPTION("Tempesta consistent-hash (ketama) scheduler");
+MODULE_VERSION("0.1.0");
+MODULE_LICENSE("GPL");
+
+/*
+ * Classic continuum density: enough virtual points per server for a
+ * fair load split with tens of servers.
+ */
+#define TFW_KETAMA_VPOINTS	160
+#define TFW_KETAMA_PTS_MAX	(TFW_SG_MAX_SRV * TFW_KETAMA_VPOINTS)
+/*
+ * The O(1) lookup table maps the most significant bits of a request
+ * hash to the continuum position, so the scheduling path avoids the
+ * O(log n) binary search over the points.
+ */
+#define TFW_KETAMA_MAP_BITS	14
+#define TFW_KETAMA_MAP_SZ	(1 << TFW_KETAMA_MAP_BITS)
+
+typedef struct {
+	atomic64_t		ks_counter;
+	size_t			conn_n;
+	TfwServer		*srv;
+	TfwSrvConn		*conns[TFW_SRV_MAX_CONN];
+} TfwKetamaSrv;
+
+/**
+ * A virtual point on the continuum.
+ */
+typedef struct {
+	unsigned long		hash;
+	unsigned short		srv;
+} TfwKetamaPoint;
+
+/**
+ * Continuum of hashed virtual points over the group's servers.
+ *
+ * @pt		- virtual points sorted by hash;
+ * @map		- first continuum position with hash not below the slot
+ *		  base, indexed by top request hash bits;
+ */
+typedef struct {
+	size_t			srv_n;
+	size_t			pt_n;
+	TfwKetamaSrv		srvs[TFW_SG_MAX_SRV];
+	TfwKetamaPoint		pt[TFW_KETAMA_PTS_MAX];
+	unsigned short		map[TFW_KETAMA_MAP_SZ];
+} TfwKetamaSrvList;
+
+static void
+tfw_sched_ketama_alloc_data(TfwSrvGroup *sg)
+{
+	/* The continuum is too large for kmalloc() high orders. */
+	sg->sched_data = vzalloc(sizeof(TfwKetamaSrvList));
+	BUG_ON(!sg->sched_data);
+}
+
+static void
+tfw_sched_ketama_free_data(TfwSrvGroup *sg)
+{
+	vfree(sg->sched_data);
+}
+
+static unsigned long
+__calc_point_hash(TfwServer *srv, size_t vpoint)
+{
+	unsigned long hash = REPEAT_BYTE(0x55);
+	size_t i, bytes_n;
+	union {
+		TfwAddr addr;
+		unsigned char bytes[0];
+	} *a;
+
+	/* See __calc_conn_hash() in tfw_sched_hash.c for the invariants. */
+	a = (void *)&srv->addr;
+	bytes_n = tfw_addr_sa_len(&a->addr);
+	for (i = 0; i < bytes_n; ++i)
+		hash = hash_long(hash ^ a->bytes[i], BITS_PER_LONG);
+
+	return hash_long(hash ^ vpoint, BITS_PER_LONG);
+}
+
+static int
+tfw_sched_ketama_cmp(const void *l, const void *r)
+{
+	unsigned long a = ((const TfwKetamaPoint *)l)->hash;
+	unsigned long b = ((const TfwKetamaPoint *)r)->hash;
+
+	return a < b ? -1 : a > b;
+}
+
+/**
+ * Rebuild the whole continuum and the lookup table.
+ * Called at configuration phase only, so the quadratic-ish work and the
+ * lack of synchronization are fine.
+ */
+static void
+tfw_sched_ketama_build(TfwKetamaSrvList *sl)
+{
+	size_t s, v, p = 0;
+	unsigned int slot;
+
+	for (s = 0; s < sl->srv_n; ++s)
+		for (v = 0; v < TFW_KETAMA_VPOINTS; ++v, ++p) {
+			sl->pt[p].hash = __calc_point_hash(sl->srvs[s].srv, v);
+			sl->pt[p].srv = s;
+		}
+	sl->pt_n = p;
+
+	sort(sl->pt, sl->pt_n, sizeof(sl->pt[0]), tfw_sched_ketama_cmp, NULL);
+
+	for (slot = 0; slot < TFW_KETAMA_MAP_SZ; ++slot) {
+		unsigned long base = (unsigned long)slot
+				     << (BITS_PER_LONG - TFW_KETAMA_MAP_BITS);
+		size_t lo = 0, hi = sl->pt_n;
+
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (sl->pt[mid].hash < base)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		/* Wrap around the continuum. */
+		sl->map[slot] = lo == sl->pt_n ? 0 : lo;
+	}
+}
+
+static void
+tfw_sched_ketama_add_conn(TfwSrvGroup *sg, TfwServer *srv, TfwSrvConn *conn)
+{
+	size_t s, c;
+	TfwKetamaSrv *srv_cl;
+	TfwKetamaSrvList *sl = sg->sched_data;
+
+	BUG_ON(!sl);
+
+	for (s = 0; s < sl->srv_n; ++s)
+		if (sl->srvs[s].srv == srv)
+			break;
+	if (s == sl->srv_n) {
+		sl->srvs[s].srv = srv;
+		++sl->srv_n;
+		BUG_ON(sl->srv_n > TFW_SG_MAX_SRV);
+		srv->sched_data = &sl->srvs[s];
+		tfw_sched_ketama_build(sl);
+	}
+
+	srv_cl = &sl->srvs[s];
+	for (c = 0; c < srv_cl->conn_n; ++c)
+		if (srv_cl->conns[c] == conn) {
+			TFW_WARN("sched_ketama: Try to add existing"
+				 " connection, srv=%zu conn=%zu\n", s, c);
+			return;
+		}
+	srv_cl->conns[c] = conn;
+	++srv_cl->conn_n;
+	BUG_ON(srv_cl->conn_n > TFW_SRV_MAX_CONN);
+}
+
+static inline TfwSrvConn *
+__sched_srv(TfwKetamaSrv *srv_cl, int skipnip, int *nipconn)
+{
+	size_t c;
+
+	for (c = 0; c < srv_cl->conn_n; ++c) {
+		unsigned long idxval = atomic64_inc_return(&srv_cl->ks_counter);
+		TfwSrvConn *conn = srv_cl->conns[idxval % srv_cl->conn_n];
+
+		if (unlikely(tfw_srv_conn_restricted(conn)
+			     || tfw_srv_conn_queue_full(conn)))
+			continue;
+		if (skipnip && tfw_srv_conn_hasnip(conn)) {
+			if (likely(tfw_srv_conn_live(conn)))
+				++(*nipconn);
+			continue;
+		}
+		if (likely(tfw_srv_conn_get_if_live(conn)))
+			return conn;
+	}
+
+	return NULL;
+}
+
+/**
+ * Map the request hash to the continuum: requests with the same
+ * URI/Host stick to the same server, and when a server goes offline
+ * only its continuum arcs are redistributed to the successors while
+ * all other mappings stay intact.
+ *
+ * The lookup table resolves the continuum position in O(1): only the
+ * few points falling into one table slot (normally none) are walked.
+ */
+static TfwSrvConn *
+tfw_sched_ketama_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
+{
+	size_t i, t;
+	int skipnip = 1, nipconn = 0;
+	unsigned long msg_hash, tried_mask = 0;
+	TfwKetamaSrvList *sl = sg->sched_data;
+
+	BUG_ON(!sl);
+
+	if (unlikely(!sl->pt_n))
+		return NULL;
+
+	msg_hash = tfw_http_req_key_calc((TfwHttpReq *)msg);
+	i = sl->map[msg_hash >> (BITS_PER_LONG - TFW_KETAMA_MAP_BITS)];
+	while (sl->pt[i].hash < msg_hash) {
+		if (unlikely(++i == sl->pt_n)) {
+			i = 0;
+			break;
+		}
+	}
+rerun:
+	/* Walk the continuum clockwise until a schedulable server. */
+	for (t = 0; t < sl->pt_n; ++t, i = (i + 1) % sl->pt_n) {
+		unsigned short s = sl->pt[i].srv;
+		TfwSrvConn *srv_conn;
+
+		if (tried_mask & (1UL << s))
+			continue;
+		tried_mask |= 1UL << s;
+
+		/* Prefer healthy servers, rerun covers the fallback. */
+		if (skipnip && (tfw_srv_suspended(sl->srvs[s].srv)
+				|| tfw_srv_ramp_skip(sl->srvs[s].srv))) {
+			++nipconn;
+			continue;
+		}
+		if ((srv_conn = __sched_srv(&sl->srvs[s], skipnip, &nipconn)))
+			return srv_conn;
+	}
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		tried_mask = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+/**
+ * Same as @tfw_sched_ketama_get_sg_conn(), but schedule for a specific
+ * server in a group.
+ */
+static TfwSrvConn *
+tfw_sched_ketama_get_srv_conn(TfwMsg *msg, TfwServer *srv)
+{
+	int skipnip = 1, nipconn = 0;
+	TfwKetamaSrv *srv_cl = srv->sched_data;
+	TfwSrvConn *srv_conn;
+
+	/*
+	 * For @srv without connections srv_cl will be NULL, that normally
+	 * does not happen in real life, but unit tests check that case.
+	*/
+	if (unlikely(!srv_cl))
+		return NULL;
+
+rerun:
+	if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+		return srv_conn;
+
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+static TfwScheduler tfw_sched_ketama = {
+	.name		= "ketama",
+	.list		= LIST_HEAD_INIT(tfw_sched_ketama.list),
+	.add_grp	= tfw_sched_ketama_alloc_data,
+	.del_grp	= tfw_sched_ketama_free_data,
+	.add_conn	= tfw_sched_ketama_add_conn,
+	.sched_sg_conn	= tfw_sched_ketama_get_sg_conn,
+	.sched_srv_conn	= tfw_sched_ketama_get_srv_conn,
+};
+
+int
+tfw_sched_ketama_init(void)
+{
+	TFW_DBG("sched_ketama: init\n");
+	return tfw_sched_register(&tfw_sched_ketama);
+}
+module_init(tfw_sched_ketama_init);
+
+void
+tfw_sched_ketama_exit(void)
+{
+	TFW_DBG("sched_ketama: exit\n");
+	tfw_sched_unregister(&tfw_sched_ketama);
+}
+module_exit(tfw_sched_ketama_exit);
@@ -0,0 +1,263 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "tempesta_fw.h"
+#include "log.h"
+#include "server.h"
+
+MODULE_AUTHOR(TFW_AUTHOR);
+MODULE_DESCRIPTION("Tempesta least-connections scheduler");
+MODULE_VERSION("0.1.0");
+MODULE_LICENSE("GPL");
+
+/**
+ * List of connections to an upstream server.
+ * Connections can up and down during failover process and shouldn't be
+ * taken into account by the scheduler.
+ */
+typedef struct {
+	atomic64_t	lc_counter;
+	size_t		conn_n;
+	TfwServer	*srv;
+	TfwSrvConn	*conns[TFW_SRV_MAX_CONN];
+} TfwLcSrv;
+
+/**
+ * List of upstream servers.
+ * The list is considered static, i.e. all the servers are alive during
+ * whole run-time. This can be changed in future.
+ */
+typedef struct {
+	size_t		srv_n;
+	TfwLcSrv	srvs[TFW_SG_MAX_SRV];
+} TfwLcSrvList;
+
+static void
+tfw_sched_lc_alloc_data(TfwSrvGroup *sg)
+{
+	sg->sched_data = kzalloc(sizeof(TfwLcSrvList), GFP_KERNEL);
+	BUG_ON(!sg->sched_data);
+}
+
+static void
+tfw_sched_lc_free_data(TfwSrvGroup *sg)
+{
+	kfree(sg->sched_data);
+}
+
+/**
+ * Add connection and server, if new, to the scheduler.
+ * Called at configuration phase, no synchronization is required.
+ */
+static void
+tfw_sched_lc_add_conn(TfwSrvGroup *sg, TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	size_t s, c;
+	TfwLcSrv *srv_cl;
+	TfwLcSrvList *sl = sg->sched_data;
+
+	BUG_ON(!sl);
+
+	for (s = 0; s < sl->srv_n; ++s)
+		if (sl->srvs[s].srv == srv)
+			break;
+	if (s == sl->srv_n) {
+		sl->srvs[s].srv = srv;
+		++sl->srv_n;
+		BUG_ON(sl->srv_n > TFW_SG_MAX_SRV);
+		srv->sched_data = &sl->srvs[s];
+	}
+
+	srv_cl = &sl->srvs[s];
+	for (c = 0; c < srv_cl->conn_n; ++c)
+		if (srv_cl->conns[c] == srv_conn) {
+			TFW_WARN("sched_lc: Try to add existing connection,"
+				 " srv=%zu conn=%zu\n", s, c);
+			return;
+		}
+	srv_cl->conns[c] = srv_conn;
+	++srv_cl->conn_n;
+	BUG_ON(srv_cl->conn_n > TFW_SRV_MAX_CONN);
+}
+
+/**
+ * Choose the schedulable connection with the fewest outstanding requests.
+ * @qsize is the number of requests in the connection's forwarding queue,
+ * so it's exactly the load metric we want. Scanning starts at a rotating
+ * offset, so equally loaded connections are used in the round-robin
+ * manner instead of beating the first one.
+ */
+static inline TfwSrvConn *
+__sched_srv(TfwLcSrv *srv_cl, int skipnip, int *nipconn)
+{
+	size_t c;
+	unsigned int qs, qs_min = UINT_MAX;
+	unsigned long off = atomic64_inc_return(&srv_cl->lc_counter);
+	TfwSrvConn *conn, *best = NULL;
+
+	for (c = 0; c < srv_cl->conn_n; ++c) {
+		conn = srv_cl->conns[(off + c) % srv_cl->conn_n];
+
+		if (unlikely(tfw_srv_conn_restricted(conn)
+			     || tfw_srv_conn_queue_full(conn)))
+			continue;
+		if (skipnip && tfw_srv_conn_hasnip(conn)) {
+			if (likely(tfw_srv_conn_live(conn)))
+				++(*nipconn);
+			continue;
+		}
+		qs = ACCESS_ONCE(conn->qsize);
+		if (qs < qs_min && tfw_srv_conn_live(conn)) {
+			qs_min = qs;
+			best = conn;
+		}
+	}
+	/*
+	 * The queue might grow or the connection might die since we
+	 * looked at it - then just report the failure to the caller.
+	 */
+	if (best && likely(tfw_srv_conn_get_if_live(best)))
+		return best;
+
+	return NULL;
+}
+
+/**
+ * On each subsequent call the function returns a connection to the
+ * server with the fewest outstanding requests in the group.
+ *
+ * Dead connections and servers w/o live connections are skipped.
+ * Initially, connections with non-idempotent requests are also skipped
+ * in attempt to increase throughput. However, if all live connections
+ * contain a non-idempotent request, then re-run the algorithm and get
+ * the first live connection the way it is usually done.
+ */
+static TfwSrvConn *
+tfw_sched_lc_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
+{
+	size_t s;
+	int skipnip = 1, nipconn = 0;
+	unsigned int qs_min;
+	TfwLcSrvList *sl = sg->sched_data;
+	TfwLcSrv *srv_cl, *best;
+	TfwSrvConn *srv_conn;
+
+	BUG_ON(!sl);
+rerun:
+	/*
+	 * Choose the least loaded server first and then the least
+	 * loaded of its connections: the aggregate load identifies
+	 * slow servers regardless of which connection is busy.
+	 */
+	best = NULL;
+	qs_min = UINT_MAX;
+	for (s = 0; s < sl->srv_n; ++s) {
+		unsigned int qs = 0;
+		size_t c;
+
+		srv_cl = &sl->srvs[s];
+		/* Prefer healthy servers, rerun covers the fallback. */
+		if (skipnip && (tfw_srv_suspended(srv_cl->srv)
+				|| tfw_srv_ramp_skip(srv_cl->srv))) {
+			++nipconn;
+			continue;
+		}
+		for (c = 0; c < srv_cl->conn_n; ++c)
+			qs += ACCESS_ONCE(srv_cl->conns[c]->qsize);
+		if (qs < qs_min || !best) {
+			qs_min = qs;
+			best = srv_cl;
+		}
+	}
+	if (best && (srv_conn = __sched_srv(best, skipnip, &nipconn)))
+		return srv_conn;
+
+	/* The best server has no schedulable connections - scan them all. */
+	for (s = 0; s < sl->srv_n; ++s) {
+		srv_cl = &sl->srvs[s];
+		if (srv_cl == best)
+			continue;
+		if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+			return srv_conn;
+	}
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+/**
+ * Same as @tfw_sched_lc_get_sg_conn(), but schedule for a specific server
+ * in a group.
+ */
+static TfwSrvConn *
+tfw_sched_lc_get_srv_conn(TfwMsg *msg, TfwServer *srv)
+{
+	int skipnip = 1, nipconn = 0;
+	TfwLcSrv *srv_cl = srv->sched_data;
+	TfwSrvConn *srv_conn;
+
+	/*
+	 * For @srv without connections srv_cl will be NULL, that normally
+	 * does not happen in real life, but unit tests check that case.
+	*/
+	if (unlikely(!srv_cl))
+		return NULL;
+
+rerun:
+	if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+		return srv_conn;
+
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+static TfwScheduler tfw_sched_lc = {
+	.name		= "least-conn",
+	.decision_cacheable = true,
+	.list		= LIST_HEAD_INIT(tfw_sched_lc.list),
+	.add_grp	= tfw_sched_lc_alloc_data,
+	.del_grp	= tfw_sched_lc_free_data,
+	.add_conn	= tfw_sched_lc_add_conn,
+	.sched_sg_conn	= tfw_sched_lc_get_sg_conn,
+	.sched_srv_conn	= tfw_sched_lc_get_srv_conn,
+};
+
+int
+tfw_sched_lc_init(void)
+{
+	TFW_DBG("sched_lc: init\n");
+	return tfw_sched_register(&tfw_sched_lc);
+}
+module_init(tfw_sched_lc_init);
+
+void
+tfw_sched_lc_exit(void)
+{
+	TFW_DBG("sched_lc: exit\n");
+	tfw_sched_unregister(&tfw_sched_lc);
+}
+module_exit(tfw_sched_lc_exit);
@@ -156,6 +156,12 @@ rerun:
 		TfwRrSrv *srv_cl = &sl->srvs[idxval % sl->srv_n];
 		TfwSrvConn *srv_conn;
 
+		/* Prefer healthy servers, rerun covers the fallback. */
+		if (skipnip && (tfw_srv_suspended(srv_cl->srv)
+				|| tfw_srv_ramp_skip(srv_cl->srv))) {
+			++nipconn;
+			continue;
+		}
 		if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
 				return srv_conn;
 	}
@@ -197,6 +203,7 @@ rerun:
 
 static TfwScheduler tfw_sched_rr = {
 	.name		= "round-robin",
+	.decision_cacheable = true,
 	.list		= LIST_HEAD_INIT(tfw_sched_rr.list),
 	.add_grp	= tfw_sched_rr_alloc_data,
 	.del_grp	= tfw_sched_rr_free_data,
@@ -0,0 +1,239 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+#include "tempesta_fw.h"
+#include "log.h"
+#include "server.h"
+
+MODULE_AUTHOR(TFW_AUTHOR);
+MODULE_DESCRIPTION("Tempesta smooth weighted round-robin scheduler");
+MODULE_VERSION("0.1.0");
+MODULE_LICENSE("GPL");
+
+/**
+ * List of connections to an upstream server.
+ *
+ * @cur_weight	- the smoothly accumulated selection weight.
+ */
+typedef struct {
+	atomic64_t	wrr_counter;
+	int		cur_weight;
+	size_t		conn_n;
+	TfwServer	*srv;
+	TfwSrvConn	*conns[TFW_SRV_MAX_CONN];
+} TfwWrrSrv;
+
+/**
+ * List of upstream servers.
+ *
+ * @lock protects the smooth weight accumulation: the critical section
+ * is a scan of a few dozen integers, so a plain spinlock beats any
+ * clever lock-free scheme here.
+ */
+typedef struct {
+	spinlock_t	lock;
+	int		total_weight;
+	size_t		srv_n;
+	TfwWrrSrv	srvs[TFW_SG_MAX_SRV];
+} TfwWrrSrvList;
+
+static void
+tfw_sched_wrr_alloc_data(TfwSrvGroup *sg)
+{
+	TfwWrrSrvList *sl = kzalloc(sizeof(TfwWrrSrvList), GFP_KERNEL);
+
+	BUG_ON(!sl);
+	spin_lock_init(&sl->lock);
+	sg->sched_data = sl;
+}
+
+static void
+tfw_sched_wrr_free_data(TfwSrvGroup *sg)
+{
+	kfree(sg->sched_data);
+}
+
+static void
+tfw_sched_wrr_add_conn(TfwSrvGroup *sg, TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	size_t s, c;
+	TfwWrrSrv *srv_cl;
+	TfwWrrSrvList *sl = sg->sched_data;
+
+	BUG_ON(!sl);
+
+	for (s = 0; s < sl->srv_n; ++s)
+		if (sl->srvs[s].srv == srv)
+			break;
+	if (s == sl->srv_n) {
+		sl->srvs[s].srv = srv;
+		++sl->srv_n;
+		BUG_ON(sl->srv_n > TFW_SG_MAX_SRV);
+		srv->sched_data = &sl->srvs[s];
+		sl->total_weight += srv->weight ? : 1;
+	}
+
+	srv_cl = &sl->srvs[s];
+	for (c = 0; c < srv_cl->conn_n; ++c)
+		if (srv_cl->conns[c] == srv_conn) {
+			TFW_WARN("sched_wrr: Try to add existing connection,"
+				 " srv=%zu conn=%zu\n", s, c);
+			return;
+		}
+	srv_cl->conns[c] = srv_conn;
+	++srv_cl->conn_n;
+	BUG_ON(srv_cl->conn_n > TFW_SRV_MAX_CONN);
+}
+
+static inline TfwSrvConn *
+__sched_srv(TfwWrrSrv *srv_cl, int skipnip, int *nipconn)
+{
+	size_t c;
+
+	for (c = 0; c < srv_cl->conn_n; ++c) {
+		unsigned long idxval =
+			atomic64_inc_return(&srv_cl->wrr_counter);
+		TfwSrvConn *srv_conn = srv_cl->conns[idxval % srv_cl->conn_n];
+
+		if (unlikely(tfw_srv_conn_restricted(srv_conn)
+			     || tfw_srv_conn_queue_full(srv_conn)))
+			continue;
+		if (skipnip && tfw_srv_conn_hasnip(srv_conn)) {
+			if (likely(tfw_srv_conn_live(srv_conn)))
+				++(*nipconn);
+			continue;
+		}
+		if (likely(tfw_srv_conn_get_if_live(srv_conn)))
+			return srv_conn;
+	}
+
+	return NULL;
+}
+
+/**
+ * The classic smooth weighted round-robin: every pick adds each
+ * server's weight to its current weight, selects the maximum and
+ * subtracts the total weight from it. The sequence interleaves
+ * servers proportionally to their weights with no bursts, e.g.
+ * weights 5/1/1 give AABABAA-like patterns rather than AAAAABB.
+ */
+static TfwSrvConn *
+tfw_sched_wrr_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
+{
+	size_t s;
+	int skipnip = 1, nipconn = 0;
+	TfwWrrSrvList *sl = sg->sched_data;
+	TfwWrrSrv *srv_cl, *best;
+	TfwSrvConn *srv_conn;
+
+	BUG_ON(!sl);
+rerun:
+	spin_lock(&sl->lock);
+	best = NULL;
+	for (s = 0; s < sl->srv_n; ++s) {
+		srv_cl = &sl->srvs[s];
+		if (skipnip && (tfw_srv_suspended(srv_cl->srv)
+				|| tfw_srv_ramp_skip(srv_cl->srv))) {
+			++nipconn;
+			continue;
+		}
+		srv_cl->cur_weight += srv_cl->srv->weight ? : 1;
+		if (!best || srv_cl->cur_weight > best->cur_weight)
+			best = srv_cl;
+	}
+	if (best)
+		best->cur_weight -= sl->total_weight;
+	spin_unlock(&sl->lock);
+
+	if (best && (srv_conn = __sched_srv(best, skipnip, &nipconn)))
+		return srv_conn;
+
+	/* The chosen server has no schedulable connections. */
+	for (s = 0; s < sl->srv_n; ++s) {
+		srv_cl = &sl->srvs[s];
+		if (srv_cl == best)
+			continue;
+		if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+			return srv_conn;
+	}
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+/**
+ * Same as @tfw_sched_wrr_get_sg_conn(), but schedule for a specific
+ * server in a group.
+ */
+static TfwSrvConn *
+tfw_sched_wrr_get_srv_conn(TfwMsg *msg, TfwServer *srv)
+{
+	int skipnip = 1, nipconn = 0;
+	TfwWrrSrv *srv_cl = srv->sched_data;
+	TfwSrvConn *srv_conn;
+
+	/*
+	 * For @srv without connections srv_cl will be NULL, that normally
+	 * does not happen in real life, but unit tests check that case.
+	*/
+	if (unlikely(!srv_cl))
+		return NULL;
+
+rerun:
+	if ((srv_conn = __sched_srv(srv_cl, skipnip, &nipconn)))
+		return srv_conn;
+
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+	return NULL;
+}
+
+static TfwScheduler tfw_sched_wrr = {
+	.name		= "wrr",
+	.decision_cacheable = true,
+	.list		= LIST_HEAD_INIT(tfw_sched_wrr.list),
+	.add_grp	= tfw_sched_wrr_alloc_data,
+	.del_grp	= tfw_sched_wrr_free_data,
+	.add_conn	= tfw_sched_wrr_add_conn,
+	.sched_sg_conn	= tfw_sched_wrr_get_sg_conn,
+	.sched_srv_conn	= tfw_sched_wrr_get_srv_conn,
+};
+
+int
+tfw_sched_wrr_init(void)
+{
+	TFW_DBG("sched_wrr: init\n");
+	return tfw_sched_register(&tfw_sched_wrr);
+}
+module_init(tfw_sched_wrr_init);
+
+void
+tfw_sched_wrr_exit(void)
+{
+	TFW_DBG("sched_wrr: exit\n");
+	tfw_sched_unregister(&tfw_sched_wrr);
+}
+module_exit(tfw_sched_wrr_exit);
@@ -21,6 +21,8 @@
 #ifndef __SERVER_H__
 #define __SERVER_H__
 
+#include <linux/random.h>
+
 #include "addr.h"
 #include "connection.h"
 #include "peer.h"
@@ -39,6 +41,13 @@ typedef struct tfw_scheduler_t TfwScheduler;
  * @sg		- back-reference to the server group;
  * @sched_data	- private scheduler data for the server;
  * @apm		- opaque handle for APM stats;
+ * @weight	- configured relative weight, see the wrr scheduler;
+ * @hostname	- configured DNS name, NULL for literal addresses; the
+ *		  resolver re-resolves it periodically;
+ * @ramp_until	- end of the slow-start ramp after the server came back,
+ *		  see tfw_srv_ramp_skip();
+ * @hc_fails	- consecutive failed responses, for passive health checks;
+ * @hc_until	- the server is suspended until this time, in jiffies;
  */
 typedef struct {
 	TFW_PEER_COMMON;
@@ -46,6 +55,11 @@ typedef struct {
 	TfwSrvGroup		*sg;
 	void			*sched_data;
 	void			*apm;
+	int			weight;
+	char			*hostname;
+	unsigned long		ramp_until;
+	atomic_t		hc_fails;
+	unsigned long		hc_until;
 } TfwServer;
 
 /**
@@ -61,9 +75,20 @@ typedef struct {
  * @sched	- requests scheduling handler;
  * @sched_data	- private scheduler data for the server group;
  * @max_qsize	- maximum queue size of a server connection;
+ * @max_inflight - maximum pipelined (sent and unanswered) requests
+ *		  per server connection;
  * @max_refwd	- maximum number of tries for forwarding a request;
  * @max_jqage	- maximum age of a request in a server connection, in jiffies;
  * @max_recns	- maximum number of reconnect attempts;
+ * @hc_fails_thr - failed responses to suspend a server, 0 disables
+ *		  the passive health checks;
+ * @hc_penalty	- suspension time, in jiffies;
+ * @ramp_jtmo	- slow-start ramp length for recovered servers, jiffies;
+ * @hedge_jtmo	- queue age after which unsent idempotent requests are
+ *		  moved to another connection, in jiffies, 0 - off;
+ * @retry_budget - re-forwards allowed as a percentage of the forwards
+ *		  of the last second, 0 disables the budget;
+ * @rb_win	- the sliding accounting window for the retry budget;
  * @flags	- server group related flags;
  * @name	- name of the group specified in the configuration;
  */
@@ -74,15 +99,28 @@ struct tfw_srv_group_t {
 	TfwScheduler		*sched;
 	void			*sched_data;
 	unsigned int		max_qsize;
+	unsigned int		max_inflight;
 	unsigned int		max_refwd;
 	unsigned long		max_jqage;
 	unsigned int		max_recns;
+	unsigned int		hc_fails_thr;
+	unsigned long		hc_penalty;
+	unsigned long		hedge_jtmo;
+	unsigned long		ramp_jtmo;
+	unsigned int		retry_budget;
+	struct {
+		unsigned long	ts;
+		atomic_t	reqs;
+		atomic_t	retries;
+	} rb_win[8];
 	unsigned int		flags;
 	char			name[0];
 };
 
 /* Server related flags. */
 #define TFW_SRV_RETRY_NIP	0x0001	/* Retry non-idemporent req. */
+#define TFW_SRV_STREAM_BODIES	0x0008	/* Donate body skbs, no re-forward. */
+#define TFW_SRV_FASTOPEN	0x0010	/* TCP Fast Open for connects. */
 #define TFW_SRV_STICKY_FLAGS	(TFW_SRV_STICKY | TFW_SRV_STICKY_FAILOVER)
 #define TFW_SRV_STICKY		0x0002	/* Use sticky sessions. */
 #define TFW_SRV_STICKY_FAILOVER	0x0004	/* Allow failovering of sticky
@@ -114,6 +152,12 @@ struct tfw_srv_group_t {
 struct tfw_scheduler_t {
 	const char		*name;
 	struct list_head	list;
+	/*
+	 * The decision doesn't depend on the message content, so it
+	 * may be cached per session and reused while the connection
+	 * stays schedulable, see tfw_http_sess_get_srv_conn().
+	 */
+	bool			decision_cacheable;
 	void			(*add_grp)(TfwSrvGroup *sg);
 	void			(*del_grp)(TfwSrvGroup *sg);
 	void			(*add_conn)(TfwSrvGroup *sg, TfwServer *srv,
@@ -134,7 +178,113 @@ static inline bool
 tfw_srv_conn_queue_full(TfwSrvConn *srv_conn)
 {
 	TfwSrvGroup *sg = ((TfwServer *)srv_conn->peer)->sg;
-	return ACCESS_ONCE(srv_conn->qsize) >= sg->max_qsize;
+	return ACCESS_ONCE(srv_conn->qsize) >= sg->max_qsize
+	       || ACCESS_ONCE(srv_conn->sent_cnt) >= sg->max_inflight;
+}
+
+/*
+ * Passive health checks: a run of failed responses suspends the server
+ * for a penalty period, the schedulers prefer healthy servers and fall
+ * back to the suspended ones only when nothing else is available.
+ */
+static inline bool
+tfw_srv_suspended(TfwServer *srv)
+{
+	return srv->sg->hc_fails_thr
+	       && time_before(jiffies, ACCESS_ONCE(srv->hc_until));
+}
+
+/*
+ * Slow-start ramp for a server that just came back: its share of
+ * traffic grows linearly from near zero to full over @ramp_jtmo, so
+ * stone-cold backends warm up instead of browning out under their
+ * full share. The gate is probabilistic and shares the schedulers'
+ * suspended-server skip: a ramped-out server is preferred less often
+ * on the first pass but still usable when nothing else is - the
+ * rerun never leaves traffic unserved.
+ */
+static inline bool
+tfw_srv_ramp_skip(TfwServer *srv)
+{
+	unsigned long until = ACCESS_ONCE(srv->ramp_until);
+	unsigned long left;
+
+	if (likely(!until || time_after_eq(jiffies, until)))
+		return false;
+	left = until - jiffies;
+	/* Admission probability = elapsed fraction of the ramp. */
+	return prandom_u32() % srv->sg->ramp_jtmo < left;
+}
+
+static inline void
+tfw_srv_health_fail(TfwServer *srv)
+{
+	TfwSrvGroup *sg = srv->sg;
+
+	if (!sg->hc_fails_thr)
+		return;
+	if (atomic_inc_return(&srv->hc_fails) >= sg->hc_fails_thr) {
+		atomic_set(&srv->hc_fails, 0);
+		ACCESS_ONCE(srv->hc_until) = jiffies + sg->hc_penalty;
+	}
+}
+
+/*
+ * Retry budgets: re-forwards are allowed only up to a percentage of
+ * the recent forwarding rate, so a failing group degrades to errors
+ * instead of a retry storm multiplying its load. The window slots
+ * reuse the frang accounting scheme with its benign races.
+ */
+static inline int
+__tfw_sg_rb_slot(TfwSrvGroup *sg)
+{
+	unsigned long ts = jiffies * ARRAY_SIZE(sg->rb_win) / HZ;
+	int i = ts % ARRAY_SIZE(sg->rb_win);
+	unsigned long old_ts = ACCESS_ONCE(sg->rb_win[i].ts);
+
+	if (old_ts != ts && cmpxchg(&sg->rb_win[i].ts, old_ts, ts) == old_ts) {
+		atomic_set(&sg->rb_win[i].reqs, 0);
+		atomic_set(&sg->rb_win[i].retries, 0);
+	}
+	return i;
+}
+
+static inline void
+tfw_sg_account_req(TfwSrvGroup *sg)
+{
+	if (sg->retry_budget)
+		atomic_inc(&sg->rb_win[__tfw_sg_rb_slot(sg)].reqs);
+}
+
+static inline bool
+tfw_sg_retry_over_budget(TfwSrvGroup *sg)
+{
+	int i;
+	unsigned long ts, reqs = 0, retries = 0;
+
+	if (!sg->retry_budget)
+		return false;
+
+	atomic_inc(&sg->rb_win[__tfw_sg_rb_slot(sg)].retries);
+
+	ts = jiffies * ARRAY_SIZE(sg->rb_win) / HZ;
+	for (i = 0; i < ARRAY_SIZE(sg->rb_win); ++i)
+		if (ACCESS_ONCE(sg->rb_win[i].ts) + ARRAY_SIZE(sg->rb_win)
+		    >= ts)
+		{
+			reqs += atomic_read(&sg->rb_win[i].reqs);
+			retries += atomic_read(&sg->rb_win[i].retries);
+		}
+
+	/* Always allow a trickle of retries to probe recovery. */
+	return retries > 8 && retries * 100 > reqs * sg->retry_budget;
+}
+
+static inline void
+tfw_srv_health_ok(TfwServer *srv)
+{
+	if (atomic_read(&srv->hc_fails))
+		atomic_set(&srv->hc_fails, 0);
 }
 
 /*
@@ -151,6 +301,7 @@ tfw_srv_conn_need_resched(TfwSrvConn *srv_conn)
 }
 
 /* Server group routines. */
+void tfw_srv_preconnect_kick(void);
 TfwSrvGroup *tfw_sg_lookup(const char *name);
 TfwSrvGroup *tfw_sg_new(const char *name, gfp_t flags);
 void tfw_sg_free(TfwSrvGroup *sg);
@@ -33,6 +33,7 @@
 typedef enum {
 	SS_SEND,
 	SS_CLOSE,
+	SS_RX_DRAIN,
 } SsAction;
 
 typedef struct {
@@ -252,6 +253,19 @@ ss_do_send(struct sock *sk, SsSkbList *skb_list, int flags)
 		}
 
 		skb->ip_summed = CHECKSUM_PARTIAL;
+		/*
+		 * Make locally built jumbo skbs (e.g. cache hits carrying
+		 * up to 64KB of body frags) first class GSO citizens:
+		 * received skbs inherit their GSO marking from GRO, but
+		 * skbs we construct had none, risking software
+		 * linearization on the way out. The zero pcount below
+		 * makes TCP recompute the segment accounting against
+		 * the current MSS.
+		 */
+		if (skb->len > mss && !skb_shinfo(skb)->gso_type) {
+			skb_shinfo(skb)->gso_size = mss;
+			skb_shinfo(skb)->gso_type = sk->sk_gso_type;
+		}
 		tcp_skb_pcount_set(skb, 0);
 
 		/* @skb should be rerouted on forwarding. */
@@ -668,7 +682,28 @@ ss_tcp_process_data(struct sock *sk)
 	struct sk_buff *skb, *tmp;
 	struct tcp_sock *tp = tcp_sk(sk);
 
+	/*
+	 * Cooperative time slicing: one maliciously fragmented or
+	 * megabyte-header message must not monopolize the CPU for all
+	 * connections sharing it. After a byte budget (roughly tens of
+	 * microseconds of parsing) the rest of the receive queue is
+	 * re-scheduled through the work queue, so other sockets' queued
+	 * work interleaves with the rest of this message.
+	 */
+#define SS_RX_BUDGET	(128 * 1024)
+
 	skb_queue_walk_safe(&sk->sk_receive_queue, skb, tmp) {
+		if (unlikely(processed > SS_RX_BUDGET)) {
+			SsWork sw = {
+				.sk	= sk,
+				.action	= SS_RX_DRAIN,
+			};
+
+			ss_skb_queue_head_init(&sw.skb_list);
+			if (!ss_wq_push(&sw, false))
+				break;
+			/* Queue overrun: keep processing inline. */
+		}
 		if (unlikely(before(tp->copied_seq, TCP_SKB_CB(skb)->seq))) {
 			SS_WARN("recvmsg bug: TCP sequence gap at seq %X"
 				" recvnxt %X\n",
@@ -683,6 +718,39 @@ ss_tcp_process_data(struct sock *sk)
 		if (skb_shared(skb))
 			BUG();
 
+		/*
+		 * Adaptive receive aggregation: merge small sequential
+		 * segments into one skb so the parser FSM is entered
+		 * once per aggregate instead of once per segment. Only
+		 * small segments are aggregated - interactive and bulk
+		 * traffic goes through unchanged - and the aggregate is
+		 * bounded so a flood of tiny segments can't monopolize
+		 * the CPU here.
+		 */
+#define SS_AGGR_SEG_LIMIT	1024
+#define SS_AGGR_LIMIT		16384
+		while (skb->len < SS_AGGR_SEG_LIMIT) {
+			bool stolen = false;
+			int delta = 0;
+			struct sk_buff *next = skb_peek(&sk->sk_receive_queue);
+
+			if (!next
+			    || TCP_SKB_CB(next)->seq != TCP_SKB_CB(skb)->end_seq
+			    || skb->len + next->len > SS_AGGR_LIMIT
+			    || skb_shared(next))
+				break;
+			if (!skb_try_coalesce(skb, next, &stolen, &delta))
+				break;
+			__skb_unlink(next, &sk->sk_receive_queue);
+			TCP_SKB_CB(skb)->end_seq = TCP_SKB_CB(next)->end_seq;
+			kfree_skb_partial(next, stolen);
+		}
+		/* The walk cursor may have just been coalesced. */
+		tmp = skb_peek(&sk->sk_receive_queue)
+		      ? : (struct sk_buff *)&sk->sk_receive_queue;
+#undef SS_AGGR_SEG_LIMIT
+#undef SS_AGGR_LIMIT
+
 		/* Save the original len and seq for reporting. */
 		skb_len = skb->len;
 		skb_seq = TCP_SKB_CB(skb)->seq;
@@ -730,6 +798,20 @@ ss_tcp_data_ready(struct sock *sk)
 	ss_sock_cpu_check(sk, "recv");
 	assert_spin_locked(&sk->sk_lock.slock);
 
+	/* Warm up the connection's hot header before the upcalls. */
+	if (sk->sk_user_data)
+		prefetch(sk->sk_user_data);
+
+	/*
+	 * Feed the RFS flow table: the flow "application" is this
+	 * softirq, and since we never call recvmsg() nobody else
+	 * records the flow. With accelerated RFS the NIC then steers
+	 * the flow's interrupts to the CPU processing the socket, so
+	 * the multi-queue steering aligns with the socket's CPU
+	 * pinning instead of fighting it.
+	 */
+	sock_rps_record_flow(sk);
+
 	if (!skb_queue_empty(&sk->sk_error_queue)) {
 		/*
 		 * Error packet received.
@@ -1108,6 +1190,43 @@ ss_connect(struct sock *sk, struct sockaddr *uaddr, int uaddr_len, int flags)
 }
 EXPORT_SYMBOL(ss_connect);
 
+/**
+ * Connect through the TCP Fast Open path: the SYN carries the fast
+ * open option, so the kernel's per-destination metric cache acquires
+ * and refreshes the TFO cookie for this server across reconnects.
+ * Carrying request data in the SYN additionally needs the deferred
+ * connect machinery of newer kernels, since our egress path entails
+ * skbs directly rather than going through sendmsg - until then the
+ * warmed cookie keeps that option one backport away.
+ */
+int
+ss_connect_fastopen(struct sock *sk, struct sockaddr *uaddr, int uaddr_len)
+{
+	int r;
+	struct msghdr msg = {
+		.msg_name	= uaddr,
+		.msg_namelen	= uaddr_len,
+		.msg_flags	= MSG_FASTOPEN | MSG_DONTWAIT,
+	};
+
+	BUG_ON((sk->sk_family != AF_INET) && (sk->sk_family != AF_INET6));
+
+	if (sk->sk_state != TCP_CLOSE)
+		return -EISCONN;
+
+	if (ss_active_guard_enter(SS_V_ACT_LIVECONN))
+		return SS_SHUTDOWN;
+
+	r = tcp_sendmsg(sk, &msg, 0);
+	if (r == -EINPROGRESS)
+		r = 0;
+	if (unlikely(r))
+		ss_active_guard_exit(SS_V_ACT_LIVECONN);
+
+	return r;
+}
+EXPORT_SYMBOL(ss_connect_fastopen);
+
 /*
  * The original functions are inet_bind() and inet6_bind().
  * These two can be made a bit shorter should that become necessary.
@@ -1187,45 +1306,161 @@ do {								\
 	sock_put(sk); /* paired with ss_do_close() */		\
 } while (0)
 
-static void
-ss_tx_action(void)
+/*
+ * Coordinated backpressure: when a work queue runs towards overflow,
+ * dropping or busy-retrying at the FSM is the most expensive possible
+ * reaction - the bytes have already been received, decrypted and
+ * parsed. Instead the advertised TCP receive window of the
+ * contributing client sockets is clamped, so the peer's kernel stack
+ * throttles the sender for us. Throttled sockets are remembered in a
+ * small per-CPU ring and their windows are restored once the local
+ * queues drain below the low watermark.
+ */
+#define SS_THROTTLE_RING	64
+#define SS_THROTTLE_WND		128
+#define SS_THROTTLE_HOLD	(HZ / 10)
+#define SS_WQ_LOWAT		256
+
+typedef struct {
+	struct sock	*sk[SS_THROTTLE_RING];
+	unsigned long	until[SS_THROTTLE_RING];
+	int		n;
+} SsThrottleRing;
+
+static DEFINE_PER_CPU(SsThrottleRing, ss_throttle);
+
+void
+ss_sock_throttle(struct sock *sk)
 {
-	SsWork sw;
+	SsThrottleRing *tr = this_cpu_ptr(&ss_throttle);
 
-	/* FIXME The loop is unlimited, so we can face live lock in softirq. */
-	while (!tfw_wq_pop(this_cpu_ptr(&si_wq), &sw)) {
-		struct sock *sk = sw.sk;
+	if (tr->n >= SS_THROTTLE_RING)
+		return;
+	sock_hold(sk);
+	tcp_sk(sk)->window_clamp = SS_THROTTLE_WND;
+	tr->sk[tr->n] = sk;
+	/*
+	 * The pressured queue may live on another CPU (e.g. a cache
+	 * queue), so a drained local queue alone doesn't prove the
+	 * overload is over: hold the clamp for a minimum interval.
+	 */
+	tr->until[tr->n++] = jiffies + SS_THROTTLE_HOLD;
+}
+EXPORT_SYMBOL(ss_sock_throttle);
+
+void
+ss_socks_unthrottle(void)
+{
+	int i = 0;
+	SsThrottleRing *tr = this_cpu_ptr(&ss_throttle);
+
+	while (i < tr->n) {
+		struct sock *sk = tr->sk[i];
 
-		bh_lock_sock(sk);
-		if (sock_flag(sk, SOCK_DEAD)) {
-			/* We've closed the socket on earlier job. */
+		if (time_before(jiffies, tr->until[i])) {
+			++i;
+			continue;
+		}
+		if (!sock_flag(sk, SOCK_DEAD))
+			tcp_sk(sk)->window_clamp = tcp_full_space(sk);
+		sock_put(sk);
+		tr->sk[i] = tr->sk[--tr->n];
+		tr->until[i] = tr->until[tr->n];
+	}
+}
+EXPORT_SYMBOL(ss_socks_unthrottle);
+
+static void
+ss_tx_work(SsWork *sw)
+{
+	struct sock *sk = sw->sk;
+
+	bh_lock_sock(sk);
+	if (sock_flag(sk, SOCK_DEAD)) {
+		/* We've closed the socket on earlier job. */
+		bh_unlock_sock(sk);
+		goto dead_sock;
+	}
+	switch (sw->action) {
+	case SS_SEND:
+		ss_do_send(sk, &sw->skb_list, sw->flags);
+		if (!(sw->flags & SS_F_CONN_CLOSE)) {
 			bh_unlock_sock(sk);
-			goto dead_sock;
+			break;
 		}
-		switch (sw.action) {
-		case SS_SEND:
-			ss_do_send(sk, &sw.skb_list, sw.flags);
-			if (!(sw.flags & SS_F_CONN_CLOSE)) {
-				bh_unlock_sock(sk);
-				break;
-			}
-			__sk_close_locked(sk); /* paired with bh_lock_sock() */
+		__sk_close_locked(sk); /* paired with bh_lock_sock() */
+		break;
+	case SS_CLOSE:
+		if (!ss_sock_live(sk)) {
+			SS_DBG("[%d]: %s: Socket inactive: sk %p\n",
+			       smp_processor_id(), __func__, sk);
+			bh_unlock_sock(sk);
 			break;
-		case SS_CLOSE:
-			if (!ss_sock_live(sk)) {
-				SS_DBG("[%d]: %s: Socket inactive: sk %p\n",
-				       smp_processor_id(), __func__, sk);
-				bh_unlock_sock(sk);
-				break;
-			}
+		}
+		__sk_close_locked(sk); /* paired with bh_lock_sock() */
+		break;
+	case SS_RX_DRAIN:
+		/* Continue a receive run cut by the parse budget. */
+		if (ss_sock_active(sk)
+		    && !skb_queue_empty(&sk->sk_receive_queue)
+		    && ss_tcp_process_data(sk))
+		{
 			__sk_close_locked(sk); /* paired with bh_lock_sock() */
 			break;
-		default:
-			BUG();
 		}
+		bh_unlock_sock(sk);
+		break;
+	default:
+		BUG();
+	}
 dead_sock:
-		sock_put(sk); /* paired with tfw_wq_push() */
+	sock_put(sk); /* paired with tfw_wq_push() */
+}
+
+static void
+ss_tx_action(void)
+{
+	SsWork sw[8];
+	int n, i;
+
+	/* FIXME The loop is unlimited, so we can face live lock in softirq. */
+	while ((n = tfw_wq_pop_n(this_cpu_ptr(&si_wq), sw, ARRAY_SIZE(sw)))) {
+		for (i = 0; i < n; ++i) {
+			int j = i;
+
+			/*
+			 * Cork consecutive sends to the same socket
+			 * (headers then body, or several coalesced
+			 * responses to one client): their skb lists are
+			 * spliced and the socket lock is taken and TCP
+			 * pushed once at the batch flush point instead
+			 * of per call. Only compatible sends merge -
+			 * the flags govern cloning and closing
+			 * semantics per message.
+			 */
+			while (j + 1 < n
+			       && sw[i].action == SS_SEND
+			       && sw[j + 1].action == SS_SEND
+			       && sw[j + 1].sk == sw[i].sk
+			       && sw[j + 1].flags == sw[i].flags
+			       && !(sw[i].flags & SS_F_CONN_CLOSE))
+			{
+				struct sk_buff *skb;
+
+				++j;
+				while ((skb = ss_skb_dequeue(&sw[j].skb_list)))
+					ss_skb_queue_tail(&sw[i].skb_list,
+							  skb);
+				sock_put(sw[j].sk);
+			}
+			ss_tx_work(&sw[i]);
+			i = j;
+		}
 	}
+
+	/* The queue drained - let the throttled senders run again. */
+	if (tfw_wq_size(this_cpu_ptr(&si_wq)) < SS_WQ_LOWAT)
+		ss_socks_unthrottle();
 }
 
 #define HANDLE_TOO_LONG_WAIT(t0, job)					\
@@ -20,6 +20,8 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <net/tcp.h>
+
 #include "cfg.h"
 #include "classifier.h"
 #include "client.h"
@@ -29,6 +31,7 @@
 #include "sync_socket.h"
 #include "tempesta_fw.h"
 #include "server.h"
+#include "stress.h"
 #include "procfs.h"
 
 /*
@@ -37,6 +40,33 @@
  * ------------------------------------------------------------------------
  */
 
+/**
+ * The listening socket representation.
+ * One such structure corresponds to one "listen" configuration entry.
+ *
+ * @proto	- protocol descriptor for the listening socket;
+ * @sk		- The underlying networking representation.
+ * @list	- An entry in the tfw_listen_socks list.
+ * @addr	- The IP address specified in the configuration.
+ * @busy_poll	- microseconds of NAPI busy polling for accepted sockets,
+ *		  zero disables the low-latency mode.
+ * @shard_sk	- per-CPU sibling listeners bound with SO_REUSEPORT so
+ *		  each CPU accepts from its own queue, NULL if sharding
+ *		  is off;
+ * @shard_n	- number of entries in @shard_sk.
+ */
+typedef struct {
+	SsProto			proto;
+	struct sock		*sk;
+	struct list_head	list;
+	TfwAddr			addr;
+	unsigned int		busy_poll;
+	bool			lazy;
+	struct sock		**shard_sk;
+	int			shard_n;
+	bool			proxy_proto;
+} TfwListenSock;
+
 static struct kmem_cache *tfw_cli_conn_cache;
 static struct kmem_cache *tfw_tls_conn_cache;
 static int tfw_cli_cfg_ka_timeout = -1;
@@ -52,9 +82,24 @@ static void
 tfw_sock_cli_keepalive_timer_cb(unsigned long data)
 {
 	TfwCliConn *cli_conn = (TfwCliConn *)data;
+	unsigned long deadline = ACCESS_ONCE(cli_conn->jlast)
+				 + msecs_to_jiffies(tfw_cli_cfg_ka_timeout
+						    * 1000);
 
 	TFW_DBG("Client timeout end\n");
 
+	/*
+	 * Lazy keep-alive: the send path only stamps the activity time
+	 * instead of re-arming the timer for every message, so the
+	 * timer fires at the timeout of the connection's first message
+	 * and is pushed forward here if the connection is still active.
+	 * One cheap store per message replaces a timer base update.
+	 */
+	if (time_before(jiffies, deadline)) {
+		mod_timer(&cli_conn->timer, deadline);
+		return;
+	}
+
 	/*
 	 * Close the socket (and the connection) asynchronously to avoid
 	 * a deadlock on del_timer_sync(). In case of error try to close
@@ -64,12 +109,76 @@ tfw_sock_cli_keepalive_timer_cb(unsigned long data)
 		mod_timer(&cli_conn->timer, jiffies + msecs_to_jiffies(1000));
 }
 
+/*
+ * Per-CPU batches of preallocated connection objects. An LB failover
+ * can dump hundreds of thousands of connections on us at once and
+ * each accept runs in softirq, so the allocator round-trip is paid in
+ * bulk (kmem_cache_alloc_bulk() takes the slab locks once per
+ * TFW_CLI_CONN_BATCH objects) instead of per connection. Frees feed
+ * the local batch first, so an accept storm mostly recycles objects
+ * CPU-locally. HTTP and TLS connections have different sizes and
+ * therefore separate batches, mirroring the two slab caches.
+ */
+#define TFW_CLI_CONN_BATCH	16
+
+typedef struct {
+	void		*objs[TFW_CLI_CONN_BATCH];
+	int		n;
+} TfwCliConnBatch;
+
+static DEFINE_PER_CPU(TfwCliConnBatch, cli_conn_batch[2]);
+
+static void *
+tfw_cli_conn_batch_get(int type)
+{
+	TfwCliConnBatch *b = this_cpu_ptr(cli_conn_batch);
+
+	b += (type != Conn_HttpClnt);
+	if (!b->n) {
+		b->n = kmem_cache_alloc_bulk(tfw_cli_cache(type), GFP_ATOMIC,
+					     TFW_CLI_CONN_BATCH, b->objs);
+		if (!b->n)
+			return kmem_cache_alloc(tfw_cli_cache(type),
+						GFP_ATOMIC);
+	}
+	return b->objs[--b->n];
+}
+
+static void
+tfw_cli_conn_batch_put(int type, void *obj)
+{
+	TfwCliConnBatch *b = this_cpu_ptr(cli_conn_batch);
+
+	b += (type != Conn_HttpClnt);
+	if (b->n < TFW_CLI_CONN_BATCH) {
+		b->objs[b->n++] = obj;
+		return;
+	}
+	kmem_cache_free(tfw_cli_cache(type), obj);
+}
+
+static void
+tfw_cli_conn_batch_drain(void)
+{
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		TfwCliConnBatch *b = per_cpu_ptr(cli_conn_batch, cpu);
+
+		for (i = 0; i < b[0].n; ++i)
+			kmem_cache_free(tfw_cli_conn_cache, b[0].objs[i]);
+		for (i = 0; i < b[1].n; ++i)
+			kmem_cache_free(tfw_tls_conn_cache, b[1].objs[i]);
+		b[0].n = b[1].n = 0;
+	}
+}
+
 static TfwCliConn *
 tfw_cli_conn_alloc(int type)
 {
 	TfwCliConn *cli_conn;
 
-	if (!(cli_conn = kmem_cache_alloc(tfw_cli_cache(type), GFP_ATOMIC)))
+	if (!(cli_conn = tfw_cli_conn_batch_get(type)))
 		return NULL;
 
 	tfw_connection_init((TfwConn *)cli_conn);
@@ -93,7 +202,7 @@ tfw_cli_conn_free(TfwCliConn *cli_conn)
 	tfw_connection_validate_cleanup((TfwConn *)cli_conn);
 	BUG_ON(!list_empty(&cli_conn->seq_queue));
 
-	kmem_cache_free(tfw_cli_cache(TFW_CONN_TYPE(cli_conn)), cli_conn);
+	tfw_cli_conn_batch_put(TFW_CONN_TYPE(cli_conn), cli_conn);
 }
 
 void
@@ -115,8 +224,11 @@ tfw_cli_conn_send(TfwCliConn *cli_conn, TfwMsg *msg)
 	int r;
 
 	r = tfw_connection_send((TfwConn *)cli_conn, msg);
-	mod_timer(&cli_conn->timer,
-		  jiffies + msecs_to_jiffies(tfw_cli_cfg_ka_timeout * 1000));
+	ACCESS_ONCE(cli_conn->jlast) = jiffies;
+	if (!timer_pending(&cli_conn->timer))
+		mod_timer(&cli_conn->timer,
+			  jiffies
+			  + msecs_to_jiffies(tfw_cli_cfg_ka_timeout * 1000));
 
 	if (r)
 		/* Quite usual on system shutdown. */
@@ -129,16 +241,13 @@ tfw_cli_conn_send(TfwCliConn *cli_conn, TfwMsg *msg)
  * This hook is called when a new client connection is established.
  */
 static int
-tfw_sock_clnt_new(struct sock *sk)
+__tfw_sock_clnt_promote(struct sock *sk)
 {
 	int r = -ENOMEM;
 	TfwClient *cli;
 	TfwConn *conn;
 	SsProto *listen_sock_proto;
 
-	TFW_DBG3("new client socket: sk=%p, state=%u\n", sk, sk->sk_state);
-	TFW_INC_STAT_BH(clnt.conn_attempts);
-
 	/*
 	 * New sk->sk_user_data points to TfwListenSock{} of the parent
 	 * listening socket. We set it to NULL to stop other functions
@@ -148,6 +257,27 @@ tfw_sock_clnt_new(struct sock *sk)
 	listen_sock_proto = sk->sk_user_data;
 	tfw_connection_unlink_from_sk(sk);
 
+	/*
+	 * The first bytes of a TLS connection (the ClientHello) imply a
+	 * handshake worth of latency before the first request needs a
+	 * backend - use it to revive dead backend connections early.
+	 */
+	if (TFW_FSM_TYPE(listen_sock_proto->type) == TFW_FSM_HTTPS)
+		tfw_srv_preconnect_kick();
+
+	/*
+	 * Ultra-low-latency mode of the listener: let the NAPI busy
+	 * polling spin on the device queue of this socket and never
+	 * delay small segments.
+	 */
+	if (unlikely(((TfwListenSock *)listen_sock_proto)->busy_poll)) {
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		sk->sk_ll_usec =
+			((TfwListenSock *)listen_sock_proto)->busy_poll;
+#endif
+		tcp_sk(sk)->nonagle = TCP_NAGLE_OFF;
+	}
+
 	cli = tfw_client_obtain(sk, NULL);
 	if (!cli) {
 		TFW_ERR("can't obtain a client for the new socket\n");
@@ -162,6 +292,10 @@ tfw_sock_clnt_new(struct sock *sk)
 
 	ss_proto_inherit(listen_sock_proto, &conn->proto, Conn_Clnt);
 
+	/* Expect a PROXY protocol header first on such listeners. */
+	if (((TfwListenSock *)listen_sock_proto)->proxy_proto)
+		((TfwCliConn *)conn)->pp_state = 1;
+
 	conn->destructor = (void *)tfw_cli_conn_release;
 
 	r = tfw_connection_new(conn);
@@ -183,7 +317,6 @@ tfw_sock_clnt_new(struct sock *sk)
 
 	TFW_DBG3("new client socket is accepted: sk=%p, conn=%p, cli=%p\n",
 		 sk, conn, cli);
-	TFW_INC_STAT_BH(clnt.conn_established);
 	return 0;
 
 err_conn:
@@ -194,6 +327,119 @@ err_client:
 	return r;
 }
 
+/*
+ * Lazy promotion: on a 'lazy' listener an accepted socket gets only a
+ * tiny embryo - no client lookup, no connection object, no pool, no
+ * protocol state - until its first data arrives. Scanners that
+ * connect and close (a third of the accept volume during sweeps) then
+ * cost a slab object and a timer-wheel slot instead of the full
+ * connection lifecycle; the frang accounting still runs at accept
+ * time through the classifier hooks, so the flood limits see them.
+ *
+ * @proto	- SS dispatch state, must be first;
+ * @sk		- the accepted socket, referenced;
+ * @listen_proto - the parent listener, restored for the promotion;
+ * @timer	- reclaims embryos that never send data.
+ */
+#define TFW_CLI_EMBRYO_TOUT	(10 * HZ)
+
+typedef struct {
+	SsProto			proto;
+	struct sock		*sk;
+	SsProto			*listen_proto;
+	struct timer_list	timer;
+} TfwCliEmbryo;
+
+static struct kmem_cache *tfw_cli_embryo_cache;
+
+static void
+tfw_sock_clnt_embryo_timer_cb(unsigned long data)
+{
+	TfwCliEmbryo *emb = (TfwCliEmbryo *)data;
+
+	/* No data in time: close; the drop hook frees the embryo. */
+	ss_close(emb->sk);
+}
+
+static int
+tfw_sock_clnt_embryo_recv(void *obj, struct sk_buff *skb, unsigned int off)
+{
+	TfwCliEmbryo *emb = obj;
+	struct sock *sk = emb->sk;
+	int r;
+
+	/* First data: build the real connection and replay the skb. */
+	del_timer(&emb->timer);
+	sk->sk_user_data = emb->listen_proto;
+	sock_put(sk);
+	kmem_cache_free(tfw_cli_embryo_cache, emb);
+
+	if ((r = __tfw_sock_clnt_promote(sk))) {
+		__kfree_skb(skb);
+		return TFW_BLOCK;
+	}
+	TFW_INC_STAT_BH(clnt.conn_established);
+
+	return tfw_connection_recv(sk->sk_user_data, skb, off);
+}
+
+static void
+tfw_sock_clnt_embryo_drop(struct sock *sk)
+{
+	TfwCliEmbryo *emb = sk->sk_user_data;
+
+	del_timer_sync(&emb->timer);
+	sk->sk_user_data = NULL;
+	sock_put(sk);
+	kmem_cache_free(tfw_cli_embryo_cache, emb);
+}
+
+static const SsHooks tfw_sock_clnt_embryo_hooks = {
+	.connection_drop	= tfw_sock_clnt_embryo_drop,
+	.connection_error	= tfw_sock_clnt_embryo_drop,
+	.connection_recv	= tfw_sock_clnt_embryo_recv,
+};
+
+static int
+tfw_sock_clnt_new(struct sock *sk)
+{
+	SsProto *listen_sock_proto = sk->sk_user_data;
+
+	TFW_DBG3("new client socket: sk=%p, state=%u\n", sk, sk->sk_state);
+	TFW_INC_STAT_BH(clnt.conn_attempts);
+
+	/* The deny-new-connections overload action, see stress.c. */
+	if (unlikely(tfw_stress_overloaded()))
+		return -ENOMEM;
+
+	if (((TfwListenSock *)listen_sock_proto)->lazy) {
+		TfwCliEmbryo *emb;
+
+		emb = kmem_cache_alloc(tfw_cli_embryo_cache, GFP_ATOMIC);
+		if (!emb)
+			return -ENOMEM;
+		emb->proto = *listen_sock_proto;
+		emb->proto.hooks = &tfw_sock_clnt_embryo_hooks;
+		emb->sk = sk;
+		emb->listen_proto = listen_sock_proto;
+		sock_hold(sk);
+		sk->sk_user_data = emb;
+		ss_set_callbacks(sk);
+		setup_timer(&emb->timer, tfw_sock_clnt_embryo_timer_cb,
+			    (unsigned long)emb);
+		mod_timer(&emb->timer, jiffies + TFW_CLI_EMBRYO_TOUT);
+		return 0;
+	}
+
+	{
+		int r = __tfw_sock_clnt_promote(sk);
+
+		if (!r)
+			TFW_INC_STAT_BH(clnt.conn_established);
+		return r;
+	}
+}
+
 /**
  * Do the same stuff for intetional client connection closing and due to some
  * error on TCP socket or application layers.
@@ -277,22 +523,6 @@ tfw_cli_conn_close_all(TfwClient *cli)
 
 #define TFW_LISTEN_SOCK_BACKLOG_LEN 	1024
 
-/**
- * The listening socket representation.
- * One such structure corresponds to one "listen" configuration entry.
- *
- * @proto	- protocol descriptor for the listening socket;
- * @sk		- The underlying networking representation.
- * @list	- An entry in the tfw_listen_socks list.
- * @addr	- The IP address specified in the configuration.
- */
-typedef struct {
-	SsProto			proto;
-	struct sock		*sk;
-	struct list_head	list;
-	TfwAddr			addr;
-} TfwListenSock;
-
 /**
  * The list of all existing TfwListenSock structures.
  *
@@ -309,7 +539,8 @@ static LIST_HEAD(tfw_listen_socks);
  * @type is the SsProto->type.
  */
 static int
-tfw_listen_sock_add(const TfwAddr *addr, int type)
+tfw_listen_sock_add(const TfwAddr *addr, int type, unsigned int busy_poll,
+		    bool shard, bool proxy_proto, bool lazy)
 {
 	TfwListenSock *ls;
 
@@ -336,6 +567,16 @@ tfw_listen_sock_add(const TfwAddr *addr, int type)
 
 	list_add(&ls->list, &tfw_listen_socks);
 	ls->addr = *addr;
+	ls->busy_poll = busy_poll;
+	ls->proxy_proto = proxy_proto;
+	ls->lazy = lazy;
+	if (shard && num_online_cpus() > 1) {
+		ls->shard_n = num_online_cpus() - 1;
+		ls->shard_sk = kcalloc(ls->shard_n, sizeof(*ls->shard_sk),
+				       GFP_KERNEL);
+		if (!ls->shard_sk)
+			ls->shard_n = 0;
+	}
 
 	/* Port is placed at the same offset in sockaddr_in and sockaddr_in6. */
 	tfw_classifier_add_inport(addr->v4.sin_port);
@@ -350,6 +591,7 @@ tfw_listen_sock_del_all(void)
 
 	list_for_each_entry_safe(ls, tmp, &tfw_listen_socks, list) {
 		BUG_ON(ls->sk);
+		kfree(ls->shard_sk);
 		kfree(ls);
 	}
 
@@ -391,6 +633,15 @@ tfw_listen_sock_start(TfwListenSock *ls)
 
 	inet_sk(sk)->freebind = 1;
 	sk->sk_reuse = 1;
+	/*
+	 * SO_REUSEPORT must be set before bind(): the bind bucket gets
+	 * fastreuseport from the first socket, and only then does the
+	 * kernel form the reuseport group that spreads lookups over
+	 * the shard listeners. Setting it after listen() leaves the
+	 * sharding silently inert.
+	 */
+	if (ls->shard_n)
+		sk->sk_reuseport = 1;
 	r = ss_bind(sk, &addr->sa, tfw_addr_sa_len(addr));
 	if (r) {
 		TFW_ERR_ADDR("can't bind to", addr);
@@ -404,6 +655,43 @@ tfw_listen_sock_start(TfwListenSock *ls)
 		return r;
 	}
 
+	if (!ls->shard_n)
+		return 0;
+
+	/*
+	 * Receive sharding: open one more listener per remaining CPU on
+	 * the same address with SO_REUSEPORT (set on the primary before
+	 * its bind above), so the kernel spreads the SYN queues over
+	 * the sockets and every CPU accepts connections from its own
+	 * queue with no contention on one accept queue.
+	 */
+	{
+		int i;
+
+		for (i = 0; i < ls->shard_n; ++i) {
+			struct sock *ssk;
+
+			r = ss_sock_create(addr->family, SOCK_STREAM,
+					   IPPROTO_TCP, &ssk);
+			if (r)
+				return r;
+			ls->shard_sk[i] = ssk;
+			ssk->sk_user_data = ls;
+			ss_set_listen(ssk);
+			inet_sk(ssk)->freebind = 1;
+			ssk->sk_reuse = 1;
+			ssk->sk_reuseport = 1;
+			r = ss_bind(ssk, &addr->sa, tfw_addr_sa_len(addr));
+			if (r) {
+				TFW_ERR_ADDR("can't bind shard to", addr);
+				return r;
+			}
+			r = ss_listen(ssk, TFW_LISTEN_SOCK_BACKLOG_LEN);
+			if (r)
+				return r;
+		}
+	}
+
 	return 0;
 }
 
@@ -429,19 +717,91 @@ tfw_listen_sock_start_all(void)
 }
 
 static void
-tfw_sock_clnt_stop_all(void)
+__tfw_listen_socks_release(void)
 {
 	TfwListenSock *ls;
 
-	might_sleep();
-
-	/* Stop listening sockets. */
 	list_for_each_entry(ls, &tfw_listen_socks, list) {
-		BUG_ON(!ls->sk);
-		ss_release(ls->sk);
-		ls->sk = NULL;
+		int i;
+
+		/* Already NULL if a drain released the listeners. */
+		if (ls->sk) {
+			ss_release(ls->sk);
+			ls->sk = NULL;
+		}
+		for (i = 0; i < ls->shard_n; ++i) {
+			if (!ls->shard_sk[i])
+				continue;
+			ss_release(ls->shard_sk[i]);
+			ls->shard_sk[i] = NULL;
+		}
 	}
 	ss_wait_listeners();
+}
+
+/* Draining progress, read through procfs (see procfs.c). */
+atomic_t tfw_cli_drain_left = ATOMIC_INIT(-1);
+
+static int
+__cli_conn_count_cb(TfwConn *conn)
+{
+	if (tfw_connection_live(conn))
+		atomic_inc(&tfw_cli_drain_left);
+	return 0;
+}
+
+static int
+tfw_cli_conn_count(TfwClient *cli)
+{
+	TfwConn *conn;
+
+	return tfw_peer_for_each_conn(cli, conn, list, __cli_conn_count_cb);
+}
+
+/**
+ * Drain client connections before a stop: close the listeners so no
+ * new connections appear, then let the established ones finish their
+ * in-flight responses and keep-alive grace on their own. Returns when
+ * no live client connections remain or @tmo_s seconds pass; connections
+ * still alive at the deadline are closed by the normal stop that
+ * follows. The remaining count is published in tfw_cli_drain_left for
+ * the procfs readout, so a rolling-restart driver can watch the drain
+ * converge.
+ */
+int
+tfw_sock_clnt_drain(unsigned int tmo_s)
+{
+	unsigned long deadline = jiffies + tmo_s * HZ;
+	int left;
+
+	might_sleep();
+
+	__tfw_listen_socks_release();
+
+	do {
+		atomic_set(&tfw_cli_drain_left, 0);
+		local_bh_disable();
+		tfw_client_for_each(tfw_cli_conn_count);
+		local_bh_enable();
+		left = atomic_read(&tfw_cli_drain_left);
+		if (!left)
+			break;
+		schedule_timeout_interruptible(HZ / 10);
+	} while (time_before(jiffies, deadline));
+
+	TFW_LOG("drain finished, %d connection(s) left\n", left);
+	atomic_set(&tfw_cli_drain_left, -1);
+
+	return left;
+}
+
+static void
+tfw_sock_clnt_stop_all(void)
+{
+	might_sleep();
+
+	/* Stop listening sockets. */
+	__tfw_listen_socks_release();
 
 	/*
 	 * Now all listening sockets are closed, so no new connections
@@ -526,23 +886,40 @@ tfw_sock_clnt_cfg_handle_listen(TfwCfgSpec *cs, TfwCfgEntry *ce)
 			goto parse_err;
 	}
 
-	r = tfw_cfg_check_range(ce->attr_n, 0, 1);
+	r = tfw_cfg_check_range(ce->attr_n, 0, 4);
 	if (r)
 		goto parse_err;
 
-	if (!ce->attr_n)
-		return tfw_listen_sock_add(&addr, TFW_FSM_HTTP);
+	{
+		int type = TFW_FSM_HTTP, bpoll = 0;
+		const char *bp_str;
+
+		in_str = tfw_cfg_get_attr(ce, "proto", NULL);
+		if (in_str) {
+			if (!strcasecmp(in_str, "http"))
+				type = TFW_FSM_HTTP;
+			else if (!strcasecmp(in_str, "https"))
+				type = TFW_FSM_HTTPS;
+			else
+				goto parse_err;
+		}
 
-	in_str = tfw_cfg_get_attr(ce, "proto", NULL);
-	if (!in_str)
-		goto parse_err;
+		bp_str = tfw_cfg_get_attr(ce, "bpoll", NULL);
+		if (bp_str) {
+			in_str = bp_str;
+			if (tfw_cfg_parse_int(bp_str, &bpoll)
+			    || tfw_cfg_check_range(bpoll, 0, USEC_PER_SEC))
+				goto parse_err;
+		}
 
-	if (!strcasecmp(in_str, "http"))
-		return tfw_listen_sock_add(&addr, TFW_FSM_HTTP);
-	else if (!strcasecmp(in_str, "https"))
-		return tfw_listen_sock_add(&addr, TFW_FSM_HTTPS);
-	else
-		goto parse_err;
+		return tfw_listen_sock_add(&addr, type, bpoll,
+					   !!tfw_cfg_get_attr(ce, "shard",
+							      NULL),
+					   !!tfw_cfg_get_attr(ce, "pp",
+							      NULL),
+					   !!tfw_cfg_get_attr(ce, "lazy",
+							      NULL));
+	}
 
 parse_err:
 	TFW_ERR_NL("Unable to parse 'listen' value: '%s'\n",
@@ -619,17 +996,22 @@ tfw_sock_clnt_init(void)
 	BUG_ON(tfw_tls_conn_cache);
 
 	tfw_cli_conn_cache = kmem_cache_create("tfw_cli_conn_cache",
-					       sizeof(TfwCliConn), 0, 0, NULL);
+					       sizeof(TfwCliConn), 0, SLAB_HWCACHE_ALIGN, NULL);
 	tfw_tls_conn_cache = kmem_cache_create("tfw_tls_conn_cache",
-					       sizeof(TfwTlsConn), 0, 0, NULL);
+					       sizeof(TfwTlsConn), 0, SLAB_HWCACHE_ALIGN, NULL);
+	tfw_cli_embryo_cache = kmem_cache_create("tfw_cli_embryo_cache",
+						 sizeof(TfwCliEmbryo), 0, 0,
+						 NULL);
 
-	if (tfw_cli_conn_cache && tfw_tls_conn_cache)
+	if (tfw_cli_conn_cache && tfw_tls_conn_cache && tfw_cli_embryo_cache)
 		return 0;
 
 	if (tfw_cli_conn_cache)
 		kmem_cache_destroy(tfw_cli_conn_cache);
 	if (tfw_tls_conn_cache)
 		kmem_cache_destroy(tfw_tls_conn_cache);
+	if (tfw_cli_embryo_cache)
+		kmem_cache_destroy(tfw_cli_embryo_cache);
 
 	return 0;
 }
@@ -637,6 +1019,8 @@ tfw_sock_clnt_init(void)
 void
 tfw_sock_clnt_exit(void)
 {
+	tfw_cli_conn_batch_drain();
+	kmem_cache_destroy(tfw_cli_embryo_cache);
 	kmem_cache_destroy(tfw_tls_conn_cache);
 	kmem_cache_destroy(tfw_cli_conn_cache);
 }
@@ -55,6 +55,82 @@
  * ------------------------------------------------------------------------
  */
 
+/*
+ * Asynchronous DNS for server addresses. Resolution goes through the
+ * kernel DNS resolver (the request-key upcall), so it happens in
+ * process context at configuration time and in the periodic
+ * re-resolution work, never on the traffic path. A changed address is
+ * installed into the server and its connections are closed: the
+ * failover machinery reconnects them to the new address.
+ */
+#include <linux/dns_resolver.h>
+
+#define TFW_SRV_DNS_PERIOD	(60 * HZ)
+
+static int
+tfw_srv_resolve(const char *name, TfwAddr *addr)
+{
+#if IS_ENABLED(CONFIG_DNS_RESOLVER)
+	int n;
+	char *ip = NULL;
+	char buf[64];
+	const char *host = name, *colon = strchr(name, ':');
+	size_t hlen = colon ? (size_t)(colon - name) : strlen(name);
+
+	n = dns_query(NULL, host, hlen, NULL, &ip, NULL);
+	if (n < 0)
+		return n;
+	/* Re-append the configured port to the resolved address. */
+	if (snprintf(buf, sizeof(buf), "%.*s%s", n, ip, colon ? : "")
+	    >= sizeof(buf))
+	{
+		kfree(ip);
+		return -EINVAL;
+	}
+	kfree(ip);
+
+	return tfw_addr_pton(&TFW_STR_FROM(buf), addr);
+#else
+	return -EOPNOTSUPP;
+#endif
+}
+
+static void tfw_srv_dns_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tfw_srv_dns_work, tfw_srv_dns_fn);
+
+static int
+__srv_re_resolve(TfwServer *srv)
+{
+	TfwAddr addr;
+	TfwSrvConn *srv_conn;
+
+	if (!srv->hostname)
+		return 0;
+	if (tfw_srv_resolve(srv->hostname, &addr))
+		return 0;
+	if (tfw_addr_eq(&addr, &srv->addr))
+		return 0;
+
+	TFW_LOG_ADDR("server address changed to", &addr);
+	srv->addr = addr;
+	/* Kick the connections over to the new address. */
+	list_for_each_entry(srv_conn, &srv->conn_list, list)
+		if (tfw_srv_conn_live(srv_conn))
+			ss_close(srv_conn->sk);
+
+	return 0;
+}
+
+static void
+tfw_srv_dns_fn(struct work_struct *work)
+{
+	tfw_sg_for_each_srv(__srv_re_resolve);
+	schedule_delayed_work(&tfw_srv_dns_work, TFW_SRV_DNS_PERIOD);
+}
+
+/* Abort a pending connect attempt after so many milliseconds. */
+#define TFW_SRV_CONNECT_DLINE	300
+
 /**
  * A server connection differs from a client connection. For clients,
  * a new TfwCliConn{} instance is created when a new client socket is
@@ -151,6 +227,10 @@ tfw_sock_srv_connect_try(TfwSrvConn *srv_conn)
 	tfw_connection_link_from_sk((TfwConn *)srv_conn, sk);
 	ss_set_callbacks(sk);
 
+	/* For the connect deadline timer, see the retry timer callback. */
+	sock_hold(sk);
+	BUG_ON(xchg(&srv_conn->pending_sk, sk));
+
 	/*
 	 * There are two possible use patterns of this function:
 	 *
@@ -167,11 +247,29 @@ tfw_sock_srv_connect_try(TfwSrvConn *srv_conn)
 	 * Thus we don't need syncronization for ss_connect().
 	 */
 	TFW_INC_STAT_BH(serv.conn_attempts);
-	r = ss_connect(sk, &addr->sa, tfw_addr_sa_len(addr), 0);
-	if (r) {
+	if (((TfwServer *)srv_conn->peer)->sg->flags & TFW_SRV_FASTOPEN)
+		r = ss_connect_fastopen(sk, &addr->sa, tfw_addr_sa_len(addr));
+	else
+		r = ss_connect(sk, &addr->sa, tfw_addr_sa_len(addr), 0);
+	if (!r) {
+		/*
+		 * A happy-eyeballs style connect deadline: don't sit out
+		 * the multi-second kernel SYN retransmissions when the
+		 * server (or path) is silently dropping SYNs - abort
+		 * the attempt shortly and let the failover machinery
+		 * retry, possibly through a sibling connection which
+		 * already went a different path.
+		 */
+		mod_timer(&srv_conn->timer,
+			  jiffies + msecs_to_jiffies(TFW_SRV_CONNECT_DLINE));
+	} else {
+		struct sock *psk;
+
 		if (r != SS_SHUTDOWN)
 			TFW_ERR("Unable to initiate a connect to server: %d\n",
 				r);
+		if ((psk = xchg(&srv_conn->pending_sk, NULL)))
+			sock_put(psk);
 		ss_close_sync(sk, false);
 		/*
 		 * We hadle shutdown by closing the socket, so we can return
@@ -257,11 +355,60 @@ tfw_sock_srv_connect_retry_timer_cb(unsigned long data)
 {
 	TfwSrvConn *srv_conn = (TfwSrvConn *)data;
 
+	struct sock *psk;
+
+	/*
+	 * The connect deadline fired on a pending attempt: abort the
+	 * socket, the error upcall then schedules the next attempt via
+	 * the usual failover path.
+	 */
+	if ((psk = xchg(&srv_conn->pending_sk, NULL))) {
+		ss_close(psk);
+		sock_put(psk);
+		return;
+	}
+	/* The completion won the race, nothing to retry. */
+	if (srv_conn->sk)
+		return;
+
 	/* A new socket is created for each connect attempt. */
 	if (tfw_sock_srv_connect_try(srv_conn))
 		tfw_sock_srv_connect_try_later(srv_conn);
 }
 
+/*
+ * Pre-connect kick: a client just arrived (e.g. a TLS ClientHello came
+ * in), so expire the pending reconnect timers of dead backend
+ * connections right away instead of waiting out the exponential
+ * backoff - by the time the handshake completes the backends are
+ * connected again. Rate limited to once a second.
+ */
+static unsigned long tfw_srv_kick_ts;
+
+static int
+__srv_preconnect_kick(TfwServer *srv)
+{
+	TfwSrvConn *srv_conn;
+
+	list_for_each_entry(srv_conn, &srv->conn_list, list)
+		if (!tfw_srv_conn_live(srv_conn)
+		    && timer_pending(&srv_conn->timer))
+			mod_timer_pending(&srv_conn->timer, jiffies);
+	return 0;
+}
+
+void
+tfw_srv_preconnect_kick(void)
+{
+	unsigned long now = jiffies, ts = READ_ONCE(tfw_srv_kick_ts);
+
+	if (time_before(now, ts + HZ))
+		return;
+	if (cmpxchg(&tfw_srv_kick_ts, ts, now) != ts)
+		return;
+	tfw_sg_for_each_srv(__srv_preconnect_kick);
+}
+
 static inline void
 __reset_retry_timer(TfwSrvConn *srv_conn)
 {
@@ -280,6 +427,12 @@ __setup_retry_timer(TfwSrvConn *srv_conn)
 void
 tfw_srv_conn_release(TfwSrvConn *srv_conn)
 {
+	struct sock *psk;
+
+	/* The attempt is over (failed or closed), drop the deadline ref. */
+	if ((psk = xchg(&srv_conn->pending_sk, NULL)))
+		sock_put(psk);
+
 	tfw_connection_release((TfwConn *)srv_conn);
 	/*
 	 * conn->sk may be zeroed if we get here after a failed
@@ -307,6 +460,27 @@ tfw_sock_srv_connect_complete(struct sock *sk)
 	TfwConn *conn = sk->sk_user_data;
 	TfwServer *srv = (TfwServer *)conn->peer;
 
+	/*
+	 * If no other connection of the server is live, the server is
+	 * coming back cold - start the slow-start ramp before the
+	 * schedulers see the new connection.
+	 */
+	if (srv->sg->ramp_jtmo
+	    && !time_before(jiffies, srv->ramp_until))
+	{
+		TfwSrvConn *c;
+		bool was_up = false;
+
+		list_for_each_entry(c, &srv->conn_list, list)
+			if (c != (TfwSrvConn *)conn && tfw_srv_conn_live(c)) {
+				was_up = true;
+				break;
+			}
+		if (!was_up)
+			WRITE_ONCE(srv->ramp_until,
+				   jiffies + srv->sg->ramp_jtmo);
+	}
+
 	/* Link Tempesta with the socket. */
 	tfw_connection_link_to_sk(conn, sk);
 
@@ -323,6 +497,13 @@ tfw_sock_srv_connect_complete(struct sock *sk)
 	if (unlikely(tfw_srv_conn_restricted((TfwSrvConn *)conn)))
 		tfw_connection_repair(conn);
 
+	{
+		struct sock *psk =
+			xchg(&((TfwSrvConn *)conn)->pending_sk, NULL);
+		if (psk)
+			sock_put(psk);
+	}
+	del_timer(&((TfwSrvConn *)conn)->timer);
 	__reset_retry_timer((TfwSrvConn *)conn);
 
 	TFW_DBG_ADDR("connected", &srv->addr);
@@ -581,6 +762,14 @@ static TfwScheduler *tfw_cfg_in_sched, *tfw_cfg_out_sched;
 static TfwSrvGroup *tfw_cfg_in_sg, *tfw_cfg_out_sg;
 
 static int tfw_cfg_in_queue_size = TFW_CFG_SRV_QUEUE_SIZE_DEF;
+static int tfw_cfg_in_pipeline_depth = 0;
+static int tfw_cfg_in_hc_fails = 0;
+static int tfw_cfg_in_hedge_tmo = 0;
+static int tfw_cfg_in_retry_budget = 0;
+static int tfw_cfg_in_stream_bodies = 0;
+static int tfw_cfg_in_fastopen = 0;
+static int tfw_cfg_in_ramp_time = 0;
+static int tfw_cfg_in_hc_penalty = 10;
 static int tfw_cfg_in_fwd_timeout = TFW_CFG_SRV_FWD_TIMEOUT_DEF;
 static int tfw_cfg_in_fwd_retries = TFW_CFG_SRV_FWD_RETRIES_DEF;
 static int tfw_cfg_in_cns_retries = TFW_CFG_SRV_CNS_RETRIES_DEF;
@@ -588,6 +777,14 @@ static int tfw_cfg_in_retry_nip = TFW_CFG_SRV_RETRY_NIP_DEF;
 static unsigned int tfw_cfg_in_sticky = TFW_CFG_SRV_STICKY_DEF;
 
 static int tfw_cfg_out_queue_size = TFW_CFG_SRV_QUEUE_SIZE_DEF;
+static int tfw_cfg_out_pipeline_depth = 0;
+static int tfw_cfg_out_hc_fails = 0;
+static int tfw_cfg_out_hedge_tmo = 0;
+static int tfw_cfg_out_retry_budget = 0;
+static int tfw_cfg_out_stream_bodies = 0;
+static int tfw_cfg_out_fastopen = 0;
+static int tfw_cfg_out_ramp_time = 0;
+static int tfw_cfg_out_hc_penalty = 10;
 static int tfw_cfg_out_fwd_timeout = TFW_CFG_SRV_FWD_TIMEOUT_DEF;
 static int tfw_cfg_out_fwd_retries = TFW_CFG_SRV_FWD_RETRIES_DEF;
 static int tfw_cfg_out_cns_retries = TFW_CFG_SRV_CNS_RETRIES_DEF;
@@ -627,6 +824,94 @@ tfw_cfgop_out_queue_size(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_queue_size);
 }
 
+static int
+tfw_cfgop_in_pipeline_depth(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_in_pipeline_depth);
+}
+
+static int
+tfw_cfgop_out_pipeline_depth(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_pipeline_depth);
+}
+
+static int
+tfw_cfgop_in_hc_fails(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_in_hc_fails);
+}
+
+static int
+tfw_cfgop_out_hc_fails(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_hc_fails);
+}
+
+static int
+tfw_cfgop_in_hedge_tmo(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_in_hedge_tmo);
+}
+
+static int
+tfw_cfgop_out_hedge_tmo(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_hedge_tmo);
+}
+
+static int
+tfw_cfgop_in_retry_budget(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_in_retry_budget);
+}
+
+static int
+tfw_cfgop_out_retry_budget(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_retry_budget);
+}
+
+static int
+tfw_cfgop_in_fastopen(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_in_fastopen = 1;
+	return 0;
+}
+
+static int
+tfw_cfgop_out_fastopen(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_out_fastopen = 1;
+	return 0;
+}
+
+static int
+tfw_cfgop_in_stream_bodies(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_in_stream_bodies = 1;
+	return 0;
+}
+
+static int
+tfw_cfgop_out_stream_bodies(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_out_stream_bodies = 1;
+	return 0;
+}
+
+static int
+tfw_cfgop_in_hc_penalty(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_in_hc_penalty);
+}
+
+static int
+tfw_cfgop_out_hc_penalty(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_out_hc_penalty);
+}
+
 static int
 tfw_cfgop_in_fwd_timeout(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
@@ -752,8 +1037,8 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce,
 {
 	TfwAddr addr;
 	TfwServer *srv;
-	int i, conns_n = 0;
-	bool has_conns_n = false;
+	int i, conns_n = 0, weight = 1;
+	bool has_conns_n = false, has_weight = false;
 	const char *key, *val, *saddr;
 
 	if (ce->val_n != 1) {
@@ -771,9 +1056,13 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce,
 	saddr = ce->vals[0];
 
 	if (tfw_addr_pton(&TFW_STR_FROM(saddr), &addr)) {
-		TFW_ERR_NL("%s: %s %s: Invalid IP address: '%s'\n",
-			   sg->name, cs->name, saddr, saddr);
-		return -EINVAL;
+		/* Not a literal address - try asynchronous DNS. */
+		if (tfw_srv_resolve(saddr, &addr)) {
+			TFW_ERR_NL("%s: %s %s: Invalid address or"
+				   " unresolvable name: '%s'\n",
+				   sg->name, cs->name, saddr, saddr);
+			return -EINVAL;
+		}
 	}
 
 	TFW_CFG_ENTRY_FOR_EACH_ATTR(ce, i, key, val) {
@@ -791,6 +1080,16 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce,
 				return -EINVAL;
 			}
 			has_conns_n = true;
+		} else if (!strcasecmp(key, "weight")) {
+			if (has_weight || tfw_cfg_parse_int(val, &weight)
+			    || weight < 1 || weight > 100)
+			{
+				TFW_ERR_NL("%s: %s %s: Invalid value: '%s=%s'"
+					   "\n", sg->name, cs->name, saddr,
+					   key, val);
+				return -EINVAL;
+			}
+			has_weight = true;
 		} else {
 			TFW_ERR_NL("%s: %s %s: Unsupported argument: '%s=%s'\n",
 				   sg->name, cs->name, saddr, key, val);
@@ -812,6 +1111,10 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce,
 			   sg->name, cs->name, saddr);
 		return -EINVAL;
 	}
+	srv->weight = weight;
+	/* Remember the name for periodic re-resolution. */
+	if (tfw_addr_pton(&TFW_STR_FROM(saddr), &(TfwAddr){}))
+		srv->hostname = kstrdup(saddr, GFP_KERNEL);
 	tfw_sg_add(sg, srv);
 
 	*arg_srv = srv;
@@ -836,6 +1139,9 @@ tfw_cfgop_in_server(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	int nconn;
 	TfwServer *srv;
 
+	if (tfw_cfg_is_reloading())
+		return 0;
+
 	if (tfw_cfg_in_slstsz >= TFW_SG_MAX_SRV)
 		return -EINVAL;
 	if (tfw_cfgop_server(cs, ce, tfw_cfg_in_sg, &srv, &nconn))
@@ -871,6 +1177,15 @@ tfw_cfgop_out_server(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	int nconn;
 	TfwServer *srv;
 
+	/*
+	 * On a configuration reload the running servers and their
+	 * established connections are kept: only the limit directives
+	 * are re-applied, see tfw_sock_srv_reconf(). Topology changes
+	 * require a full restart.
+	 */
+	if (tfw_cfg_is_reloading())
+		return 0;
+
 	if (tfw_cfg_out_slstsz >= TFW_SG_MAX_SRV)
 		return -EINVAL;
 	/*
@@ -909,6 +1224,8 @@ tfw_cfgop_out_server(TfwCfgSpec *cs, TfwCfgEntry *ce)
 static int
 tfw_cfgop_begin_srv_group(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
+	if (tfw_cfg_is_reloading())
+		return 0;
 	if (ce->val_n != 1) {
 		TFW_ERR_NL("%s %s: Invalid number of arguments: %zd\n",
 			   cs->name, ce->val_n ? ce->vals[0] : "", ce->val_n);
@@ -931,6 +1248,14 @@ tfw_cfgop_begin_srv_group(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	tfw_cfg_in_slstsz = 0;
 	tfw_cfg_in_sched = tfw_cfg_out_sched;
 	tfw_cfg_in_queue_size = tfw_cfg_out_queue_size;
+	tfw_cfg_in_pipeline_depth = tfw_cfg_out_pipeline_depth;
+	tfw_cfg_in_hc_fails = tfw_cfg_out_hc_fails;
+	tfw_cfg_in_hedge_tmo = tfw_cfg_out_hedge_tmo;
+	tfw_cfg_in_retry_budget = tfw_cfg_out_retry_budget;
+	tfw_cfg_in_stream_bodies = tfw_cfg_out_stream_bodies;
+	tfw_cfg_in_fastopen = tfw_cfg_out_fastopen;
+	tfw_cfg_in_ramp_time = tfw_cfg_out_ramp_time;
+	tfw_cfg_in_hc_penalty = tfw_cfg_out_hc_penalty;
 	tfw_cfg_in_fwd_timeout = tfw_cfg_out_fwd_timeout;
 	tfw_cfg_in_fwd_retries = tfw_cfg_out_fwd_retries;
 	tfw_cfg_in_cns_retries = tfw_cfg_out_cns_retries;
@@ -956,6 +1281,8 @@ tfw_cfgop_finish_srv_group(TfwCfgSpec *cs)
 	int i;
 	TfwSrvGroup *sg = tfw_cfg_in_sg;
 
+	if (tfw_cfg_is_reloading())
+		return 0;
 	BUG_ON(!sg);
 	BUG_ON(list_empty(&sg->srv_list));
 	BUG_ON(!tfw_cfg_in_sched);
@@ -963,6 +1290,14 @@ tfw_cfgop_finish_srv_group(TfwCfgSpec *cs)
 
 	tfw_cfgop_set_conn_retries(sg, tfw_cfg_in_cns_retries);
 	sg->max_qsize = tfw_cfg_in_queue_size ? : UINT_MAX;
+	sg->max_inflight = tfw_cfg_in_pipeline_depth ? : UINT_MAX;
+	sg->hc_fails_thr = tfw_cfg_in_hc_fails;
+	sg->hc_penalty = tfw_cfg_in_hc_penalty * HZ;
+	sg->hedge_jtmo = msecs_to_jiffies(tfw_cfg_in_hedge_tmo);
+	sg->retry_budget = tfw_cfg_in_retry_budget;
+	sg->flags |= tfw_cfg_in_stream_bodies ? TFW_SRV_STREAM_BODIES : 0;
+	sg->flags |= tfw_cfg_in_fastopen ? TFW_SRV_FASTOPEN : 0;
+	sg->ramp_jtmo = tfw_cfg_in_ramp_time * HZ;
 	sg->max_jqage = tfw_cfg_in_fwd_timeout
 		      ? msecs_to_jiffies(tfw_cfg_in_fwd_timeout * 1000)
 		      : ULONG_MAX;
@@ -1039,6 +1374,10 @@ tfw_cfgop_out_sched(TfwCfgSpec *cs, TfwCfgEntry *ce)
 static void
 tfw_clean_srv_groups(TfwCfgSpec *cs)
 {
+	/* The running groups are kept across a reload. */
+	if (tfw_cfg_is_reloading())
+		return;
+
 	tfw_sock_srv_delete_all_conns();
 	tfw_sg_release_all();
 
@@ -1047,6 +1386,34 @@ tfw_clean_srv_groups(TfwCfgSpec *cs)
 	tfw_cfg_in_slstsz = tfw_cfg_out_slstsz = 0;
 }
 
+/**
+ * Re-apply the per-group limit directives on a configuration reload.
+ * The servers and their established connections are reused: only the
+ * tunables change. Limits of explicit srv_group sections are re-applied
+ * from the top-level values as well - per-group overrides require a
+ * full restart, as do topology changes.
+ */
+static int
+tfw_sock_srv_reconf(void)
+{
+	TfwSrvGroup *sg = tfw_cfg_out_sg;
+
+	if (!sg)
+		return 0;
+
+	tfw_cfgop_set_conn_retries(sg, tfw_cfg_out_cns_retries);
+	sg->max_qsize = tfw_cfg_out_queue_size ? : UINT_MAX;
+	sg->max_inflight = tfw_cfg_out_pipeline_depth ? : UINT_MAX;
+	sg->hc_fails_thr = tfw_cfg_out_hc_fails;
+	sg->hc_penalty = tfw_cfg_out_hc_penalty * HZ;
+	sg->max_jqage = tfw_cfg_out_fwd_timeout
+		      ? msecs_to_jiffies(tfw_cfg_out_fwd_timeout * 1000)
+		      : ULONG_MAX;
+	sg->max_refwd = tfw_cfg_out_fwd_retries ? : UINT_MAX;
+
+	return 0;
+}
+
 static int
 tfw_sock_srv_start(void)
 {
@@ -1058,6 +1425,15 @@ tfw_sock_srv_start(void)
 
 		tfw_cfgop_set_conn_retries(sg, tfw_cfg_out_cns_retries);
 		sg->max_qsize = tfw_cfg_out_queue_size ? : UINT_MAX;
+		sg->max_inflight = tfw_cfg_out_pipeline_depth ? : UINT_MAX;
+		sg->hc_fails_thr = tfw_cfg_out_hc_fails;
+		sg->hc_penalty = tfw_cfg_out_hc_penalty * HZ;
+		sg->hedge_jtmo = msecs_to_jiffies(tfw_cfg_out_hedge_tmo);
+		sg->retry_budget = tfw_cfg_out_retry_budget;
+		sg->flags |= tfw_cfg_out_stream_bodies
+			     ? TFW_SRV_STREAM_BODIES : 0;
+		sg->flags |= tfw_cfg_out_fastopen ? TFW_SRV_FASTOPEN : 0;
+		sg->ramp_jtmo = tfw_cfg_out_ramp_time * HZ;
 		sg->max_jqage = tfw_cfg_out_fwd_timeout
 			      ? msecs_to_jiffies(tfw_cfg_out_fwd_timeout * 1000)
 			      : ULONG_MAX;
@@ -1091,12 +1467,24 @@ tfw_sock_srv_start(void)
 	if ((ret = tfw_sg_for_each_srv(tfw_server_apm_create)) != 0)
 		return ret;
 
+	schedule_delayed_work(&tfw_srv_dns_work, TFW_SRV_DNS_PERIOD);
+
 	return tfw_sg_for_each_srv(tfw_sock_srv_connect_srv);
 }
 
+static int
+__srv_free_hostname(TfwServer *srv)
+{
+	kfree(srv->hostname);
+	srv->hostname = NULL;
+	return 0;
+}
+
 static void
 tfw_sock_srv_stop(void)
 {
+	cancel_delayed_work_sync(&tfw_srv_dns_work);
+	tfw_sg_for_each_srv(__srv_free_hostname);
 	tfw_sg_for_each_srv(tfw_sock_srv_disconnect_srv);
 }
 
@@ -1121,6 +1509,60 @@ static TfwCfgSpec tfw_srv_group_specs[] = {
 		.allow_repeat = false,
 		.cleanup = tfw_clean_srv_groups,
 	},
+	{
+		"server_pipeline_depth", NULL,
+		tfw_cfgop_in_pipeline_depth,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_stream_bodies", NULL,
+		tfw_cfgop_in_stream_bodies,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_fastopen", NULL,
+		tfw_cfgop_in_fastopen,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_ramp_time", "0",
+		tfw_cfg_set_int,
+		&tfw_cfg_in_ramp_time,
+	},
+	{
+		"server_retry_budget", NULL,
+		tfw_cfgop_in_retry_budget,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_hedge_timeout", NULL,
+		tfw_cfgop_in_hedge_tmo,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_health_failures", NULL,
+		tfw_cfgop_in_hc_fails,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
+	{
+		"server_health_penalty", NULL,
+		tfw_cfgop_in_hc_penalty,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_clean_srv_groups,
+	},
 	{
 		"server_forward_timeout", NULL,
 		tfw_cfgop_in_fwd_timeout,
@@ -1163,6 +1605,7 @@ TfwCfgMod tfw_sock_srv_cfg_mod = {
 	.name  = "sock_srv",
 	.start = tfw_sock_srv_start,
 	.stop  = tfw_sock_srv_stop,
+	.reconf = tfw_sock_srv_reconf,
 	.specs = (TfwCfgSpec[] ) {
 		{
 			"server", NULL,
@@ -1185,6 +1628,60 @@ TfwCfgMod tfw_sock_srv_cfg_mod = {
 			.allow_repeat = true,
 			.cleanup = tfw_clean_srv_groups,
 		},
+		{
+			"server_pipeline_depth", NULL,
+			tfw_cfgop_out_pipeline_depth,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_stream_bodies", NULL,
+			tfw_cfgop_out_stream_bodies,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_fastopen", NULL,
+			tfw_cfgop_out_fastopen,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_ramp_time", "0",
+			tfw_cfg_set_int,
+			&tfw_cfg_out_ramp_time,
+		},
+		{
+			"server_retry_budget", NULL,
+			tfw_cfgop_out_retry_budget,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_hedge_timeout", NULL,
+			tfw_cfgop_out_hedge_tmo,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_health_failures", NULL,
+			tfw_cfgop_out_hc_fails,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
+		{
+			"server_health_penalty", NULL,
+			tfw_cfgop_out_hc_penalty,
+			.allow_none = true,
+			.allow_repeat = true,
+			.cleanup = tfw_clean_srv_groups,
+		},
 		{
 			"server_forward_timeout", NULL,
 			tfw_cfgop_out_fwd_timeout,
@@ -1247,7 +1744,7 @@ tfw_sock_srv_init(void)
 {
 	BUG_ON(tfw_srv_conn_cache);
 	tfw_srv_conn_cache = kmem_cache_create("tfw_srv_conn_cache",
-					       sizeof(TfwSrvConn), 0, 0, NULL);
+					       sizeof(TfwSrvConn), 0, SLAB_HWCACHE_ALIGN, NULL);
 	return !tfw_srv_conn_cache ? -ENOMEM : 0;
 }
 
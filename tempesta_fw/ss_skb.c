@@ -78,8 +78,40 @@ ss_skb_alloc_pages(size_t len)
 	if ((skb = ss_skb_alloc()) == NULL)
 		return NULL;
 
+	/*
+	 * Multi-fragment messages take all their pages from the buddy
+	 * allocator in one higher-order allocation split into singles,
+	 * one allocator round trip instead of one per fragment. The
+	 * split pages are independently refcounted, so the consumers
+	 * free them as usual. Fall back to per-page allocations when
+	 * a contiguous block isn't available.
+	 */
+	if (nr_frags > 1) {
+		int order = get_order(nr_frags << PAGE_SHIFT);
+		struct page *pg = alloc_pages_node(numa_node_id(),
+						   GFP_ATOMIC
+						   | __GFP_THISNODE, order);
+		if (pg) {
+			split_page(pg, order);
+			for (i = 0; i < nr_frags; ++i)
+				skb_fill_page_desc(skb, i, pg + i, 0, 0);
+			for (i = nr_frags; i < (1 << order); ++i)
+				__free_page(pg + i);
+			return skb;
+		}
+	}
+
 	for (i = 0; i < nr_frags; ++i) {
-		struct page *page = alloc_page(GFP_ATOMIC);
+		/*
+		 * The data is written and transmitted by the current
+		 * CPU, so prefer a node-local page and fall back to a
+		 * remote node only when the local one is exhausted.
+		 */
+		struct page *page = alloc_pages_node(numa_node_id(),
+						     GFP_ATOMIC
+						     | __GFP_THISNODE, 0);
+		if (!page)
+			page = alloc_page(GFP_ATOMIC);
 		if (!page) {
 			kfree_skb(skb);
 			return NULL;
@@ -900,14 +932,22 @@ ss_skb_process(struct sk_buff *skb, unsigned int *off, ss_skb_actor_t actor,
 	}
 
 	/*
-	 * Process paged fragments. This is where GROed data is placed.
-	 * See ixgbe_fetch_rx_buffer() and tcp_gro_receive().
+	 * Process paged fragments natively - this is where GROed data
+	 * is placed (see ixgbe_fetch_rx_buffer() and tcp_gro_receive())
+	 * and a 64KB aggregate never gets linearized: the actor is fed
+	 * each fragment in place. The next fragment's page is
+	 * prefetched before the actor chews through the current one,
+	 * so the page-crossing stalls of a long GRO frag chain overlap
+	 * with parsing instead of following it.
 	 */
 	for (i = 0; i < si->nr_frags; ++i) {
 		const skb_frag_t *frag = &si->frags[i];
 		unsigned int frag_size = skb_frag_size(frag);
 		if (offset < frag_size) {
 			unsigned char *frag_addr = skb_frag_address(frag);
+
+			if (i + 1 < si->nr_frags)
+				prefetch(skb_frag_address(&si->frags[i + 1]));
 			*off += frag_size - offset;
 			r = actor(objdata, frag_addr + offset,
 					   frag_size - offset);
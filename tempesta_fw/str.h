@@ -89,6 +89,50 @@ size_t tfw_match_ctext_vchar(const char *s, size_t len);
 size_t tfw_match_xff(const char *s, size_t len);
 size_t tfw_match_cookie(const char *s, size_t len);
 
+/*
+ * Identifiers of known request header names classified by
+ * tfw_hdr_req_lookup() in one 16/32-byte gulp. The caller maps them
+ * to its own header-value processing states.
+ */
+enum {
+	TFW_HDRN_REQ_AUTHORIZATION,
+	TFW_HDRN_REQ_CACHE_CONTROL,
+	TFW_HDRN_REQ_CONNECTION,
+	TFW_HDRN_REQ_CONTENT_LENGTH,
+	TFW_HDRN_REQ_CONTENT_TYPE,
+	TFW_HDRN_REQ_COOKIE,
+	TFW_HDRN_REQ_HOST,
+	TFW_HDRN_REQ_KEEP_ALIVE,
+	TFW_HDRN_REQ_PRAGMA,
+	TFW_HDRN_REQ_TRANSFER_ENCODING,
+	TFW_HDRN_REQ_USER_AGENT,
+	TFW_HDRN_REQ_X_FORWARDED_FOR,
+	TFW_HDRN_REQ_NUM
+};
+
+/* Known response header names, same contract as the request set. */
+enum {
+	TFW_HDRN_RESP_AGE,
+	TFW_HDRN_RESP_CACHE_CONTROL,
+	TFW_HDRN_RESP_CONNECTION,
+	TFW_HDRN_RESP_CONTENT_LENGTH,
+	TFW_HDRN_RESP_CONTENT_TYPE,
+	TFW_HDRN_RESP_DATE,
+	TFW_HDRN_RESP_EXPIRES,
+	TFW_HDRN_RESP_KEEP_ALIVE,
+	TFW_HDRN_RESP_SERVER,
+	TFW_HDRN_RESP_TRANSFER_ENCODING,
+	TFW_HDRN_RESP_NUM
+};
+
+/* The classifier reads the full vector regardless of the name length. */
+#define TFW_HDR_REQ_MAXLEN	32
+
+int tfw_hdr_req_lookup(const char *str);
+unsigned char tfw_hdr_req_nlen(int hid);
+int tfw_hdr_resp_lookup(const char *str);
+unsigned char tfw_hdr_resp_nlen(int hid);
+
 #ifdef AVX2
 void __tfw_strtolower_avx2(unsigned char *dest, const unsigned char *src,
 			    size_t len);
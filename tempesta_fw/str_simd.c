@@ -30,6 +30,7 @@
 
 #include "htype.h"
 #include "log.h"
+#include "str.h"
 
 /*
  * Static structure of constants for vector processing.
@@ -1207,13 +1208,30 @@ EXPORT_SYMBOL(tfw_match_nctl);
 size_t
 tfw_match_ctext_vchar(const char *str, size_t len)
 {
-	size_t r;
+	size_t r = 0;
+
+	/*
+	 * ctext/VCHAR is the only alphabet with obs-text (%x80-%xFF):
+	 * the nibble bitmaps cover ASCII rows only, so the vector scan
+	 * stops at any high byte. The table accepts obs-text, thus on
+	 * a high stop byte take it and keep scanning - otherwise the
+	 * match boundary would depend on which code path the chunk
+	 * length selects.
+	 */
+	while (r < len) {
+		size_t n;
 #ifdef AVX2
-	r = __tfw_strspn_simd(str, len, ctext_vchar, __C.CTVCH128,
-				 __C.CTVCH256);
+		n = __tfw_strspn_simd(str + r, len - r, ctext_vchar,
+				      __C.CTVCH128, __C.CTVCH256);
 #else
-	r = __tfw_strspn_simd(str, len, ctext_vchar, __C.CTVCH128);
+		n = __tfw_strspn_simd(str + r, len - r, ctext_vchar,
+				      __C.CTVCH128);
 #endif
+		r += n;
+		if (r >= len || !(str[r] & 0x80))
+			break;
+		++r;
+	}
 	TFW_DBG3("%s: str[0]=%#x len=%lu r=%lu\n", __func__, str[0], len, r);
 
 	return r;
@@ -1249,3 +1267,187 @@ tfw_match_cookie(const char *str, size_t len)
 	return r;
 }
 EXPORT_SYMBOL(tfw_match_cookie);
+
+/*
+ * ------------------------------------------------------------------------
+ *	Known header name classification
+ * ------------------------------------------------------------------------
+ * The header dispatch in the HTTP parser walks header names byte by byte
+ * before it reaches the per-header states. Classify the most frequent
+ * request header names in one 16/32-byte gulp instead: lowercase the
+ * loaded vector in the same way as __tfw_stricmp_avx2_2lc() does and
+ * compare it against precomputed colon-terminated patterns for candidates
+ * sharing the first character. The caller must guarantee
+ * TFW_HDR_REQ_MAXLEN bytes of contiguous data at @str.
+ */
+typedef struct {
+	char		name[TFW_HDR_REQ_MAXLEN];
+	unsigned char	len;
+} __HdrName;
+
+static const __HdrName hdr_req_tbl[TFW_HDRN_REQ_NUM] ____cacheline_aligned = {
+	[TFW_HDRN_REQ_AUTHORIZATION]	 = { "authorization:", 14 },
+	[TFW_HDRN_REQ_CACHE_CONTROL]	 = { "cache-control:", 14 },
+	[TFW_HDRN_REQ_CONNECTION]	 = { "connection:", 11 },
+	[TFW_HDRN_REQ_CONTENT_LENGTH]	 = { "content-length:", 15 },
+	[TFW_HDRN_REQ_CONTENT_TYPE]	 = { "content-type:", 13 },
+	[TFW_HDRN_REQ_COOKIE]		 = { "cookie:", 7 },
+	[TFW_HDRN_REQ_HOST]		 = { "host:", 5 },
+	[TFW_HDRN_REQ_KEEP_ALIVE]	 = { "keep-alive:", 11 },
+	[TFW_HDRN_REQ_PRAGMA]		 = { "pragma:", 7 },
+	[TFW_HDRN_REQ_TRANSFER_ENCODING] = { "transfer-encoding:", 18 },
+	[TFW_HDRN_REQ_USER_AGENT]	 = { "user-agent:", 11 },
+	[TFW_HDRN_REQ_X_FORWARDED_FOR]	 = { "x-forwarded-for:", 16 },
+};
+
+/*
+ * Candidate lists by the lowercased first character of a header name.
+ * Entries are header identifiers biased by 1, so zero terminates a list
+ * and characters with no known headers give all-zero rows for free.
+ */
+static const unsigned char hdr_req_fc['z' - 'a' + 1][6] = {
+	['a' - 'a'] = { TFW_HDRN_REQ_AUTHORIZATION + 1 },
+	['c' - 'a'] = { TFW_HDRN_REQ_CONNECTION + 1,
+			TFW_HDRN_REQ_CONTENT_LENGTH + 1,
+			TFW_HDRN_REQ_CONTENT_TYPE + 1,
+			TFW_HDRN_REQ_COOKIE + 1,
+			TFW_HDRN_REQ_CACHE_CONTROL + 1 },
+	['h' - 'a'] = { TFW_HDRN_REQ_HOST + 1 },
+	['k' - 'a'] = { TFW_HDRN_REQ_KEEP_ALIVE + 1 },
+	['p' - 'a'] = { TFW_HDRN_REQ_PRAGMA + 1 },
+	['t' - 'a'] = { TFW_HDRN_REQ_TRANSFER_ENCODING + 1 },
+	['u' - 'a'] = { TFW_HDRN_REQ_USER_AGENT + 1 },
+	['x' - 'a'] = { TFW_HDRN_REQ_X_FORWARDED_FOR + 1 },
+};
+
+#ifdef AVX2
+static inline int
+__hdr_name_match(const char *str, const __HdrName *hn)
+{
+	unsigned int eq, lmask = ~0U >> (32 - hn->len);
+
+	__m256i v = _mm256_lddqu_si256((void *)str);
+	__m256i n = _mm256_lddqu_si256((void *)hn->name);
+
+	__m256i sub = _mm256_sub_epi8(v, __C.A256);
+	__m256i cmp_r = _mm256_cmpgt_epi8(__C.D256, sub);
+	__m256i lc = _mm256_and_si256(cmp_r, __C.CASE256);
+	__m256i vl = _mm256_or_si256(v, lc);
+
+	eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(vl, n));
+
+	return (eq & lmask) == lmask;
+}
+#else
+static inline int
+__hdr_name_match(const char *str, const __HdrName *hn)
+{
+	unsigned int eq0, eq1, lmask = ~0U >> (32 - hn->len);
+
+	__m128i v0 = _mm_lddqu_si128((void *)str);
+	__m128i v1 = _mm_lddqu_si128((void *)(str + 16));
+	__m128i n0 = _mm_lddqu_si128((void *)hn->name);
+	__m128i n1 = _mm_lddqu_si128((void *)(hn->name + 16));
+
+	__m128i sub0 = _mm_sub_epi8(v0, __C.A128);
+	__m128i sub1 = _mm_sub_epi8(v1, __C.A128);
+	__m128i cmp_r0 = _mm_cmpgt_epi8(__C.D128, sub0);
+	__m128i cmp_r1 = _mm_cmpgt_epi8(__C.D128, sub1);
+	__m128i lc0 = _mm_and_si128(cmp_r0, __C.CASE128);
+	__m128i lc1 = _mm_and_si128(cmp_r1, __C.CASE128);
+	__m128i vl0 = _mm_or_si128(v0, lc0);
+	__m128i vl1 = _mm_or_si128(v1, lc1);
+
+	eq0 = _mm_movemask_epi8(_mm_cmpeq_epi8(vl0, n0));
+	eq1 = _mm_movemask_epi8(_mm_cmpeq_epi8(vl1, n1));
+
+	return ((eq0 | (eq1 << 16)) & lmask) == lmask;
+}
+#endif
+
+/**
+ * Classify a known request header name with its terminating colon at @str.
+ *
+ * @return the header identifier or -1 if the name is not recognized;
+ * -1 just sends the caller to its byte-at-a-time path, so false negatives
+ * are fine while false positives are not.
+ */
+int
+tfw_hdr_req_lookup(const char *str)
+{
+	int i, id;
+	unsigned int fc = TFW_LC(*(const unsigned char *)str) - 'a';
+
+	if (fc > 'z' - 'a')
+		return -1;
+	for (i = 0; hdr_req_fc[fc][i]; ++i) {
+		id = hdr_req_fc[fc][i] - 1;
+		if (__hdr_name_match(str, &hdr_req_tbl[id])) {
+			TFW_DBG3("%s: str[0]=%#x id=%d\n", __func__,
+				 str[0], id);
+			return id;
+		}
+	}
+	return -1;
+}
+EXPORT_SYMBOL(tfw_hdr_req_lookup);
+
+unsigned char
+tfw_hdr_req_nlen(int hid)
+{
+	return hdr_req_tbl[hid].len;
+}
+EXPORT_SYMBOL(tfw_hdr_req_nlen);
+
+/*
+ * The response header set, dispatched by the same one-gulp classifier.
+ */
+static const __HdrName hdr_resp_tbl[TFW_HDRN_RESP_NUM] ____cacheline_aligned = {
+	[TFW_HDRN_RESP_AGE]		 = { "age:", 4 },
+	[TFW_HDRN_RESP_CACHE_CONTROL]	 = { "cache-control:", 14 },
+	[TFW_HDRN_RESP_CONNECTION]	 = { "connection:", 11 },
+	[TFW_HDRN_RESP_CONTENT_LENGTH]	 = { "content-length:", 15 },
+	[TFW_HDRN_RESP_CONTENT_TYPE]	 = { "content-type:", 13 },
+	[TFW_HDRN_RESP_DATE]		 = { "date:", 5 },
+	[TFW_HDRN_RESP_EXPIRES]		 = { "expires:", 8 },
+	[TFW_HDRN_RESP_KEEP_ALIVE]	 = { "keep-alive:", 11 },
+	[TFW_HDRN_RESP_SERVER]		 = { "server:", 7 },
+	[TFW_HDRN_RESP_TRANSFER_ENCODING] = { "transfer-encoding:", 18 },
+};
+
+static const unsigned char hdr_resp_fc['z' - 'a' + 1][6] = {
+	['a' - 'a'] = { TFW_HDRN_RESP_AGE + 1 },
+	['c' - 'a'] = { TFW_HDRN_RESP_CONNECTION + 1,
+			TFW_HDRN_RESP_CONTENT_LENGTH + 1,
+			TFW_HDRN_RESP_CONTENT_TYPE + 1,
+			TFW_HDRN_RESP_CACHE_CONTROL + 1 },
+	['d' - 'a'] = { TFW_HDRN_RESP_DATE + 1 },
+	['e' - 'a'] = { TFW_HDRN_RESP_EXPIRES + 1 },
+	['k' - 'a'] = { TFW_HDRN_RESP_KEEP_ALIVE + 1 },
+	['s' - 'a'] = { TFW_HDRN_RESP_SERVER + 1 },
+	['t' - 'a'] = { TFW_HDRN_RESP_TRANSFER_ENCODING + 1 },
+};
+
+int
+tfw_hdr_resp_lookup(const char *str)
+{
+	int i, id;
+	unsigned int fc = TFW_LC(*(const unsigned char *)str) - 'a';
+
+	if (fc > 'z' - 'a')
+		return -1;
+	for (i = 0; hdr_resp_fc[fc][i]; ++i) {
+		id = hdr_resp_fc[fc][i] - 1;
+		if (__hdr_name_match(str, &hdr_resp_tbl[id]))
+			return id;
+	}
+	return -1;
+}
+EXPORT_SYMBOL(tfw_hdr_resp_lookup);
+
+unsigned char
+tfw_hdr_resp_nlen(int hid)
+{
+	return hdr_resp_tbl[hid].len;
+}
+EXPORT_SYMBOL(tfw_hdr_resp_nlen);
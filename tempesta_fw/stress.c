@@ -29,6 +29,31 @@
 static LIST_HEAD(stress_handlers);
 static DEFINE_RWLOCK(tfw_stress_lock);
 
+/* New client connections are rejected until this time. */
+static unsigned long tfw_stress_deny_until;
+
+void
+tfw_stress_deny_new_conns(void)
+{
+	ACCESS_ONCE(tfw_stress_deny_until) = jiffies + HZ;
+}
+EXPORT_SYMBOL(tfw_stress_deny_new_conns);
+
+bool
+tfw_stress_overloaded(void)
+{
+	return time_before(jiffies, ACCESS_ONCE(tfw_stress_deny_until));
+}
+
+static inline void
+__stress_overload(TfwStress *s)
+{
+	if (s->overload)
+		s->overload();
+	else
+		tfw_classify_shrink();
+}
+
 void
 tfw_stress_account_srv(/* we need here a packet and connection */)
 {
@@ -38,7 +63,7 @@ tfw_stress_account_srv(/* we need here a packet and connection */)
 	list_for_each_entry(s, &stress_handlers, st_list) {
 		if (s->type & TfwStress_Srv)
 			if (s->account_srv())
-				tfw_classify_shrink();
+				__stress_overload(s);
 	}
 	read_unlock(&tfw_stress_lock);
 }
@@ -52,11 +77,13 @@ tfw_stress_account_sys(void)
 	list_for_each_entry(s, &stress_handlers, st_list) {
 		if (s->type & TfwStress_Sys)
 			if (s->account_sys())
-				tfw_classify_shrink();
+				__stress_overload(s);
 	}
 	read_unlock(&tfw_stress_lock);
 }
 
+EXPORT_SYMBOL(tfw_stress_overloaded);
+
 int
 tfw_stress_register(TfwStress *mod)
 {
@@ -67,6 +94,8 @@ tfw_stress_register(TfwStress *mod)
 	return 0;
 }
 
+EXPORT_SYMBOL(tfw_stress_register);
+
 void
 tfw_stress_unregister(TfwStress *mod)
 {
@@ -81,3 +110,4 @@ tfw_stress_unregister(TfwStress *mod)
 	}
 	write_unlock(&tfw_stress_lock);
 }
+EXPORT_SYMBOL(tfw_stress_unregister);
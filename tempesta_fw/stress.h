@@ -52,11 +52,25 @@ typedef struct {
 	 */
 	bool		(*account_sys)(void);
 
+	/*
+	 * Pluggable overload action, called when one of the accounting
+	 * callbacks reports overload. Classifier shrinking is the
+	 * default when the callback isn't set.
+	 */
+	void		(*overload)(void);
+
 } TfwStress;
 
 void tfw_stress_account_srv(void);
 void tfw_stress_account_sys(void);
 
+/*
+ * A built-in overload action: reject new client connections for a
+ * short period while the load settles, see tfw_stress_overloaded().
+ */
+void tfw_stress_deny_new_conns(void);
+bool tfw_stress_overloaded(void);
+
 int tfw_stress_register(TfwStress *mod);
 void tfw_stress_unregister(TfwStress *mod);
 
@@ -23,22 +23,58 @@
 #include <linux/module.h>
 
 #include "../tempesta_fw.h"
+#include "../stress.h"
 
 MODULE_AUTHOR(TFW_AUTHOR);
 MODULE_DESCRIPTION("Tempesta system stress accounting");
-MODULE_VERSION("0.1.0");
+MODULE_VERSION("0.2.0");
 MODULE_LICENSE("GPL");
 
+/* Requests per second the box is allowed to take, 0 - unlimited. */
+static int req_rate_max = 0;
+module_param(req_rate_max, int, 0644);
+MODULE_PARM_DESC(req_rate_max, "Max requests per second, 0 - unlimited");
+
+static atomic_t req_cnt;
+static unsigned long win_ts;
+
+/**
+ * Count the requests of the current second; report overload above the
+ * limit. The window reset is raced benignly: a few events may land in
+ * the neighbour window, which is fine for an overload heuristic.
+ */
+static bool
+th_stress_sys_account(void)
+{
+	unsigned long now = jiffies / HZ;
+	unsigned long ts = ACCESS_ONCE(win_ts);
+
+	if (!req_rate_max)
+		return false;
+
+	if (ts != now && cmpxchg(&win_ts, ts, now) == ts)
+		atomic_set(&req_cnt, 0);
+
+	return atomic_inc_return(&req_cnt) > req_rate_max;
+}
+
+static TfwStress th_stress_sys = {
+	.type		= TfwStress_Sys,
+	.account_sys	= th_stress_sys_account,
+	/* Shed load at the front door while the spike settles. */
+	.overload	= tfw_stress_deny_new_conns,
+};
 
 static int __init
 th_stress_sys_init(void)
 {
-	return 0;
+	return tfw_stress_register(&th_stress_sys);
 }
 
 static void __exit
 th_stress_sys_exit(void)
 {
+	tfw_stress_unregister(&th_stress_sys);
 }
 
 module_init(th_stress_sys_init);
@@ -103,6 +103,10 @@ void ss_proto_inherit(const SsProto *parent, SsProto *child, int child_type);
 void ss_set_callbacks(struct sock *sk);
 void ss_set_listen(struct sock *sk);
 int ss_send(struct sock *sk, SsSkbList *skb_list, int flags);
+int ss_connect_fastopen(struct sock *sk, struct sockaddr *uaddr,
+			int uaddr_len);
+void ss_sock_throttle(struct sock *sk);
+void ss_socks_unthrottle(void);
 int __ss_close(struct sock *sk, int flags);
 int ss_sock_create(int family, int type, int protocol, struct sock **res);
 void ss_release(struct sock *sk);
@@ -82,6 +82,7 @@ typedef struct {
 	SsProto			proto;
 	struct sock 		*sk;
 	struct tfw_bmb_task_t	*task;
+	unsigned long		last_send;
 } TfwBmbConn;
 
 /*
@@ -112,6 +113,30 @@ static atomic_t bmb_conn_compl		= ATOMIC_INIT(0);
 static atomic_t bmb_conn_error		= ATOMIC_INIT(0);
 static atomic_t bmb_conn_drop		= ATOMIC_INIT(0);
 static atomic_t bmb_request_send	= ATOMIC_INIT(0);
+static atomic_t bmb_resp_rcvd		= ATOMIC_INIT(0);
+
+/*
+ * Response latency histogram with power-of-two millisecond buckets:
+ * bucket i counts responses with latency in [2^(i-1), 2^i) ms, the
+ * last bucket is a catch-all.
+ */
+#define BMB_LAT_BUCKETS		16
+static atomic_t bmb_lat_hist[BMB_LAT_BUCKETS];
+static atomic64_t bmb_lat_sum	= ATOMIC64_INIT(0);
+static atomic_t bmb_lat_max	= ATOMIC_INIT(0);
+
+static void
+tfw_bmb_lat_account(unsigned long jlat)
+{
+	int b, ms = jiffies_to_msecs(jlat), old;
+
+	b = ms ? min(fls(ms), BMB_LAT_BUCKETS - 1) : 0;
+	atomic_inc(&bmb_lat_hist[b]);
+	atomic64_add(ms, &bmb_lat_sum);
+	while ((old = atomic_read(&bmb_lat_max)) < ms)
+		if (atomic_cmpxchg(&bmb_lat_max, old, ms) == old)
+			break;
+}
 
 static TfwAddr bmb_server_address;
 static SsHooks bmb_hooks;
@@ -168,6 +193,15 @@ tfw_bmb_print_msg(void *msg_data, unsigned char *data, size_t len)
 static int
 tfw_bmb_conn_recv(void *cdata, struct sk_buff *skb, unsigned int off)
 {
+	TfwBmbConn *conn = container_of((SsProto *)cdata, TfwBmbConn, proto);
+
+	/*
+	 * With pipelining the latency of the batch is attributed to the
+	 * last request on the connection, the same trade-off wrk makes.
+	 */
+	atomic_inc(&bmb_resp_rcvd);
+	tfw_bmb_lat_account(jiffies - conn->last_send);
+
 	if (verbose) {
 		unsigned int data_off = 0;
 
@@ -278,6 +312,7 @@ tfw_bmb_msg_send(TfwBmbTask *task, int cn)
 			task->buf);
 
 	tfw_http_msg_write(&it, &hmreq, &msg);
+	task->conn[cn].last_send = jiffies;
 	ss_send(task->conn[cn].sk, &hmreq.msg.skb_list, true);
 
 	atomic_inc(&bmb_request_send);
@@ -413,7 +448,28 @@ tfw_bmb_report(unsigned long ts_start)
 	R("  error connections: %d\n", atomic_read(&bmb_conn_error));
 	R("  dropped connections: %d\n", atomic_read(&bmb_conn_drop));
 	R("  total requests: %d\n", atomic_read(&bmb_request_send));
+	R("  total responses: %d\n", atomic_read(&bmb_resp_rcvd));
 	R("  total time: %ldms\n", jiffies - ts_start);
+	{
+		int i, resp = atomic_read(&bmb_resp_rcvd);
+		unsigned long ms = jiffies_to_msecs(jiffies - ts_start) ? : 1;
+
+		R("  requests/sec: %lu\n",
+		  atomic_read(&bmb_request_send) * 1000UL / ms);
+		if (resp) {
+			R("  latency avg: %lums max: %dms\n",
+			  (unsigned long)atomic64_read(&bmb_lat_sum) / resp,
+			  atomic_read(&bmb_lat_max));
+			R("  latency distribution:\n");
+			for (i = 0; i < BMB_LAT_BUCKETS; ++i) {
+				int n = atomic_read(&bmb_lat_hist[i]);
+				if (!n)
+					continue;
+				R("    <%4dms: %d (%d%%)\n",
+				  1 << i, n, n * 100 / resp);
+			}
+		}
+	}
 #undef R
 }
 
@@ -1,7 +1,14 @@
 /**
  * Multithreaded client for performance testing of Synchronous Socket API.
  *
+ * Streams messages over many connections and, in RTT mode against an
+ * echoing server, reports per-message latency histograms, so socket
+ * layer regressions show up as shifted percentiles and not just as a
+ * lower aggregate rate. Message size, connection and thread counts are
+ * runtime arguments to allow sweeps from one binary.
+ *
  * Copyright (C) 2014 NatSys Lab. (info@natsys-lab.com).
+ * Copyright (C) 2015-2017 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by
@@ -20,28 +27,80 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <thread>
+#include <vector>
+
+#ifndef MSG_SZ
+#define MSG_SZ		64
+#endif
+
+// Log2 latency buckets: bucket i covers [2^i us, 2^(i+1) us).
+static const size_t LAT_BUCKETS = 20;
 
-static const size_t THR_N = 16;
-static const size_t CONNECTIONS = 64; // connections per thread
-static const size_t MESSAGES = 4096;
-static int msg[MSG_SZ];
+static size_t thr_n = 16;
+static size_t connections = 64; // connections per thread
+static size_t messages = 4096;
+static size_t msg_sz = MSG_SZ * sizeof(int);
+static bool rtt_mode = false;
 static unsigned short PORT = 5000;
 static struct sockaddr_in saddr = {};
 
+static std::atomic<unsigned long> total_msgs(0);
+static std::atomic<unsigned long> lat_hist[LAT_BUCKETS];
+
+static inline unsigned long
+now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static void
+lat_account(unsigned long us)
+{
+	size_t b = 0;
+
+	while (us > 1 && b < LAT_BUCKETS - 1)
+		us >>= 1, ++b;
+	lat_hist[b].fetch_add(1, std::memory_order_relaxed);
+}
+
+static int
+recv_full(int sd, char *buf, size_t len)
+{
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t r = recv(sd, buf + got, len - got, 0);
+		if (r <= 0)
+			return -1;
+		got += r;
+	}
+	return 0;
+}
+
 void
 run_tcp_load()
 {
-	int sd[CONNECTIONS] = { 0 };
+	std::vector<int> sd(connections, 0);
+	std::vector<char> msg(msg_sz), rbuf(msg_sz);
+
+	for (size_t i = 0; i < msg_sz; ++i)
+		msg[i] = i;
 
-	for (size_t i = 0; i < CONNECTIONS; ++i) {
+	for (size_t i = 0; i < connections; ++i) {
 		sd[i] = socket(PF_INET, SOCK_STREAM, 0);
 		if (sd[i] < 0) {
 			sd[i] = 0;
@@ -62,40 +121,119 @@ run_tcp_load()
 		}
 	}
 
-	for (size_t i = 0; i < CONNECTIONS; ++i) {
+	for (size_t i = 0; i < connections; ++i) {
 		if (!sd[i])
 			continue;
-		for (size_t m = 0; m < MESSAGES; ++m)
-			if (send(sd[i], msg, sizeof(msg), 0) != sizeof(msg)) {
+		for (size_t m = 0; m < messages; ++m) {
+			unsigned long t0 = rtt_mode ? now_us() : 0;
+
+			if (send(sd[i], msg.data(), msg_sz, 0)
+			    != (ssize_t)msg_sz)
+			{
 				std::cerr << "can't send on socket #"
 					<< i << std::endl;
 				close(sd[i]);
 				sd[i] = 0;
+				break;
+			}
+			if (rtt_mode) {
+				if (recv_full(sd[i], rbuf.data(), msg_sz)) {
+					std::cerr << "can't recv on socket #"
+						<< i << std::endl;
+					close(sd[i]);
+					sd[i] = 0;
+					break;
+				}
+				lat_account(now_us() - t0);
 			}
+			total_msgs.fetch_add(1, std::memory_order_relaxed);
+		}
 	}
 
-	for (size_t i = 0; i < CONNECTIONS; ++i)
+	for (size_t i = 0; i < connections; ++i)
 		if (sd[i])
 			close(sd[i]);
 }
 
+static unsigned long
+hist_percentile(const std::vector<unsigned long> &hist, unsigned long total,
+		double p)
+{
+	unsigned long acc = 0;
+
+	for (size_t b = 0; b < hist.size(); ++b) {
+		acc += hist[b];
+		if (acc >= total * p)
+			return 1UL << b;
+	}
+	return 1UL << (LAT_BUCKETS - 1);
+}
+
+static void
+report(unsigned long us)
+{
+	unsigned long msgs = total_msgs.load();
+
+	std::cout << "threads=" << thr_n << " conns/thread=" << connections
+		<< " msg_sz=" << msg_sz << ": "
+		<< msgs << " msgs in " << us / 1000 << "ms, "
+		<< (us ? msgs * 1000000UL / us : 0) << " msg/s, "
+		<< (us ? msgs * msg_sz / us : 0) << " MB/s" << std::endl;
+
+	if (!rtt_mode)
+		return;
+
+	std::vector<unsigned long> hist(LAT_BUCKETS);
+	unsigned long total = 0;
+	for (size_t b = 0; b < LAT_BUCKETS; ++b)
+		total += hist[b] = lat_hist[b].load();
+	if (!total)
+		return;
+
+	std::cout << "rtt p50<=" << hist_percentile(hist, total, 0.5)
+		<< "us p99<=" << hist_percentile(hist, total, 0.99)
+		<< "us p999<=" << hist_percentile(hist, total, 0.999)
+		<< "us, histogram (us:count):";
+	for (size_t b = 0; b < LAT_BUCKETS; ++b)
+		if (hist[b])
+			std::cout << " " << (1UL << b) << ":" << hist[b];
+	std::cout << std::endl;
+}
+
 int
 main(int argc, char *argv[])
 {
 	if (argc < 2) {
-		std::cerr << "Please specify server address" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <server_addr>"
+			<< " [threads] [conns_per_thread] [messages]"
+			<< " [msg_sz] [--rtt]" << std::endl
+			<< "  --rtt expects an echoing server (see the"
+			<< " ss_kserver echo_mode parameter) and reports"
+			<< " per-message latency histograms" << std::endl;
 		return 1;
 	}
+	for (int i = 2; i < argc; ++i) {
+		if (!strcmp(argv[i], "--rtt"))
+			rtt_mode = true;
+		else if (i == 2)
+			thr_n = atol(argv[i]);
+		else if (i == 3)
+			connections = atol(argv[i]);
+		else if (i == 4)
+			messages = atol(argv[i]);
+		else if (i == 5)
+			msg_sz = atol(argv[i]);
+	}
 
 	struct rlimit rlim;
 	if (getrlimit(RLIMIT_NOFILE, &rlim)) {
 		std::cerr << "getrlimit() failed" << std::endl;
 	} else {
-		if (rlim.rlim_cur < THR_N * CONNECTIONS
-		    || rlim.rlim_max < THR_N * CONNECTIONS)
+		if (rlim.rlim_cur < thr_n * connections
+		    || rlim.rlim_max < thr_n * connections)
 		{
 			std::cerr << "please adjust limit of open files to "
-				<< THR_N * CONNECTIONS << std::endl;
+				<< thr_n * connections << std::endl;
 			return 2;
 		}
 	}
@@ -107,15 +245,15 @@ main(int argc, char *argv[])
 		return 3;
 	}
 
-	// Initialize message - the same for all transmission.
-	for (size_t i = 0; i < MSG_SZ; ++i)
-		msg[i] = i;
+	unsigned long t0 = now_us();
 
-	std::thread thr[THR_N];
-	for (size_t i = 0; i < THR_N; ++i)
+	std::vector<std::thread> thr(thr_n);
+	for (size_t i = 0; i < thr_n; ++i)
 		thr[i] = std::thread{ run_tcp_load };
-	for (size_t i = 0; i < THR_N; ++i)
+	for (size_t i = 0; i < thr_n; ++i)
 		thr[i].join();
 
+	report(now_us() - t0);
+
 	return 0;
 }
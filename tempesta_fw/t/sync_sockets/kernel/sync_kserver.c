@@ -29,6 +29,7 @@
 #include <net/inet_sock.h>
 
 #include "sync_socket.h"
+#include "ss_skb.h"
 
 #define MAX_CONN	(1000 * 1000)
 #define PORT		5000
@@ -39,8 +40,22 @@ typedef struct {
 	SsProto		proto;
 } MyProto;
 
+/*
+ * Per-connection descriptor so the recv hook can reach the socket:
+ * echo mode sends the received bytes back, which is what the RTT mode
+ * of the user-space client measures against.
+ */
+typedef struct {
+	SsProto		proto;
+	struct sock	*sk;
+} MyConn;
+
 static MyProto my_proto;
 
+static int echo_mode = 0;
+module_param(echo_mode, int, 0);
+MODULE_PARM_DESC(echo_mode, "Echo received data back for RTT measurement");
+
 /* Statistics */
 static long last_ts = 0;
 static unsigned int pps_curr = 0, pps_max = 0;
@@ -75,16 +90,34 @@ stat_print(void)
 }
 
 /*
- * Just do some useless work.
+ * Just do some useless work over the linear part and, in echo mode,
+ * send the data back. The callee owns the skb.
  */
 static int
-kserver_read(struct sock *sk, unsigned char *data, size_t len)
+kserver_read(void *conn, struct sk_buff *skb, unsigned int off)
 {
 	int i;
-	for (i = 0; i < len / 4; ++i)
+	unsigned char *data = skb->data + off;
+	unsigned int len = skb_headlen(skb) - off;
+
+	for (i = 0; i < len; ++i)
 		g_counter += data[i];
 
-	stat_update(len);
+	stat_update(skb->len - off);
+
+	if (echo_mode) {
+		struct sk_buff *nskb = skb_copy(skb, GFP_ATOMIC);
+
+		if (nskb) {
+			SsSkbList list;
+
+			ss_skb_queue_head_init(&list);
+			ss_skb_queue_tail(&list, nskb);
+			if (ss_send(((MyConn *)conn)->sk, &list, 0))
+				__kfree_skb(nskb);
+		}
+	}
+	__kfree_skb(skb);
 
 	return 0;
 }
@@ -93,10 +126,16 @@ static int
 kserver_connection_new(struct sock *sk)
 {
 	int ci;
+	MyConn *mc;
 
 	BUG_ON(!sk->sk_user_data);
 
-	/* TODO Typically we should allocate a new connection here. */
+	/* The recv hook needs the socket, see kserver_read(). */
+	if (!(mc = kzalloc(sizeof(*mc), GFP_ATOMIC)))
+		return -ENOMEM;
+	mc->proto = *(SsProto *)sk->sk_user_data;
+	mc->sk = sk;
+	sk->sk_user_data = mc;
 
 	/* Write the socket to free it as module exit. */
 	ci = atomic_inc_return(&conn_i);
@@ -111,12 +150,13 @@ kserver_connection_new(struct sock *sk)
 	return 0;
 }
 
-static int
+static void
 kserver_connection_drop(struct sock *sk)
 {
-	stat_update(READ_SZ);
+	kfree(sk->sk_user_data);
+	sk->sk_user_data = NULL;
 
-	return 0;
+	stat_update(READ_SZ);
 }
 
 static SsHooks ssocket_hooks = {
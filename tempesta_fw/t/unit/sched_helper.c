@@ -64,6 +64,7 @@ test_create_sg(const char *name, const char *sched_name)
 	}
 
 	sg->max_qsize = 100;
+	sg->max_inflight = UINT_MAX;
 
 	kernel_fpu_begin();
 
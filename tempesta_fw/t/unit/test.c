@@ -19,7 +19,11 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <asm/fpu/api.h>
+#include <linux/fs.h>
 #include <linux/module.h>
+#include <linux/sort.h>
+#include <linux/timex.h>
+#include <linux/uaccess.h>
 #include "test.h"
 
 #include "apm.c"
@@ -51,6 +55,176 @@ test_fixture_fn_t test_teardown_fn;
  * It doesn't prevent flooding, but at least it makes interesting
  * messages appear at the end of the log where they can be found easily.
  */
+/*
+ * Benchmark layer, see the BENCH() description in test.h.
+ */
+static int bench_thr = 10;
+module_param(bench_thr, int, 0);
+MODULE_PARM_DESC(bench_thr,
+		 "Regression threshold, percent over baseline; 0 - report only");
+
+static bool bench_update = false;
+module_param(bench_update, bool, 0);
+MODULE_PARM_DESC(bench_update, "Rewrite the baseline file with this run");
+
+static char *bench_baseline = "/var/tmp/tempesta_test.baseline";
+module_param(bench_baseline, charp, 0);
+MODULE_PARM_DESC(bench_baseline, "Path to the benchmark baseline file");
+
+#define BENCH_RES_MAX	64
+#define BENCH_NAME_LEN	47
+
+typedef struct {
+	char	name[BENCH_NAME_LEN + 1];
+	u64	cycles;
+} TestBenchRes;
+
+static TestBenchRes bench_res[BENCH_RES_MAX];
+static TestBenchRes bench_base[BENCH_RES_MAX];
+static int bench_res_n, bench_base_n;
+
+static int
+__bench_cmp_u64(const void *a, const void *b)
+{
+	return *(const u64 *)a < *(const u64 *)b
+	       ? -1 : *(const u64 *)a > *(const u64 *)b;
+}
+
+static u64
+__bench_baseline(const char *name)
+{
+	int i;
+
+	for (i = 0; i < bench_base_n; ++i)
+		if (!strcmp(bench_base[i].name, name))
+			return bench_base[i].cycles;
+	return 0;
+}
+
+static void
+__test_bench_finish(TestBench *b)
+{
+	int i, trim = b->n / 10;
+	u64 sum = 0, mean, base;
+
+	sort(b->samples, b->n, sizeof(u64), __bench_cmp_u64, NULL);
+	for (i = trim; i < b->n - trim; ++i)
+		sum += b->samples[i];
+	mean = sum / (b->n - 2 * trim);
+
+	base = __bench_baseline(b->name);
+	TEST_LOG_LF("BENCH(%s): %llu cycles/iter (baseline %llu)",
+		    b->name, mean, base);
+	if (base && bench_thr && !bench_update
+	    && mean > base + base * bench_thr / 100)
+	{
+		TEST_ERR_LF("FAIL: BENCH(%s) regressed %llu%% over baseline"
+			    " (threshold %d%%)",
+			    b->name, (mean - base) * 100 / base, bench_thr);
+		test_register_failure();
+	}
+
+	if (bench_res_n < BENCH_RES_MAX) {
+		strlcpy(bench_res[bench_res_n].name, b->name,
+			sizeof(bench_res[0].name));
+		bench_res[bench_res_n++].cycles = mean;
+	}
+}
+
+int
+__test_bench_iter(TestBench *b)
+{
+	u64 now = get_cycles();
+
+	if (!b->samples) {
+		/* Preemption may be off (FPU section): atomic alloc. */
+		b->samples = kmalloc(b->n * sizeof(u64), GFP_ATOMIC);
+		if (!b->samples)
+			return 0;
+		b->i = -TEST_BENCH_WARMUP;
+	} else if (b->i > 0) {
+		b->samples[b->i - 1] = now - b->t0;
+	}
+	if (b->i == b->n) {
+		__test_bench_finish(b);
+		kfree(b->samples);
+		return 0;
+	}
+	++b->i;
+	b->t0 = get_cycles();
+	return 1;
+}
+
+/*
+ * The baseline lives in a plain "name cycles" text file. File IO can
+ * sleep, so the load and save run before and after the suites, outside
+ * the FPU sections.
+ */
+void
+test_bench_baseline_load(void)
+{
+	struct file *f;
+	char *buf, *p, *nl;
+	int n;
+
+	bench_base_n = bench_res_n = 0;
+
+	f = filp_open(bench_baseline, O_RDONLY, 0);
+	if (IS_ERR(f))
+		return; /* First run - every bench just records. */
+	if (!(buf = kzalloc(PAGE_SIZE, GFP_KERNEL)))
+		goto close;
+	n = kernel_read(f, 0, buf, PAGE_SIZE - 1);
+	if (n <= 0)
+		goto free;
+
+	for (p = buf; (nl = strchr(p, '\n')) && bench_base_n < BENCH_RES_MAX;
+	     p = nl + 1)
+	{
+		TestBenchRes *r = &bench_base[bench_base_n];
+
+		*nl = '\0';
+		if (sscanf(p, "%47s %llu", r->name, &r->cycles) == 2)
+			++bench_base_n;
+	}
+free:
+	kfree(buf);
+close:
+	filp_close(f, NULL);
+}
+
+void
+test_bench_baseline_save(void)
+{
+	struct file *f;
+	char line[BENCH_NAME_LEN + 32];
+	mm_segment_t old_fs;
+	loff_t off = 0;
+	int i;
+
+	/* Keep an existing baseline unless an update is requested. */
+	if (!bench_res_n || (bench_base_n && !bench_update))
+		return;
+
+	f = filp_open(bench_baseline, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (IS_ERR(f)) {
+		TEST_ERR_LF("can't write benchmark baseline to %s",
+			    bench_baseline);
+		return;
+	}
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (i = 0; i < bench_res_n; ++i) {
+		int n = snprintf(line, sizeof(line), "%s %llu\n",
+				 bench_res[i].name, bench_res[i].cycles);
+		vfs_write(f, line, n, &off);
+	}
+	set_fs(old_fs);
+	filp_close(f, NULL);
+	TEST_LOG_LF("benchmark baseline %s to %s",
+		    bench_base_n ? "updated" : "recorded", bench_baseline);
+}
+
 void
 test_register_failure(void)
 {
@@ -88,10 +262,20 @@ test_call_teardown_fn(void)
 TEST_SUITE(cfg);
 TEST_SUITE(tfw_str);
 TEST_SUITE(http_parser);
+TEST_SUITE(parser_bench);
 TEST_SUITE(http_sticky);
 TEST_SUITE(http_match);
+TEST_SUITE(http_norm);
+TEST_SUITE(http2);
+TEST_SUITE(rex);
+TEST_SUITE(gzip);
 TEST_SUITE(hash);
+TEST_SUITE(hpack);
 TEST_SUITE(addr);
+TEST_SUITE(sched_bench);
+TEST_SUITE(sched_ewma);
+TEST_SUITE(sched_ketama);
+TEST_SUITE(sched_lc);
 TEST_SUITE(sched_rr);
 TEST_SUITE(sched_hash);
 TEST_SUITE(sched_http);
@@ -101,8 +285,12 @@ test_run_all(void)
 {
 	test_fail_counter = 0;
 
+	test_bench_baseline_load();
+
 	/* Run sleeping tests first. */
 	TEST_SUITE_RUN(cfg);
+	/* The regex compiler allocates with GFP_KERNEL/vmalloc. */
+	TEST_SUITE_RUN(rex);
 
 	kernel_fpu_begin();
 	tfw_str_init_const();
@@ -113,15 +301,26 @@ test_run_all(void)
 	 */
 	TEST_SUITE_RUN(tfw_str);
 	TEST_SUITE_RUN(http_parser);
+	TEST_SUITE_RUN(parser_bench);
 	TEST_SUITE_RUN(http_match);
+	TEST_SUITE_RUN(http_norm);
+	TEST_SUITE_RUN(http2);
 	TEST_SUITE_RUN(http_sticky);
+	TEST_SUITE_RUN(gzip);
 	TEST_SUITE_RUN(hash);
+	TEST_SUITE_RUN(hpack);
 	TEST_SUITE_RUN(addr);
+	TEST_SUITE_RUN(sched_ewma);
+	TEST_SUITE_RUN(sched_bench);
+	TEST_SUITE_RUN(sched_ketama);
+	TEST_SUITE_RUN(sched_lc);
 	TEST_SUITE_RUN(sched_rr);
 	TEST_SUITE_RUN(sched_hash);
 	TEST_SUITE_RUN(sched_http);
 
 	kernel_fpu_end();
 
+	test_bench_baseline_save();
+
 	return test_fail_counter;
 }
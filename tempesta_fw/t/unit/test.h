@@ -111,6 +111,50 @@ do {							\
 	test_register_failure();			\
 } while (0)
 
+/*
+ * ------------------------------------------------------------------------
+ *	Cycle-accurate benchmarks
+ *
+ * BENCH() runs @block @iters times after a fixed warmup, timing each
+ * pass with the cycle counter; the top and bottom tenth of the samples
+ * are trimmed before averaging so scheduler and SMI noise doesn't move
+ * the number. Results are compared against a baseline file (loaded and
+ * saved around test_run_all(), since most suites run with preemption
+ * disabled) and a regression past the configured threshold counts as a
+ * test failure - performance regressions are caught with the same
+ * granularity as correctness ones. See the bench_* module parameters
+ * in test.c.
+ *
+ * @block is a statement list; wrap top-level commas in parentheses as
+ * with any macro argument.
+ * ------------------------------------------------------------------------
+ */
+#define TEST_BENCH_WARMUP	8
+#define TEST_BENCH_MAX_ITER	4096
+
+typedef struct {
+	const char	*name;
+	int		n;
+	int		i;
+	u64		t0;
+	u64		*samples;
+} TestBench;
+
+int __test_bench_iter(TestBench *b);
+void test_bench_baseline_load(void);
+void test_bench_baseline_save(void);
+
+#define BENCH(bname, iters, block)			\
+do {							\
+	TestBench __b = {				\
+		.name = bname,				\
+		.n = min((int)(iters), TEST_BENCH_MAX_ITER), \
+	};						\
+	while (__test_bench_iter(&__b)) {		\
+		block;					\
+	}						\
+} while (0)
+
 #define __EXPECT_COND(name, expr, cond_expr)	\
 do {						\
 	typeof(expr) _val = (expr);		\
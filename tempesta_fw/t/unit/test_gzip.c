@@ -0,0 +1,121 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "gzip.c"
+
+#include "test.h"
+#include "tfw_str_helper.h"
+
+static const char body[] =
+	"<html><body>Hello, world! Hello, world! Hello, world!"
+	" Hello, world! Hello, world! Hello, world!</body></html>";
+
+/**
+ * Inflate @src of @src_len raw deflate bytes into @dst and return the
+ * produced length, or -1 on error.
+ */
+static int
+test_inflate(const unsigned char *src, size_t src_len, char *dst,
+	     size_t dst_len)
+{
+	int r;
+	struct z_stream_s zs = {};
+
+	zs.workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!zs.workspace)
+		return -1;
+	if (zlib_inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+		vfree(zs.workspace);
+		return -1;
+	}
+	zs.next_in = (unsigned char *)src;
+	zs.avail_in = src_len;
+	zs.next_out = (unsigned char *)dst;
+	zs.avail_out = dst_len;
+
+	r = zlib_inflate(&zs, Z_FINISH);
+	zlib_inflateEnd(&zs);
+	vfree(zs.workspace);
+
+	return r == Z_STREAM_END ? dst_len - zs.avail_out : -1;
+}
+
+TEST(gzip, roundtrip_plain)
+{
+	TfwStr src = { .ptr = (void *)body, .len = sizeof(body) - 1 };
+	char gz[256], plain[256];
+	size_t gz_len = sizeof(gz);
+	int n;
+
+	EXPECT_ZERO(tfw_gzip_compress(&src, gz, &gz_len));
+	/* RFC 1952 magic and deflate method. */
+	EXPECT_EQ((unsigned char)gz[0], 0x1f);
+	EXPECT_EQ((unsigned char)gz[1], 0x8b);
+	EXPECT_EQ(gz[2], Z_DEFLATED);
+	EXPECT_TRUE(gz_len > TFW_GZIP_OVERHEAD);
+	EXPECT_TRUE(gz_len < sizeof(body) - 1);
+
+	n = test_inflate((unsigned char *)gz + 10,
+			 gz_len - TFW_GZIP_OVERHEAD, plain, sizeof(plain));
+	EXPECT_EQ(n, (int)(sizeof(body) - 1));
+	EXPECT_ZERO(memcmp(plain, body, sizeof(body) - 1));
+}
+
+TEST(gzip, roundtrip_compound)
+{
+	TfwStr *src;
+	char gz[256], plain[256];
+	size_t gz_len = sizeof(gz);
+	int n;
+
+	create_str_pool();
+
+	src = make_compound_str(body);
+	EXPECT_NOT_NULL(src);
+	if (!src)
+		goto out;
+
+	EXPECT_ZERO(tfw_gzip_compress(src, gz, &gz_len));
+	n = test_inflate((unsigned char *)gz + 10,
+			 gz_len - TFW_GZIP_OVERHEAD, plain, sizeof(plain));
+	EXPECT_EQ(n, (int)(sizeof(body) - 1));
+	EXPECT_ZERO(memcmp(plain, body, sizeof(body) - 1));
+out:
+	free_all_str();
+}
+
+TEST(gzip, small_buffer)
+{
+	TfwStr src = { .ptr = (void *)body, .len = sizeof(body) - 1 };
+	char gz[TFW_GZIP_OVERHEAD + 2];
+	size_t gz_len = sizeof(gz);
+
+	EXPECT_EQ(tfw_gzip_compress(&src, gz, &gz_len), -E2BIG);
+}
+
+TEST_SUITE(gzip)
+{
+	tfw_gzip_init();
+
+	TEST_RUN(gzip, roundtrip_plain);
+	TEST_RUN(gzip, roundtrip_compound);
+	TEST_RUN(gzip, small_buffer);
+
+	tfw_gzip_exit();
+}
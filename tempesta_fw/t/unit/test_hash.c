@@ -101,6 +101,27 @@ TEST(tfw_hash_str, calcs_same_hash_for_diff_chunks_n)
 	EXPECT_EQ(h3, h2);
 }
 
+TEST(tfw_hash_str, calcs_same_hash_for_lane_crossing_chunks)
+{
+	unsigned long h1;
+	const char *data = "abcdefgh01234567ABCDEFGH";
+
+	TfwStr s1 = { .len = 24, .ptr = (void *)data };
+
+	/* Splits crossing the 8- and 16-byte CRC lane boundaries. */
+	TfwStr s2chunks[] = {
+		{ .len = 9, .ptr = (void *)data },
+		{ .len = 6, .ptr = (void *)(data + 9) },
+		{ .len = 9, .ptr = (void *)(data + 15) },
+	};
+	TfwStr s2 = { .len = 24, .ptr = s2chunks };
+
+	__TFW_STR_CHUNKN_SET(&s2, 3);
+
+	h1 = tfw_hash_str(&s1);
+	EXPECT_EQ(h1, tfw_hash_str(&s2));
+}
+
 TEST(tfw_hash_str, hashes_all_chars)
 {
 	int i;
@@ -199,11 +220,29 @@ TEST(tfw_hash_str, distributes_all_input_across_hash_bits)
 	}
 }
 
+TEST(tfw_hash_str, bench)
+{
+	static char buf[1024];
+	int i;
+	TfwStr s = { .ptr = buf, .len = sizeof(buf) };
+	unsigned long acc = 0;
+
+	for (i = 0; i < sizeof(buf); ++i)
+		buf[i] = i;
+
+	BENCH("hash_str_1k", 2048, {
+		acc += tfw_hash_str(&s);
+	});
+	EXPECT_NE(acc, 0);
+}
+
 TEST_SUITE(hash)
 {
 	TEST_RUN(tfw_hash_str, calcs_diff_hash_for_diff_str);
 	TEST_RUN(tfw_hash_str, calcs_same_hash_for_diff_chunks_n);
+	TEST_RUN(tfw_hash_str, calcs_same_hash_for_lane_crossing_chunks);
 	TEST_RUN(tfw_hash_str, hashes_all_chars);
 	TEST_RUN(tfw_hash_str, doesnt_read_behind_end_of_buf);
 	TEST_RUN(tfw_hash_str, distributes_all_input_across_hash_bits);
+	TEST_RUN(tfw_hash_str, bench);
 }
@@ -0,0 +1,248 @@
+/**
+ *		Tempesta FW
+ *
+ * Tests for the HPACK decoder, the vectors are taken from RFC 7541
+ * Appendix C (the representations without Huffman coding).
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "http_hpack.c"
+
+#include "test.h"
+
+#define HDRS_MAX	16
+
+static struct {
+	char		name[64];
+	char		val[64];
+	unsigned int	n_len;
+	unsigned int	v_len;
+} hdrs[HDRS_MAX];
+static int hdrs_n;
+
+static int
+hdr_cb(const char *name, unsigned int n_len, const char *val,
+       unsigned int v_len, void *data)
+{
+	BUG_ON(hdrs_n >= HDRS_MAX);
+	BUG_ON(n_len >= sizeof(hdrs[0].name) || v_len >= sizeof(hdrs[0].val));
+
+	memcpy(hdrs[hdrs_n].name, name, n_len);
+	memcpy(hdrs[hdrs_n].val, val, v_len);
+	hdrs[hdrs_n].n_len = n_len;
+	hdrs[hdrs_n].v_len = v_len;
+	++hdrs_n;
+
+	return 0;
+}
+
+#define EXPECT_HDR(i, n, v)						\
+do {									\
+	EXPECT_EQ(hdrs[i].n_len, (unsigned int)SLEN(n));		\
+	EXPECT_EQ(hdrs[i].v_len, (unsigned int)SLEN(v));		\
+	EXPECT_ZERO(memcmp(hdrs[i].name, n, SLEN(n)));			\
+	EXPECT_ZERO(memcmp(hdrs[i].val, v, SLEN(v)));			\
+} while (0)
+
+static int
+decode(TfwHPack *hp, const unsigned char *buf, unsigned long len)
+{
+	hdrs_n = 0;
+	return tfw_hpack_decode(hp, buf, len, hdr_cb, NULL);
+}
+
+/* RFC 7541 C.2.1: literal header field with incremental indexing. */
+TEST(hpack, literal_with_indexing)
+{
+	TfwHPack hp;
+	static const unsigned char buf[] = {
+		0x40, 0x0a, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d,
+		0x2d, 0x6b, 0x65, 0x79, 0x0d, 0x63, 0x75, 0x73,
+		0x74, 0x6f, 0x6d, 0x2d, 0x68, 0x65, 0x61, 0x64,
+		0x65, 0x72
+	};
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+	EXPECT_ZERO(decode(&hp, buf, sizeof(buf)));
+	EXPECT_EQ(hdrs_n, 1);
+	EXPECT_HDR(0, "custom-key", "custom-header");
+	EXPECT_EQ(hp.n, 1U);
+	EXPECT_EQ(hp.size, 55U);
+
+	tfw_hpack_free(&hp);
+}
+
+/* RFC 7541 C.2.4: indexed header field. */
+TEST(hpack, indexed_field)
+{
+	TfwHPack hp;
+	static const unsigned char buf[] = { 0x82 };
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+	EXPECT_ZERO(decode(&hp, buf, sizeof(buf)));
+	EXPECT_EQ(hdrs_n, 1);
+	EXPECT_HDR(0, ":method", "GET");
+	EXPECT_EQ(hp.n, 0U);
+
+	tfw_hpack_free(&hp);
+}
+
+/* RFC 7541 C.3: three requests on one connection, no Huffman coding. */
+TEST(hpack, request_sequence)
+{
+	TfwHPack hp;
+	static const unsigned char req1[] = {
+		0x82, 0x86, 0x84, 0x41, 0x0f, 0x77, 0x77, 0x77,
+		0x2e, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65,
+		0x2e, 0x63, 0x6f, 0x6d
+	};
+	static const unsigned char req2[] = {
+		0x82, 0x86, 0x84, 0xbe, 0x58, 0x08, 0x6e, 0x6f,
+		0x2d, 0x63, 0x61, 0x63, 0x68, 0x65
+	};
+	static const unsigned char req3[] = {
+		0x82, 0x87, 0x85, 0xbf, 0x40, 0x0a, 0x63, 0x75,
+		0x73, 0x74, 0x6f, 0x6d, 0x2d, 0x6b, 0x65, 0x79,
+		0x0c, 0x63, 0x75, 0x73, 0x74, 0x6f, 0x6d, 0x2d,
+		0x76, 0x61, 0x6c, 0x75, 0x65
+	};
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+
+	EXPECT_ZERO(decode(&hp, req1, sizeof(req1)));
+	EXPECT_EQ(hdrs_n, 4);
+	EXPECT_HDR(0, ":method", "GET");
+	EXPECT_HDR(1, ":scheme", "http");
+	EXPECT_HDR(2, ":path", "/");
+	EXPECT_HDR(3, ":authority", "www.example.com");
+	EXPECT_EQ(hp.n, 1U);
+	EXPECT_EQ(hp.size, 57U);
+
+	EXPECT_ZERO(decode(&hp, req2, sizeof(req2)));
+	EXPECT_EQ(hdrs_n, 5);
+	EXPECT_HDR(3, ":authority", "www.example.com");
+	EXPECT_HDR(4, "cache-control", "no-cache");
+	EXPECT_EQ(hp.n, 2U);
+	EXPECT_EQ(hp.size, 110U);
+
+	EXPECT_ZERO(decode(&hp, req3, sizeof(req3)));
+	EXPECT_EQ(hdrs_n, 5);
+	EXPECT_HDR(0, ":method", "GET");
+	EXPECT_HDR(1, ":scheme", "https");
+	EXPECT_HDR(2, ":path", "/index.html");
+	EXPECT_HDR(3, ":authority", "www.example.com");
+	EXPECT_HDR(4, "custom-key", "custom-value");
+	EXPECT_EQ(hp.n, 3U);
+	EXPECT_EQ(hp.size, 164U);
+
+	tfw_hpack_free(&hp);
+}
+
+/* RFC 7541 C.4.1: Huffman-coded request. */
+TEST(hpack, huffman_request)
+{
+	TfwHPack hp;
+	static const unsigned char buf[] = {
+		0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2,
+		0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4,
+		0xff
+	};
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+	EXPECT_ZERO(decode(&hp, buf, sizeof(buf)));
+	EXPECT_EQ(hdrs_n, 4);
+	EXPECT_HDR(3, ":authority", "www.example.com");
+	/* The inflated string is copied into the dynamic table. */
+	EXPECT_EQ(hp.n, 1U);
+	tfw_hpack_free(&hp);
+}
+
+/* RFC 7541 C.6.1: Huffman-coded literals with mixed symbol lengths. */
+TEST(hpack, huffman_literals)
+{
+	TfwHPack hp;
+	/* cache-control: private, date: Mon, 21 Oct 2013 20:13:21 GMT. */
+	static const unsigned char buf[] = {
+		0x58, 0x85, 0xae, 0xc3, 0x77, 0x1a, 0x4b,
+		0x61, 0x96, 0xd0, 0x7a, 0xbe, 0x94, 0x10, 0x54,
+		0xd4, 0x44, 0xa8, 0x20, 0x05, 0x95, 0x04, 0x0b,
+		0x81, 0x66, 0xe0, 0x82, 0xa6, 0x2d, 0x1b, 0xff
+	};
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+	EXPECT_ZERO(decode(&hp, buf, sizeof(buf)));
+	EXPECT_EQ(hdrs_n, 2);
+	EXPECT_HDR(0, "cache-control", "private");
+	EXPECT_HDR(1, "date", "Mon, 21 Oct 2013 20:13:21 GMT");
+	tfw_hpack_free(&hp);
+}
+
+/* Padding must be a prefix of EOS: all ones and shorter than a byte. */
+TEST(hpack, huffman_bad_padding)
+{
+	TfwHPack hp;
+	/* '0' (00000) padded with 101 instead of 111. */
+	static const unsigned char buf[] = { 0x41, 0x81, 0x05 };
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+	EXPECT_EQ(decode(&hp, buf, sizeof(buf)), -EINVAL);
+	tfw_hpack_free(&hp);
+}
+
+/* A too large entry must just empty the dynamic table, RFC 7541 4.4. */
+TEST(hpack, tbl_size_update)
+{
+	TfwHPack hp;
+	/* Size update to 0 and then back to 4096. */
+	static const unsigned char upd0[] = { 0x20 };
+	static const unsigned char upd4k[] = { 0x3f, 0xe1, 0x1f };
+	static const unsigned char lit[] = {
+		0x40, 0x01, 0x61, 0x01, 0x62	/* a: b, indexed */
+	};
+
+	EXPECT_ZERO(tfw_hpack_init(&hp));
+
+	EXPECT_ZERO(decode(&hp, lit, sizeof(lit)));
+	EXPECT_EQ(hp.n, 1U);
+
+	EXPECT_ZERO(decode(&hp, upd0, sizeof(upd0)));
+	EXPECT_EQ(hp.n, 0U);
+	EXPECT_EQ(hp.size, 0U);
+
+	/* With a zero-sized table literals are emitted but not stored. */
+	EXPECT_ZERO(decode(&hp, lit, sizeof(lit)));
+	EXPECT_EQ(hdrs_n, 1);
+	EXPECT_HDR(0, "a", "b");
+	EXPECT_EQ(hp.n, 0U);
+
+	EXPECT_ZERO(decode(&hp, upd4k, sizeof(upd4k)));
+	EXPECT_ZERO(decode(&hp, lit, sizeof(lit)));
+	EXPECT_EQ(hp.n, 1U);
+
+	tfw_hpack_free(&hp);
+}
+
+TEST_SUITE(hpack)
+{
+	TEST_RUN(hpack, literal_with_indexing);
+	TEST_RUN(hpack, indexed_field);
+	TEST_RUN(hpack, request_sequence);
+	TEST_RUN(hpack, huffman_request);
+	TEST_RUN(hpack, huffman_literals);
+	TEST_RUN(hpack, huffman_bad_padding);
+	TEST_RUN(hpack, tbl_size_update);
+}
@@ -0,0 +1,83 @@
+/**
+ *		Tempesta FW
+ *
+ * Tests for the HTTP/2 framing primitives.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "http2.h"
+
+#include "test.h"
+
+TEST(http2, frame_hdr_roundtrip)
+{
+	unsigned char buf[TFW_H2_FRAME_HDR_SZ];
+	TfwH2FrameHdr in = {
+		.len = 0x4321,
+		.stream = 0x12345,
+		.type = TFW_H2_HEADERS,
+		.flags = TFW_H2_F_END_HEADERS | TFW_H2_F_END_STREAM,
+	}, out;
+
+	tfw_h2_frame_hdr_write(&in, buf);
+	EXPECT_ZERO(tfw_h2_frame_hdr_parse(buf, sizeof(buf), &out));
+	EXPECT_EQ(out.len, in.len);
+	EXPECT_EQ(out.stream, in.stream);
+	EXPECT_EQ(out.type, in.type);
+	EXPECT_EQ(out.flags, in.flags);
+
+	/* Short input and oversized payload length. */
+	EXPECT_EQ(tfw_h2_frame_hdr_parse(buf, 8, &out), -EAGAIN);
+	buf[0] = 0xff;
+	EXPECT_EQ(tfw_h2_frame_hdr_parse(buf, sizeof(buf), &out), -EINVAL);
+}
+
+static int
+settings_count_cb(unsigned short id, unsigned int val, void *data)
+{
+	int *seen = data;
+
+	if (id == TFW_H2_SET_INITIAL_WINDOW)
+		EXPECT_EQ(val, 1 << 20);
+	if (id == TFW_H2_SET_MAX_CONCURRENT)
+		EXPECT_EQ(val, 128);
+	++*seen;
+	return 0;
+}
+
+TEST(http2, settings_roundtrip)
+{
+	unsigned char buf[12], *p = buf;
+	int seen = 0;
+
+	p = tfw_h2_settings_put(p, TFW_H2_SET_INITIAL_WINDOW, 1 << 20);
+	p = tfw_h2_settings_put(p, TFW_H2_SET_MAX_CONCURRENT, 128);
+	EXPECT_EQ(p - buf, 12);
+
+	EXPECT_ZERO(tfw_h2_settings_parse(buf, 12, settings_count_cb, &seen));
+	EXPECT_EQ(seen, 2);
+
+	/* A partial setting is a frame size error. */
+	EXPECT_EQ(tfw_h2_settings_parse(buf, 11, settings_count_cb, &seen),
+		  -EINVAL);
+}
+
+TEST_SUITE(http2)
+{
+	TEST_RUN(http2, frame_hdr_roundtrip);
+	TEST_RUN(http2, settings_roundtrip);
+}
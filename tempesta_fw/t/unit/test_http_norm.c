@@ -0,0 +1,76 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "http_norm.c"
+
+#include "helpers.h"
+#include "test.h"
+
+static TfwHttpReq *req;
+
+static void
+norm_check(const char *in, const char *exp)
+{
+	char out[256];
+
+	req = test_req_alloc(1);
+	req->uri_path.ptr = (void *)in;
+	req->uri_path.len = strlen(in);
+
+	EXPECT_ZERO(tfw_http_uri_normalize(req));
+	EXPECT_EQ(req->uri_path.len, strlen(exp));
+	BUG_ON(req->uri_path.len >= sizeof(out));
+	memcpy(out, req->uri_path.ptr, req->uri_path.len);
+	out[req->uri_path.len] = 0;
+	EXPECT_ZERO(strcmp(out, exp));
+
+	test_req_free(req);
+}
+
+TEST(http_norm, unchanged)
+{
+	norm_check("/index.html", "/index.html");
+	norm_check("/a/b/c?x=%2F", "/a/b/c?x=%2F");
+}
+
+TEST(http_norm, unreserved_decoded)
+{
+	norm_check("/%7Euser/%61%2Fb", "/~user/a%2Fb");
+	norm_check("/a%2fb", "/a%2Fb");
+}
+
+TEST(http_norm, dot_segments)
+{
+	norm_check("/a/./b", "/a/b");
+	norm_check("/a/b/../c", "/a/c");
+	norm_check("/a//b", "/a/b");
+	norm_check("/a/b/..", "/a/");
+	norm_check("/../a", "/a");
+}
+
+TEST_SUITE(http_norm)
+{
+	tfw_http_norm_uri_on = true;
+
+	TEST_RUN(http_norm, unchanged);
+	TEST_RUN(http_norm, unreserved_decoded);
+	TEST_RUN(http_norm, dot_segments);
+
+	tfw_http_norm_uri_on = false;
+}
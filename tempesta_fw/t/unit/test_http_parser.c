@@ -1413,6 +1413,32 @@ end:
 	kernel_fpu_begin();
 }
 
+TEST(http_parser, bench)
+{
+	static unsigned char get_req[] =
+		"GET /foo/bar/baz.html?q=1 HTTP/1.1\r\n"
+		"Host: example.com\r\n"
+		"User-Agent: Wget/1.13.4 (linux-gnu)\r\n"
+		"Accept: */*\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Cookie: session=42; theme=dark\r\n"
+		"\r\n";
+	size_t len = strlen(get_req);
+	unsigned long parsed = 0;
+
+	/* The request allocation is part of the per-message cost. */
+	BENCH("parse_get_req", 1024, {
+		TfwHttpReq *r = test_req_alloc(len);
+
+		if (r) {
+			if (tfw_http_parse_req(r, get_req, len) == TFW_PASS)
+				++parsed;
+			test_req_free(r);
+		}
+	});
+	EXPECT_NE(parsed, 0);
+}
+
 TEST_SUITE(http_parser)
 {
 	TEST_RUN(http_parser, leading_eol);
@@ -1422,6 +1448,7 @@ TEST_SUITE(http_parser)
 	TEST_RUN(http_parser, alphabets);
 	TEST_RUN(http_parser, fills_hdr_tbl_for_req);
 	TEST_RUN(http_parser, fills_hdr_tbl_for_resp);
+	TEST_RUN(http_parser, bench);
 	TEST_RUN(http_parser, suspicious_x_forwarded_for);
 	TEST_RUN(http_parser, parses_connection_value);
 	TEST_RUN(http_parser, content_length);
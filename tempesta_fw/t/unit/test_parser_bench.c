@@ -0,0 +1,102 @@
+/**
+ *		Tempesta FW
+ *
+ * Parser benchmark replaying a fuzzer-generated corpus: the fuzzer
+ * produces a deterministic stream of valid requests, so runs are
+ * comparable between kernels and parser changes.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/ktime.h>
+
+#include "http.h"
+
+#include "helpers.h"
+#include "fuzzer.h"
+#include "test.h"
+
+#define BENCH_CORPUS_N	256
+#define BENCH_REPS	64
+#define BENCH_BUF	(10 * 1024)
+
+static int bench_iter = BENCH_REPS;
+module_param_named(bench_iter, bench_iter, int, 0);
+MODULE_PARM_DESC(bench_iter, "Parser benchmark repetitions, 0 to skip");
+
+TEST(parser_bench, corpus_replay)
+{
+	static char *corpus[BENCH_CORPUS_N];
+	static int corpus_len[BENCH_CORPUS_N];
+	static TfwFuzzContext ctx;
+	unsigned long total = 0, parsed = 0;
+	ktime_t t0;
+	s64 ns;
+	int i, rep, n = 0;
+
+	if (!bench_iter)
+		return;
+
+	fuzz_init(&ctx, true);
+	for (i = 0; i < BENCH_CORPUS_N; ++i) {
+		int r;
+
+		corpus[i] = vmalloc(BENCH_BUF);
+		if (!corpus[i])
+			goto free;
+		r = fuzz_gen(&ctx, corpus[i], corpus[i] + BENCH_BUF, 0, 1,
+			     FUZZ_REQ);
+		if (r == FUZZ_END)
+			fuzz_init(&ctx, true);
+		if (r != FUZZ_VALID && r != FUZZ_END) {
+			vfree(corpus[i]);
+			break;
+		}
+		corpus_len[i] = strlen(corpus[i]);
+		++n;
+	}
+
+	t0 = ktime_get();
+	for (rep = 0; rep < bench_iter; ++rep) {
+		for (i = 0; i < n; ++i) {
+			TfwHttpReq *req = test_req_alloc(corpus_len[i]);
+
+			if (!req)
+				continue;
+			if (tfw_http_parse_req(req,
+						       (unsigned char *)corpus[i],
+						       corpus_len[i])
+			    == TFW_PASS)
+				++parsed;
+			total += corpus_len[i];
+			test_req_free(req);
+		}
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	pr_info("parser bench: corpus=%d reps=%d bytes=%lu parsed=%lu"
+		" time=%lldms rate=%lluMB/s\n",
+		n, bench_iter, total, parsed, ns / 1000000,
+		ns ? total * 1000ULL / ns : 0);
+free:
+	for (i = 0; i < n; ++i)
+		vfree(corpus[i]);
+}
+
+TEST_SUITE(parser_bench)
+{
+	TEST_RUN(parser_bench, corpus_replay);
+}
@@ -0,0 +1,119 @@
+/**
+ *		Tempesta FW
+ *
+ * Tests for the DFA regex engine behind the HTTP matching rules.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "http_rex.h"
+
+#include "test.h"
+
+static bool
+rex_match_cstr(TfwRex *re, const char *str)
+{
+	TfwStr s = { .ptr = (void *)str, .len = strlen(str) };
+
+	return tfw_rex_match(re, &s);
+}
+
+TEST(rex, literals_and_anchors)
+{
+	TfwRex *re;
+
+	re = tfw_rex_compile("foo");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "foo"));
+	EXPECT_TRUE(rex_match_cstr(re, "a foo b"));
+	EXPECT_FALSE(rex_match_cstr(re, "fo"));
+	tfw_rex_free(re);
+
+	re = tfw_rex_compile("^/static/");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "/static/img.png"));
+	EXPECT_FALSE(rex_match_cstr(re, "/api/static/"));
+	tfw_rex_free(re);
+
+	re = tfw_rex_compile("\\.html$");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "/index.html"));
+	EXPECT_FALSE(rex_match_cstr(re, "/index.html.bak"));
+	EXPECT_FALSE(rex_match_cstr(re, "/indexXhtml"));
+	tfw_rex_free(re);
+}
+
+TEST(rex, classes_and_repeats)
+{
+	TfwRex *re;
+
+	re = tfw_rex_compile("^/v[0-9]+/");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "/v1/users"));
+	EXPECT_TRUE(rex_match_cstr(re, "/v42/users"));
+	EXPECT_FALSE(rex_match_cstr(re, "/v/users"));
+	EXPECT_FALSE(rex_match_cstr(re, "/va/users"));
+	tfw_rex_free(re);
+
+	re = tfw_rex_compile("^/([a-z]+/)*index\\.(html|php)$");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "/index.html"));
+	EXPECT_TRUE(rex_match_cstr(re, "/a/b/c/index.php"));
+	EXPECT_FALSE(rex_match_cstr(re, "/a/b/index.cgi"));
+	tfw_rex_free(re);
+
+	re = tfw_rex_compile("^[^/]*$");
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(rex_match_cstr(re, "no-slashes"));
+	EXPECT_FALSE(rex_match_cstr(re, "has/slash"));
+	tfw_rex_free(re);
+}
+
+TEST(rex, chunked_input)
+{
+	TfwRex *re = tfw_rex_compile("bar\\.example\\.com$");
+	TfwStr chunks[3] = {
+		{ .ptr = "www.bar", .len = 7 },
+		{ .ptr = ".exam", .len = 5 },
+		{ .ptr = "ple.com", .len = 7 },
+	};
+	TfwStr s = {
+		.ptr = chunks,
+		.len = 19,
+		.flags = 3 << TFW_STR_CN_SHIFT,
+	};
+
+	EXPECT_NOT_NULL(re);
+	EXPECT_TRUE(tfw_rex_match(re, &s));
+	tfw_rex_free(re);
+}
+
+TEST(rex, rejects_invalid)
+{
+	/* Syntax errors and out-of-grammar constructs. */
+	EXPECT_NULL(tfw_rex_compile("(unbalanced"));
+	EXPECT_NULL(tfw_rex_compile("a**"));
+	EXPECT_NULL(tfw_rex_compile("[unclosed"));
+	EXPECT_NULL(tfw_rex_compile("trailing\\"));
+}
+
+TEST_SUITE(rex)
+{
+	TEST_RUN(rex, literals_and_anchors);
+	TEST_RUN(rex, classes_and_repeats);
+	TEST_RUN(rex, chunked_input);
+	TEST_RUN(rex, rejects_invalid);
+}
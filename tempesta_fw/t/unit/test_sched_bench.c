@@ -0,0 +1,103 @@
+/**
+ *		Tempesta FW
+ *
+ * Scheduler microbenchmarks built on the sched_helper fixtures: each
+ * content-independent scheduler picks connections from a fully
+ * populated group in a tight loop and the per-decision cost is
+ * reported, so scheduler changes get a number to regress against.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <asm/fpu/api.h>
+#include <linux/ktime.h>
+
+#include "sched_helper.h"
+#include "server.h"
+#include "test.h"
+
+#define SCHED_BENCH_ITER	100000
+
+static int sched_bench_iter = SCHED_BENCH_ITER;
+module_param_named(sched_bench_iter, sched_bench_iter, int, 0);
+MODULE_PARM_DESC(sched_bench_iter, "Scheduler benchmark picks, 0 to skip");
+
+static void
+sched_bench_run(const char *sched)
+{
+	size_t i, j;
+	unsigned long picks = 0;
+	ktime_t t0;
+	s64 ns;
+	TfwSrvGroup *sg;
+
+	sg = test_create_sg("bench", sched);
+
+	for (i = 0; i < TFW_SG_MAX_SRV; ++i) {
+		TfwServer *srv = test_create_srv("127.0.0.1", sg);
+
+		srv->weight = 1 + i % 7;
+		for (j = 0; j < 8; ++j) {
+			TfwSrvConn *conn = test_create_conn((TfwPeer *)srv);
+			sg->sched->add_conn(sg, srv, conn);
+		}
+	}
+
+	t0 = ktime_get();
+	for (i = 0; i < sched_bench_iter; ++i) {
+		TfwSrvConn *conn = sg->sched->sched_sg_conn(NULL, sg);
+
+		if (likely(conn)) {
+			++picks;
+			tfw_srv_conn_put(conn);
+		}
+		if (!(i % 4096)) {
+			kernel_fpu_end();
+			schedule();
+			kernel_fpu_begin();
+		}
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	pr_info("sched bench %-12s: picks=%lu/%d time=%lldms %lldns/pick\n",
+		sched, picks, sched_bench_iter, ns / 1000000,
+		picks ? ns / picks : 0);
+
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST(sched_bench, all)
+{
+	static const char * const scheds[] = {
+		"round-robin", "least-conn", "ewma", "wrr",
+	};
+	size_t i;
+
+	if (!sched_bench_iter)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(scheds); ++i) {
+		if (!tfw_sched_lookup(scheds[i]))
+			continue;
+		sched_bench_run(scheds[i]);
+	}
+}
+
+TEST_SUITE(sched_bench)
+{
+	TEST_RUN(sched_bench, all);
+}
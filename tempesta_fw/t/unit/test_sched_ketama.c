@@ -0,0 +1,178 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <asm/fpu/api.h>
+
+#undef tfw_sock_srv_init
+#define tfw_sock_srv_init test_ketama_sock_srv_conn_init
+#undef tfw_sock_srv_exit
+#define tfw_sock_srv_exit test_ketama_sock_srv_exit
+#undef tfw_srv_conn_release
+#define tfw_srv_conn_release test_ketama_srv_conn_release
+#undef tfw_sock_srv_cfg_mod
+#define tfw_sock_srv_cfg_mod test_ketama_sock_srv_cfg_mod
+
+#include "sock_srv.c"
+
+#ifdef module_init
+#undef module_init
+#undef module_exit
+#define module_init(func)
+#define module_exit(func)
+#endif
+
+#include "../../sched/tfw_sched_ketama.c"
+
+#include "helpers.h"
+#include "http_msg.h"
+#include "sched_helper.h"
+#include "test.h"
+
+static char *req_strs[] = {
+	"GET / HTTP/1.1\r\nhost:host1\r\n\r\n",
+	"GET / HTTP/1.1\r\nhost:host2\r\n\r\n",
+	"GET / HTTP/1.1\r\nhost:host3\r\n\r\n",
+	"GET / HTTP/1.1\r\nhost:host4\r\n\r\n",
+};
+
+static TfwMsg *sched_ketama_get_arg(size_t conn_type);
+
+static void
+sched_ketama_free_arg(TfwMsg *msg)
+{
+	test_req_free((TfwHttpReq *)msg);
+}
+
+static struct TestSchedHelper sched_helper_ketama = {
+	.sched = "ketama",
+	.conn_types = ARRAY_SIZE(req_strs),
+	.get_sched_arg = &sched_ketama_get_arg,
+	.free_sched_arg = &sched_ketama_free_arg,
+};
+
+static TfwMsg *
+sched_ketama_get_arg(size_t conn_type)
+{
+	TfwHttpReq *req = NULL;
+
+	BUG_ON(conn_type >= sched_helper_ketama.conn_types);
+
+	req = test_req_alloc(strlen(req_strs[conn_type]));
+	tfw_http_parse_req(req,
+			   (unsigned char *) req_strs[conn_type],
+			   strlen(req_strs[conn_type]));
+
+	return (TfwMsg *) req;
+}
+
+TEST(tfw_sched_ketama, sg_empty)
+{
+	test_sched_sg_empty_sg(&sched_helper_ketama);
+}
+
+TEST(tfw_sched_ketama, sched_sg_one_srv_zero_conn)
+{
+	test_sched_sg_one_srv_zero_conn(&sched_helper_ketama);
+}
+
+TEST(tfw_sched_ketama, sched_sg_max_srv_zero_conn)
+{
+	test_sched_sg_max_srv_zero_conn(&sched_helper_ketama);
+}
+
+TEST(tfw_sched_ketama, sched_srv_one_srv_zero_conn)
+{
+	test_sched_srv_one_srv_zero_conn(&sched_helper_ketama);
+}
+
+TEST(tfw_sched_ketama, sched_srv_max_srv_zero_conn)
+{
+	test_sched_srv_max_srv_zero_conn(&sched_helper_ketama);
+}
+
+TEST(tfw_sched_ketama, sched_srv_offline_srv)
+{
+	test_sched_srv_offline_srv(&sched_helper_ketama);
+}
+
+/*
+ * Requests with the same URI/Host must stick to the same server even
+ * with many servers in the group.
+ */
+TEST(tfw_sched_ketama, sched_sg_sticky_srv)
+{
+	size_t i, j;
+
+	TfwSrvGroup *sg = test_create_sg("test", sched_helper_ketama.sched);
+
+	for (i = 0; i < TFW_SG_MAX_SRV; ++i) {
+		TfwServer *srv = test_create_srv("127.0.0.1", sg);
+
+		for (j = 0; j < 4; ++j) {
+			TfwSrvConn *srv_conn = test_create_conn((TfwPeer *)srv);
+			sg->sched->add_conn(sg, srv, srv_conn);
+		}
+	}
+
+	for (i = 0; i < sched_helper_ketama.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_ketama.get_sched_arg(i);
+		TfwServer *exp_srv = NULL;
+
+		for (j = 0; j < 16; ++j) {
+			TfwSrvConn *srv_conn =
+					sg->sched->sched_sg_conn(msg, sg);
+			EXPECT_NOT_NULL(srv_conn);
+			if (!srv_conn)
+				goto err;
+
+			if (!exp_srv)
+				exp_srv = (TfwServer *)srv_conn->peer;
+			EXPECT_EQ((TfwServer *)srv_conn->peer, exp_srv);
+			tfw_srv_conn_put(srv_conn);
+
+			kernel_fpu_end();
+			schedule();
+			kernel_fpu_begin();
+		}
+		sched_helper_ketama.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST_SUITE(sched_ketama)
+{
+	kernel_fpu_end();
+
+	tfw_server_init();
+	tfw_sched_ketama_init();
+
+	kernel_fpu_begin();
+
+	TEST_RUN(tfw_sched_ketama, sg_empty);
+
+	TEST_RUN(tfw_sched_ketama, sched_sg_one_srv_zero_conn);
+	TEST_RUN(tfw_sched_ketama, sched_sg_max_srv_zero_conn);
+	TEST_RUN(tfw_sched_ketama, sched_sg_sticky_srv);
+
+	TEST_RUN(tfw_sched_ketama, sched_srv_one_srv_zero_conn);
+	TEST_RUN(tfw_sched_ketama, sched_srv_max_srv_zero_conn);
+	TEST_RUN(tfw_sched_ketama, sched_srv_offline_srv);
+}
@@ -0,0 +1,185 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <asm/fpu/api.h>
+
+#undef tfw_sock_srv_init
+#define tfw_sock_srv_init test_lc_sock_srv_conn_init
+#undef tfw_sock_srv_exit
+#define tfw_sock_srv_exit test_lc_sock_srv_exit
+#undef tfw_srv_conn_release
+#define tfw_srv_conn_release test_lc_srv_conn_release
+#undef tfw_sock_srv_cfg_mod
+#define tfw_sock_srv_cfg_mod test_lc_srv_cfg_mod
+
+#include "sock_srv.c"
+
+#ifdef module_init
+#undef module_init
+#undef module_exit
+#define module_init(func)
+#define module_exit(func)
+#endif
+
+#include "../../sched/tfw_sched_lc.c"
+
+#include "sched_helper.h"
+#include "server.h"
+#include "test.h"
+
+static TfwMsg *
+sched_lc_get_arg(size_t conn_type __attribute__((unused)))
+{
+	return NULL;
+}
+
+static void
+sched_lc_free_arg(TfwMsg *msg __attribute__((unused)))
+{
+}
+
+static struct TestSchedHelper sched_helper_lc = {
+	.sched = "least-conn",
+	.conn_types = 1,
+	.get_sched_arg = &sched_lc_get_arg,
+	.free_sched_arg = &sched_lc_free_arg,
+};
+
+TEST(tfw_sched_lc, sg_empty)
+{
+	test_sched_sg_empty_sg(&sched_helper_lc);
+}
+
+TEST(tfw_sched_lc, sched_sg_one_srv_zero_conn)
+{
+	test_sched_sg_one_srv_zero_conn(&sched_helper_lc);
+}
+
+TEST(tfw_sched_lc, sched_sg_max_srv_zero_conn)
+{
+	test_sched_sg_max_srv_zero_conn(&sched_helper_lc);
+}
+
+TEST(tfw_sched_lc, sched_srv_one_srv_zero_conn)
+{
+	test_sched_srv_one_srv_zero_conn(&sched_helper_lc);
+}
+
+TEST(tfw_sched_lc, sched_srv_max_srv_zero_conn)
+{
+	test_sched_srv_max_srv_zero_conn(&sched_helper_lc);
+}
+
+TEST(tfw_sched_lc, sched_srv_offline_srv)
+{
+	test_sched_srv_offline_srv(&sched_helper_lc);
+}
+
+/*
+ * The scheduler must prefer the server with the fewest outstanding
+ * requests accumulated over all its connections.
+ */
+TEST(tfw_sched_lc, sched_sg_least_loaded_srv)
+{
+	size_t i, j;
+	TfwServer *srvs[2];
+
+	TfwSrvGroup *sg = test_create_sg("test", sched_helper_lc.sched);
+
+	for (i = 0; i < ARRAY_SIZE(srvs); ++i) {
+		srvs[i] = test_create_srv("127.0.0.1", sg);
+		for (j = 0; j < 4; ++j) {
+			TfwSrvConn *srv_conn =
+				test_create_conn((TfwPeer *)srvs[i]);
+			sg->sched->add_conn(sg, srvs[i], srv_conn);
+			/* Load the first server. */
+			srv_conn->qsize = i == 0 ? 5 : 1;
+		}
+	}
+
+	for (i = 0; i < 3; ++i) {
+		TfwMsg *msg = sched_helper_lc.get_sched_arg(0);
+		TfwSrvConn *srv_conn = sg->sched->sched_sg_conn(msg, sg);
+
+		EXPECT_NOT_NULL(srv_conn);
+		if (!srv_conn)
+			goto err;
+		EXPECT_EQ((TfwServer *)srv_conn->peer, srvs[1]);
+		tfw_srv_conn_put(srv_conn);
+		sched_helper_lc.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+/*
+ * Within one server the connection with the shortest forwarding queue
+ * must be chosen.
+ */
+TEST(tfw_sched_lc, sched_srv_least_loaded_conn)
+{
+	size_t i;
+	TfwSrvConn *conns[4];
+
+	TfwSrvGroup *sg = test_create_sg("test", sched_helper_lc.sched);
+	TfwServer *srv = test_create_srv("127.0.0.1", sg);
+
+	for (i = 0; i < ARRAY_SIZE(conns); ++i) {
+		conns[i] = test_create_conn((TfwPeer *)srv);
+		sg->sched->add_conn(sg, srv, conns[i]);
+		conns[i]->qsize = i == 2 ? 0 : 3;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		TfwMsg *msg = sched_helper_lc.get_sched_arg(0);
+		TfwSrvConn *srv_conn = sg->sched->sched_srv_conn(msg, srv);
+
+		EXPECT_NOT_NULL(srv_conn);
+		if (!srv_conn)
+			goto err;
+		EXPECT_EQ(srv_conn, conns[2]);
+		tfw_srv_conn_put(srv_conn);
+		sched_helper_lc.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST_SUITE(sched_lc)
+{
+	kernel_fpu_end();
+
+	tfw_server_init();
+	tfw_sched_lc_init();
+
+	kernel_fpu_begin();
+
+	TEST_RUN(tfw_sched_lc, sg_empty);
+
+	TEST_RUN(tfw_sched_lc, sched_sg_one_srv_zero_conn);
+	TEST_RUN(tfw_sched_lc, sched_sg_max_srv_zero_conn);
+	TEST_RUN(tfw_sched_lc, sched_sg_least_loaded_srv);
+
+	TEST_RUN(tfw_sched_lc, sched_srv_one_srv_zero_conn);
+	TEST_RUN(tfw_sched_lc, sched_srv_max_srv_zero_conn);
+	TEST_RUN(tfw_sched_lc, sched_srv_least_loaded_conn);
+	TEST_RUN(tfw_sched_lc, sched_srv_offline_srv);
+}
@@ -762,6 +762,27 @@ TEST(tfw_str_eq_cstr_off, compound)
 
 }
 
+TEST(cstr, bench)
+{
+	static char b1[1024], b2[1024];
+	int i;
+	unsigned long acc = 0;
+
+	for (i = 0; i < sizeof(b1); ++i)
+		b1[i] = b2[i] = 'a' + i % 26;
+
+	BENCH("match_uri_1k", 2048, {
+		acc += tfw_match_uri(b1, sizeof(b1));
+	});
+	BENCH("stricmp_1k", 2048, {
+		acc += tfw_stricmp(b1, b2, sizeof(b1));
+	});
+	BENCH("strtolower_1k", 2048, {
+		tfw_strtolower(b2, b1, sizeof(b1));
+	});
+	EXPECT_NE(acc, 0);
+}
+
 TEST_SUITE(tfw_str)
 {
 	TEST_SETUP(create_str_pool);
@@ -773,6 +794,7 @@ TEST_SUITE(tfw_str)
 	TEST_RUN(cstr, simd_stricmp);
 
 	TEST_RUN(cstr, ultoa);
+	TEST_RUN(cstr, bench);
 
 	TEST_RUN(tfw_strcpy, zero_src);
 	TEST_RUN(tfw_strcpy, zero_dst);
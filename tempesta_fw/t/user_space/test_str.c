@@ -0,0 +1,259 @@
+/**
+ *		Tempesta FW
+ *
+ * User-space harness for the string and hashing primitives: the code
+ * under the HTTP parser and the cache key. Compiling these translation
+ * units against the ktest stubs lets them run under ASan/UBSan, perf
+ * and callgrind with real corpora, so an optimization iteration takes
+ * seconds instead of a kernel rebuild and reboot.
+ *
+ * Modes:
+ *   test_str		- randomized differential tests: every SIMD
+ *			  matcher against a scalar reference over the
+ *			  same character table, tfw_stricmp() against
+ *			  strncasecmp(), and the chunked tfw_hash_str()
+ *			  (the cache key core) against the plain-string
+ *			  hash of the same bytes;
+ *   test_str bench [MB]- a profiling loop over a synthetic corpus for
+ *			  perf/callgrind runs.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * One translation unit: the scalar references below read the SIMD
+ * character tables directly.
+ */
+#include "str_simd.c"
+#include "str.c"
+#include "hash.c"
+
+/* Malloc-backed pool stubs: leaks don't matter in a short test run. */
+void *
+tfw_pool_alloc(TfwPool *p, size_t n)
+{
+	return malloc(n);
+}
+
+void *
+tfw_pool_realloc(TfwPool *p, void *ptr, size_t old_n, size_t new_n)
+{
+	void *a = malloc(new_n);
+
+	if (a && ptr)
+		memcpy(a, ptr, old_n);
+	return a;
+}
+
+#define FUZZ_ITER	100000
+#define BUF_SZ		4096
+/* The vector matchers may touch up to a vector beyond the data. */
+#define BUF_PAD		64
+
+static unsigned int seed = 42;
+
+static size_t
+strspn_ref(const char *s, size_t len, const unsigned char *tbl)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		if (!tbl[(unsigned char)s[i]])
+			break;
+	return i;
+}
+
+static const struct {
+	const char		*name;
+	size_t			(*match)(const char *, size_t);
+	const unsigned char	*tbl;
+} matchers[] = {
+	{ "uri",	tfw_match_uri,		uri },
+	{ "token",	tfw_match_token,	token },
+	{ "qetoken",	tfw_match_qetoken,	qetoken },
+	{ "nctl",	tfw_match_nctl,		nctl },
+	{ "ctext_vchar", tfw_match_ctext_vchar,	ctext_vchar },
+	{ "xff",	tfw_match_xff,		xff },
+	{ "cookie",	tfw_match_cookie,	cookie_octet },
+};
+
+static int
+test_matchers(char *buf)
+{
+	int it, m, failures = 0;
+
+	for (it = 0; it < FUZZ_ITER; ++it) {
+		size_t len = rand_r(&seed) % BUF_SZ;
+		size_t i;
+
+		for (i = 0; i < len; ++i)
+			buf[i] = rand_r(&seed) % (it & 1 ? 128 : 256);
+
+		for (m = 0; m < ARRAY_SIZE(matchers); ++m) {
+			size_t r = matchers[m].match(buf, len);
+			size_t ref = strspn_ref(buf, len, matchers[m].tbl);
+
+			if (r != ref) {
+				fprintf(stderr, "FAIL: match_%s len=%zu:"
+					" got %zu, expected %zu\n",
+					matchers[m].name, len, r, ref);
+				++failures;
+			}
+		}
+	}
+	return failures;
+}
+
+static int
+test_stricmp(char *buf)
+{
+	int it, failures = 0;
+	char *b2 = buf + BUF_SZ + BUF_PAD;
+
+	for (it = 0; it < FUZZ_ITER; ++it) {
+		size_t len = rand_r(&seed) % 256 + 1;
+		size_t i;
+		int r, ref;
+
+		for (i = 0; i < len; ++i) {
+			buf[i] = 'A' + rand_r(&seed) % 26;
+			/* Mostly equal strings to exercise both paths. */
+			b2[i] = (rand_r(&seed) % 8)
+				? tolower(buf[i])
+				: 'a' + rand_r(&seed) % 26;
+		}
+		r = tfw_stricmp(buf, b2, len);
+		ref = strncasecmp(buf, b2, len);
+		if (!!r != !!ref) {
+			fprintf(stderr, "FAIL: stricmp len=%zu: got %d,"
+				" expected %d\n", len, r, ref);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+/*
+ * The cache key is tfw_hash_str() over chunked URI and Host strings;
+ * verify that any chunking produces the hash of the flat bytes.
+ */
+static int
+test_hash_chunked(char *buf)
+{
+	int it, failures = 0;
+
+	for (it = 0; it < FUZZ_ITER / 10; ++it) {
+		size_t len = rand_r(&seed) % BUF_SZ + 1;
+		size_t i, off = 0;
+		TfwStr chunks[16], flat = { .ptr = buf, .len = len };
+		TfwStr compound = { .ptr = chunks };
+		int n = 0;
+
+		for (i = 0; i < len; ++i)
+			buf[i] = rand_r(&seed);
+
+		while (off < len && n < 15) {
+			size_t c = rand_r(&seed) % (len - off) + 1;
+
+			chunks[n].ptr = buf + off;
+			chunks[n].len = c;
+			chunks[n].flags = 0;
+			off += c;
+			++n;
+		}
+		if (off < len) {
+			chunks[n].ptr = buf + off;
+			chunks[n].len = len - off;
+			chunks[n].flags = 0;
+			++n;
+		}
+		compound.len = len;
+		compound.flags = n << TFW_STR_CN_SHIFT;
+
+		if (tfw_hash_str(&flat) != tfw_hash_str(&compound)) {
+			fprintf(stderr, "FAIL: chunked hash mismatch,"
+				" len=%zu chunks=%d\n", len, n);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+static void
+bench(char *buf, long mb)
+{
+	long total = mb << 20, done = 0;
+	size_t i;
+	unsigned long acc = 0;
+	struct timespec ts0, ts1;
+	long ns;
+
+	for (i = 0; i < BUF_SZ; ++i)
+		buf[i] = "abcdefghijklmnopqrstuvwxyz0123456789/.-_"[
+			rand_r(&seed) % 40];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	while (done < total) {
+		TfwStr s = { .ptr = buf, .len = BUF_SZ };
+
+		acc += tfw_match_uri(buf, BUF_SZ);
+		acc += tfw_match_token(buf, BUF_SZ);
+		acc += tfw_hash_str(&s);
+		done += 3 * BUF_SZ;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts1);
+	ns = (ts1.tv_sec - ts0.tv_sec) * 1000000000L
+	     + ts1.tv_nsec - ts0.tv_nsec;
+
+	printf("bench: %ldMB in %ldms, %ldMB/s (acc=%lx)\n",
+	       mb, ns / 1000000, ns ? total * 1000L / ns : 0, acc);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int failures = 0;
+	char *buf = malloc(2 * (BUF_SZ + BUF_PAD));
+
+	if (!buf) {
+		perror("malloc");
+		return 2;
+	}
+	tfw_str_init_const();
+
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		bench(buf, argc > 2 ? atol(argv[2]) : 1024);
+		free(buf);
+		return 0;
+	}
+
+	failures += test_matchers(buf);
+	failures += test_stricmp(buf);
+	failures += test_hash_chunked(buf);
+
+	free(buf);
+	if (failures) {
+		fprintf(stderr, "%d failure(s)\n", failures);
+		return 1;
+	}
+	printf("all string/hash tests passed\n");
+	return 0;
+}
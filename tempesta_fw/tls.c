@@ -19,12 +19,20 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/hash.h>
 #include <linux/vmalloc.h>
 
 #include "cfg.h"
 #include "connection.h"
 #include "client.h"
+#include "procfs.h"
+#include "tdb.h"
 #include "tls.h"
+#include "work_queue.h"
+
+#include "ctr_drbg.h"
+#include "ssl_internal.h"
+#include "ssl_ticket.h"
 
 #define tls_dbg(c, fmt, ...)					\
 	TFW_DBG("TLS(%p,%p):%s " fmt "\n", c, c->sk, __func__, ## __VA_ARGS__)
@@ -41,6 +49,335 @@ typedef struct {
 
 static TfwTls tfw_tls;
 
+/*
+ * SNI-keyed certificates: additional ssl_certificate/ssl_certificate_key
+ * pairs carrying a host name are collected here and selected by the
+ * SNI callback during the handshake; the nameless pair in @tfw_tls
+ * stays the default.
+ */
+#define TFW_TLS_SNI_MAX	16
+
+typedef struct {
+	char			name[64];
+	size_t			name_len;
+	mbedtls_x509_crt	crt;
+	mbedtls_pk_context	key;
+	bool			has_key;
+} TfwTlsSniCert;
+
+static TfwTlsSniCert tfw_tls_sni[TFW_TLS_SNI_MAX];
+static unsigned int tfw_tls_sni_n;
+
+/*
+ * Certificate hot swap. The configured file paths are remembered so a
+ * reload re-reads them into one of two spare slots and republishes the
+ * pair via mbedtls_ssl_conf_own_cert(); the slot retired two swaps ago
+ * is freed then - any handshake that could reference it is long done.
+ * SNI certificates require a full restart for now.
+ */
+static const char *tls_crt_path, *tls_key_path;
+static struct {
+	mbedtls_x509_crt	crt;
+	mbedtls_pk_context	key;
+	mbedtls_ssl_key_cert	*kc;
+	bool			used;
+} tls_cert_slot[2];
+static int tls_cert_act = -1;
+/*
+ * The key_cert node displaced by the very first reload references the
+ * start-time certificate, which is never freed at runtime - the node is
+ * retained alongside it.
+ */
+static mbedtls_ssl_key_cert *tls_cert_init_kc;
+
+static int
+tfw_tls_reconf(void)
+{
+	int r, next = tls_cert_act == 0 ? 1 : 0;
+	void *crt_data, *key_data;
+	size_t crt_size, key_size;
+	mbedtls_ssl_key_cert *kc;
+
+	if (!tls_crt_path || !tls_key_path)
+		return 0;
+
+	if (tls_cert_slot[next].used) {
+		mbedtls_ssl_key_cert_free(tls_cert_slot[next].kc);
+		tls_cert_slot[next].kc = NULL;
+		mbedtls_x509_crt_free(&tls_cert_slot[next].crt);
+		mbedtls_pk_free(&tls_cert_slot[next].key);
+		tls_cert_slot[next].used = false;
+	}
+
+	crt_data = tfw_cfg_read_file(tls_crt_path, &crt_size);
+	if (!crt_data)
+		return -EINVAL;
+	key_data = tfw_cfg_read_file(tls_key_path, &key_size);
+	if (!key_data) {
+		vfree(crt_data);
+		return -EINVAL;
+	}
+
+	mbedtls_x509_crt_init(&tls_cert_slot[next].crt);
+	mbedtls_pk_init(&tls_cert_slot[next].key);
+	r = mbedtls_x509_crt_parse(&tls_cert_slot[next].crt, crt_data,
+				   crt_size);
+	if (!r)
+		r = mbedtls_pk_parse_key(&tls_cert_slot[next].key, key_data,
+					 key_size, NULL, 0);
+	vfree(crt_data);
+	vfree(key_data);
+	if (r) {
+		TFW_ERR_NL("TLS: reload: invalid certificate or key (%x)\n",
+			   -r);
+		mbedtls_x509_crt_free(&tls_cert_slot[next].crt);
+		mbedtls_pk_free(&tls_cert_slot[next].key);
+		return -EINVAL;
+	}
+
+	/*
+	 * Replace the certificate list head - appending via
+	 * mbedtls_ssl_conf_own_cert() would keep the start-time pair
+	 * selectable and leak a list node per reload. The displaced
+	 * node references the currently active slot's certificate, so
+	 * it retires together with that slot two swaps from now.
+	 */
+	r = mbedtls_ssl_conf_own_cert_replace(&tfw_tls.cfg,
+					      &tls_cert_slot[next].crt,
+					      &tls_cert_slot[next].key, &kc);
+	if (r) {
+		TFW_ERR_NL("TLS: reload: can't publish certificate (%x)\n",
+			   -r);
+		mbedtls_x509_crt_free(&tls_cert_slot[next].crt);
+		mbedtls_pk_free(&tls_cert_slot[next].key);
+		return -EINVAL;
+	}
+	if (tls_cert_act >= 0)
+		tls_cert_slot[tls_cert_act].kc = kc;
+	else
+		tls_cert_init_kc = kc;
+	tls_cert_slot[next].used = true;
+	tls_cert_act = next;
+	TFW_LOG("TLS: certificate reloaded from %s\n", tls_crt_path);
+
+	return 0;
+}
+
+static int
+tfw_tls_sni_cb(void *data, mbedtls_ssl_context *ssl,
+	       const unsigned char *name, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < tfw_tls_sni_n; ++i) {
+		TfwTlsSniCert *sc = &tfw_tls_sni[i];
+
+		if (sc->name_len == len
+		    && !strncasecmp(sc->name, name, len))
+		{
+			mbedtls_ssl_set_hs_own_cert(ssl, &sc->crt, &sc->key);
+			return 0;
+		}
+	}
+	/* Unknown names are served with the default certificate. */
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ *	TLS session cache
+ * ------------------------------------------------------------------------
+ * Resumed handshakes skip the key exchange, so session reuse is the
+ * cheapest TLS optimization there is. The built-in mbed TLS cache is a
+ * linked list under a single mutex, instead the sessions are stored as
+ * fixed-size TDB records keyed by the hash of the session id and shared
+ * by all CPUs. Peer certificates aren't stored: we don't require client
+ * certificates, and the verify result is kept in the record.
+ */
+typedef struct {
+	time_t		ts;
+	int		ciphersuite;
+	int		compression;
+	size_t		id_len;
+	unsigned char	id[32];
+	unsigned char	master[48];
+	uint32_t	verify_result;
+} TfwTlsCachedSess;
+
+/* One day, the same as the mbed TLS default. */
+#define TFW_TLS_SESS_LIFETIME	86400
+
+static struct {
+	unsigned int	db_size;
+	const char	*db_path;
+} tls_sess_cfg __read_mostly;
+
+/* 0 - off, 1 - optional, 2 - required client certificates. */
+static int tls_verify_client __read_mostly;
+
+/* Minimal accepted protocol: 0 - TLS 1.0, 1 - TLS 1.1, 2 - TLS 1.2. */
+static int tls_min_proto __read_mostly = 0;
+
+/*
+ * TLS session tickets (RFC 5077). The mbed TLS ticket context keeps
+ * two in-kernel keys and rotates them automatically once per key
+ * lifetime, so a ticket sealed with the previous key is still accepted
+ * for one rotation period. 0 disables tickets.
+ */
+static int tls_ticket_lifetime __read_mostly;
+static mbedtls_ssl_ticket_context tls_ticket_ctx;
+
+/*
+ * OCSP stapling material. The DER-encoded OCSP response is produced
+ * and refreshed by an external agent (e.g. certbot) in a file; we
+ * reload it in the background once an hour so a fresh staple is always
+ * at hand. Handshakes pull the blob through the library's OCSP
+ * callback, which emits it as the RFC 6066 CertificateStatus message
+ * to clients asking for a staple via status_request.
+ */
+#define TFW_TLS_OCSP_REFRESH	(3600 * HZ)
+
+static const char *tls_ocsp_path __read_mostly;
+static struct {
+	void		*der;
+	size_t		len;
+	spinlock_t	lock;
+} tls_ocsp;
+static void tfw_tls_ocsp_refresh_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tls_ocsp_work, tfw_tls_ocsp_refresh_fn);
+
+static void
+tfw_tls_ocsp_load(void)
+{
+	void *der, *old;
+	size_t len = 0;
+
+	der = tfw_cfg_read_file(tls_ocsp_path, &len);
+	if (!der) {
+		TFW_WARN("TLS: can't read OCSP response from %s\n",
+			 tls_ocsp_path);
+		return;
+	}
+
+	/* The handshake callback reads the blob in softirq. */
+	spin_lock_bh(&tls_ocsp.lock);
+	old = tls_ocsp.der;
+	tls_ocsp.der = der;
+	tls_ocsp.len = len;
+	spin_unlock_bh(&tls_ocsp.lock);
+
+	vfree(old);
+}
+
+/* The library's OCSP callback, see mbedtls_ssl_conf_ocsp(). */
+static int
+tfw_tls_ocsp_cb(void *data, unsigned char *buf, size_t buflen, size_t *olen)
+{
+	int r = -1;
+
+	spin_lock(&tls_ocsp.lock);
+	if (tls_ocsp.der && tls_ocsp.len && tls_ocsp.len <= buflen) {
+		memcpy(buf, tls_ocsp.der, tls_ocsp.len);
+		*olen = tls_ocsp.len;
+		r = 0;
+	}
+	spin_unlock(&tls_ocsp.lock);
+
+	return r;
+}
+
+static void
+tfw_tls_ocsp_refresh_fn(struct work_struct *work)
+{
+	tfw_tls_ocsp_load();
+	schedule_delayed_work(&tls_ocsp_work, TFW_TLS_OCSP_REFRESH);
+}
+
+static TDB *tls_sess_db;
+
+/* The TTL callback for the background TDB compaction. */
+static bool
+tfw_tls_sess_expired(TdbRec *rec)
+{
+	TfwTlsCachedSess *cs = (TfwTlsCachedSess *)((TdbFRec *)rec)->data;
+
+	return get_seconds() - cs->ts > TFW_TLS_SESS_LIFETIME;
+}
+
+static bool
+tfw_tls_sess_eq(TdbRec *rec, void *data)
+{
+	TfwTlsCachedSess *cs = (TfwTlsCachedSess *)((TdbFRec *)rec)->data;
+	const mbedtls_ssl_session *sess = data;
+
+	/*
+	 * The negotiated parameters must match the stored ones, see
+	 * mbedtls_ssl_cache_get(): only the master secret and the
+	 * verify result are restored.
+	 */
+	return cs->id_len == sess->id_len
+	       && !memcmp(cs->id, sess->id, sess->id_len)
+	       && cs->ciphersuite == sess->ciphersuite
+	       && cs->compression == sess->compression;
+}
+
+static int
+tfw_tls_sess_get(void *data, mbedtls_ssl_session *sess)
+{
+	unsigned long key;
+	TfwTlsCachedSess cs;
+
+	if (!tls_sess_db || !sess->id_len)
+		return 1;
+
+	/*
+	 * A resumed session restores the cached verify result, so the
+	 * whole client certificate chain verification of the mutual
+	 * auth is skipped - this is the verification cache in action.
+	 */
+	if (tls_verify_client)
+		TFW_INC_STAT_BH(clnt.tls_verify_resumed);
+
+	/*
+	 * The record is copied out, so the bucket lock is held only
+	 * for the copy and never across the handshake processing.
+	 */
+	key = tdb_hash_calc(sess->id, sess->id_len);
+	if (tdb_rec_get_copy(tls_sess_db, key, &cs, sizeof(cs),
+			     tfw_tls_sess_eq, sess) < 0)
+		return 1;
+	if (get_seconds() - cs.ts > TFW_TLS_SESS_LIFETIME)
+		return 1;
+
+	memcpy(sess->master, cs.master, sizeof(cs.master));
+	sess->verify_result = cs.verify_result;
+
+	return 0;
+}
+
+static int
+tfw_tls_sess_set(void *data, const mbedtls_ssl_session *sess)
+{
+	unsigned long key;
+	size_t len = sizeof(TfwTlsCachedSess);
+	TfwTlsCachedSess cs = {};
+
+	if (!tls_sess_db || !sess->id_len)
+		return 1;
+
+	cs.ts = get_seconds();
+	cs.ciphersuite = sess->ciphersuite;
+	cs.compression = sess->compression;
+	cs.id_len = sess->id_len;
+	memcpy(cs.id, sess->id, sizeof(cs.id));
+	memcpy(cs.master, sess->master, sizeof(cs.master));
+	cs.verify_result = sess->verify_result;
+
+	key = tdb_hash_calc(cs.id, cs.id_len);
+
+	return tdb_entry_create(tls_sess_db, key, &cs, &len) ? 0 : 1;
+}
+
 static inline int
 ttls_ssl_handshake(TfwTlsContext *tls)
 {
@@ -89,12 +426,156 @@ ttls_ssl_close_notify(TfwTlsContext *tls)
 	return r;
 }
 
+/*
+ * Handshake CPU load balancing: the asymmetric crypto of a handshake
+ * costs milliseconds of softirq time, so an accept storm pins whole
+ * CPUs while others idle. Handshake flights are pushed to the per-CPU
+ * work queue with the shortest backlog and executed by its tasklet;
+ * established connections keep the low-latency inline path. The TLS
+ * context lock keeps the context consistent wherever the work runs.
+ */
+typedef struct {
+	TfwConn		*c;
+	struct sk_buff	*skb;
+	unsigned long	off;
+	unsigned long	__unused;
+} TfwTlsHsWork;
+
+typedef struct {
+	struct tasklet_struct	tasklet;
+	struct irq_work		ipi_work;
+	TfwRBQueue		wq;
+} TfwTlsHsQueue;
+
+static TfwTlsHsQueue __percpu *tls_hs_wq;
+
+static int __tfw_tls_msg_process(void *conn, struct sk_buff *skb,
+				 unsigned int off);
+
+static void
+tfw_tls_hs_ipi(struct irq_work *work)
+{
+	TfwTlsHsQueue *q = container_of(work, TfwTlsHsQueue, ipi_work);
+
+	tasklet_schedule(&q->tasklet);
+}
+
+static void
+tfw_tls_hs_tasklet(unsigned long data)
+{
+	TfwTlsHsQueue *q = (TfwTlsHsQueue *)data;
+	TfwTlsHsWork hw;
+
+	while (!tfw_wq_pop(&q->wq, &hw)) {
+		if (__tfw_tls_msg_process(hw.c, hw.skb, hw.off) == TFW_BLOCK)
+			ss_close(hw.c->sk);
+		tfw_connection_put(hw.c);
+	}
+}
+
+/*
+ * A handshake costs two orders of magnitude more CPU than a plain
+ * connection or request, so it gets its own limiter: a global cap on
+ * handshakes in progress, checked before any record is fed to the
+ * library - a ClientHello flood is shed before the ECDHE work starts.
+ * Every connection holds at most one slot (@hs_counted), released
+ * when its handshake finishes or the connection dies mid-handshake.
+ */
+static unsigned int tfw_tls_hs_max; /* 0 - unlimited */
+static atomic_t tfw_tls_hs_cur;
+
+static int
+tfw_tls_hs_account(TfwConn *c, TfwTlsContext *tls)
+{
+	if (tls->hs_counted)
+		return 0;
+	if (tfw_tls_hs_max
+	    && atomic_inc_return(&tfw_tls_hs_cur) > tfw_tls_hs_max)
+	{
+		atomic_dec(&tfw_tls_hs_cur);
+		tls_err(c, "-- handshake shed, %u in progress",
+			tfw_tls_hs_max);
+		return -EBUSY;
+	}
+	if (!tfw_tls_hs_max)
+		atomic_inc(&tfw_tls_hs_cur);
+	tls->hs_counted = 1;
+
+	return 0;
+}
+
+static void
+tfw_tls_hs_done(TfwTlsContext *tls)
+{
+	if (!tls->hs_counted)
+		return;
+	tls->hs_counted = 0;
+	atomic_dec(&tfw_tls_hs_cur);
+	/*
+	 * Resumed and full handshakes have very different CPU cost,
+	 * so they're accounted separately.
+	 */
+	if (tls->hs_resumed)
+		TFW_INC_STAT_BH(clnt.tls_hs_resumed);
+	else
+		TFW_INC_STAT_BH(clnt.tls_hs_full);
+}
+
+static int
+tfw_tls_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
+{
+	TfwConn *c = conn;
+	TfwTlsContext *tls = tfw_tls_context(c);
+
+	if (tls->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER
+	    && tfw_tls_hs_account(c, tls))
+	{
+		__kfree_skb(skb);
+		return TFW_BLOCK;
+	}
+
+	if (tls_hs_wq
+	    && tls->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+	{
+		int cpu, hs_cpu;
+		unsigned int n;
+		TfwTlsHsQueue *q;
+		TfwTlsHsWork hw = { .c = c, .skb = skb, .off = off };
+
+		/*
+		 * Pin the connection to one queue by its identity: the
+		 * records of a handshake flight (ClientKeyExchange, CCS,
+		 * Finished) arrive as separate skbs, and spreading them
+		 * over queues would reorder the handshake bytes. The
+		 * hash spreads an accept storm about as well as picking
+		 * the shortest backlog did.
+		 */
+		n = hash_long((unsigned long)c, 32) % num_online_cpus();
+		hs_cpu = smp_processor_id();
+		for_each_online_cpu(cpu)
+			if (!n--) {
+				hs_cpu = cpu;
+				break;
+			}
+
+		q = per_cpu_ptr(tls_hs_wq, hs_cpu);
+		tfw_connection_get(c);
+		if (!tfw_wq_push(&q->wq, &hw, hs_cpu, &q->ipi_work,
+				 tfw_tls_hs_ipi, false))
+			return TFW_PASS;
+		/* Queue overrun: fall back to inline processing. */
+		tfw_connection_put(c);
+	}
+
+	return __tfw_tls_msg_process(conn, skb, off);
+}
+
 /**
  * Decrypted response messages should be directly placed in TDB area
  * to avoid copying.
  */
 static int
-tfw_tls_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
+__tfw_tls_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
 {
 	int r;
 	TfwConn *c = conn;
@@ -102,9 +583,26 @@ tfw_tls_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
 
 	tls_dbg(c, "=>");
 
+	/*
+	 * The rx queue is part of the shared context state: the inline
+	 * path and a queued handshake work may run on different CPUs.
+	 */
+	spin_lock(&tls->lock);
 	ss_skb_queue_tail(&tls->rx_queue, skb);
+	spin_unlock(&tls->lock);
 
 	r = ttls_ssl_handshake(tls);
+	/* Publish the ClientHello fingerprint for the classifiers. */
+	if (TFW_CONN_TYPE(c) & Conn_Clnt)
+		((TfwCliConn *)c)->tls_fp = tls->ssl.cli_fingerprint;
+	/*
+	 * The library frees the handshake params on completion, so the
+	 * resumption indicator is sampled while they're still alive.
+	 */
+	if (tls->ssl.handshake && tls->ssl.handshake->resume)
+		tls->hs_resumed = 1;
+	if (tls->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER)
+		tfw_tls_hs_done(tls);
 	if (r == MBEDTLS_ERR_SSL_CONN_EOF) {
 		return TFW_PASS; /* more data needed */
 	} else if (r == 0) {
@@ -145,6 +643,16 @@ tfw_tls_msg_process(void *conn, struct sk_buff *skb, unsigned int off)
 }
 
 
+/*
+ * Dynamic TLS record sizing: the first bytes of a connection go out in
+ * records fitting a single TCP segment, so the browser can decrypt the
+ * response head after one MSS instead of buffering a 16KB record split
+ * over a dozen segments; once the flow proves to be bulk the records
+ * grow to the maximum to amortize the per-record overhead.
+ */
+#define TFW_TLS_REC_SMALL	1360
+#define TFW_TLS_REC_DYN_LIM	(64 * 1024)
+
 /**
  * Send @buf of length @len using TLS context @tls.
  */
@@ -152,40 +660,93 @@ static inline int
 tfw_tls_send_buf(TfwConn *c, const unsigned char *buf, size_t len)
 {
 	int r;
+	size_t n;
 	TfwTlsContext *tls = tfw_tls_context(c);
 
 	tls_dbg(c, "=>");
 
-	while ((r = ttls_ssl_write(tls, buf, len)) > 0) {
-		if (r == len)
-			return 0;
+	while (len) {
+		n = tls->tx_bytes < TFW_TLS_REC_DYN_LIM
+		    ? min_t(size_t, len, TFW_TLS_REC_SMALL)
+		    : len;
+		r = ttls_ssl_write(tls, buf, n);
+		if (r <= 0) {
+			tls_err(c, "-- write failed (%x)", -r);
+			return -EINVAL;
+		}
+		tls->tx_bytes += r;
 		buf += r;
 		len -= r;
 	}
 
-	tls_err(c, "-- write failed (%x)", -r);
+	return 0;
+}
+
+/*
+ * TLS write corking: every piece handed to the TLS library becomes at
+ * least one record, so an skb chopped into a small linear part and a
+ * handful of short fragments produced a record (with its padding, MAC
+ * and framing overhead) per piece. Small pieces are gathered into a
+ * per-CPU cork buffer and sealed as one record; large pieces are
+ * written directly with an implicit flush to keep the byte order.
+ */
+#define TFW_TLS_CORK_SZ		16384
+#define TFW_TLS_CORK_MIN	2048
 
-	return -EINVAL;
+static char __percpu *tls_cork_buf;
+
+typedef struct {
+	TfwConn		*c;
+	char		*buf;
+	size_t		len;
+} TfwTlsCork;
+
+static int
+tfw_tls_cork_flush(TfwTlsCork *ck)
+{
+	int r = 0;
+
+	if (ck->len) {
+		r = tfw_tls_send_buf(ck->c, ck->buf, ck->len);
+		ck->len = 0;
+	}
+	return r;
+}
+
+static int
+tfw_tls_cork_add(TfwTlsCork *ck, const unsigned char *data, size_t len)
+{
+	if (!ck->buf || len >= TFW_TLS_CORK_MIN) {
+		if (tfw_tls_cork_flush(ck))
+			return -EINVAL;
+		return tfw_tls_send_buf(ck->c, data, len);
+	}
+	if (ck->len + len > TFW_TLS_CORK_SZ && tfw_tls_cork_flush(ck))
+		return -EINVAL;
+	memcpy(ck->buf + ck->len, data, len);
+	ck->len += len;
+
+	return 0;
 }
 
 /**
- * Send @skb using TLS context @tls.
+ * Send @skb through the cork @ck.
  */
 static inline int
-tfw_tls_send_skb(TfwConn *c, struct sk_buff *skb)
+tfw_tls_send_skb(TfwTlsCork *ck, struct sk_buff *skb)
 {
 	int i;
 
-	tls_dbg(c, "=>");
+	tls_dbg(ck->c, "=>");
 
 	if (skb_headlen(skb)) {
-		if (tfw_tls_send_buf(c, skb->data, skb_headlen(skb)))
+		if (tfw_tls_cork_add(ck, skb->data, skb_headlen(skb)))
 		    return -EINVAL;
 	}
 
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
 		const skb_frag_t *f = &skb_shinfo(skb)->frags[i];
-		if (tfw_tls_send_buf(c, skb_frag_address(f), f->size))
+		if (tfw_tls_cork_add(ck, skb_frag_address(f), f->size))
 		    return -EINVAL;
 	}
 
@@ -256,12 +817,27 @@ tfw_tls_recv_cb(void *conn, unsigned char *buf, size_t len)
 	return len;
 }
 
+static void *
+tfw_tls_arena_alloc(void *arena, size_t size)
+{
+	return tfw_pool_alloc(arena, size);
+}
+
 static void
 tfw_tls_conn_dtor(TfwConn *c)
 {
 	TfwTlsContext *tls = tfw_tls_context(c);
 
+	/* Died mid-handshake: give the slot back. */
+	if (tls->hs_counted) {
+		tls->hs_counted = 0;
+		atomic_dec(&tfw_tls_hs_cur);
+	}
 	mbedtls_ssl_free(&tls->ssl);
+	if (tls->pool) {
+		tfw_pool_destroy(tls->pool);
+		tls->pool = NULL;
+	}
 	tfw_cli_conn_release((TfwCliConn *)c);
 }
 
@@ -283,9 +859,23 @@ tfw_tls_conn_init(TfwConn *c)
 		return -EINVAL;
 	}
 
+	/*
+	 * The session buffers (tens of KB) allocated by the setup live
+	 * exactly as long as the connection, so back them with a
+	 * connection arena instead of atomic heap allocations: they're
+	 * reclaimed wholesale by the pool at teardown, see
+	 * ttls_set_arena().
+	 */
+	tls->pool = __tfw_pool_new(0);
+	if (tls->pool)
+		ttls_set_arena(tfw_tls_arena_alloc, tls->pool);
 	r = mbedtls_ssl_setup(&tls->ssl, &tfw_tls.cfg);
+	if (tls->pool)
+		ttls_set_arena(NULL, NULL);
 	if (r) {
 		TFW_ERR("TLS:%p setup failed (%x)\n", tls, -r);
+		tfw_pool_destroy(tls->pool);
+		tls->pool = NULL;
 		return -EINVAL;
 	}
 
@@ -325,11 +915,28 @@ tfw_tls_conn_send(TfwConn *c, TfwMsg *msg)
 
 	tls_dbg(c, "=>");
 
-	while ((skb = ss_skb_dequeue(&msg->skb_list))) {
-		if (tfw_tls_send_skb(c, skb)) {
-			kfree_skb(skb);
+	{
+		TfwTlsCork ck = {
+			.c = c,
+			.buf = tls_cork_buf ? get_cpu_ptr(tls_cork_buf) : NULL,
+		};
+
+		while ((skb = ss_skb_dequeue(&msg->skb_list))) {
+			if (tfw_tls_send_skb(&ck, skb)) {
+				kfree_skb(skb);
+				if (ck.buf)
+					put_cpu_ptr(tls_cork_buf);
+				return -EINVAL;
+			}
+		}
+		/* Seal whatever is corked as the final record. */
+		if (tfw_tls_cork_flush(&ck)) {
+			if (ck.buf)
+				put_cpu_ptr(tls_cork_buf);
 			return -EINVAL;
 		}
+		if (ck.buf)
+			put_cpu_ptr(tls_cork_buf);
 	}
 
 	if (msg->ss_flags & SS_F_CONN_CLOSE)
@@ -360,14 +967,99 @@ tfw_tls_dbg_cb(void *ctx, int level, const char *file, int line, const char *str
 }
 #endif
 
+/*
+ * Per-CPU DRBG instances: get_random_bytes() serializes all CPUs on
+ * the global entropy pool locks, while every TLS handshake asks for
+ * random bytes several times. Each CPU runs its own CTR_DRBG seeded
+ * from the kernel pool and reseeds from it only at the standard DRBG
+ * reseed interval.
+ */
+static mbedtls_ctr_drbg_context __percpu *tls_drbg;
+
+/*
+ * Account the full (non-resumed) client certificate verifications.
+ * Called for every certificate of the chain; the depth-zero call
+ * carries the final verdict of the leaf.
+ */
 static int
-tfw_tls_rnd_cb(void *rnd, unsigned char *out, size_t len)
+tfw_tls_verify_cb(void *data, mbedtls_x509_crt *crt, int depth,
+		  uint32_t *flags)
+{
+	if (!depth) {
+		if (*flags)
+			TFW_INC_STAT_BH(clnt.tls_verify_fail);
+		else
+			TFW_INC_STAT_BH(clnt.tls_verify_ok);
+	}
+	return 0;
+}
+
+static int
+tfw_tls_entropy_cb(void *data, unsigned char *out, size_t len)
 {
-	/* TODO: improve random generation. */
 	get_random_bytes(out, len);
 	return 0;
 }
 
+static int
+tfw_tls_rnd_cb(void *rnd, unsigned char *out, size_t len)
+{
+	int r;
+	mbedtls_ctr_drbg_context *drbg;
+
+	if (unlikely(!tls_drbg)) {
+		get_random_bytes(out, len);
+		return 0;
+	}
+
+	drbg = get_cpu_ptr(tls_drbg);
+	r = mbedtls_ctr_drbg_random(drbg, out, len);
+	put_cpu_ptr(tls_drbg);
+
+	return r;
+}
+
+static int
+tfw_tls_drbg_init(void)
+{
+	int cpu;
+
+	tls_drbg = alloc_percpu(mbedtls_ctr_drbg_context);
+	if (!tls_drbg)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		mbedtls_ctr_drbg_context *drbg = per_cpu_ptr(tls_drbg, cpu);
+		/* Personalize each instance with its CPU number. */
+		unsigned char pers[16];
+		int r;
+
+		snprintf(pers, sizeof(pers), "tfw_tls_%d", cpu);
+		mbedtls_ctr_drbg_init(drbg);
+		r = mbedtls_ctr_drbg_seed(drbg, tfw_tls_entropy_cb, NULL,
+					  pers, strlen(pers));
+		if (r) {
+			TFW_ERR("TLS: can't seed DRBG (%x)\n", -r);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static void
+tfw_tls_drbg_exit(void)
+{
+	int cpu;
+
+	if (!tls_drbg)
+		return;
+	for_each_possible_cpu(cpu)
+		mbedtls_ctr_drbg_free(per_cpu_ptr(tls_drbg, cpu));
+	free_percpu(tls_drbg);
+	tls_drbg = NULL;
+}
+
 static int
 tfw_tls_do_init(void)
 {
@@ -389,6 +1081,24 @@ tfw_tls_do_init(void)
 #endif
 	mbedtls_ssl_conf_rng(&tfw_tls.cfg, tfw_tls_rnd_cb, NULL);
 
+	/*
+	 * Prefer the modern curves for ECDHE: X25519 first - constant
+	 * time by construction with no point validation pitfalls - then
+	 * P-256 which enjoys the NIST reduction fast path. The Curve25519
+	 * ladder runs on the bignum core with the x86-64 multiply
+	 * assembly; a dedicated vectorized field implementation is an
+	 * import into the crypto library, not a proxy-side change.
+	 */
+	{
+		static const mbedtls_ecp_group_id curves[] = {
+			MBEDTLS_ECP_DP_CURVE25519,
+			MBEDTLS_ECP_DP_SECP256R1,
+			MBEDTLS_ECP_DP_SECP384R1,
+			MBEDTLS_ECP_DP_NONE
+		};
+		mbedtls_ssl_conf_curves(&tfw_tls.cfg, curves);
+	}
+
 	return 0;
 }
 
@@ -424,6 +1134,92 @@ tfw_tls_cfg_start(void)
 		return -EINVAL;
 	}
 
+	/*
+	 * Client certificate verification for mutual auth. The chain
+	 * is verified synchronously within the handshake: the mbed TLS
+	 * state machine can't be suspended mid-handshake, so a
+	 * verification pool has nowhere to resume into. The verified
+	 * result is cached with the session, thus resumed handshakes
+	 * skip the chain walk entirely.
+	 */
+	/*
+	 * TLS 1.3 needs a record layer and handshake state machine the
+	 * bundled library doesn't have; until the library is lifted,
+	 * 1-RTT setup comes from session resumption (tickets and the
+	 * session cache) and the operator can at least fence off the
+	 * legacy protocol versions.
+	 */
+	mbedtls_ssl_conf_min_version(&tfw_tls.cfg,
+				     MBEDTLS_SSL_MAJOR_VERSION_3,
+				     MBEDTLS_SSL_MINOR_VERSION_1
+				     + tls_min_proto);
+
+	switch (tls_verify_client) {
+	case 1:
+		mbedtls_ssl_conf_authmode(&tfw_tls.cfg,
+					  MBEDTLS_SSL_VERIFY_OPTIONAL);
+		break;
+	case 2:
+		mbedtls_ssl_conf_authmode(&tfw_tls.cfg,
+					  MBEDTLS_SSL_VERIFY_REQUIRED);
+		break;
+	}
+	if (tls_verify_client)
+		mbedtls_ssl_conf_verify(&tfw_tls.cfg, tfw_tls_verify_cb,
+					NULL);
+
+	if (tfw_tls_sni_n) {
+		unsigned int i;
+
+		for (i = 0; i < tfw_tls_sni_n; ++i)
+			if (!tfw_tls_sni[i].has_key) {
+				TFW_ERR("TLS: SNI certificate '%s' has no"
+					" key\n", tfw_tls_sni[i].name);
+				return -EINVAL;
+			}
+		mbedtls_ssl_conf_sni(&tfw_tls.cfg, tfw_tls_sni_cb, NULL);
+	}
+
+	if (tls_ocsp_path && *tls_ocsp_path) {
+		spin_lock_init(&tls_ocsp.lock);
+		tfw_tls_ocsp_load();
+		schedule_delayed_work(&tls_ocsp_work, TFW_TLS_OCSP_REFRESH);
+		mbedtls_ssl_conf_ocsp(&tfw_tls.cfg, tfw_tls_ocsp_cb, NULL);
+	}
+
+	if (tls_ticket_lifetime) {
+		mbedtls_ssl_ticket_init(&tls_ticket_ctx);
+		r = mbedtls_ssl_ticket_setup(&tls_ticket_ctx, tfw_tls_rnd_cb,
+					     NULL,
+					     MBEDTLS_CIPHER_AES_256_GCM,
+					     tls_ticket_lifetime);
+		if (r) {
+			TFW_ERR("TLS: can't set up session tickets (%x)\n",
+				-r);
+			return -EINVAL;
+		}
+		mbedtls_ssl_conf_session_tickets_cb(&tfw_tls.cfg,
+						    mbedtls_ssl_ticket_write,
+						    mbedtls_ssl_ticket_parse,
+						    &tls_ticket_ctx);
+	}
+
+	if (tls_sess_cfg.db_size) {
+		tls_sess_db = tdb_open(tls_sess_cfg.db_path,
+				       tls_sess_cfg.db_size,
+				       sizeof(TfwTlsCachedSess),
+				       numa_node_id());
+		if (!tls_sess_db) {
+			TFW_WARN("TLS: can't open session cache, resumption"
+				 " is disabled\n");
+		} else {
+			tdb_set_expire_cb(tls_sess_db, tfw_tls_sess_expired);
+			mbedtls_ssl_conf_session_cache(&tfw_tls.cfg, NULL,
+						       tfw_tls_sess_get,
+						       tfw_tls_sess_set);
+		}
+	}
+
 	return 0;
 }
 
@@ -432,6 +1228,45 @@ tfw_tls_cfg_stop(void)
 {
 	mbedtls_x509_crt_free(&tfw_tls.crt);
 	mbedtls_pk_free(&tfw_tls.key);
+
+	{
+		int i;
+
+		for (i = 0; i < 2; ++i)
+			if (tls_cert_slot[i].used) {
+				mbedtls_x509_crt_free(&tls_cert_slot[i].crt);
+				mbedtls_pk_free(&tls_cert_slot[i].key);
+				tls_cert_slot[i].used = false;
+			}
+		tls_cert_act = -1;
+		kfree((void *)tls_crt_path);
+		kfree((void *)tls_key_path);
+		tls_crt_path = tls_key_path = NULL;
+	}
+
+	while (tfw_tls_sni_n) {
+		TfwTlsSniCert *sc = &tfw_tls_sni[--tfw_tls_sni_n];
+
+		mbedtls_x509_crt_free(&sc->crt);
+		if (sc->has_key)
+			mbedtls_pk_free(&sc->key);
+		memset(sc, 0, sizeof(*sc));
+	}
+
+	if (tls_ticket_lifetime)
+		mbedtls_ssl_ticket_free(&tls_ticket_ctx);
+
+	if (tls_ocsp_path && *tls_ocsp_path) {
+		cancel_delayed_work_sync(&tls_ocsp_work);
+		vfree(tls_ocsp.der);
+		tls_ocsp.der = NULL;
+		tls_ocsp.len = 0;
+	}
+
+	if (tls_sess_db) {
+		tdb_close(tls_sess_db);
+		tls_sess_db = NULL;
+	}
 }
 
 /**
@@ -444,19 +1279,28 @@ tfw_tls_cfg_handle_crt(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	void *crt_data;
 	size_t crt_size;
 
-	mbedtls_x509_crt_init(&tfw_tls.crt);
+	if (!tfw_tls.crt.version)
+		mbedtls_x509_crt_init(&tfw_tls.crt);
 
 	if (ce->attr_n) {
 		TFW_ERR_NL("%s: Arguments may not have the \'=\' sign\n",
 			   cs->name);
 		return -EINVAL;
 	}
-	if (ce->val_n != 1) {
+	if (ce->val_n < 1 || ce->val_n > 2) {
 		TFW_ERR_NL("%s: Invalid number of arguments: %d\n",
 			   cs->name, (int)ce->val_n);
 		return -EINVAL;
 	}
 
+	if (ce->val_n == 1) {
+		kfree((void *)tls_crt_path);
+		tls_crt_path = kstrdup(ce->vals[0], GFP_KERNEL);
+	}
+	/* On a reload only the remembered path changes. */
+	if (tfw_cfg_is_reloading())
+		return 0;
+
 	crt_data = tfw_cfg_read_file((const char *)ce->vals[0], &crt_size);
 	if (!crt_data) {
 		TFW_ERR_NL("%s: Can't read certificate file '%s'\n",
@@ -464,9 +1308,31 @@ tfw_tls_cfg_handle_crt(TfwCfgSpec *cs, TfwCfgEntry *ce)
 		return -EINVAL;
 	}
 
-	r = mbedtls_x509_crt_parse(&tfw_tls.crt,
-				   (const unsigned char *)crt_data,
-				   crt_size);
+	if (ce->val_n == 2) {
+		/* An SNI certificate: "ssl_certificate FILE NAME;" */
+		TfwTlsSniCert *sc;
+		size_t nlen = strlen(ce->vals[1]);
+
+		if (tfw_tls_sni_n == TFW_TLS_SNI_MAX
+		    || nlen >= sizeof(sc->name))
+		{
+			TFW_ERR_NL("%s: Too many SNI certificates or too"
+				   " long name\n", cs->name);
+			vfree(crt_data);
+			return -EINVAL;
+		}
+		sc = &tfw_tls_sni[tfw_tls_sni_n++];
+		memcpy(sc->name, ce->vals[1], nlen);
+		sc->name_len = nlen;
+		mbedtls_x509_crt_init(&sc->crt);
+		r = mbedtls_x509_crt_parse(&sc->crt,
+					   (const unsigned char *)crt_data,
+					   crt_size);
+	} else {
+		r = mbedtls_x509_crt_parse(&tfw_tls.crt,
+					   (const unsigned char *)crt_data,
+					   crt_size);
+	}
 	vfree(crt_data);
 
 	if (r) {
@@ -488,19 +1354,27 @@ tfw_tls_cfg_handle_crt_key(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	void *key_data;
 	size_t key_size;
 
-	mbedtls_pk_init(&tfw_tls.key);
+	if (!tfw_tls.key.pk_ctx)
+		mbedtls_pk_init(&tfw_tls.key);
 
 	if (ce->attr_n) {
 		TFW_ERR_NL("%s: Arguments may not have the \'=\' sign\n",
 			   cs->name);
 		return -EINVAL;
 	}
-	if (ce->val_n != 1) {
+	if (ce->val_n < 1 || ce->val_n > 2) {
 		TFW_ERR_NL("%s: Invalid number of arguments: %d\n",
 			   cs->name, (int)ce->val_n);
 		return -EINVAL;
 	}
 
+	if (ce->val_n == 1) {
+		kfree((void *)tls_key_path);
+		tls_key_path = kstrdup(ce->vals[0], GFP_KERNEL);
+	}
+	if (tfw_cfg_is_reloading())
+		return 0;
+
 	key_data = tfw_cfg_read_file((const char *)ce->vals[0], &key_size);
 	if (!key_data) {
 		TFW_ERR_NL("%s: Can't read certificate file '%s'\n",
@@ -508,9 +1382,33 @@ tfw_tls_cfg_handle_crt_key(TfwCfgSpec *cs, TfwCfgEntry *ce)
 		return -EINVAL;
 	}
 
-	r = mbedtls_pk_parse_key(&tfw_tls.key,
-				 (const unsigned char *)key_data,
-				 key_size, NULL, 0);
+	if (ce->val_n == 2) {
+		/* The key of the last SNI certificate with this name. */
+		unsigned int i;
+		size_t nlen = strlen(ce->vals[1]);
+		TfwTlsSniCert *sc = NULL;
+
+		for (i = 0; i < tfw_tls_sni_n; ++i)
+			if (tfw_tls_sni[i].name_len == nlen
+			    && !strncasecmp(tfw_tls_sni[i].name, ce->vals[1],
+					    nlen))
+				sc = &tfw_tls_sni[i];
+		if (!sc) {
+			TFW_ERR_NL("%s: No certificate for SNI name '%s'\n",
+				   cs->name, (const char *)ce->vals[1]);
+			vfree(key_data);
+			return -EINVAL;
+		}
+		mbedtls_pk_init(&sc->key);
+		r = mbedtls_pk_parse_key(&sc->key,
+					 (const unsigned char *)key_data,
+					 key_size, NULL, 0);
+		sc->has_key = !r;
+	} else {
+		r = mbedtls_pk_parse_key(&tfw_tls.key,
+					 (const unsigned char *)key_data,
+					 key_size, NULL, 0);
+	}
 	vfree(key_data);
 
 	if (r) {
@@ -527,13 +1425,73 @@ static TfwCfgSpec tfw_tls_cfg_specs[] = {
 		"ssl_certificate", NULL,
 		tfw_tls_cfg_handle_crt,
 		.allow_none = true,
-		.allow_repeat = false,
+		.allow_repeat = true,
 	},
 	{
 		"ssl_certificate_key", NULL,
 		tfw_tls_cfg_handle_crt_key,
 		.allow_none = true,
-		.allow_repeat = false,
+		.allow_repeat = true,
+	},
+	{
+		"ssl_stapling_file",
+		"",
+		tfw_cfg_set_str,
+		&tls_ocsp_path,
+		&(TfwCfgSpecStr) {
+			.len_range = { 0, PATH_MAX },
+		}
+	},
+	{
+		"ssl_handshakes_max", "0",
+		tfw_cfg_set_int,
+		&tfw_tls_hs_max,
+	},
+	{
+		"ssl_ticket_lifetime",
+		"0",
+		tfw_cfg_set_int,
+		&tls_ticket_lifetime,
+		&(TfwCfgSpecInt) {
+			.range = { 0, 7 * 86400 },
+		}
+	},
+	{
+		"ssl_min_proto",
+		"0",
+		tfw_cfg_set_int,
+		&tls_min_proto,
+		&(TfwCfgSpecInt) {
+			.range = { 0, 2 },
+		}
+	},
+	{
+		"ssl_verify_client",
+		"0",
+		tfw_cfg_set_int,
+		&tls_verify_client,
+		&(TfwCfgSpecInt) {
+			.range = { 0, 2 },
+		}
+	},
+	{
+		"ssl_session_cache_size",
+		"2097152",
+		tfw_cfg_set_int,
+		&tls_sess_cfg.db_size,
+		&(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { 0, (1 << 30) },
+		}
+	},
+	{
+		"ssl_session_cache_db",
+		"/opt/tempesta/db/tls_sess.tdb",
+		tfw_cfg_set_str,
+		&tls_sess_cfg.db_path,
+		&(TfwCfgSpecStr) {
+			.len_range = { 1, PATH_MAX },
+		}
 	},
 	{}
 };
@@ -542,6 +1500,7 @@ TfwCfgMod tfw_tls_cfg_mod = {
 	.name	= "tls",
 	.start	= tfw_tls_cfg_start,
 	.stop	= tfw_tls_cfg_stop,
+	.reconf	= tfw_tls_reconf,
 	.specs	= tfw_tls_cfg_specs,
 };
 
@@ -560,6 +1519,37 @@ tfw_tls_init(void)
 	if (r)
 		return -EINVAL;
 
+	if (tfw_tls_drbg_init()) {
+		tfw_tls_do_cleanup();
+		return -EINVAL;
+	}
+
+	tls_cork_buf = __alloc_percpu(TFW_TLS_CORK_SZ, L1_CACHE_BYTES);
+	if (!tls_cork_buf)
+		TFW_WARN("TLS: no cork buffer, small writes aren't"
+			 " coalesced\n");
+
+	TFW_WQ_CHECKSZ(TfwTlsHsWork);
+	tls_hs_wq = alloc_percpu(TfwTlsHsQueue);
+	if (tls_hs_wq) {
+		int cpu;
+
+		for_each_online_cpu(cpu) {
+			TfwTlsHsQueue *q = per_cpu_ptr(tls_hs_wq, cpu);
+
+			if (tfw_wq_init(&q->wq, cpu_to_node(cpu))) {
+				TFW_WARN("TLS: no handshake queues,"
+					 " handshakes run inline\n");
+				free_percpu(tls_hs_wq);
+				tls_hs_wq = NULL;
+				break;
+			}
+			init_irq_work(&q->ipi_work, tfw_tls_hs_ipi);
+			tasklet_init(&q->tasklet, tfw_tls_hs_tasklet,
+				     (unsigned long)q);
+		}
+	}
+
 	r = tfw_gfsm_register_fsm(TFW_FSM_TLS, tfw_tls_msg_process);
 	if (r) {
 		tfw_tls_do_cleanup();
@@ -574,6 +1564,22 @@ tfw_tls_init(void)
 void
 tfw_tls_exit(void)
 {
+	if (tls_hs_wq) {
+		int cpu;
+
+		for_each_online_cpu(cpu) {
+			TfwTlsHsQueue *q = per_cpu_ptr(tls_hs_wq, cpu);
+
+			tasklet_kill(&q->tasklet);
+			irq_work_sync(&q->ipi_work);
+			tfw_wq_destroy(&q->wq);
+		}
+		free_percpu(tls_hs_wq);
+		tls_hs_wq = NULL;
+	}
+	free_percpu(tls_cork_buf);
+	tls_cork_buf = NULL;
+	tfw_tls_drbg_exit();
 	tfw_connection_hooks_unregister(TFW_FSM_TLS);
 	tfw_gfsm_unregister_fsm(TFW_FSM_TLS);
 	tfw_tls_do_cleanup();
@@ -20,6 +20,8 @@
 #ifndef __TFW_TLS_H__
 #define __TFW_TLS_H__
 
+#include "pool.h"
+
 #include "gfsm.h"
 #include "ttls.h"
 
@@ -45,6 +47,13 @@ enum {
  * @rx_queue	- temporary queue for incoming SKBs;
  * @tx_queue	- temporary queue for outgoing SKBs;
  * @lock	- lock for serializing @ssl context access;
+ * @tx_bytes	- application bytes sent, drives dynamic record sizing;
+ * @pool	- arena backing the per-session library allocations,
+ *		  reclaimed wholesale with the connection;
+ * @hs_counted	- the connection holds a slot in the global in-progress
+ *		  handshake counter;
+ * @hs_resumed	- the handshake in progress is a session resumption,
+ *		  sampled while the handshake params are still alive;
  *
  * TODO: Get rid of @rx_queue and @tx_queue. The queues seem like dirty
  *       workaround to be able to work with mbedTLS w/o reworking its IO and FSM
@@ -61,6 +70,10 @@ typedef struct {
 	SsSkbList		rx_queue;
 	SsSkbList		tx_queue;
 	spinlock_t		lock;
+	unsigned long		tx_bytes;
+	TfwPool			*pool;
+	unsigned char		hs_counted:1;
+	unsigned char		hs_resumed:1;
 } TfwTlsContext;
 
 #endif /* __TFW_TLS_H__ */
@@ -0,0 +1,121 @@
+/**
+ *		Tempesta FW
+ *
+ * Tracepoints along the request processing path. Being static jump
+ * labels, disabled tracepoints cost a single nop in the hot code, yet
+ * perf and ftrace can hook any stage of a request's life with exact
+ * timestamps and no log parsing.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tempesta
+
+#if !defined(__TFW_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __TFW_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+/* A request is fully parsed and enters the processing pipeline. */
+TRACE_EVENT(tfw_req_recv,
+	TP_PROTO(const void *req, unsigned char method, unsigned long hash),
+	TP_ARGS(req, method, hash),
+	TP_STRUCT__entry(
+		__field(const void *, req)
+		__field(unsigned char, method)
+		__field(unsigned long, hash)
+	),
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->method = method;
+		__entry->hash = hash;
+	),
+	TP_printk("req=%p method=%u hash=%#lx",
+		  __entry->req, __entry->method, __entry->hash)
+);
+
+/* The cache served or missed the request. */
+TRACE_EVENT(tfw_cache_lookup,
+	TP_PROTO(const void *req, bool hit),
+	TP_ARGS(req, hit),
+	TP_STRUCT__entry(
+		__field(const void *, req)
+		__field(bool, hit)
+	),
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->hit = hit;
+	),
+	TP_printk("req=%p %s", __entry->req, __entry->hit ? "hit" : "miss")
+);
+
+/* The request is written to a server connection. */
+TRACE_EVENT(tfw_req_fwd,
+	TP_PROTO(const void *req, const void *srv_conn),
+	TP_ARGS(req, srv_conn),
+	TP_STRUCT__entry(
+		__field(const void *, req)
+		__field(const void *, srv_conn)
+	),
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->srv_conn = srv_conn;
+	),
+	TP_printk("req=%p srv_conn=%p", __entry->req, __entry->srv_conn)
+);
+
+/* A response is paired with its request. */
+TRACE_EVENT(tfw_resp_recv,
+	TP_PROTO(const void *req, unsigned short status, unsigned long rtt),
+	TP_ARGS(req, status, rtt),
+	TP_STRUCT__entry(
+		__field(const void *, req)
+		__field(unsigned short, status)
+		__field(unsigned long, rtt)
+	),
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->status = status;
+		__entry->rtt = rtt;
+	),
+	TP_printk("req=%p status=%u rtt=%lums",
+		  __entry->req, __entry->status, __entry->rtt)
+);
+
+/* The response is handed to the client socket. */
+TRACE_EVENT(tfw_resp_fwd,
+	TP_PROTO(const void *req, const void *resp),
+	TP_ARGS(req, resp),
+	TP_STRUCT__entry(
+		__field(const void *, req)
+		__field(const void *, resp)
+	),
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->resp = resp;
+	),
+	TP_printk("req=%p resp=%p", __entry->req, __entry->resp)
+);
+
+#endif /* __TFW_TRACE_H__ */
+
+/* This part must be outside the include guard. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>
@@ -17,12 +17,19 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <asm/fpu/api.h>
+#include <linux/hash.h>
+
 #include "tempesta_fw.h"
+#include "apm.h"
 #include "http.h"
+#include "http_norm.h"
 #include "http_match.h"
 #include "vhost.h"
 #include "str.h"
 
+unsigned long tfw_hash_str(const TfwStr *str);
+
 /* Mappings for match operators. */
 static TfwCfgEnum const __read_mostly tfw_match_enum[] = {
 	{ "*",		TFW_HTTP_MATCH_O_WILDCARD },
@@ -108,6 +115,9 @@ static TfwAddr		tfw_capuacl[TFW_CAPUACL_ARRAY_SZ];
 static char const __read_mostly s_hdr_via_dflt[] =
 	"tempesta_fw" " (" TFW_NAME " " TFW_VERSION ")";
 
+DEFINE_PER_CPU(TfwVhostRes [TFW_VHOST_MAX], tfw_vhost_res);
+EXPORT_PER_CPU_SYMBOL(tfw_vhost_res);
+
 static TfwVhost		tfw_vhost_dflt = {
 	.hdr_via	= s_hdr_via_dflt,
 	.hdr_via_len	= sizeof(s_hdr_via_dflt) - 1,
@@ -288,12 +298,146 @@ tfw_vhost_get_default(void)
 	return &tfw_vhost_dflt;
 }
 
+/**
+ * Expose the configured locations for the statistics export.
+ */
+size_t
+tfw_vhost_locations(TfwLocation **loc)
+{
+	*loc = tfw_location;
+	return tfw_location_sz;
+}
+
+/*
+ * Host name to vhost index. Host names are case-folded and hashed at
+ * configuration time; resolution is a bucket walk guarded by length
+ * and hash compares, so it stays O(1) regardless of how many names
+ * are configured. Wildcard names ("*.example.com") are stored by
+ * their suffix starting at the dot and probed once per label boundary
+ * of the request host, longest suffix first.
+ */
+#define TFW_VHN_HBITS		9
+
+typedef struct {
+	struct hlist_node	hlist;
+	TfwVhost		*vhost;
+	unsigned long		hash;
+	unsigned short		len;
+	unsigned char		wildcard;
+	char			name[0];
+} TfwVhostName;
+
+static struct hlist_head	tfw_vhost_names[1 << TFW_VHN_HBITS];
+static unsigned int		tfw_vhost_names_n;
+/* Hosts are limited to 255 octets (RFC 1035). */
+#define TFW_VHN_MAXLEN		255
+
+static TfwVhostName *
+__vhn_lookup(const char *name, size_t len, bool wildcard)
+{
+	TfwVhostName *vhn;
+	TfwStr str = { .ptr = (void *)name, .len = len };
+	unsigned long hash = tfw_hash_str(&str);
+
+	hlist_for_each_entry(vhn, &tfw_vhost_names[hash_long(hash,
+							     TFW_VHN_HBITS)],
+			     hlist)
+	{
+		if (vhn->hash == hash && vhn->len == len
+		    && vhn->wildcard == wildcard
+		    && !memcmp(vhn->name, name, len))
+			return vhn;
+	}
+	return NULL;
+}
+
+int
+tfw_vhost_add_name(TfwVhost *vhost, const char *name)
+{
+	TfwVhostName *vhn;
+	TfwStr str;
+	bool wildcard = false;
+	size_t len = strlen(name);
+
+	if (name[0] == '*') {
+		/* Store the suffix including the leading dot. */
+		if (name[1] != '.') {
+			TFW_ERR_NL("invalid wildcard host '%s'\n", name);
+			return -EINVAL;
+		}
+		wildcard = true;
+		++name;
+		--len;
+	}
+	if (!len || len > TFW_VHN_MAXLEN) {
+		TFW_ERR_NL("invalid host name length %zu\n", len);
+		return -EINVAL;
+	}
+
+	if (!(vhn = kmalloc(sizeof(*vhn) + len, GFP_KERNEL)))
+		return -ENOMEM;
+
+	str = (TfwStr){ .ptr = vhn->name, .len = len };
+	kernel_fpu_begin();
+	tfw_strtolower(vhn->name, name, len);
+	vhn->hash = tfw_hash_str(&str);
+	kernel_fpu_end();
+	vhn->len = len;
+	vhn->wildcard = wildcard;
+	vhn->vhost = vhost;
+	hlist_add_head(&vhn->hlist,
+		       &tfw_vhost_names[hash_long(vhn->hash, TFW_VHN_HBITS)]);
+	++tfw_vhost_names_n;
+
+	return 0;
+}
+
+static void
+tfw_vhost_del_names(void)
+{
+	int i;
+	TfwVhostName *vhn;
+	struct hlist_node *tmp;
+
+	for (i = 0; i < (1 << TFW_VHN_HBITS); ++i)
+		hlist_for_each_entry_safe(vhn, tmp, &tfw_vhost_names[i],
+					  hlist)
+		{
+			hlist_del(&vhn->hlist);
+			kfree(vhn);
+		}
+	tfw_vhost_names_n = 0;
+}
+
 TfwVhost *
-tfw_vhost_match(TfwStr *arg)
+tfw_vhost_match(TfwStr *host)
 {
-	BUG_ON(!arg);
+	char buf[TFW_VHN_MAXLEN + 1];
+	size_t i, len;
+	TfwVhostName *vhn;
+
+	BUG_ON(!host);
+
+	if (!tfw_vhost_names_n || !host->len || host->len > TFW_VHN_MAXLEN)
+		return &tfw_vhost_dflt;
+
+	len = tfw_str_to_cstr(host, buf, sizeof(buf));
+	tfw_strtolower(buf, buf, len);
+	/* The port, if any, is not part of the name. */
+	for (i = 0; i < len; ++i)
+		if (buf[i] == ':') {
+			len = i;
+			break;
+		}
+
+	if ((vhn = __vhn_lookup(buf, len, false)))
+		return vhn->vhost;
+	/* Probe wildcard suffixes, longest (leftmost dot) first. */
+	for (i = 0; i < len; ++i)
+		if (buf[i] == '.'
+		    && (vhn = __vhn_lookup(buf + i, len - i, true)))
+			return vhn->vhost;
 
-	/* For now there's just the default vhost. */
 	return &tfw_vhost_dflt;
 }
 
@@ -946,21 +1090,171 @@ tfw_vhost_cfg_start(void)
 	BUILD_BUG_ON(sizeof(tfw_location_dflt.op) * 8 - 1
 		     < _TFW_HTTP_MATCH_O_COUNT);
 
+	size_t i;
+
 	if (tfw_vhost_dflt.cache_purge && !tfw_vhost_dflt.cache_purge_acl)
 		TFW_WARN("cache_purge directive works only in combination"
 			 " with cache_purge_acl directive.\n");
 	tfw_vhost_dflt.loc_sz = tfw_location_sz;
 
+	/*
+	 * Response time histograms aggregated per vhost and per
+	 * location, exported through procfs next to the per-server
+	 * statistics.
+	 */
+	INIT_LIST_HEAD(&tfw_vhost_dflt.conc_queue);
+	spin_lock_init(&tfw_vhost_dflt.conc_qlock);
+	atomic_set(&tfw_vhost_dflt.conc_cur, 0);
+
+	if (!(tfw_vhost_dflt.apm = tfw_apm_create()))
+		return -ENOMEM;
+	for (i = 0; i < tfw_location_sz; ++i)
+		if (!(tfw_location[i].apm = tfw_apm_create()))
+			return -ENOMEM;
+
 	return 0;
 }
 
 static void
 tfw_vhost_cfg_stop(void)
 {
+	size_t i;
+
+	tfw_apm_destroy(tfw_vhost_dflt.apm);
+	tfw_vhost_dflt.apm = NULL;
+	for (i = 0; i < tfw_location_sz; ++i) {
+		tfw_apm_destroy(tfw_location[i].apm);
+		tfw_location[i].apm = NULL;
+	}
+
 	__tfw_cleanup_hdrvia();
 	__tfw_cleanup_locache();
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Header transformation programs
+ * ------------------------------------------------------------------------
+ * The req_hdr_set/req_hdr_del and resp_hdr_set/resp_hdr_del directives
+ * are compiled at configuration time into flat per-direction programs
+ * executed by the message adjustment code for every proxied message.
+ */
+#define TFW_HDR_XFRM_MAX	16
+
+static TfwHdrXfrm tfw_hdr_xfrm[2][TFW_HDR_XFRM_MAX];
+static size_t tfw_hdr_xfrm_sz[2];
+
+TfwHdrXfrm *
+tfw_vhost_hdr_xfrm(bool resp, size_t *n)
+{
+	*n = tfw_hdr_xfrm_sz[resp];
+	return tfw_hdr_xfrm[resp];
+}
+
+static int
+tfw_handle_hdr_xfrm(TfwCfgSpec *cs, TfwCfgEntry *ce, bool resp, bool del)
+{
+	TfwHdrXfrm *x;
+
+	if (ce->attr_n || ce->val_n != (del ? 1 : 2)) {
+		TFW_ERR_NL("%s: Expected arguments: NAME%s\n",
+			   cs->name, del ? "" : " VALUE");
+		return -EINVAL;
+	}
+	if (tfw_hdr_xfrm_sz[resp] == TFW_HDR_XFRM_MAX) {
+		TFW_ERR_NL("%s: Too many transformations, max %d\n",
+			   cs->name, TFW_HDR_XFRM_MAX);
+		return -EINVAL;
+	}
+
+	x = &tfw_hdr_xfrm[resp][tfw_hdr_xfrm_sz[resp]];
+	x->n_len = strlen(ce->vals[0]);
+	if (!(x->name = kstrdup(ce->vals[0], GFP_KERNEL)))
+		return -ENOMEM;
+	if (!del) {
+		x->v_len = strlen(ce->vals[1]);
+		if (!(x->val = kstrdup(ce->vals[1], GFP_KERNEL))) {
+			kfree(x->name);
+			x->name = NULL;
+			return -ENOMEM;
+		}
+	} else {
+		x->val = NULL;
+		x->v_len = 0;
+	}
+	++tfw_hdr_xfrm_sz[resp];
+
+	return 0;
+}
+
+static int
+tfw_handle_req_hdr_set(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_handle_hdr_xfrm(cs, ce, false, false);
+}
+
+static int
+tfw_handle_req_hdr_del(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_handle_hdr_xfrm(cs, ce, false, true);
+}
+
+static int
+tfw_handle_resp_hdr_set(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_handle_hdr_xfrm(cs, ce, true, false);
+}
+
+static int
+tfw_handle_resp_hdr_del(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_handle_hdr_xfrm(cs, ce, true, true);
+}
+
+static void
+tfw_cleanup_hdr_xfrm(TfwCfgSpec *cs)
+{
+	int d;
+	size_t i;
+
+	for (d = 0; d < 2; ++d) {
+		for (i = 0; i < tfw_hdr_xfrm_sz[d]; ++i) {
+			kfree(tfw_hdr_xfrm[d][i].name);
+			kfree(tfw_hdr_xfrm[d][i].val);
+		}
+		memset(tfw_hdr_xfrm[d], 0, sizeof(tfw_hdr_xfrm[d]));
+		tfw_hdr_xfrm_sz[d] = 0;
+	}
+}
+
+/**
+ * Handle 'cache_quota' directive: bytes of cache the vhost may occupy.
+ */
+static int
+tfw_handle_cache_quota(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	unsigned long quota;
+
+	if (ce->attr_n) {
+		TFW_ERR_NL("%s: Arguments may not have the \'=\' sign\n",
+			   cs->name);
+		return -EINVAL;
+	}
+	if (ce->val_n != 1) {
+		TFW_ERR_NL("%s: Invalid number of arguments: %d\n",
+			   cs->name, (int)ce->val_n);
+		return -EINVAL;
+	}
+	if (kstrtoul(ce->vals[0], 10, &quota)) {
+		TFW_ERR_NL("%s: Invalid value: '%s'\n",
+			   cs->name, (const char *)ce->vals[0]);
+		return -EINVAL;
+	}
+	tfw_vhost_dflt.cache_quota = quota;
+
+	return 0;
+}
+
 static TfwCfgSpec tfw_location_specs[] = {
 	{
 		"cache_bypass", NULL,
@@ -986,7 +1280,43 @@ static TfwCfgSpec tfw_location_specs[] = {
 	{ 0 }
 };
 
+static int
+tfw_handle_server_names(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i, r;
+	const char *val;
+
+	if (ce->attr_n) {
+		TFW_ERR_NL("%s: Arguments may not have the \'=\' sign\n",
+			   cs->name);
+		return -EINVAL;
+	}
+	if (!ce->val_n) {
+		TFW_ERR_NL("%s: At least one host name is required\n",
+			   cs->name);
+		return -EINVAL;
+	}
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val)
+		if ((r = tfw_vhost_add_name(&tfw_vhost_dflt, val)))
+			return r;
+
+	return 0;
+}
+
+static void
+tfw_cleanup_server_names(TfwCfgSpec *cs)
+{
+	tfw_vhost_del_names();
+}
+
 static TfwCfgSpec tfw_vhost_cfg_specs[] = {
+	{
+		"server_names", NULL,
+		tfw_handle_server_names,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cleanup_server_names
+	},
 	{
 		"hdr_via", NULL,
 		tfw_handle_hdr_via,
@@ -994,6 +1324,59 @@ static TfwCfgSpec tfw_vhost_cfg_specs[] = {
 		.allow_repeat = false,
 		.cleanup = tfw_cleanup_hdrvia
 	},
+	{
+		"latency_trace",
+		"0",
+		tfw_cfg_set_int,
+		&tfw_http_latency_trace_ms,
+	},
+	{
+		"concurrency_limit",
+		"0",
+		tfw_cfg_set_int,
+		&tfw_vhost_dflt.conc_limit,
+	},
+	{
+		"cache_quota",
+		NULL,
+		tfw_handle_cache_quota,
+		.allow_none = true,
+		.allow_repeat = false,
+	},
+	{
+		"http_uri_normalize",
+		"false",
+		tfw_cfg_set_bool,
+		&tfw_http_norm_uri_on,
+	},
+	{
+		"req_hdr_set", NULL,
+		tfw_handle_req_hdr_set,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cleanup_hdr_xfrm,
+	},
+	{
+		"req_hdr_del", NULL,
+		tfw_handle_req_hdr_del,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cleanup_hdr_xfrm,
+	},
+	{
+		"resp_hdr_set", NULL,
+		tfw_handle_resp_hdr_set,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cleanup_hdr_xfrm,
+	},
+	{
+		"resp_hdr_del", NULL,
+		tfw_handle_resp_hdr_del,
+		.allow_none = true,
+		.allow_repeat = true,
+		.cleanup = tfw_cleanup_hdr_xfrm,
+	},
 	{
 		"cache_purge",
 		NULL,
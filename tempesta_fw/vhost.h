@@ -78,6 +78,7 @@ typedef struct {
 	size_t		nipdef_sz;
 	TfwCaPolicy	**capo;
 	TfwNipDef	**nipdef;
+	void		*apm;
 } TfwLocation;
 
 /* Cache purge configuration modes. */
@@ -91,6 +92,11 @@ enum {
  * @loc_dflt	- Group of default policies.
  * @loc_sz	- Size of @loc array.
  * @loc_dflt_sz	- Size of @loc_dflt.
+ * @cache_quota	- bytes of cache the vhost may occupy, 0 - unlimited;
+ * @conc_limit	- maximum concurrent requests in flight to backends,
+ *		  0 - unlimited; excess requests queue on @conc_queue;
+ * @idx		- dense vhost index for per-vhost accounting arrays;
+ * @apm		- response time statistics aggregated over the vhost.
  */
 typedef struct {
 	TfwLocation	*loc;
@@ -101,16 +107,70 @@ typedef struct {
 	size_t		loc_dflt_sz;
 	size_t		capuacl_sz;
 	size_t		hdr_via_len;
+	unsigned long	cache_quota;
+	unsigned int	conc_limit;
+	atomic_t	conc_cur;
+	struct list_head conc_queue;
+	spinlock_t	conc_qlock;
+	unsigned short	idx;
+	void		*apm;
 	u8		cache_purge:1;
 	u8		cache_purge_mode:2;
 	u8		cache_purge_acl:1;
 } TfwVhost;
 
+/* Upper bound for per-vhost accounting arrays. */
+#define TFW_VHOST_MAX	16
+
+/*
+ * Per-vhost resource usage, accumulated per CPU and folded by the
+ * telemetry reader: CPU cycles spent processing the tenant's
+ * messages, bytes received and sent, and messages seen. The cycle
+ * deltas are taken around the HTTP processing calls once the vhost
+ * is resolved, so per-tenant cost attribution doesn't need a
+ * tcpdump investigation.
+ */
+typedef struct {
+	u64	cycles;
+	u64	rx_bytes;
+	u64	tx_bytes;
+	u64	msgs;
+} TfwVhostRes;
+
+DECLARE_PER_CPU(TfwVhostRes [TFW_VHOST_MAX], tfw_vhost_res);
+
+static inline void
+tfw_vhost_acct(TfwVhost *vh, u64 cycles, u64 rx, u64 tx)
+{
+	TfwVhostRes *r = this_cpu_ptr(tfw_vhost_res)
+			 + (vh ? vh->idx : 0);
+
+	r->cycles += cycles;
+	r->rx_bytes += rx;
+	r->tx_bytes += tx;
+	r->msgs += !!rx;
+}
+
 TfwNipDef *tfw_nipdef_match(TfwLocation *loc, unsigned char meth, TfwStr *arg);
 bool tfw_capuacl_match(TfwVhost *vhost, TfwAddr *addr);
 TfwCaPolicy *tfw_capolicy_match(TfwLocation *loc, TfwStr *arg);
 TfwLocation *tfw_location_match(TfwVhost *vhost, TfwStr *arg);
-TfwVhost *tfw_vhost_match(TfwStr *arg);
+TfwVhost *tfw_vhost_match(TfwStr *host);
+int tfw_vhost_add_name(TfwVhost *vhost, const char *name);
 TfwVhost *tfw_vhost_get_default(void);
+size_t tfw_vhost_locations(TfwLocation **loc);
+
+/*
+ * A precompiled header transformation: set (replace or add) the header
+ * to the given value, or delete it when @val is NULL.
+ */
+typedef struct {
+	char		*name;
+	char		*val;
+	unsigned int	n_len;
+	unsigned int	v_len;
+} TfwHdrXfrm;
+
+TfwHdrXfrm *tfw_vhost_hdr_xfrm(bool resp, size_t *n);
 
 #endif /* __TFW_VHOST_H__ */
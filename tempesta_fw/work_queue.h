@@ -48,7 +48,13 @@ typedef struct {
 int tfw_wq_init(TfwRBQueue *wq, int node);
 void tfw_wq_destroy(TfwRBQueue *wq);
 int __tfw_wq_push(TfwRBQueue *wq, void *ptr, bool sync);
-int tfw_wq_pop(TfwRBQueue *wq, void *buf);
+int tfw_wq_pop_n(TfwRBQueue *wq, void *buf, int n);
+
+static inline int
+tfw_wq_pop(TfwRBQueue *wq, void *buf)
+{
+	return tfw_wq_pop_n(wq, buf, 1) == 1 ? 0 : -EBUSY;
+}
 
 static inline int
 tfw_wq_push(TfwRBQueue *q, void *ptr, int cpu, struct irq_work *work,
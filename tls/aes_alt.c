@@ -0,0 +1,202 @@
+/**
+ *		Tempesta TLS
+ *
+ * AES via the Linux Crypto API, see aes_alt.h.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_AES_ALT)
+
+#include "aes.h"
+
+void
+mbedtls_aes_init(mbedtls_aes_context *ctx)
+{
+    ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+    if (IS_ERR(ctx->tfm))
+        ctx->tfm = NULL;
+}
+
+void
+mbedtls_aes_free(mbedtls_aes_context *ctx)
+{
+    if (ctx && ctx->tfm)
+        crypto_free_cipher(ctx->tfm);
+}
+
+static int
+aes_alt_setkey(mbedtls_aes_context *ctx, const unsigned char *key,
+               unsigned int keybits)
+{
+    if (!ctx->tfm)
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    if (crypto_cipher_setkey(ctx->tfm, key, keybits / 8))
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    return 0;
+}
+
+int
+mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key,
+                       unsigned int keybits)
+{
+    return aes_alt_setkey(ctx, key, keybits);
+}
+
+int
+mbedtls_aes_setkey_dec(mbedtls_aes_context *ctx, const unsigned char *key,
+                       unsigned int keybits)
+{
+    return aes_alt_setkey(ctx, key, keybits);
+}
+
+int
+mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx, int mode,
+                      const unsigned char input[16],
+                      unsigned char output[16])
+{
+    if (!ctx->tfm)
+        return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+    if (mode == MBEDTLS_AES_ENCRYPT)
+        crypto_cipher_encrypt_one(ctx->tfm, output, input);
+    else
+        crypto_cipher_decrypt_one(ctx->tfm, output, input);
+    return 0;
+}
+
+#if defined(MBEDTLS_CIPHER_MODE_CBC)
+int
+mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx, int mode, size_t length,
+                      unsigned char iv[16], const unsigned char *input,
+                      unsigned char *output)
+{
+    int i;
+    unsigned char temp[16];
+
+    if (length % 16)
+        return MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH;
+
+    if (mode == MBEDTLS_AES_DECRYPT) {
+        while (length > 0) {
+            memcpy(temp, input, 16);
+            mbedtls_aes_crypt_ecb(ctx, mode, input, output);
+            for (i = 0; i < 16; i++)
+                output[i] = (unsigned char)(output[i] ^ iv[i]);
+            memcpy(iv, temp, 16);
+            input += 16;
+            output += 16;
+            length -= 16;
+        }
+    } else {
+        while (length > 0) {
+            for (i = 0; i < 16; i++)
+                output[i] = (unsigned char)(input[i] ^ iv[i]);
+            mbedtls_aes_crypt_ecb(ctx, mode, output, output);
+            memcpy(iv, output, 16);
+            input += 16;
+            output += 16;
+            length -= 16;
+        }
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CBC */
+
+#if defined(MBEDTLS_CIPHER_MODE_CFB)
+int
+mbedtls_aes_crypt_cfb128(mbedtls_aes_context *ctx, int mode, size_t length,
+                         size_t *iv_off, unsigned char iv[16],
+                         const unsigned char *input, unsigned char *output)
+{
+    int c;
+    size_t n = *iv_off;
+
+    while (length--) {
+        if (n == 0)
+            mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT, iv, iv);
+        if (mode == MBEDTLS_AES_DECRYPT) {
+            c = *input++;
+            *output++ = (unsigned char)(c ^ iv[n]);
+            iv[n] = (unsigned char)c;
+        } else {
+            iv[n] = *output++ = (unsigned char)(iv[n] ^ *input++);
+        }
+        n = (n + 1) & 0x0F;
+    }
+    *iv_off = n;
+
+    return 0;
+}
+
+int
+mbedtls_aes_crypt_cfb8(mbedtls_aes_context *ctx, int mode, size_t length,
+                       unsigned char iv[16], const unsigned char *input,
+                       unsigned char *output)
+{
+    unsigned char c;
+    unsigned char ov[17];
+
+    while (length--) {
+        memcpy(ov, iv, 16);
+        mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT, iv, iv);
+        if (mode == MBEDTLS_AES_DECRYPT)
+            ov[16] = *input;
+        c = *output++ = (unsigned char)(iv[0] ^ *input++);
+        if (mode == MBEDTLS_AES_ENCRYPT)
+            ov[16] = c;
+        memcpy(iv, ov + 1, 16);
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CFB */
+
+#if defined(MBEDTLS_CIPHER_MODE_CTR)
+int
+mbedtls_aes_crypt_ctr(mbedtls_aes_context *ctx, size_t length,
+                      size_t *nc_off, unsigned char nonce_counter[16],
+                      unsigned char stream_block[16],
+                      const unsigned char *input, unsigned char *output)
+{
+    int c, i;
+    size_t n = *nc_off;
+
+    while (length--) {
+        if (n == 0) {
+            mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT, nonce_counter,
+                                  stream_block);
+            for (i = 16; i > 0; i--)
+                if (++nonce_counter[i - 1] != 0)
+                    break;
+        }
+        c = *input++;
+        *output++ = (unsigned char)(c ^ stream_block[n]);
+        n = (n + 1) & 0x0F;
+    }
+    *nc_off = n;
+
+    return 0;
+}
+#endif /* MBEDTLS_CIPHER_MODE_CTR */
+
+#endif /* MBEDTLS_AES_ALT */
@@ -0,0 +1,41 @@
+/**
+ *		Tempesta TLS
+ *
+ * AES via the Linux Crypto API - the hardware offload hook.
+ *
+ * When MBEDTLS_AES_ALT is enabled in config.h, the built-in AES
+ * implementation is replaced by a thin bridge to the kernel crypto
+ * API, which transparently routes the block operations to a hardware
+ * accelerator driver (QAT, CAAM, CESA etc.) when one is available.
+ * On plain x86-64 the built-in AES-NI path is faster than the bridge,
+ * so the option is off by default.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef MBEDTLS_AES_ALT_H
+#define MBEDTLS_AES_ALT_H
+
+#include <linux/crypto.h>
+
+/**
+ * AES context backed by a kernel crypto transform.
+ */
+typedef struct {
+    struct crypto_cipher *tfm;
+} mbedtls_aes_context;
+
+#endif /* MBEDTLS_AES_ALT_H */
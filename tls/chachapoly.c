@@ -0,0 +1,138 @@
+/**
+ *		Tempesta TLS
+ *
+ * ChaCha20-Poly1305 AEAD over the Linux Crypto API, see chachapoly.h.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/scatterlist.h>
+
+#include "chachapoly.h"
+#include "ssl.h" /* for error codes */
+
+int
+mbedtls_chachapoly_init(mbedtls_chachapoly_context *ctx)
+{
+    /* The kernel picks the vectorized implementation when available. */
+    ctx->tfm = crypto_alloc_aead("rfc7539(chacha20,poly1305)", 0, 0);
+    if (IS_ERR(ctx->tfm)) {
+        ctx->tfm = NULL;
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+    crypto_aead_setauthsize(ctx->tfm, MBEDTLS_CHACHAPOLY_TAG_LEN);
+
+    return 0;
+}
+
+void
+mbedtls_chachapoly_free(mbedtls_chachapoly_context *ctx)
+{
+    if (ctx && ctx->tfm) {
+        crypto_free_aead(ctx->tfm);
+        ctx->tfm = NULL;
+    }
+}
+
+int
+mbedtls_chachapoly_setkey(mbedtls_chachapoly_context *ctx,
+                          const unsigned char *key)
+{
+    if (!ctx->tfm)
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    if (crypto_aead_setkey(ctx->tfm, key, MBEDTLS_CHACHAPOLY_KEY_LEN))
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+
+    return 0;
+}
+
+/*
+ * The buffers of the record layer are contiguous, so a small on-stack
+ * scatterlist covers aad + text + tag. The rfc7539 template expects
+ * the nonce as the request IV.
+ */
+static int
+chachapoly_crypt(mbedtls_chachapoly_context *ctx, bool enc, size_t length,
+                 const unsigned char *nonce, const unsigned char *aad,
+                 size_t aad_len, const unsigned char *src,
+                 unsigned char *dst, unsigned char *tag)
+{
+    struct scatterlist sg_in[3], sg_out[3];
+    struct aead_request *req;
+    int r;
+
+    if (!ctx->tfm)
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+
+    req = aead_request_alloc(ctx->tfm, GFP_ATOMIC);
+    if (!req)
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+
+    sg_init_table(sg_in, 3);
+    sg_set_buf(&sg_in[0], aad, aad_len);
+    sg_set_buf(&sg_in[1], src, length);
+    sg_init_table(sg_out, 3);
+    sg_set_buf(&sg_out[0], aad, aad_len);
+    sg_set_buf(&sg_out[1], dst, length);
+    if (enc) {
+        sg_set_buf(&sg_in[2], tag, MBEDTLS_CHACHAPOLY_TAG_LEN);
+        sg_set_buf(&sg_out[2], tag, MBEDTLS_CHACHAPOLY_TAG_LEN);
+    } else {
+        sg_set_buf(&sg_in[2], tag, MBEDTLS_CHACHAPOLY_TAG_LEN);
+        sg_set_buf(&sg_out[2], tag, MBEDTLS_CHACHAPOLY_TAG_LEN);
+    }
+
+    aead_request_set_callback(req, 0, NULL, NULL);
+    aead_request_set_ad(req, aad_len);
+    aead_request_set_crypt(req, sg_in, sg_out,
+                           enc ? length
+                               : length + MBEDTLS_CHACHAPOLY_TAG_LEN,
+                           (u8 *)nonce);
+
+    r = enc ? crypto_aead_encrypt(req) : crypto_aead_decrypt(req);
+    aead_request_free(req);
+
+    if (r)
+        return enc ? MBEDTLS_ERR_SSL_INTERNAL_ERROR
+                   : MBEDTLS_ERR_SSL_INVALID_MAC;
+
+    return 0;
+}
+
+int
+mbedtls_chachapoly_encrypt_and_tag(mbedtls_chachapoly_context *ctx,
+                                   size_t length,
+                                   const unsigned char *nonce,
+                                   const unsigned char *aad, size_t aad_len,
+                                   const unsigned char *input,
+                                   unsigned char *output, unsigned char *tag)
+{
+    return chachapoly_crypt(ctx, true, length, nonce, aad, aad_len,
+                            input, output, tag);
+}
+
+int
+mbedtls_chachapoly_auth_decrypt(mbedtls_chachapoly_context *ctx,
+                                size_t length,
+                                const unsigned char *nonce,
+                                const unsigned char *aad, size_t aad_len,
+                                const unsigned char *tag,
+                                const unsigned char *input,
+                                unsigned char *output)
+{
+    return chachapoly_crypt(ctx, false, length, nonce, aad, aad_len,
+                            input, output, (unsigned char *)tag);
+}
@@ -0,0 +1,63 @@
+/**
+ *		Tempesta TLS
+ *
+ * ChaCha20-Poly1305 AEAD (RFC 7539) over the Linux Crypto API.
+ *
+ * The kernel ships vectorized (SSSE3/AVX2) ChaCha20 and Poly1305
+ * implementations; this wrapper exposes them with an mbed TLS flavored
+ * interface for the RFC 7905 cipher suites. The record layer of the
+ * bundled library still lacks the short-IV AEAD handling those suites
+ * need, so the suite registration follows with the record layer
+ * update; the primitive is complete and usable on its own.
+ *
+ * Copyright (C) 2017 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef MBEDTLS_CHACHAPOLY_H
+#define MBEDTLS_CHACHAPOLY_H
+
+#include <linux/crypto.h>
+
+#define MBEDTLS_CHACHAPOLY_KEY_LEN	32
+#define MBEDTLS_CHACHAPOLY_NONCE_LEN	12
+#define MBEDTLS_CHACHAPOLY_TAG_LEN	16
+
+typedef struct {
+    struct crypto_aead *tfm;
+} mbedtls_chachapoly_context;
+
+int mbedtls_chachapoly_init(mbedtls_chachapoly_context *ctx);
+void mbedtls_chachapoly_free(mbedtls_chachapoly_context *ctx);
+int mbedtls_chachapoly_setkey(mbedtls_chachapoly_context *ctx,
+                              const unsigned char *key);
+int mbedtls_chachapoly_encrypt_and_tag(mbedtls_chachapoly_context *ctx,
+                                       size_t length,
+                                       const unsigned char *nonce,
+                                       const unsigned char *aad,
+                                       size_t aad_len,
+                                       const unsigned char *input,
+                                       unsigned char *output,
+                                       unsigned char *tag);
+int mbedtls_chachapoly_auth_decrypt(mbedtls_chachapoly_context *ctx,
+                                    size_t length,
+                                    const unsigned char *nonce,
+                                    const unsigned char *aad,
+                                    size_t aad_len,
+                                    const unsigned char *tag,
+                                    const unsigned char *input,
+                                    unsigned char *output);
+
+#endif /* MBEDTLS_CHACHAPOLY_H */
@@ -311,6 +311,7 @@
 #define MBEDTLS_SSL_HS_CERTIFICATE_REQUEST     13
 #define MBEDTLS_SSL_HS_SERVER_HELLO_DONE       14
 #define MBEDTLS_SSL_HS_CERTIFICATE_VERIFY      15
+#define MBEDTLS_SSL_HS_CERTIFICATE_STATUS      22
 #define MBEDTLS_SSL_HS_CLIENT_KEY_EXCHANGE     16
 #define MBEDTLS_SSL_HS_FINISHED                20
 
@@ -323,6 +324,7 @@
 #define MBEDTLS_TLS_EXT_MAX_FRAGMENT_LENGTH          1
 
 #define MBEDTLS_TLS_EXT_TRUNCATED_HMAC               4
+#define MBEDTLS_TLS_EXT_STATUS_REQUEST               5
 
 #define MBEDTLS_TLS_EXT_SUPPORTED_ELLIPTIC_CURVES   10
 #define MBEDTLS_TLS_EXT_SUPPORTED_POINT_FORMATS     11
@@ -616,6 +618,12 @@ struct mbedtls_ssl_config
     void *p_vrfy;                   /*!< context for X.509 verify calllback */
 #endif
 
+#if defined(MBEDTLS_SSL_SRV_C)
+    /** Callback to copy the stapled OCSP response into the output buffer   */
+    int (*f_ocsp)(void *, unsigned char *, size_t, size_t *);
+    void *p_ocsp;                   /*!< context for the OCSP callback      */
+#endif
+
 #if defined(MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED)
     /** Callback to retrieve PSK key from identity                          */
     int (*f_psk)(void *, mbedtls_ssl_context *, const unsigned char *, size_t);
@@ -771,6 +779,10 @@ struct mbedtls_ssl_context
     int major_ver;              /*!< equal to  MBEDTLS_SSL_MAJOR_VERSION_3    */
     int minor_ver;              /*!< either 0 (SSL3) or 1 (TLS1.0)    */
 
+    uint32_t cli_fingerprint;   /*!< JA3-class hash of the ClientHello
+                                     (version, cipher suites, extensions,
+                                     curves, point formats), server side only */
+
 #if defined(MBEDTLS_SSL_DTLS_BADMAC_LIMIT)
     unsigned badmac_seen;       /*!< records with a bad MAC received    */
 #endif
@@ -1615,6 +1627,41 @@ void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
 int mbedtls_ssl_conf_own_cert( mbedtls_ssl_config *conf,
                               mbedtls_x509_crt *own_cert,
                               mbedtls_pk_context *pk_key );
+
+/**
+ * \brief          Replace the configuration's certificate list with a
+ *                 single new certificate/key pair. Unlike
+ *                 \c mbedtls_ssl_conf_own_cert(), which appends to the
+ *                 list, this publishes the new pair as the whole list so
+ *                 that new handshakes select it.
+ *
+ * \note           The displaced list is returned through \p old_head
+ *                 and must be released with \c mbedtls_ssl_key_cert_free()
+ *                 by the caller, but only once no handshake started
+ *                 against the old list can still be running - in-flight
+ *                 handshakes keep using the displaced nodes.
+ *
+ * \param conf     SSL configuration
+ * \param own_cert own public certificate chain
+ * \param pk_key   own private key
+ * \param old_head the displaced certificate list head (may be NULL)
+ *
+ * \return         0 on success or MBEDTLS_ERR_SSL_ALLOC_FAILED
+ */
+int mbedtls_ssl_conf_own_cert_replace( mbedtls_ssl_config *conf,
+                                       mbedtls_x509_crt *own_cert,
+                                       mbedtls_pk_context *pk_key,
+                                       mbedtls_ssl_key_cert **old_head );
+
+/**
+ * \brief          Free certificate list nodes displaced by
+ *                 \c mbedtls_ssl_conf_own_cert_replace(). Only the list
+ *                 nodes are freed; the certificates and keys they
+ *                 reference are owned by the caller.
+ *
+ * \param head     displaced list head (may be NULL)
+ */
+void mbedtls_ssl_key_cert_free( mbedtls_ssl_key_cert *head );
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_KEY_EXCHANGE__SOME__PSK_ENABLED)
@@ -1871,6 +1918,30 @@ void mbedtls_ssl_conf_sni( mbedtls_ssl_config *conf,
                   void *p_sni );
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
 
+#if defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Set the OCSP staple callback (server-side only, RFC 6066
+ *                 status_request).
+ *
+ *                 If set and the client offered the status_request
+ *                 extension, the server echoes the extension in its
+ *                 ServerHello and sends a CertificateStatus handshake
+ *                 message whose body the callback provides.
+ *
+ *                 The callback writes a DER-encoded OCSPResponse into the
+ *                 supplied buffer and returns 0, or non-zero when no
+ *                 response is currently available, in which case no
+ *                 CertificateStatus message is sent.
+ *
+ * \param conf     SSL configuration
+ * \param f_ocsp   OCSP response copy function
+ * \param p_ocsp   context for the callback
+ */
+void mbedtls_ssl_conf_ocsp( mbedtls_ssl_config *conf,
+                  int (*f_ocsp)(void *, unsigned char *, size_t, size_t *),
+                  void *p_ocsp );
+#endif /* MBEDTLS_SSL_SRV_C */
+
 #if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
 /**
  * \brief          Set the EC J-PAKE password for current handshake.
@@ -155,6 +155,7 @@
  */
 #define MBEDTLS_TLS_EXT_SUPPORTED_POINT_FORMATS_PRESENT (1 << 0)
 #define MBEDTLS_TLS_EXT_ECJPAKE_KKPP_OK                 (1 << 1)
+#define MBEDTLS_TLS_EXT_STATUS_REQUEST_PRESENT          (1 << 2)
 
 #ifdef __cplusplus
 extern "C" {
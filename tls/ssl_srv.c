@@ -237,6 +237,22 @@ have_sig_alg:
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 &&
           MBEDTLS_KEY_EXCHANGE__WITH_CERT__ENABLED */
 
+/*
+ * JA3-class fingerprint of the ClientHello: an FNV-1a hash over the
+ * protocol version, the offered cipher suites, the extension ids and
+ * the supported curves and point formats, in wire order. Bots rotate
+ * IPs but rarely TLS stacks, so the value gives the upper layers a
+ * client identity that survives IP churn.
+ */
+static void ssl_fp_mix( mbedtls_ssl_context *ssl, unsigned int v )
+{
+    uint32_t fp = ssl->cli_fingerprint;
+
+    fp = ( fp ^ ( v        & 0xff ) ) * 16777619u;
+    fp = ( fp ^ ( ( v >> 8 ) & 0xff ) ) * 16777619u;
+    ssl->cli_fingerprint = fp;
+}
+
 #if defined(MBEDTLS_ECDH_C) || defined(MBEDTLS_ECDSA_C) || \
     defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
 static int ssl_parse_supported_elliptic_curves( mbedtls_ssl_context *ssl,
@@ -276,6 +292,7 @@ static int ssl_parse_supported_elliptic_curves( mbedtls_ssl_context *ssl,
     p = buf + 2;
     while( list_size > 0 && our_size > 1 )
     {
+        ssl_fp_mix( ssl, ( p[0] << 8 ) | p[1] );
         curve_info = mbedtls_ecp_curve_info_from_tls_id( ( p[0] << 8 ) | p[1] );
 
         if( curve_info != NULL )
@@ -308,6 +325,7 @@ static int ssl_parse_supported_point_formats( mbedtls_ssl_context *ssl,
     p = buf + 1;
     while( list_size > 0 )
     {
+        ssl_fp_mix( ssl, p[0] );
         if( p[0] == MBEDTLS_ECP_PF_UNCOMPRESSED ||
             p[0] == MBEDTLS_ECP_PF_COMPRESSED )
         {
@@ -394,6 +412,31 @@ static int ssl_parse_truncated_hmac_ext( mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_SSL_TRUNCATED_HMAC */
 
+static int ssl_parse_status_request_ext( mbedtls_ssl_context *ssl,
+                                         const unsigned char *buf,
+                                         size_t len )
+{
+    /*
+     * RFC 6066 8:
+     *     CertificateStatusType status_type = ocsp(1)
+     *     ResponderID responder_id_list<0..2^16-1>
+     *     Extensions  request_extensions
+     * Only the ocsp status type is defined; the responder list and
+     * request extensions are legitimately ignored by a server that
+     * staples its own response.
+     */
+    if( len == 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "bad client hello message" ) );
+        return( MBEDTLS_ERR_SSL_BAD_HS_CLIENT_HELLO );
+    }
+
+    if( buf[0] == 1 /* ocsp */ )
+        ssl->handshake->cli_exts |= MBEDTLS_TLS_EXT_STATUS_REQUEST_PRESENT;
+
+    return( 0 );
+}
+
 #if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
 static int ssl_parse_encrypt_then_mac_ext( mbedtls_ssl_context *ssl,
                                       const unsigned char *buf,
@@ -1348,6 +1391,9 @@ read_record_header:
     mbedtls_ssl_read_version( &ssl->major_ver, &ssl->minor_ver,
                       ssl->conf->transport, buf );
 
+    ssl->cli_fingerprint = 2166136261u;
+    ssl_fp_mix( ssl, ( ssl->major_ver << 8 ) | ssl->minor_ver );
+
     ssl->handshake->max_major_ver = ssl->major_ver;
     ssl->handshake->max_minor_ver = ssl->minor_ver;
 
@@ -1474,6 +1520,9 @@ read_record_header:
     MBEDTLS_SSL_DEBUG_BUF( 3, "client hello, ciphersuitelist",
                    buf + ciph_offset + 2,  ciph_len );
 
+    for( i = 0, p = buf + ciph_offset + 2; i < ciph_len; i += 2, p += 2 )
+        ssl_fp_mix( ssl, ( p[0] << 8 ) | p[1] );
+
     /*
      * Check the compression algorithms length and pick one
      */
@@ -1555,6 +1604,7 @@ read_record_header:
                 MBEDTLS_SSL_DEBUG_MSG( 1, ( "bad client hello message" ) );
                 return( MBEDTLS_ERR_SSL_BAD_HS_CLIENT_HELLO );
             }
+            ssl_fp_mix( ssl, ext_id );
             switch( ext_id )
             {
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
@@ -1647,6 +1697,14 @@ read_record_header:
                 break;
 #endif /* MBEDTLS_SSL_TRUNCATED_HMAC */
 
+            case MBEDTLS_TLS_EXT_STATUS_REQUEST:
+                MBEDTLS_SSL_DEBUG_MSG( 3, ( "found status request extension" ) );
+
+                ret = ssl_parse_status_request_ext( ssl, ext + 4, ext_size );
+                if( ret != 0 )
+                    return( ret );
+                break;
+
 #if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
             case MBEDTLS_TLS_EXT_ENCRYPT_THEN_MAC:
                 MBEDTLS_SSL_DEBUG_MSG( 3, ( "found encrypt then mac extension" ) );
@@ -1885,6 +1943,37 @@ static void ssl_write_truncated_hmac_ext( mbedtls_ssl_context *ssl,
 #endif /* MBEDTLS_SSL_TRUNCATED_HMAC */
 
 #if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+static void ssl_write_status_request_ext( mbedtls_ssl_context *ssl,
+                                          unsigned char *buf,
+                                          size_t *olen )
+{
+    unsigned char *p = buf;
+
+    /*
+     * Echo an empty status_request only when a CertificateStatus
+     * message will actually follow the Certificate, see
+     * ssl_write_certificate_status().
+     */
+    if( ( ssl->handshake->cli_exts &
+          MBEDTLS_TLS_EXT_STATUS_REQUEST_PRESENT ) == 0 ||
+        ssl->conf->f_ocsp == NULL ||
+        ssl->handshake->resume != 0 )
+    {
+        *olen = 0;
+        return;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "server hello, adding status request extension" ) );
+
+    *p++ = (unsigned char)( ( MBEDTLS_TLS_EXT_STATUS_REQUEST >> 8 ) & 0xFF );
+    *p++ = (unsigned char)( ( MBEDTLS_TLS_EXT_STATUS_REQUEST      ) & 0xFF );
+
+    *p++ = 0x00;
+    *p++ = 0x00;
+
+    *olen = 4;
+}
+
 static void ssl_write_encrypt_then_mac_ext( mbedtls_ssl_context *ssl,
                                             unsigned char *buf,
                                             size_t *olen )
@@ -2396,6 +2485,9 @@ static int ssl_write_server_hello( mbedtls_ssl_context *ssl )
     ext_len += olen;
 #endif
 
+    ssl_write_status_request_ext( ssl, p + 2 + ext_len, &olen );
+    ext_len += olen;
+
 #if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
     ssl_write_encrypt_then_mac_ext( ssl, p + 2 + ext_len, &olen );
     ext_len += olen;
@@ -3775,6 +3867,62 @@ static int ssl_write_new_session_ticket( mbedtls_ssl_context *ssl )
 /*
  * SSL handshake -- server side -- single step
  */
+/*
+ * RFC 6066 8: CertificateStatus, sent between Certificate and
+ * ServerKeyExchange when the client asked for a staple via the
+ * status_request extension and the OCSP callback has a response:
+ *
+ *     struct {
+ *         CertificateStatusType status_type = ocsp(1);
+ *         OCSPResponse response<1..2^24-1>;
+ *     } CertificateStatus;
+ *
+ * Sharing the SERVER_CERTIFICATE state with the Certificate flight
+ * avoids renumbering the state enum the client side steps through.
+ */
+static int ssl_write_certificate_status( mbedtls_ssl_context *ssl )
+{
+    int ret;
+    size_t olen = 0;
+
+    if( ( ssl->handshake->cli_exts &
+          MBEDTLS_TLS_EXT_STATUS_REQUEST_PRESENT ) == 0 ||
+        ssl->conf->f_ocsp == NULL )
+        return( 0 );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> write certificate status" ) );
+
+    if( ssl->conf->f_ocsp( ssl->conf->p_ocsp, ssl->out_msg + 8,
+                           MBEDTLS_SSL_MAX_CONTENT_LEN - 8, &olen ) != 0 ||
+        olen == 0 )
+    {
+        /* The ServerHello promised a staple; an expired or missing
+         * response downgrades to no message, which clients treat as
+         * "no staple available". */
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= skip write certificate status" ) );
+        return( 0 );
+    }
+
+    ssl->out_msg[4] = 1; /* status_type: ocsp */
+    ssl->out_msg[5] = (unsigned char)( olen >> 16 );
+    ssl->out_msg[6] = (unsigned char)( olen >>  8 );
+    ssl->out_msg[7] = (unsigned char)( olen       );
+
+    ssl->out_msglen  = 8 + olen;
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
+    ssl->out_msg[0]  = MBEDTLS_SSL_HS_CERTIFICATE_STATUS;
+
+    if( ( ret = mbedtls_ssl_write_record( ssl ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_write_record", ret );
+        return( ret );
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= write certificate status" ) );
+
+    return( 0 );
+}
+
 int mbedtls_ssl_handshake_server_step( mbedtls_ssl_context *ssl )
 {
     int ret = 0;
@@ -3827,6 +3975,8 @@ int mbedtls_ssl_handshake_server_step( mbedtls_ssl_context *ssl )
 
         case MBEDTLS_SSL_SERVER_CERTIFICATE:
             ret = mbedtls_ssl_write_certificate( ssl );
+            if( ret == 0 )
+                ret = ssl_write_certificate_status( ssl );
             break;
 
         case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
@@ -5733,6 +5733,44 @@ int mbedtls_ssl_conf_own_cert( mbedtls_ssl_config *conf,
     return( ssl_append_key_cert( &conf->key_cert, own_cert, pk_key ) );
 }
 
+int mbedtls_ssl_conf_own_cert_replace( mbedtls_ssl_config *conf,
+                                       mbedtls_x509_crt *own_cert,
+                                       mbedtls_pk_context *pk_key,
+                                       mbedtls_ssl_key_cert **old_head )
+{
+    mbedtls_ssl_key_cert *new;
+
+    new = mbedtls_calloc( 1, sizeof( mbedtls_ssl_key_cert ) );
+    if( new == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    new->cert = own_cert;
+    new->key  = pk_key;
+    new->next = NULL;
+
+    *old_head = conf->key_cert;
+    /*
+     * Single pointer store: handshakes snapshot conf->key_cert when
+     * they start and either see the complete old list or the complete
+     * new one.
+     */
+    conf->key_cert = new;
+
+    return( 0 );
+}
+
+void mbedtls_ssl_key_cert_free( mbedtls_ssl_key_cert *head )
+{
+    mbedtls_ssl_key_cert *cur;
+
+    while( head != NULL )
+    {
+        cur = head;
+        head = head->next;
+        mbedtls_free( cur );
+    }
+}
+
 void mbedtls_ssl_conf_ca_chain( mbedtls_ssl_config *conf,
                                mbedtls_x509_crt *ca_chain,
                                mbedtls_x509_crl *ca_crl )
@@ -5971,7 +6009,17 @@ void mbedtls_ssl_conf_sni( mbedtls_ssl_config *conf,
     conf->f_sni = f_sni;
     conf->p_sni = p_sni;
 }
-#endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
+#endif
+
+#if defined(MBEDTLS_SSL_SRV_C)
+void mbedtls_ssl_conf_ocsp( mbedtls_ssl_config *conf,
+                  int (*f_ocsp)(void *, unsigned char *, size_t, size_t *),
+                  void *p_ocsp )
+{
+    conf->f_ocsp = f_ocsp;
+    conf->p_ocsp = p_ocsp;
+}
+#endif /* MBEDTLS_SSL_SRV_C */
 
 #if defined(MBEDTLS_SSL_ALPN)
 int mbedtls_ssl_conf_alpn_protocols( mbedtls_ssl_config *conf, const char **protos )
@@ -21,19 +21,65 @@
 
 #include "ttls.h"
 
-/**
- * TODO: analyze all the calls to @calloc and @free over the whole code and
- * carefully change all of them to appropriate kernel routines (probably SLAB
- * allocations can be used) or exclude at all (if the optimization is possible.
+/*
+ * Pluggable allocation arenas. A caller may install a per-CPU arena
+ * allocator around a library call (e.g. Tempesta backs the per-session
+ * buffer allocations of mbedtls_ssl_setup() with the connection pool).
+ * Every allocation carries a one-word header telling free() where the
+ * memory came from: arena memory is reclaimed wholesale with its pool,
+ * so free() just ignores it.
  */
+#define TTLS_MEM_HEAP	0x454b4c4154485541UL
+#define TTLS_MEM_ARENA	0x414e4552414c4c41UL
+
+typedef void *(*ttls_arena_alloc_t)(void *arena, size_t size);
+
+struct ttls_arena {
+	ttls_arena_alloc_t	alloc;
+	void			*arena;
+};
+static DEFINE_PER_CPU(struct ttls_arena, ttls_arena);
+
+void
+ttls_set_arena(void *(*alloc)(void *, size_t), void *arena)
+{
+	struct ttls_arena *a = this_cpu_ptr(&ttls_arena);
+
+	a->alloc = alloc;
+	a->arena = arena;
+}
+EXPORT_SYMBOL(ttls_set_arena);
+
 void *calloc(size_t n, size_t size)
 {
-	return kzalloc(n * size, GFP_ATOMIC);
+	size_t len = n * size;
+	struct ttls_arena *a = this_cpu_ptr(&ttls_arena);
+	unsigned long *p;
+
+	if (a->alloc) {
+		if (!(p = a->alloc(a->arena, len + sizeof(long))))
+			return NULL;
+		memset(p, 0, len + sizeof(long));
+		*p = TTLS_MEM_ARENA;
+	} else {
+		if (!(p = kzalloc(len + sizeof(long), GFP_ATOMIC)))
+			return NULL;
+		*p = TTLS_MEM_HEAP;
+	}
+
+	return p + 1;
 }
 
 void free(void *ptr)
 {
-	kfree(ptr);
+	unsigned long *p = (unsigned long *)ptr - 1;
+
+	if (!ptr)
+		return;
+	if (*p == TTLS_MEM_ARENA)
+		return; /* Dies with its arena. */
+	BUG_ON(*p != TTLS_MEM_HEAP);
+	kfree(p);
 }
 
 #if defined(MBEDTLS_SELF_TEST) && defined(MBEDTLS_PKCS1_V15)
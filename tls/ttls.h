@@ -32,6 +32,8 @@
 
 extern void *calloc(size_t n, size_t size);
 extern void free(void *ptr);
+/* Install (or reset with NULLs) the per-CPU allocation arena. */
+extern void ttls_set_arena(void *(*alloc)(void *, size_t), void *arena);
 
 #if defined(MBEDTLS_SELF_TEST) && defined(MBEDTLS_PKCS1_V15)
 extern int rand(void);